@@ -15,23 +15,89 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
 #include "counters.h"
+#include "journal.h"
+#ifdef __GLIBC__
+#include <malloc.h>      // malloc_usable_size
+#endif
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>   // SSSE3 shuffle, to decode four values at once
+#define HAVE_SHUFFLE 1
+#endif
 
 
 /**************** file-local global variables ****************/
-/* none */
+/* the merge operations, for counters_merge */
+enum { MERGE_INTERSECT, MERGE_UNION, MERGE_DIFFERENCE };
+
+/* the parallel merge; see counters_merge_many */
+#define MAX_THREADS 64                     // most threads one merge uses
+static const long MERGE_STRIDE = 64;       // lists are sampled every this many nodes
+static const long MERGE_MIN_KEYS = 16384;  // fewest counters worth a thread
+
+
+/* the serialized form; see counters_serialize */
+static const unsigned char MAGIC[4] = { 'C', 'T', 'R', '1' };
+static const size_t HEADER = 24;             // magic and five 32-bit fields
+static const uint32_t BIG_COUNT = 0xFFFFFFFF;   // "look in the big counts"
+
+/* Stream VByte decoding tables, indexed by a length byte: the bytes its
+ * four values take, and the shuffle that spreads them into four 32-bit
+ * lanes; built on first use, by whichever thread gets there first */
+static unsigned char group_len[256];
+static unsigned char group_shuffle[256][16];
+static bool have_shuffle = false;            // the processor has SSSE3
+static atomic_int tables_state = 0;          // 0 unbuilt, 1 building, 2 built
+
+/* the allocator used for all counters memory; see counters_allocator */
+static void* (*ctrs_malloc)(size_t size) = malloc;
+static void (*ctrs_free)(void* ptr) = free;
+#ifdef __GLIBC__
+static size_t (*ctrs_usable)(void* ptr) = malloc_usable_size;
+#else
+static size_t (*ctrs_usable)(void* ptr) = NULL;
+#endif
 
 /**************** local types ****************/
 typedef struct countersnode {
     int key;                 // key 
-    int count;                // counter value
+    int64_t count;            // counter value
     struct countersnode *next;       // link to next node
   } countersnode_t;
 
+/* one list of a parallel merge, and every MERGE_STRIDE-th node of it, so
+ * a thread finds where its key range starts without walking the list */
+typedef struct merge_list {
+    countersnode_t* head;
+    countersnode_t** samples;    // nodes 0, MERGE_STRIDE, 2 * MERGE_STRIDE, ...
+    long nsamples;
+    long length;                 // nodes in the list
+} merge_list_t;
+
+/* one thread's share of a parallel merge */
+typedef struct merge_job {
+    merge_list_t* lists;         // dest's own list first, if not empty
+    int nlists;
+    int index;                   // this job's number,
+    int nthreads;                // of this many
+    void* arg;
+    int64_t (*merge)(void* arg, const int key, const int64_t count, const int64_t other);
+    int lo, hi;                  // the key range [lo, hi); hi < 0 for no bound
+    countersnode_t* head;        // the range merged, in key order
+    countersnode_t* tail;
+    bool failed;                 // out of memory
+} merge_job_t;
+
   /**************** global types ****************/
 
 typedef struct counters {
     struct countersnode* head;   // head of the list of items in set 
+    bool saturate;               // clamp at INT64_MAX rather than fail
+    journal_t* journal;          // where changes are logged; NULL if nowhere
 } counters_t;
 
 /**************** global functions ****************/
@@ -40,20 +106,52 @@ typedef struct counters {
 
 /**************** local functions ****************/
 /* not visible outside this file */
-static countersnode_t* countersnode_new(const int key, int count);
+static countersnode_t* countersnode_new(const int key, int64_t count);
+static inline int clamp_int(const int64_t count);
+static size_t block_size(void* ptr, size_t requested);
+static countersnode_t** counters_seek(counters_t* ctrs, const int key);
+static bool set_count(counters_t* ctrs, const int key, const int64_t count);
+static void journal_record(counters_t* ctrs, const int key, const int64_t count);
+static void replay_one(void* arg, const void* record, const size_t len);
+static bool counters_merge(counters_t* dest, counters_t* a, counters_t* b,
+                           const int op);
+static void run_threads(void* (*fn)(void* job), void* jobs, const size_t size,
+                        const int n);
+static void* merge_sample(void* arg);
+static void* merge_range(void* arg);
+static countersnode_t* merge_start(merge_list_t* list, const int lo);
+static inline bool merge_within(merge_job_t* job, countersnode_t* node);
+static void merge_sift_down(int* heap, const int n, countersnode_t** cursors, int i);
+static int compare_ints(const void* a, const void* b);
+static void free_nodes(countersnode_t* node);
+static inline bool entry_before(const counters_entry_t* a, const counters_entry_t* b);
+static void heap_sift_down(counters_entry_t* heap, const int n, int i);
+static inline int vbyte_len(const uint32_t v);
+static unsigned char* vbyte_put(unsigned char* ctl, unsigned char* data,
+                                const uint32_t i, const uint32_t v);
+static inline void put32(unsigned char* p, const uint32_t v);
+static inline uint32_t get32(const unsigned char* p);
+static uint32_t adler32(const unsigned char* p, size_t len);
+static void tables_init(void);
+static const unsigned char* group_decode(const unsigned char* p, const unsigned char* end,
+                                         const unsigned char* limit, const unsigned ctl,
+                                         const int count, uint32_t out[4]);
+static bool reader_fill(counters_reader_t* r, counters_entry_t* out);
 
 /**************** counter_new() ****************/
 /* see counter.h for description */
 counters_t*
 counters_new(void)
 {
-    counters_t* ctrs = malloc(sizeof(counters_t));
+    counters_t* ctrs = ctrs_malloc(sizeof(counters_t));
 
     if (ctrs == NULL) {
         return NULL;              // error allocating counter
     } else {
         // initialize contents of counter structure
         ctrs->head = NULL;
+        ctrs->saturate = false;
+        ctrs->journal = NULL;
         return ctrs;
     }
 }
@@ -62,9 +160,9 @@ counters_new(void)
 /* allocate and initialize a counternode */
 
 static countersnode_t*  // not visible outside this file
-countersnode_new(const int key, int count)
+countersnode_new(const int key, int64_t count)
 {
-    countersnode_t* node = malloc(sizeof(countersnode_t));
+    countersnode_t* node = ctrs_malloc(sizeof(countersnode_t));
 
     if (node == NULL) {
         // error allocating memory for node; return error
@@ -77,32 +175,73 @@ countersnode_new(const int key, int count)
     }
 }
 
+/**************** counters_seek() ****************/
+/* return the link that points at key's node, or where that node belongs;
+ * the list is kept in increasing key order */
+static countersnode_t**
+counters_seek(counters_t* ctrs, const int key)
+{
+    countersnode_t** prev = &ctrs->head;
+    while (*prev != NULL && (*prev)->key < key) {
+        prev = &(*prev)->next;
+    }
+    return prev;
+}
+
+/**************** clamp_int() ****************/
+/* a count as an int, for the int-valued functions; INT_MAX if larger */
+static inline int
+clamp_int(const int64_t count)
+{
+    return count > INT_MAX ? INT_MAX : (int)count;
+}
+
 /**************** counter_add() ****************/
 /*see counter.h for description */
 
 int counters_add(counters_t* ctrs, const int key)
 {
-    if (ctrs == NULL || key < 0) {
-        return 0; // error
+    return clamp_int(counters_add_n(ctrs, key, 1));
+}
+
+/**************** counters_add_n() ****************/
+/*see counter.h for description */
+
+int64_t counters_add_n(counters_t* ctrs, const int key, const int64_t delta)
+{
+    if (ctrs == NULL || key < 0 || delta <= 0) {
+        return 0; // error; a zero delta would change nothing, or make a zero count
     } else {
         // check if the key already exists
-        for (countersnode_t* node = ctrs->head; node != NULL; node = node->next) {
-            if (node->key == key) {
-                // key already exists, increment the count
-                node->count = node->count + 1;
-                return node->count;
+        countersnode_t** prev = counters_seek(ctrs, key);
+        countersnode_t* node = *prev;
+        if (node != NULL && node->key == key) {
+            // key already exists, add delta unless the count would overflow
+            if (node->count > INT64_MAX - delta) {
+                if (!ctrs->saturate) {
+                    return 0;      // error; the count is unchanged
+                }
+                node->count = INT64_MAX;
+            } else {
+                node->count = node->count + delta;
+            }
+            if (ctrs->journal != NULL) {
+                journal_record(ctrs, key, node->count);
             }
+            return node->count;
         }
         // key does not exist, create a new counternode
-        countersnode_t* new_node = countersnode_new(key, 1);
+        countersnode_t* new_node = countersnode_new(key, delta);
         if (new_node == NULL) {
             return 0; // error allocating memory
         }
 
-        int value = new_node->count; // return the new count
-        new_node->next = ctrs->head; // add to the head of the list
-        ctrs->head = new_node;
-        return value;
+        new_node->next = node;       // link it in, in key order
+        *prev = new_node;
+        if (ctrs->journal != NULL) {
+            journal_record(ctrs, key, delta);
+        }
+        return delta;
 
     }
 }
@@ -112,20 +251,37 @@ int counters_add(counters_t* ctrs, const int key)
 /*see counter.h for description */
 
 int counters_get(counters_t* ctrs, const int key)
+{
+    return clamp_int(counters_get64(ctrs, key));
+}
+
+/**************** counters_get64() ****************/
+/*see counter.h for description */
+
+int64_t counters_get64(counters_t* ctrs, const int key)
 {
     if (ctrs == NULL || key < 0) {
         return 0; // error
     } else {
         // check if the key already exists
-        for (countersnode_t* node = ctrs->head; node != NULL; node = node->next) {
-            if (node->key == key) {                
-                return node->count; // found the item
-            }
+        countersnode_t* node = *counters_seek(ctrs, key);
+        if (node != NULL && node->key == key) {
+            return node->count; // found the item
         }
         return 0;              // key not found
     }
 }
 
+/**************** counters_saturate() ****************/
+/*see counter.h for description */
+
+void counters_saturate(counters_t* ctrs, const bool saturate)
+{
+    if (ctrs != NULL) {
+        ctrs->saturate = saturate;
+    }
+}
+
 
 /**************** counter_set() ****************/
 /*see counter.h for description */
@@ -134,23 +290,91 @@ bool counters_set(counters_t* ctrs, const int key, const int count)
 {
     if (ctrs == NULL || key < 0 || count < 0) {
         return false; // error
-    } else {
-        // check if the key already exists
-        for (countersnode_t* node = ctrs->head; node != NULL; node = node->next) {
-            if (node->key == key) {
-                // key already exists, update the count
-                node->count = count;
-                return true;
-            }
-        }
-        // key does not exist, create a new counternode
-        countersnode_t* new_node = countersnode_new(key, count);
-        if (new_node == NULL) {
-            return false; // error allocating memory
-        }
-        new_node->next = ctrs->head; // add to the head of the list
-        ctrs->head = new_node;
-        return true; // success
+    }
+    if (!set_count(ctrs, key, count)) {
+        return false;
+    }
+    if (ctrs->journal != NULL) {
+        journal_record(ctrs, key, count);
+    }
+    return true; // success
+}
+
+/**************** set_count() ****************/
+/* set key's count, creating its counter if need be; false if out of memory */
+static bool
+set_count(counters_t* ctrs, const int key, const int64_t count)
+{
+    // check if the key already exists
+    countersnode_t** prev = counters_seek(ctrs, key);
+    countersnode_t* node = *prev;
+    if (node != NULL && node->key == key) {
+        // key already exists, update the count
+        node->count = count;
+        return true;
+    }
+    // key does not exist, create a new counternode
+    countersnode_t* new_node = countersnode_new(key, count);
+    if (new_node == NULL) {
+        return false; // error allocating memory
+    }
+    new_node->next = node;       // link it in, in key order
+    *prev = new_node;
+    return true;
+}
+
+/**************** counters_journal() ****************/
+/*see counter.h for description */
+
+bool counters_journal(counters_t* ctrs, journal_t* journal)
+{
+    if (ctrs == NULL) {
+        return false;
+    }
+    ctrs->journal = journal;
+    return true;
+}
+
+/**************** counters_replay() ****************/
+/*see counter.h for description */
+
+long counters_replay(counters_t* ctrs, const char* path)
+{
+    if (ctrs == NULL || path == NULL) {
+        return -1;
+    }
+    journal_t* journal = ctrs->journal;
+    ctrs->journal = NULL;         // don't log the changes we replay
+    long records = journal_replay(path, ctrs, replay_one);
+    ctrs->journal = journal;
+    return records;
+}
+
+/**************** journal_record() ****************/
+/* log a counter's new count: the key, then the count, in host byte order;
+ * every change is logged as the count it leaves, so replay just sets it */
+static void
+journal_record(counters_t* ctrs, const int key, const int64_t count)
+{
+    int32_t k = key;
+    journal_part_t parts[2] = { { &k, sizeof(k) }, { &count, sizeof(count) } };
+    journal_append(ctrs->journal, parts, 2);
+}
+
+/**************** replay_one() ****************/
+/* apply one journal record, as journal_record wrote it */
+static void
+replay_one(void* arg, const void* record, const size_t len)
+{
+    int32_t key;
+    int64_t count;
+    if (len != sizeof(key) + sizeof(count)) {
+        return;                   // not one of ours
+    }
+    memcpy(&key, record, sizeof(key));
+    memcpy(&count, (const char*)record + sizeof(key), sizeof(count));
+    if (key >= 0 && count >= 0) {
+        set_count(arg, key, count);
     }
 }
 
@@ -165,14 +389,14 @@ void counters_print(counters_t* ctrs, FILE* fp)
         for (countersnode_t* node = ctrs->head; node != NULL; node = node->next) {
             fprintf(fp, "%d", node->key);
             fputc('=', fp);
-            fprintf(fp, "%d", node->count);
+            fprintf(fp, "%lld", (long long)node->count);
             if (node->next != NULL) {
                 fputc(',', fp);
             }
         }
         fputc('}', fp);
     }
-    else if (ctrs == NULL) {
+    else if (fp != NULL) {
         fputs("(null)", fp);
     }
 }
@@ -185,6 +409,19 @@ void counters_iterate(counters_t* ctrs, void* arg, void (*itemfunc)(void* arg, c
 {
     if (ctrs != NULL && itemfunc != NULL) {
         // call itemfunc with arg, on each item
+        for (countersnode_t* node = ctrs->head; node != NULL; node = node->next) {
+            (*itemfunc)(arg, node->key, clamp_int(node->count));
+        }
+    }
+}
+
+/**************** counters_iterate64() ****************/
+/*see counter.h for description */
+
+void counters_iterate64(counters_t* ctrs, void* arg,
+                        void (*itemfunc)(void* arg, const int key, const int64_t count))
+{
+    if (ctrs != NULL && itemfunc != NULL) {
         for (countersnode_t* node = ctrs->head; node != NULL; node = node->next) {
             (*itemfunc)(arg, node->key, node->count);
         }
@@ -198,25 +435,899 @@ void counters_delete(counters_t*ctrs){
         // delete each node in the list
         for (countersnode_t* node = ctrs->head; node != NULL; ) {
             countersnode_t* next = node->next; // save the next node
-            free(node);                  // free the current node
+            ctrs_free(node);             // free the current node
             node = next;                    // move to the next node
         }
-        free(ctrs);                    // free the counter set itself
+        ctrs_free(ctrs);               // free the counter set itself
+    }
+}
+
+/**************** block_size() ****************/
+/* bytes a block really occupies: its usable size, if the allocator can tell us */
+static size_t
+block_size(void* ptr, size_t requested)
+{
+    if (ctrs_usable != NULL) {
+        size_t usable = ctrs_usable(ptr);
+        if (usable > requested) {
+            return usable;          // requested bytes plus slack
+        }
     }
+    return requested;
 }
 
+/**************** counters_memory_usage() ****************/
+/*see counter.h for description */
 
+size_t counters_memory_usage(counters_t* ctrs)
+{
+    if (ctrs == NULL) {
+        return 0;
+    }
+    size_t bytes = block_size(ctrs, sizeof(counters_t));
+    for (countersnode_t* node = ctrs->head; node != NULL; node = node->next) {
+        bytes += block_size(node, sizeof(countersnode_t));
+    }
+    return bytes;
+}
 
+/**************** counters_allocator() ****************/
+/*see counter.h for description */
 
+void counters_allocator(void* (*allocfn)(size_t size), void (*freefn)(void* ptr),
+                        size_t (*sizefn)(void* ptr))
+{
+    if (allocfn == NULL || freefn == NULL) {
+        ctrs_malloc = malloc;
+        ctrs_free = free;
+#ifdef __GLIBC__
+        ctrs_usable = malloc_usable_size;
+#else
+        ctrs_usable = NULL;
+#endif
+    } else {
+        ctrs_malloc = allocfn;
+        ctrs_free = freefn;
+        ctrs_usable = sizefn;
+    }
+}
+
+/**************** counters_topk() ****************/
+/*see counter.h for description */
+
+int counters_topk(counters_t* ctrs, const int k, counters_entry_t* out)
+{
+    if (ctrs == NULL || out == NULL || k <= 0) {
+        return 0;
+    }
+    // out[0..n) is a heap whose root is the worst of the best k so far
+    int n = 0;
+    for (countersnode_t* node = ctrs->head; node != NULL; node = node->next) {
+        counters_entry_t entry = { node->key, node->count };
+        if (n < k) {
+            // room left: add it at the bottom and sift it up
+            int i = n++;
+            while (i > 0 && entry_before(&out[(i - 1) / 2], &entry)) {
+                out[i] = out[(i - 1) / 2];
+                i = (i - 1) / 2;
+            }
+            out[i] = entry;
+        } else if (entry_before(&entry, &out[0])) {
+            // better than the worst kept: replace the root
+            out[0] = entry;
+            heap_sift_down(out, n, 0);
+        }
+    }
+    // heapsort in place: repeatedly move the worst to the end
+    for (int last = n - 1; last > 0; last--) {
+        counters_entry_t worst = out[0];
+        out[0] = out[last];
+        out[last] = worst;
+        heap_sift_down(out, last, 0);
+    }
+    return n;
+}
+
+/**************** entry_before() ****************/
+/* true if a ranks ahead of b: a larger count, or an equal count and a
+ * smaller key */
+static inline bool
+entry_before(const counters_entry_t* a, const counters_entry_t* b)
+{
+    return a->count > b->count || (a->count == b->count && a->key < b->key);
+}
+
+/**************** heap_sift_down() ****************/
+/* restore the heap heap[0..n) below i, where each parent ranks behind
+ * its children, so the root is the worst entry */
+static void
+heap_sift_down(counters_entry_t* heap, const int n, int i)
+{
+    counters_entry_t entry = heap[i];
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= n) {
+            break;
+        }
+        if (child + 1 < n && entry_before(&heap[child], &heap[child + 1])) {
+            child++;              // the worse of the two children
+        }
+        if (!entry_before(&entry, &heap[child])) {
+            break;
+        }
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = entry;
+}
 
+/**************** counters_merge() ****************/
+/* Walk the sorted lists a and b together, appending to the empty dest
+ * the counters that op keeps: for MERGE_INTERSECT, keys in both with the
+ * smaller count; for MERGE_UNION, keys in either with the sum of counts;
+ * for MERGE_DIFFERENCE, keys only in a with a's count.
+ * Linear in |a| + |b|.
+ */
+static bool
+counters_merge(counters_t* dest, counters_t* a, counters_t* b, const int op)
+{
+    if (dest == NULL || a == NULL || b == NULL || dest == a || dest == b
+        || dest->head != NULL) {
+        return false;             // bad countersets, or dest not empty
+    }
+    countersnode_t** tail = &dest->head;  // where the next node goes
+    countersnode_t* na = a->head;
+    countersnode_t* nb = b->head;
+    while (na != NULL || nb != NULL) {
+        bool keep = false;
+        int key;
+        int64_t count;
+        if (nb == NULL || (na != NULL && na->key < nb->key)) {
+            // key only in a
+            keep = (op != MERGE_INTERSECT);
+            key = na->key;
+            count = na->count;
+            na = na->next;
+        } else if (na == NULL || nb->key < na->key) {
+            // key only in b
+            keep = (op == MERGE_UNION);
+            key = nb->key;
+            count = nb->count;
+            nb = nb->next;
+        } else {
+            // key in both
+            keep = (op != MERGE_DIFFERENCE);
+            key = na->key;
+            if (op == MERGE_INTERSECT) {
+                count = na->count < nb->count ? na->count : nb->count;
+            } else {
+                count = na->count > INT64_MAX - nb->count
+                      ? INT64_MAX : na->count + nb->count;  // saturate
+            }
+            na = na->next;
+            nb = nb->next;
+        }
+        if (keep) {
+            countersnode_t* new_node = countersnode_new(key, count);
+            if (new_node == NULL) {
+                return false;     // out of memory; dest holds a partial result
+            }
+            *tail = new_node;     // append, keeping dest in key order
+            tail = &new_node->next;
+        }
+    }
+    return true;
+}
 
+/**************** counters_intersect() ****************/
+/*see counter.h for description */
 
+bool counters_intersect(counters_t* dest, counters_t* a, counters_t* b)
+{
+    return counters_merge(dest, a, b, MERGE_INTERSECT);
+}
 
+/**************** counters_union() ****************/
+/*see counter.h for description */
 
+bool counters_union(counters_t* dest, counters_t* a, counters_t* b)
+{
+    return counters_merge(dest, a, b, MERGE_UNION);
+}
 
+/**************** counters_difference() ****************/
+/*see counter.h for description */
 
+bool counters_difference(counters_t* dest, counters_t* a, counters_t* b)
+{
+    return counters_merge(dest, a, b, MERGE_DIFFERENCE);
+}
 
+/**************** counters_merge_many() ****************/
+/*see counter.h for description */
 
+bool
+counters_merge_many(counters_t* dest, counters_t** srcs, const int nsrcs,
+                    const int nthreads, void* arg,
+                    int64_t (*merge)(void* arg, const int key,
+                                     const int64_t count, const int64_t other))
+{
+    if (dest == NULL || nsrcs < 0 || (srcs == NULL && nsrcs > 0) || nthreads < 1) {
+        return false;
+    }
+    for (int i = 0; i < nsrcs; i++) {
+        if (srcs[i] == NULL || srcs[i] == dest) {
+            return false;
+        }
+    }
+    int nlists = nsrcs + (dest->head != NULL);
+    if (nlists == 0) {
+        return true;              // nothing to merge
+    }
+    merge_list_t* lists = ctrs_malloc(nlists * sizeof(merge_list_t));
+    if (lists == NULL) {
+        return false;
+    }
+    int k = 0;
+    if (dest->head != NULL) {
+        lists[k++] = (merge_list_t){ dest->head, NULL, 0, 0 };  // dest folds first
+    }
+    for (int i = 0; i < nsrcs; i++) {
+        lists[k++] = (merge_list_t){ srcs[i]->head, NULL, 0, 0 };
+    }
+    int threads = nthreads < MAX_THREADS ? nthreads : MAX_THREADS;
+    merge_job_t jobs[MAX_THREADS];
+    for (int j = 0; j < threads; j++) {
+        jobs[j] = (merge_job_t){ lists, nlists, j, threads, arg, merge,
+                                 -1, -1, NULL, NULL, false };
+    }
 
+    if (threads > 1) {
+        // too small a merge to share is done here; count only so far
+        long seen = 0;
+        for (int i = 0; i < nlists && seen < 2 * MERGE_MIN_KEYS; i++) {
+            for (countersnode_t* node = lists[i].head;
+                 node != NULL && seen < 2 * MERGE_MIN_KEYS; node = node->next) {
+                seen++;
+            }
+        }
+        threads = seen < 2 * MERGE_MIN_KEYS ? 1 : threads;
+    }
+    bool ok = true;
+    if (threads > 1) {
+        // sample every list, a list to a thread...
+        run_threads(merge_sample, jobs, sizeof(merge_job_t),
+                    threads < nlists ? threads : nlists);
+        long total = 0, nsamples = 0;
+        for (int i = 0; i < nlists; i++) {
+            total += lists[i].length;
+            nsamples += lists[i].nsamples;
+        }
+        for (int j = 0; j < threads; j++) {
+            ok = ok && !jobs[j].failed;
+        }
+        if (total / MERGE_MIN_KEYS + 1 < threads) {
+            threads = total / MERGE_MIN_KEYS + 1;   // too little work to share
+        }
+        // ...then cut the key space at quantiles of the sampled keys
+        if (ok && threads > 1) {
+            int* keys = ctrs_malloc(nsamples * sizeof(int));
+            if (keys == NULL) {
+                ok = false;
+            } else {
+                long n = 0;
+                for (int i = 0; i < nlists; i++) {
+                    for (long s = 0; s < lists[i].nsamples; s++) {
+                        keys[n++] = lists[i].samples[s]->key;
+                    }
+                }
+                qsort(keys, nsamples, sizeof(int), compare_ints);
+                for (int j = 0; j < threads; j++) {
+                    jobs[j].nthreads = threads;
+                    jobs[j].lo = j == 0 ? -1 : keys[j * nsamples / threads];
+                    jobs[j].hi = j == threads - 1 ? -1 : keys[(j + 1) * nsamples / threads];
+                }
+                ctrs_free(keys);
+            }
+        }
+    }
+    if (ok) {
+        run_threads(merge_range, jobs, sizeof(merge_job_t), threads);
+    }
 
-  
+    // join the ranges up, in key order
+    countersnode_t* head = NULL;
+    countersnode_t** tail = &head;
+    for (int j = 0; j < threads; j++) {
+        ok = ok && !jobs[j].failed;
+        if (jobs[j].head != NULL) {
+            *tail = jobs[j].head;
+            tail = &jobs[j].tail->next;
+        }
+    }
+    for (int i = 0; i < nlists; i++) {
+        if (lists[i].samples != NULL) {
+            ctrs_free(lists[i].samples);
+        }
+    }
+    ctrs_free(lists);
+    if (!ok) {
+        free_nodes(head);
+        return false;             // out of memory; dest is as it was
+    }
+    if (dest->journal != NULL) {
+        // log the counts that changed, walking old and new lists together
+        countersnode_t* old = dest->head;
+        for (countersnode_t* node = head; node != NULL; node = node->next) {
+            while (old != NULL && old->key < node->key) {
+                old = old->next;
+            }
+            if (old == NULL || old->key != node->key || old->count != node->count) {
+                journal_record(dest, node->key, node->count);
+            }
+        }
+    }
+    free_nodes(dest->head);
+    dest->head = head;
+    return true;
+}
+
+/**************** run_threads() ****************/
+/* call fn on each of n jobs, size bytes apart: the first on this thread,
+ * the others each on a thread of its own; a job whose thread cannot be
+ * started runs here too, after the first */
+static void
+run_threads(void* (*fn)(void* job), void* jobs, const size_t size, const int n)
+{
+    pthread_t threads[MAX_THREADS];
+    bool started[MAX_THREADS];
+    for (int i = 1; i < n; i++) {
+        started[i] = pthread_create(&threads[i], NULL, fn, (char*)jobs + i * size) == 0;
+    }
+    (*fn)(jobs);
+    for (int i = 1; i < n; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        } else {
+            (*fn)((char*)jobs + i * size);
+        }
+    }
+}
+
+/**************** merge_sample() ****************/
+/* walk the job's lists (every nthreads-th, from its index), noting the
+ * length of each and every MERGE_STRIDE-th node */
+static void*
+merge_sample(void* arg)
+{
+    merge_job_t* job = arg;
+    for (int i = job->index; i < job->nlists; i += job->nthreads) {
+        merge_list_t* list = &job->lists[i];
+        long cap = 0;
+        for (countersnode_t* node = list->head; node != NULL; node = node->next) {
+            if (list->length++ % MERGE_STRIDE != 0) {
+                continue;
+            }
+            if (list->nsamples == cap) {
+                // full; double the array
+                cap = cap == 0 ? 64 : 2 * cap;
+                countersnode_t** grown = ctrs_malloc(cap * sizeof(countersnode_t*));
+                if (grown == NULL) {
+                    job->failed = true;
+                    return NULL;
+                }
+                if (list->samples != NULL) {
+                    memcpy(grown, list->samples, list->nsamples * sizeof(countersnode_t*));
+                    ctrs_free(list->samples);
+                }
+                list->samples = grown;
+            }
+            list->samples[list->nsamples++] = node;
+        }
+    }
+    return NULL;
+}
+
+/**************** merge_range() ****************/
+/* k-way merge the job's key range of every list into a new list, keeping
+ * a heap of the lists by their next key; equal keys come off the heap in
+ * list order, so merge folds them in that order */
+static void*
+merge_range(void* arg)
+{
+    merge_job_t* job = arg;
+    countersnode_t** cursors = ctrs_malloc(job->nlists * sizeof(countersnode_t*));
+    int* heap = ctrs_malloc(job->nlists * sizeof(int));
+    if (cursors == NULL || heap == NULL) {
+        job->failed = true;
+    } else {
+        int n = 0;
+        for (int i = 0; i < job->nlists; i++) {
+            cursors[i] = merge_start(&job->lists[i], job->lo);
+            if (merge_within(job, cursors[i])) {
+                heap[n++] = i;
+            }
+        }
+        for (int i = n / 2 - 1; i >= 0; i--) {
+            merge_sift_down(heap, n, cursors, i);
+        }
+        countersnode_t** tail = &job->head;
+        while (n > 0) {
+            int key = cursors[heap[0]]->key;
+            int64_t count = 0;
+            bool first = true;
+            do {
+                // fold in the next list holding key, and move it along
+                countersnode_t* node = cursors[heap[0]];
+                if (first) {
+                    count = node->count;
+                    first = false;
+                } else if (job->merge == NULL) {
+                    count = count > INT64_MAX - node->count
+                          ? INT64_MAX : count + node->count;  // saturate
+                } else {
+                    count = (*job->merge)(job->arg, key, count, node->count);
+                    count = count < 0 ? 0 : count;
+                }
+                cursors[heap[0]] = node->next;
+                if (!merge_within(job, node->next)) {
+                    heap[0] = heap[--n];        // this list's range is done
+                }
+                merge_sift_down(heap, n, cursors, 0);
+            } while (n > 0 && cursors[heap[0]]->key == key);
+
+            countersnode_t* new_node = countersnode_new(key, count);
+            if (new_node == NULL) {
+                job->failed = true;
+                break;
+            }
+            *tail = new_node;
+            tail = &new_node->next;
+            job->tail = new_node;
+        }
+    }
+    if (cursors != NULL) {
+        ctrs_free(cursors);
+    }
+    if (heap != NULL) {
+        ctrs_free(heap);
+    }
+    return NULL;
+}
+
+/**************** merge_start() ****************/
+/* the first node of the list with key >= lo: from the last sample before
+ * it, found by binary search, at most MERGE_STRIDE nodes on */
+static countersnode_t*
+merge_start(merge_list_t* list, const int lo)
+{
+    countersnode_t* node = list->head;
+    long low = 0, high = list->nsamples;  // samples[low..high) may be before lo
+    while (low < high) {
+        long mid = low + (high - low) / 2;
+        if (list->samples[mid]->key < lo) {
+            node = list->samples[mid];
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    while (node != NULL && node->key < lo) {
+        node = node->next;
+    }
+    return node;
+}
+
+/**************** merge_within() ****************/
+/* true if node is a node of the job's key range */
+static inline bool
+merge_within(merge_job_t* job, countersnode_t* node)
+{
+    return node != NULL && (job->hi < 0 || node->key < job->hi);
+}
+
+/**************** merge_sift_down() ****************/
+/* restore the heap heap[0..n) of list numbers below i, where each parent
+ * comes before its children: a smaller next key, or the same key and an
+ * earlier list */
+static void
+merge_sift_down(int* heap, const int n, countersnode_t** cursors, int i)
+{
+    int list = heap[i];
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= n) {
+            break;
+        }
+        if (child + 1 < n) {
+            int a = heap[child], b = heap[child + 1];
+            if (cursors[b]->key < cursors[a]->key
+                || (cursors[b]->key == cursors[a]->key && b < a)) {
+                child++;          // the earlier of the two children
+            }
+        }
+        int c = heap[child];
+        if (cursors[list]->key < cursors[c]->key
+            || (cursors[list]->key == cursors[c]->key && list < c)) {
+            break;
+        }
+        heap[i] = c;
+        i = child;
+    }
+    heap[i] = list;
+}
+
+/**************** compare_ints() ****************/
+/* qsort comparison of two ints, in increasing order */
+static int
+compare_ints(const void* a, const void* b)
+{
+    int x = *(const int*)a, y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+
+/**************** free_nodes() ****************/
+/* free a list of nodes */
+static void
+free_nodes(countersnode_t* node)
+{
+    while (node != NULL) {
+        countersnode_t* next = node->next;
+        ctrs_free(node);
+        node = next;
+    }
+}
+
+/**************** counters_serialize() ****************/
+/*see counter.h for description */
+
+size_t counters_serialize(counters_t* ctrs, void* buf, const size_t cap)
+{
+    if (ctrs == NULL) {
+        return 0;
+    }
+    // first pass: how big is each part?
+    uint32_t n = 0, nbig = 0;
+    size_t keybytes = 0, countbytes = 0;
+    int64_t prev = -1;            // so every gap, even the first, is >= 1
+    for (countersnode_t* node = ctrs->head; node != NULL; node = node->next) {
+        keybytes += vbyte_len((uint32_t)(node->key - prev));
+        if (node->count >= BIG_COUNT) {
+            countbytes += 4;
+            nbig++;
+        } else {
+            countbytes += vbyte_len((uint32_t)node->count);
+        }
+        prev = node->key;
+        n++;
+    }
+    size_t ctlbytes = ((size_t)n + 3) / 4;
+    size_t total = HEADER + 2 * ctlbytes + keybytes + countbytes + 8 * (size_t)nbig;
+    if (buf == NULL || cap < total) {
+        return total;
+    }
+
+    // second pass: write the keys, counts and big counts in their places
+    unsigned char* out = buf;
+    memset(out, 0, total);
+    unsigned char* keyctl = out + HEADER;
+    unsigned char* keydata = keyctl + ctlbytes;
+    unsigned char* cntctl = keydata + keybytes;
+    unsigned char* cntdata = cntctl + ctlbytes;
+    unsigned char* big = cntdata + countbytes;
+    uint32_t i = 0;
+    prev = -1;
+    for (countersnode_t* node = ctrs->head; node != NULL; node = node->next, i++) {
+        keydata = vbyte_put(keyctl, keydata, i, (uint32_t)(node->key - prev));
+        if (node->count >= BIG_COUNT) {
+            cntdata = vbyte_put(cntctl, cntdata, i, BIG_COUNT);
+            put32(big, (uint32_t)node->count);
+            put32(big + 4, (uint32_t)((uint64_t)node->count >> 32));
+            big += 8;
+        } else {
+            cntdata = vbyte_put(cntctl, cntdata, i, (uint32_t)node->count);
+        }
+        prev = node->key;
+    }
+    memcpy(out, MAGIC, sizeof(MAGIC));
+    put32(out + 4, n);
+    put32(out + 8, (uint32_t)keybytes);
+    put32(out + 12, (uint32_t)countbytes);
+    put32(out + 16, nbig);
+    put32(out + 20, adler32(out + HEADER, total - HEADER));
+    return total;
+}
+
+/**************** counters_deserialize() ****************/
+/*see counter.h for description */
+
+counters_t* counters_deserialize(const void* buf, const size_t len)
+{
+    counters_reader_t reader;
+    if (!counters_reader_init(&reader, buf, len)) {
+        return NULL;
+    }
+    counters_t* ctrs = counters_new();
+    if (ctrs == NULL) {
+        return NULL;
+    }
+    countersnode_t** tail = &ctrs->head;  // where the next node goes
+    counters_entry_t batch[64];
+    int got;
+    while ((got = counters_reader_next(&reader, batch, 64)) > 0) {
+        for (int i = 0; i < got; i++) {
+            countersnode_t* new_node = countersnode_new(batch[i].key, batch[i].count);
+            if (new_node == NULL) {
+                counters_delete(ctrs);
+                return NULL;      // out of memory
+            }
+            *tail = new_node;     // keys arrive in order; append
+            tail = &new_node->next;
+        }
+    }
+    if (got < 0) {
+        counters_delete(ctrs);
+        return NULL;              // corrupt
+    }
+    return ctrs;
+}
+
+/**************** counters_reader_init() ****************/
+/*see counter.h for description */
+
+bool counters_reader_init(counters_reader_t* reader, const void* buf, const size_t len)
+{
+    if (reader == NULL || buf == NULL || len < HEADER) {
+        return false;
+    }
+    const unsigned char* in = buf;
+    if (memcmp(in, MAGIC, sizeof(MAGIC)) != 0) {
+        return false;
+    }
+    uint32_t n = get32(in + 4);
+    uint32_t keybytes = get32(in + 8);
+    uint32_t countbytes = get32(in + 12);
+    uint32_t nbig = get32(in + 16);
+    uint64_t ctlbytes = ((uint64_t)n + 3) / 4;
+    uint64_t total = HEADER + 2 * ctlbytes + keybytes + countbytes + 8 * (uint64_t)nbig;
+    if (total != len || nbig > n
+        || get32(in + 20) != adler32(in + HEADER, len - HEADER)) {
+        return false;             // truncated, padded or damaged
+    }
+    tables_init();
+    reader->keyctl = in + HEADER;
+    reader->keydata = reader->keyctl + ctlbytes;
+    reader->keyend = reader->keydata + keybytes;
+    reader->cntctl = reader->keyend;
+    reader->cntdata = reader->cntctl + ctlbytes;
+    reader->cntend = reader->cntdata + countbytes;
+    reader->big = reader->cntend;
+    reader->bigend = reader->big + 8 * (size_t)nbig;
+    reader->end = in + len;
+    reader->left = n;
+    reader->key = -1;
+    reader->npending = reader->ipending = 0;
+    reader->error = false;
+    return true;
+}
+
+/**************** counters_reader_next() ****************/
+/*see counter.h for description */
+
+int counters_reader_next(counters_reader_t* reader, counters_entry_t* out, const int max)
+{
+    if (reader == NULL || out == NULL || max < 1 || reader->error) {
+        return -1;
+    }
+    int got = 0;
+    while (got < max && reader->ipending < reader->npending) {
+        out[got++] = reader->pending[reader->ipending++];  // left from last time
+    }
+    while (got < max && reader->left > 0) {
+        if (max - got >= 4 && reader->left >= 4) {
+            // a whole group fits: decode it straight into out
+            if (!reader_fill(reader, out + got)) {
+                reader->error = true;
+                return -1;
+            }
+            got += 4;
+            continue;
+        }
+        if (!reader_fill(reader, reader->pending)) {
+            reader->error = true;
+            return -1;
+        }
+        while (got < max && reader->ipending < reader->npending) {
+            out[got++] = reader->pending[reader->ipending++];
+        }
+    }
+    return got;
+}
+
+/**************** reader_fill() ****************/
+/* decode the next group of (up to) four counters into out, which is
+ * either the caller's array or the reader's pending entries; false if
+ * the buffer proves corrupt */
+static bool
+reader_fill(counters_reader_t* r, counters_entry_t* out)
+{
+    int count = r->left < 4 ? (int)r->left : 4;
+    uint32_t gaps[4], counts[4];
+    r->keydata = group_decode(r->keydata, r->keyend, r->end, *r->keyctl++, count, gaps);
+    r->cntdata = group_decode(r->cntdata, r->cntend, r->end, *r->cntctl++, count, counts);
+    if (r->keydata == NULL || r->cntdata == NULL) {
+        return false;             // a value runs past its stream
+    }
+    for (int i = 0; i < count; i++) {
+        int64_t key = r->key + gaps[i];
+        if (gaps[i] == 0 || key > INT_MAX) {
+            return false;         // keys must rise, and fit an int
+        }
+        int64_t value = counts[i];
+        if (counts[i] == BIG_COUNT) {
+            if (r->bigend - r->big < 8) {
+                return false;
+            }
+            uint64_t wide = get32(r->big) | (uint64_t)get32(r->big + 4) << 32;
+            if (wide < BIG_COUNT || wide > INT64_MAX) {
+                return false;
+            }
+            value = (int64_t)wide;
+            r->big += 8;
+        }
+        r->key = key;
+        out[i].key = (int)key;
+        out[i].count = value;
+    }
+    if (out == r->pending) {
+        r->npending = count;
+        r->ipending = 0;
+    }
+    r->left -= count;
+    return true;
+}
+
+#ifdef HAVE_SHUFFLE
+/**************** shuffle_decode() ****************/
+/* spread the four values at p into four 32-bit lanes, with one shuffle;
+ * reads 16 bytes at p, whatever the values' length */
+__attribute__((target("ssse3")))
+static void
+shuffle_decode(const unsigned char* p, const unsigned char* shuffle, uint32_t out[4])
+{
+    __m128i data = _mm_loadu_si128((const __m128i*)p);
+    __m128i mask = _mm_loadu_si128((const __m128i*)shuffle);
+    _mm_storeu_si128((__m128i*)out, _mm_shuffle_epi8(data, mask));
+}
+#endif
+
+/**************** group_decode() ****************/
+/* Decode the first count (1 to 4) values of the group at p, whose
+ * lengths are in ctl, into out.  The values must end by end; limit is the
+ * end of the buffer, past which we may not read even unused bytes.
+ * Return the start of the next group; NULL if the values overrun end.
+ */
+static const unsigned char*
+group_decode(const unsigned char* p, const unsigned char* end,
+             const unsigned char* limit, const unsigned ctl,
+             const int count, uint32_t out[4])
+{
+#ifdef HAVE_SHUFFLE
+    if (have_shuffle && count == 4 && limit - p >= 16) {
+        if (end - p < group_len[ctl]) {
+            return NULL;
+        }
+        shuffle_decode(p, group_shuffle[ctl], out);
+        return p + group_len[ctl];
+    }
+#endif
+    for (int i = 0; i < count; i++) {
+        int len = ((ctl >> (2 * i)) & 3) + 1;
+        if (end - p < len) {
+            return NULL;
+        }
+        uint32_t v = 0;
+        for (int b = 0; b < len; b++) {
+            v |= (uint32_t)p[b] << (8 * b);
+        }
+        out[i] = v;
+        p += len;
+    }
+    return p;
+}
+
+/**************** tables_init() ****************/
+/* build the decoding tables, once; later callers wait until built */
+static void
+tables_init(void)
+{
+    if (atomic_load_explicit(&tables_state, memory_order_acquire) == 2) {
+        return;
+    }
+    int expected = 0;
+    if (!atomic_compare_exchange_strong(&tables_state, &expected, 1)) {
+        while (atomic_load_explicit(&tables_state, memory_order_acquire) != 2) {
+            ;                     // another thread is building them
+        }
+        return;
+    }
+    for (int ctl = 0; ctl < 256; ctl++) {
+        int pos = 0;
+        for (int lane = 0; lane < 4; lane++) {
+            int len = ((ctl >> (2 * lane)) & 3) + 1;
+            for (int b = 0; b < 4; b++) {
+                // 0x80 makes the shuffle write a zero byte
+                group_shuffle[ctl][4 * lane + b] = b < len ? (unsigned char)(pos + b) : 0x80;
+            }
+            pos += len;
+        }
+        group_len[ctl] = (unsigned char)pos;
+    }
+#ifdef HAVE_SHUFFLE
+    __builtin_cpu_init();
+    have_shuffle = __builtin_cpu_supports("ssse3");
+#endif
+    atomic_store_explicit(&tables_state, 2, memory_order_release);
+}
+
+/**************** vbyte_len() ****************/
+/* the bytes v takes in a Stream VByte stream */
+static inline int
+vbyte_len(const uint32_t v)
+{
+    return v < (1u << 8) ? 1 : v < (1u << 16) ? 2 : v < (1u << 24) ? 3 : 4;
+}
+
+/**************** vbyte_put() ****************/
+/* write v, the i'th value of its stream, at data, and its length into
+ * the stream's length bytes at ctl; return where the next value goes */
+static unsigned char*
+vbyte_put(unsigned char* ctl, unsigned char* data, const uint32_t i, const uint32_t v)
+{
+    int len = vbyte_len(v);
+    ctl[i / 4] |= (unsigned char)((len - 1) << (2 * (i % 4)));
+    for (int b = 0; b < len; b++) {
+        data[b] = (unsigned char)(v >> (8 * b));
+    }
+    return data + len;
+}
+
+/**************** put32() ****************/
+/* store v little-endian, whatever the host's byte order */
+static inline void
+put32(unsigned char* p, const uint32_t v)
+{
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16);
+    p[3] = (unsigned char)(v >> 24);
+}
+
+/**************** get32() ****************/
+/* load a little-endian 32-bit value */
+static inline uint32_t
+get32(const unsigned char* p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16
+         | (uint32_t)p[3] << 24;
+}
+
+/**************** adler32() ****************/
+/* the Adler-32 checksum of len bytes (RFC 1950); summing in runs of
+ * 5552 bytes, the most that cannot overflow, defers the modulus */
+static uint32_t
+adler32(const unsigned char* p, size_t len)
+{
+    uint32_t a = 1, b = 0;
+    while (len > 0) {
+        size_t run = len < 5552 ? len : 5552;
+        len -= run;
+        while (run-- > 0) {
+            a += *p++;
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    return b << 16 | a;
+}
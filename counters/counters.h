@@ -1,4 +1,4 @@
-* 
+/* 
  * counters.h - header file for counters module
  *
  * A "counter set" is a set of counters, each distinguished by an integer key.
@@ -7,6 +7,16 @@
  * empty. Each time `counters_add` is called on a given key, that key's
  * counter is incremented. The current counter value can be retrieved by
  * asking for the relevant key.
+ *
+ * The counterset keeps its counters sorted by key, so that
+ * counters_intersect, counters_union and counters_difference run in
+ * linear time.
+ *
+ * Counts are 64-bit.  The int-valued functions (counters_add,
+ * counters_get, counters_iterate) report a count above INT_MAX as
+ * INT_MAX; counters_add_n, counters_get64 and counters_iterate64 see
+ * the full value.  A count never wraps around: an add that would pass
+ * INT64_MAX fails, or, after counters_saturate, stops at INT64_MAX.
  * 
  * David Kotz, April 2016, 2017, 2019, 2021
  * Xia Zhou, July 2017
@@ -17,10 +27,39 @@
 
 #include <stdio.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "journal.h"
 
 /**************** global types ****************/
 typedef struct counters counters_t;  // opaque to users of the module
 
+/* one (key, count) pair, as returned by counters_topk */
+typedef struct counters_entry {
+    int key;
+    int64_t count;
+} counters_entry_t;
+
+/* a decoder that reads the counters out of a buffer made by
+ * counters_serialize, in place; see counters_reader_init.  It lives
+ * wherever the caller likes (on the stack, say); its fields are private. */
+typedef struct counters_reader {
+    const unsigned char* keyctl;    // next key length byte
+    const unsigned char* keydata;   // next key gap
+    const unsigned char* keyend;
+    const unsigned char* cntctl;    // next count length byte
+    const unsigned char* cntdata;   // next count
+    const unsigned char* cntend;
+    const unsigned char* big;       // next count too big for 32 bits
+    const unsigned char* bigend;
+    const unsigned char* end;       // end of the buffer
+    uint32_t left;                  // counters not yet decoded
+    int64_t key;                    // the last key decoded
+    int npending, ipending;         // decoded, not yet returned
+    counters_entry_t pending[4];
+    bool error;                     // the buffer proved corrupt
+} counters_reader_t;
+
 /**************** functions ****************/
 
 /**************** FUNCTION ****************/
@@ -41,8 +80,9 @@ counters_t* counters_new(void);
  * Caller provides:
  *   valid pointer to counterset, and key(must be >= 0)
  * We return:
- *   the new value of the counter related to the indicated key.
- *   0 on error (if ctrs is NULL or key is negative)
+ *   the new value of the counter related to the indicated key
+ *   (INT_MAX if it is larger).
+ *   0 on error (if ctrs is NULL or key is negative, or on overflow)
  * We guarantee:
  *   the counter's value will be >= 1, on successful return.
  * We do:
@@ -52,19 +92,56 @@ counters_t* counters_new(void);
  */
 int counters_add(counters_t* ctrs, const int key);
 
+/**************** counters_add_n ****************/
+/* Add delta to the counter indicated by key, in one call.
+ *
+ * Caller provides:
+ *   valid pointer to counterset, key (must be >= 0), delta (must be > 0).
+ * We return:
+ *   the new value of the counter, which is never 0;
+ *   0 on error (if ctrs is NULL, key is negative, delta is not positive,
+ *   out of memory, or the count would pass INT64_MAX and ctrs does not
+ *   saturate).
+ * We do:
+ *   if the key does not yet exist, create a counter for it with count delta.
+ *   if the key does exist, add delta to its counter; on overflow, leave
+ *   the counter unchanged, or set it to INT64_MAX if ctrs saturates.
+ * Note:
+ *   one call replaces delta calls to counters_add, with one list walk.
+ *   A delta of 0 is refused and changes nothing, so that a 0 return
+ *   always means an error; use counters_set to make a zero counter.
+ */
+int64_t counters_add_n(counters_t* ctrs, const int key, const int64_t delta);
+
 /**************** counters_get ****************/
 /* Return current value of counter associated with the given key.
  *
  * Caller provides:
  *   valid pointer to counterset, and key(must be >= 0)
  * We return:
- *   current value of counter associte with the given key, if present,
+ *   current value of counter associte with the given key, if present
+ *   (INT_MAX if it is larger),
  *   0 if ctrs is NULL or if key is not found.   
  * Note:
  *   counterset is unchanged as a result of this call.
  */
 int counters_get(counters_t* ctrs, const int key);
 
+/**************** counters_get64 ****************/
+/* Return the full 64-bit value of the counter for key; as counters_get. */
+int64_t counters_get64(counters_t* ctrs, const int key);
+
+/**************** counters_saturate ****************/
+/* Choose what happens when an add would take a count past INT64_MAX.
+ *
+ * Caller provides:
+ *   valid pointer to counterset, and saturate: true to stop the count at
+ *   INT64_MAX, false (the default) to fail the add and keep the count.
+ * We do:
+ *   nothing if ctrs is NULL.
+ */
+void counters_saturate(counters_t* ctrs, const bool saturate);
+
 /**************** counters_set ****************/
 /* Set the current value of counter associated with the given key.
  *
@@ -106,13 +183,226 @@ void counters_print(counters_t* ctrs, FILE* fp);
  *   nothing, if ctrs==NULL or itemfunc==NULL.
  *   otherwise, call itemfunc once for each item, with (arg, key, count).
  * Note:
- *   the order in which items are handled is undefined.
+ *   items are handled in increasing order of key.
  *   the counterset is unchanged by this operation.
  */
 void counters_iterate(counters_t* ctrs, void* arg, 
                       void (*itemfunc)(void* arg, 
                                        const int key, const int count));
 
+/**************** counters_iterate64 ****************/
+/* Iterate as counters_iterate, but pass itemfunc the full 64-bit count. */
+void counters_iterate64(counters_t* ctrs, void* arg,
+                        void (*itemfunc)(void* arg,
+                                         const int key, const int64_t count));
+
+/**************** counters_topk ****************/
+/* Find the k counters with the largest counts.
+ *
+ * Caller provides:
+ *   valid pointer to counterset,
+ *   k >= 0,
+ *   valid pointer to an array out with room for k entries.
+ * We return:
+ *   the number of entries filled in: the smaller of k and the number of
+ *   counters; 0 if ctrs or out is NULL or k <= 0.
+ * We do:
+ *   fill out[0..] with the (key, count) pairs of the largest counts, in
+ *   decreasing order of count; equal counts are in increasing key order.
+ *   keep a heap of the best k seen so far in out itself, so we take
+ *   O(n log k) time and allocate nothing.
+ * Note:
+ *   the counterset is unchanged by this operation.
+ */
+int counters_topk(counters_t* ctrs, const int k, counters_entry_t* out);
+
+/**************** counters_intersect ****************/
+/* Fill dest with the keys found in both a and b, each with the smaller
+ * of its two counts.
+ *
+ * Caller provides:
+ *   valid pointer to an empty counterset dest (e.g., fresh from counters_new),
+ *   valid pointers to countersets a and b, both different from dest.
+ * We return:
+ *   false if any pointer is NULL, dest is a or b, dest is not empty,
+ *   or out of memory (dest may then hold part of the result);
+ *   true otherwise.
+ * We do:
+ *   run in O(|a| + |b|) time, by merging the sorted lists.
+ */
+bool counters_intersect(counters_t* dest, counters_t* a, counters_t* b);
+
+/**************** counters_union ****************/
+/* Fill dest with the keys found in a or b, each with the sum of its
+ * counts (a missing key counts 0; sums saturate at INT64_MAX).
+ *
+ * Caller provides, we return and we do: as for counters_intersect.
+ */
+bool counters_union(counters_t* dest, counters_t* a, counters_t* b);
+
+/**************** counters_difference ****************/
+/* Fill dest with the keys found in a but not in b, with a's counts.
+ *
+ * Caller provides, we return and we do: as for counters_intersect.
+ */
+bool counters_difference(counters_t* dest, counters_t* a, counters_t* b);
+
+/**************** counters_merge_many ****************/
+/* Merge many countersets into dest at once, on several threads.
+ *
+ * Caller provides:
+ *   valid pointer to counterset dest, empty or not;
+ *   an array of nsrcs valid pointers to countersets, none of them dest;
+ *   nthreads >= 1, the most threads to use;
+ *   merge(arg, key, count, other), which returns the count to keep when
+ *   key is in more than one counterset, or NULL to add the counts
+ *   (saturating at INT64_MAX).
+ * We return:
+ *   false if dest is NULL, srcs is NULL (nsrcs > 0), a source is NULL or
+ *   dest, nsrcs < 0, nthreads < 1, or out of memory; dest is then
+ *   unchanged.  true otherwise.
+ * We do:
+ *   leave in dest every key of dest and the sources.  A key in several
+ *   of them gets their counts folded by merge in order: dest's first,
+ *   then the sources' in array order; a result below 0 is kept as 0.
+ *   split the key space into ranges of about equal size, one per thread,
+ *   and k-way merge every list's run of each range on its own thread, so
+ *   the merge takes O((n / nthreads) log k) time for n counters in all.
+ * Notes:
+ *   merge is called from several threads at once, each key on one of
+ *   them; so is the allocator, which must then be thread-safe (malloc is).
+ *   Small merges use fewer threads.  The sources are unchanged, and none
+ *   may change during the call.  A journal attached to dest logs each
+ *   count that changed.
+ */
+bool counters_merge_many(counters_t* dest, counters_t** srcs, const int nsrcs,
+                         const int nthreads, void* arg,
+                         int64_t (*merge)(void* arg, const int key,
+                                          const int64_t count, const int64_t other));
+
+/**************** counters_memory_usage ****************/
+/* Return the number of bytes of memory the counterset uses.
+ *
+ * Caller provides:
+ *   valid pointer to counterset.
+ * We return:
+ *   0 if ctrs is NULL;
+ *   otherwise the bytes in the counterset structure and its nodes,
+ *   plus allocator slack when the allocator can report it.
+ * Note:
+ *   counterset is unchanged; this call is O(n).
+ */
+size_t counters_memory_usage(counters_t* ctrs);
+
+/**************** counters_allocator ****************/
+/* Replace the functions used to allocate and free all counters memory.
+ *
+ * Caller provides:
+ *   allocfn and freefn, a matching pair like malloc and free;
+ *   sizefn, which returns the usable size of a block (may be NULL).
+ * We do:
+ *   if allocfn or freefn is NULL, go back to malloc and free.
+ *   otherwise, use allocfn/freefn for every later allocation, and
+ *   sizefn (if any) to count allocator slack in counters_memory_usage.
+ * Note:
+ *   The allocator is shared by all countersets; change it only while
+ *   no counterset exists.
+ */
+void counters_allocator(void* (*allocfn)(size_t size), void (*freefn)(void* ptr),
+                        size_t (*sizefn)(void* ptr));
+
+/**************** counters_journal ****************/
+/* Log every later change to the counterset in a journal (see journal.h),
+ * so that counters_replay can rebuild it after a restart.
+ *
+ * Caller provides:
+ *   valid pointer to counterset, and an open journal, or NULL to stop.
+ * We return:
+ *   false if ctrs is NULL; true otherwise.
+ * We do:
+ *   from now on, log the count each successful counters_add,
+ *   counters_add_n and counters_set leaves, as a 12-byte record.
+ *   Logging only copies the record into the journal's buffer; call
+ *   journal_sync when changes must be durable.
+ * Note:
+ *   counters_intersect, counters_union and counters_difference are not
+ *   logged; log their result by journaling the destination afterwards,
+ *   e.g. with counters_set on each counter.
+ */
+bool counters_journal(counters_t* ctrs, journal_t* journal);
+
+/**************** counters_replay ****************/
+/* Replay a journal file written through counters_journal, setting each
+ * logged counter to its logged count.
+ *
+ * We return:
+ *   the number of records replayed; -1 if ctrs or path is NULL, or the
+ *   file cannot be read.
+ * Note:
+ *   replaying is not logged; a record torn by a crash ends the replay.
+ */
+long counters_replay(counters_t* ctrs, const char* path);
+
+/**************** counters_serialize ****************/
+/* Write the counterset into buf in a compact binary form, which
+ * counters_deserialize and counters_reader_* read back.
+ *
+ * Caller provides:
+ *   valid pointer to counterset; buf of cap bytes, or NULL to ask the size.
+ * We return:
+ *   the bytes the serialized form needs; 0 if ctrs is NULL.
+ *   If that is more than cap, nothing is written: call again with a
+ *   buffer that large.
+ * Notes:
+ *   The form is a 24-byte header, then the keys and then the counts,
+ *   each as a Stream VByte stream: one byte of 2-bit lengths per four
+ *   values, then the values in 1 to 4 bytes each, little-endian.  Keys
+ *   are written as the gap from the previous key, so close keys take a
+ *   byte each; counts past 32 bits are written at the end, in 8 bytes.
+ *   An Adler-32 checksum in the header covers the rest.  The form is the
+ *   same on every machine.
+ */
+size_t counters_serialize(counters_t* ctrs, void* buf, const size_t cap);
+
+/**************** counters_deserialize ****************/
+/* Make a new counterset from len bytes written by counters_serialize.
+ *
+ * We return:
+ *   the new counterset; NULL if buf is NULL, the bytes are not a whole
+ *   serialized counterset (bad size, checksum or content), or out of
+ *   memory.
+ * Caller is responsible for:
+ *   later calling counters_delete.
+ * Notes:
+ *   O(n): the counters arrive in key order, so each is appended.
+ */
+counters_t* counters_deserialize(const void* buf, const size_t len);
+
+/**************** counters_reader_init ****************/
+/* Start reading the counters out of len bytes written by
+ * counters_serialize, without copying them or building a counterset.
+ *
+ * Caller provides:
+ *   a reader to fill in, and the buffer, which must stay put while the
+ *   reader is used.
+ * We return:
+ *   true if the buffer holds a whole serialized counterset (right size,
+ *   magic and checksum); false otherwise, or if any pointer is NULL.
+ */
+bool counters_reader_init(counters_reader_t* reader, const void* buf, const size_t len);
+
+/**************** counters_reader_next ****************/
+/* Decode up to max more counters into out, in increasing key order.
+ *
+ * We return:
+ *   the number decoded; 0 once all have been read; -1 if reader or out
+ *   is NULL, max < 1, or the buffer proves corrupt.
+ * Notes:
+ *   Groups of four values are decoded at once, with one SSSE3 shuffle
+ *   each, where the processor has it.
+ */
+int counters_reader_next(counters_reader_t* reader, counters_entry_t* out, const int max);
+
 /**************** counters_delete ****************/
 /* Delete the whole counterset.
  *
@@ -0,0 +1,386 @@
+/*
+ * countersbench.c - benchmark driver for counters module
+ *
+ * usage: countersbench [maxsize [seed]]
+ *
+ * For each size n = 10, 100, ... maxsize, builds a counterset of n integer
+ * keys and times add (insert), hit-get, miss-get, iterate and delete,
+ * with uniform and Zipfian lookup streams; then freezes the counterset
+ * (see frozen.h) and times freeze, the same gets and an iterate on the
+ * frozen copy, top-k selection, and heavy-hitter (see heavy.h),
+ * Count-Min sketch (see sketch.h) and windowed (see window.h) adds over
+ * a Zipfian stream of keys.  Last, merges SHARDS countersets of about n keys each, by
+ * pairwise counters_union and by counters_merge_many on 1 and on
+ * MERGE_THREADS threads.
+ * Prints CSV (see bench.h) to stdout.
+ * The same seed always produces the same workload.
+ *
+ * Adwiteeya Rupantee Paul, April 2025
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "counters.h"
+#include "frozen.h"
+#include "heavy.h"
+#include "sketch.h"
+#include "window.h"
+#include "bench.h"
+
+/**************** file-local global variables ****************/
+static const uint64_t MINOPS = 100000;  // time at least this many ops per row
+static const int CHUNK = 4096;          // lookups generated per timed chunk
+static const double THETA = 0.99;       // Zipfian skew
+static const int TOPK = 10;             // k for the top-k rows
+static const int HEAVY = 100;           // keys tracked by the heavy-hitters rows
+static const double EPSILON = 0.001;    // sketch error bounds for the sketch rows
+static const double DELTA = 0.01;
+static const int INTERVALS = 60;        // window length for the window rows
+static const double DECAY = 0.9;        // window decay per interval
+static const int SHARDS = 8;            // countersets merged by the merge rows
+static const int MERGE_THREADS = 4;     // threads for the parallel merge row
+
+/**************** local functions ****************/
+static void bench_size(const uint64_t n, const uint64_t seed);
+static void bench_find(counters_t* ctrs, frozen_t* fz, const uint64_t first,
+                       const uint64_t* popular,
+                       const uint64_t n, const bool hit, const bool zipf,
+                       const uint64_t seed);
+static void bench_stream(const uint64_t n, const uint64_t* popular, const uint64_t seed);
+static void bench_merge(const uint64_t n, const uint64_t seed);
+static void itemcount(void* arg, const int key, const int count);
+
+/* **************************************** */
+int
+main(const int argc, char* argv[])
+{
+    uint64_t maxsize, seed;
+    if (!bench_args(argc, argv, &maxsize, &seed)) {
+        return 1;
+    }
+    bench_header(stdout);
+    for (uint64_t n = 10; n <= maxsize; n *= 10) {
+        bench_size(n, seed);
+    }
+    return 0;
+}
+
+/**************** bench_size() ****************/
+/* run every operation for one structure size */
+static void
+bench_size(const uint64_t n, const uint64_t seed)
+{
+    // keys [0,n) get inserted; keys [n,2n) never do
+    uint64_t* order = bench_permutation(n, seed);        // insert order
+    uint64_t* popular = bench_permutation(n, seed + 1);  // rank -> key
+    if (order == NULL || popular == NULL) {
+        fprintf(stderr, "countersbench: out of memory at n=%llu\n", (unsigned long long)n);
+        exit(2);
+    }
+    uint64_t reps = n < MINOPS ? MINOPS / n : 1;
+    uint64_t tins = 0, ains = 0, tdel = 0, adel = 0;
+    counters_t* ctrs = NULL;
+
+    // insert and delete: rebuild the counterset reps times
+    for (uint64_t r = 0; r < reps; r++) {
+        if (ctrs != NULL) {
+            uint64_t a0 = bench_allocs(), t0 = bench_now();
+            counters_delete(ctrs);
+            tdel += bench_now() - t0;
+            adel += bench_allocs() - a0;
+        }
+        uint64_t a0 = bench_allocs(), t0 = bench_now();
+        ctrs = counters_new();
+        for (uint64_t i = 0; i < n; i++) {
+            counters_add(ctrs, order[i]);
+        }
+        tins += bench_now() - t0;
+        ains += bench_allocs() - a0;
+    }
+    bench_report(stdout, "counters", "add", "uniform", n, n * reps, tins, ains);
+
+    // lookups
+    bench_find(ctrs, NULL, 0, popular, n, true, false, seed);
+    bench_find(ctrs, NULL, 0, popular, n, true, true, seed);
+    bench_find(ctrs, NULL, n, popular, n, false, false, seed);
+    bench_find(ctrs, NULL, n, popular, n, false, true, seed);
+
+    // freeze, and the same lookups on the frozen copy
+    frozen_t* fz = NULL;
+    uint64_t a0 = bench_allocs(), t0 = bench_now();
+    for (uint64_t r = 0; r < reps; r++) {
+        frozen_delete(fz);
+        fz = frozen_new(ctrs);
+    }
+    bench_report(stdout, "frozen", "freeze", "uniform", n, n * reps,
+                 bench_now() - t0, bench_allocs() - a0);
+    bench_find(NULL, fz, 0, popular, n, true, false, seed);
+    bench_find(NULL, fz, 0, popular, n, true, true, seed);
+    bench_find(NULL, fz, n, popular, n, false, false, seed);
+    bench_find(NULL, fz, n, popular, n, false, true, seed);
+
+    // iterate
+    uint64_t count = 0;
+    a0 = bench_allocs();
+    t0 = bench_now();
+    for (uint64_t r = 0; r < reps; r++) {
+        counters_iterate(ctrs, &count, itemcount);
+    }
+    bench_report(stdout, "counters", "iterate", "uniform", n, n * reps,
+                 bench_now() - t0, bench_allocs() - a0);
+    if (count != n * reps) {
+        fprintf(stderr, "countersbench: iterate saw %llu items, expected %llu\n",
+                (unsigned long long)count, (unsigned long long)(n * reps));
+    }
+    count = 0;
+    a0 = bench_allocs();
+    t0 = bench_now();
+    for (uint64_t r = 0; r < reps; r++) {
+        frozen_iterate(fz, &count, itemcount);   // every block unpacked
+    }
+    bench_report(stdout, "frozen", "iterate", "uniform", n, n * reps,
+                 bench_now() - t0, bench_allocs() - a0);
+    if (count != n * reps) {
+        fprintf(stderr, "countersbench: frozen iterate saw %llu items, expected %llu\n",
+                (unsigned long long)count, (unsigned long long)(n * reps));
+    }
+    frozen_delete(fz);
+
+    // top-k
+    counters_entry_t top[TOPK];
+    a0 = bench_allocs();
+    t0 = bench_now();
+    for (uint64_t r = 0; r < reps; r++) {
+        counters_topk(ctrs, TOPK, top);
+    }
+    bench_report(stdout, "counters", "topk", "uniform", n, n * reps,
+                 bench_now() - t0, bench_allocs() - a0);
+
+    // serialize, and read back into a counterset or in place
+    size_t need = counters_serialize(ctrs, NULL, 0);
+    unsigned char* ser = malloc(need);
+    if (ser == NULL) {
+        fprintf(stderr, "countersbench: out of memory at n=%llu\n", (unsigned long long)n);
+        exit(2);
+    }
+    a0 = bench_allocs();
+    t0 = bench_now();
+    for (uint64_t r = 0; r < reps; r++) {
+        counters_serialize(ctrs, ser, need);
+    }
+    bench_report(stdout, "counters", "serialize", "uniform", n, n * reps,
+                 bench_now() - t0, bench_allocs() - a0);
+    a0 = bench_allocs();
+    t0 = bench_now();
+    for (uint64_t r = 0; r < reps; r++) {
+        counters_delete(counters_deserialize(ser, need));
+    }
+    bench_report(stdout, "counters", "deserialize", "uniform", n, n * reps,
+                 bench_now() - t0, bench_allocs() - a0);
+    counters_entry_t batch[CHUNK];
+    count = 0;
+    a0 = bench_allocs();
+    t0 = bench_now();
+    for (uint64_t r = 0; r < reps; r++) {
+        counters_reader_t reader;
+        int got;
+        counters_reader_init(&reader, ser, need);
+        while ((got = counters_reader_next(&reader, batch, CHUNK)) > 0) {
+            count += got;
+        }
+    }
+    bench_report(stdout, "counters", "read_stream", "uniform", n, n * reps,
+                 bench_now() - t0, bench_allocs() - a0);
+    if (count != n * reps) {
+        fprintf(stderr, "countersbench: reader saw %llu counters, expected %llu\n",
+                (unsigned long long)count, (unsigned long long)(n * reps));
+    }
+    free(ser);
+
+    bench_stream(n, popular, seed);
+    bench_merge(n, seed);
+
+    // the last delete
+    a0 = bench_allocs();
+    t0 = bench_now();
+    counters_delete(ctrs);
+    tdel += bench_now() - t0;
+    adel += bench_allocs() - a0;
+    bench_report(stdout, "counters", "delete", "uniform", n, n * reps, tdel, adel);
+
+    free(order);
+    free(popular);
+}
+
+/**************** bench_find() ****************/
+/* time a stream of lookups, drawn uniformly or by Zipfian popularity,
+ * in the frozen copy fz if it is not NULL, otherwise in ctrs */
+static void
+bench_find(counters_t* ctrs, frozen_t* fz, const uint64_t first,
+           const uint64_t* popular,
+           const uint64_t n, const bool hit, const bool zipf,
+           const uint64_t seed)
+{
+    uint64_t ops = n < MINOPS ? MINOPS : n;
+    uint64_t* batch = malloc(CHUNK * sizeof(uint64_t));
+    bench_rand_t rng;
+    bench_zipf_t zipfgen;
+    if (batch == NULL) {
+        fprintf(stderr, "countersbench: out of memory\n");
+        exit(2);
+    }
+    bench_rand_init(&rng, seed + 2);
+    if (zipf) {
+        bench_zipf_init(&zipfgen, n, THETA, seed + 2);
+    }
+
+    uint64_t elapsed = 0, allocs = 0, found = 0;
+    for (uint64_t done = 0; done < ops; done += CHUNK) {
+        int len = ops - done < CHUNK ? ops - done : CHUNK;
+        // generate the next chunk of keys outside the timed region
+        for (int i = 0; i < len; i++) {
+            uint64_t rank = zipf ? bench_zipf_next(&zipfgen) : bench_rand_below(&rng, n);
+            batch[i] = popular[rank];
+        }
+        uint64_t a0 = bench_allocs(), t0 = bench_now();
+        for (int i = 0; i < len; i++) {
+            int count = fz != NULL ? frozen_get(fz, first + batch[i])
+                                   : counters_get(ctrs, first + batch[i]);
+            if (count != 0) {
+                found++;
+            }
+        }
+        elapsed += bench_now() - t0;
+        allocs += bench_allocs() - a0;
+    }
+    bench_report(stdout, fz != NULL ? "frozen" : "counters", hit ? "get_hit" : "get_miss",
+                 zipf ? "zipf" : "uniform", n, ops, elapsed, allocs);
+    if (found != (hit ? ops : 0)) {
+        fprintf(stderr, "countersbench: %llu of %llu lookups found\n",
+                (unsigned long long)found, (unsigned long long)ops);
+    }
+    free(batch);
+}
+
+/**************** bench_stream() ****************/
+/* time heavy_add, sketch_add and window_add over a Zipfian stream of keys
+ * drawn from n; the window advances one interval per chunk */
+static void
+bench_stream(const uint64_t n, const uint64_t* popular, const uint64_t seed)
+{
+    uint64_t ops = n < MINOPS ? MINOPS : n;
+    uint64_t* batch = malloc(CHUNK * sizeof(uint64_t));
+    heavy_t* hh = heavy_new(HEAVY);
+    sketch_t* sk = sketch_new(EPSILON, DELTA);
+    window_t* w = window_new(INTERVALS, DECAY);
+    bench_zipf_t zipfgen;
+    if (batch == NULL || hh == NULL || sk == NULL || w == NULL) {
+        fprintf(stderr, "countersbench: out of memory\n");
+        exit(2);
+    }
+    bench_zipf_init(&zipfgen, n, THETA, seed + 3);
+
+    uint64_t helapsed = 0, hallocs = 0, selapsed = 0, sallocs = 0;
+    uint64_t welapsed = 0, wallocs = 0;
+    for (uint64_t done = 0; done < ops; done += CHUNK) {
+        int len = ops - done < CHUNK ? ops - done : CHUNK;
+        for (int i = 0; i < len; i++) {
+            batch[i] = popular[bench_zipf_next(&zipfgen)];
+        }
+        uint64_t a0 = bench_allocs(), t0 = bench_now();
+        for (int i = 0; i < len; i++) {
+            heavy_add(hh, batch[i]);
+        }
+        helapsed += bench_now() - t0;
+        hallocs += bench_allocs() - a0;
+        a0 = bench_allocs();
+        t0 = bench_now();
+        for (int i = 0; i < len; i++) {
+            sketch_add(sk, batch[i]);
+        }
+        selapsed += bench_now() - t0;
+        sallocs += bench_allocs() - a0;
+        a0 = bench_allocs();
+        t0 = bench_now();
+        window_advance(w, done / CHUNK);
+        for (int i = 0; i < len; i++) {
+            window_add(w, batch[i]);
+        }
+        welapsed += bench_now() - t0;
+        wallocs += bench_allocs() - a0;
+    }
+    bench_report(stdout, "heavy", "add", "zipf", n, ops, helapsed, hallocs);
+    bench_report(stdout, "sketch", "add", "zipf", n, ops, selapsed, sallocs);
+    bench_report(stdout, "window", "add", "zipf", n, ops, welapsed, wallocs);
+    heavy_delete(hh);
+    sketch_delete(sk);
+    window_delete(w);
+    free(batch);
+}
+
+/**************** bench_merge() ****************/
+/* time merging SHARDS countersets, each holding about n of the keys
+ * [0,4n) at random, so most keys are in two or more: pairwise, then all
+ * at once on one thread and on several */
+static void
+bench_merge(const uint64_t n, const uint64_t seed)
+{
+    counters_t* shards[SHARDS];
+    bench_rand_t rng;
+    bench_rand_init(&rng, seed + 2);
+    uint64_t total = 0;
+    for (int s = 0; s < SHARDS; s++) {
+        shards[s] = counters_new();
+        for (uint64_t k = 4 * n; k-- > 0; ) {   // descending: each add is at the head
+            if (bench_rand_below(&rng, 4) == 0) {
+                counters_add_n(shards[s], (int)k, 1 + bench_rand_below(&rng, 100));
+                total++;
+            }
+        }
+    }
+    uint64_t reps = total < MINOPS ? MINOPS / total : 1;
+
+    uint64_t a0 = bench_allocs(), t0 = bench_now();
+    for (uint64_t r = 0; r < reps; r++) {
+        counters_t* dest = counters_new();
+        for (int s = 0; s < SHARDS; s++) {
+            counters_t* next = counters_new();
+            counters_union(next, dest, shards[s]);
+            counters_delete(dest);
+            dest = next;
+        }
+        counters_delete(dest);
+    }
+    bench_report(stdout, "counters", "merge_pairwise", "uniform", n, total * reps,
+                 bench_now() - t0, bench_allocs() - a0);
+    const int threads[2] = { 1, MERGE_THREADS };
+    for (int t = 0; t < 2; t++) {
+        char op[32];
+        snprintf(op, sizeof(op), "merge_many_%d", threads[t]);
+        a0 = bench_allocs();
+        t0 = bench_now();
+        for (uint64_t r = 0; r < reps; r++) {
+            counters_t* dest = counters_new();
+            counters_merge_many(dest, shards, SHARDS, threads[t], NULL, NULL);
+            counters_delete(dest);
+        }
+        bench_report(stdout, "counters", op, "uniform", n, total * reps,
+                     bench_now() - t0, bench_allocs() - a0);
+    }
+    for (int s = 0; s < SHARDS; s++) {
+        counters_delete(shards[s]);
+    }
+}
+
+/**************** itemcount() ****************/
+/* count the counters visited */
+static void
+itemcount(void* arg, const int key, const int count)
+{
+    uint64_t* nitems = arg;
+    if (nitems != NULL) {
+        (*nitems)++;
+    }
+}
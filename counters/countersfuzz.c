@@ -0,0 +1,351 @@
+/*
+ * countersfuzz.c - differential fuzzing harness for counters module
+ *
+ * usage: countersfuzz [runs [seed [maxlen]]] | countersfuzz file...   (see fuzz.h)
+ *
+ * Decodes each input into a sequence of adds, sets and gets - mostly on
+ * small keys, some on huge keys or with huge deltas, a few invalid - and
+ * runs it on a counterset, the reference.  At each freeze in the sequence,
+ * and at the end, the counterset is checked against the engines built
+ * from it: a frozen copy and the serialized form (both counters_deserialize
+ * and a counters_reader) must hold the same counters, frozen_get must
+ * agree with counters_get on every key the sequence used, and
+ * frozen_intersect with the previous freeze must match counters_intersect.
+ * Last, the adds are dealt out to four shards, and counters_merge_many
+ * must match adding the shards in one by one.
+ * Prints the time per operation of each (see fuzz.h) to stdout.
+ *
+ * Adwiteeya Rupantee Paul, April 2025
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "counters.h"
+#include "frozen.h"
+#include "fuzz.h"
+
+/**************** file-local global types ****************/
+typedef enum { OP_ADD, OP_ADDN, OP_SET, OP_GET, OP_FREEZE } optype_t;
+
+typedef struct op {
+    optype_t type;
+    int key;
+    int64_t value;              // delta for OP_ADDN, count for OP_SET
+} op_t;
+
+/* the counters an iteration visited, folded in order into a hash */
+typedef struct listing {
+    long count;
+    uint64_t hash;
+} listing_t;
+
+/* what the previous freeze left, for the intersect checks */
+typedef struct freeze {
+    counters_t* ctrs;           // deserialized copy of the counterset
+    frozen_t* fz;               // frozen copy of it
+} freeze_t;
+
+/**************** file-local global variables ****************/
+static const int MAXOPS = 2048;          // operations decoded per input
+static const int SHARDS = 4;             // countersets the adds are dealt to
+
+/**************** local functions ****************/
+static int decode(const uint8_t* data, const size_t size, op_t* ops);
+static void check(counters_t* ref, freeze_t* prev, op_t* ops, const int nops);
+static void check_gets(counters_t* ref, frozen_t* fz, op_t* ops, const int nops);
+static void check_intersect(counters_t* ctrs, frozen_t* fz, freeze_t* prev);
+static void check_merge(counters_t* ref, op_t* ops, const int nops);
+static listing_t listing(counters_t* ctrs, const bool wide);
+static void list(void* arg, const int key, const int count);
+static void list64(void* arg, const int key, const int64_t count);
+static void sum(void* arg, const int key, const int64_t count);
+
+/* **************************************** */
+int
+LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    op_t* ops = malloc(MAXOPS * sizeof(op_t));
+    counters_t* ref = counters_new();
+    if (ops == NULL || ref == NULL) {
+        fprintf(stderr, "countersfuzz: out of memory\n");
+        exit(2);
+    }
+    int nops = decode(data, size, ops);
+    freeze_t prev = { NULL, NULL };
+
+    for (int i = 0; i < nops; i++) {
+        switch (ops[i].type) {
+        case OP_ADD:
+            counters_add(ref, ops[i].key);
+            break;
+        case OP_ADDN:
+            counters_add_n(ref, ops[i].key, ops[i].value);
+            break;
+        case OP_SET:
+            counters_set(ref, ops[i].key, (int)ops[i].value);
+            break;
+        case OP_GET:
+            counters_get(ref, ops[i].key);
+            break;
+        case OP_FREEZE:
+            check(ref, &prev, ops, nops);
+            break;
+        }
+    }
+    check(ref, &prev, ops, nops);
+    check_merge(ref, ops, nops);
+
+    counters_delete(prev.ctrs);
+    frozen_delete(prev.fz);
+    counters_delete(ref);
+    free(ops);
+    return 0;
+}
+
+/**************** decode() ****************/
+/* turn the input into at most MAXOPS operations; return how many */
+static int
+decode(const uint8_t* data, const size_t size, op_t* ops)
+{
+    fuzz_input_t in;
+    fuzz_input_init(&in, data, size);
+    int nops = 0;
+
+    while (!fuzz_done(&in) && nops < MAXOPS) {
+        uint8_t b = fuzz_byte(&in);
+        op_t* op = &ops[nops++];
+        // a freeze is rare, since each one checks the whole counterset
+        op->type = (b & 0x1f) == 0 ? OP_FREEZE : (optype_t)(b % 4);
+
+        if ((b & 0x40) != 0) {
+            // any int at all, negative included: sparse, huge or invalid keys
+            op->key = (int)((uint32_t)fuzz_below(&in, 65536) << 16
+                            | fuzz_below(&in, 65536));
+        } else {
+            op->key = fuzz_below(&in, 1024);
+        }
+        if ((b & 0x80) != 0) {
+            // counts past 32 bits in total, or past INT_MAX, or negative
+            op->value = op->type == OP_ADDN ? (int64_t)fuzz_below(&in, 65536) << 24
+                : (int)((uint32_t)fuzz_below(&in, 65536) << 16 | fuzz_below(&in, 65536));
+        } else {
+            op->value = fuzz_byte(&in);
+        }
+    }
+    return nops;
+}
+
+/**************** check() ****************/
+/* check every engine built from the counterset ref */
+static void
+check(counters_t* ref, freeze_t* prev, op_t* ops, const int nops)
+{
+    listing_t expected = listing(ref, true);
+
+    // serialize, then read it back both ways
+    size_t len = counters_serialize(ref, NULL, 0);
+    void* buf = malloc(len);
+    if (buf == NULL || counters_serialize(ref, buf, len) != len) {
+        fuzz_fail("serialize: could not write %zu bytes", len);
+    }
+    uint64_t t0 = fuzz_now();
+    counters_t* copy = counters_new();
+    counters_iterate64(ref, copy, sum);
+    fuzz_time("counters", "copy", expected.count, fuzz_now() - t0);
+    t0 = fuzz_now();
+    counters_t* loaded = counters_deserialize(buf, len);
+    fuzz_time("deserialize", "copy", expected.count, fuzz_now() - t0);
+
+    listing_t got = listing(loaded, true);
+    if (loaded == NULL || got.count != expected.count || got.hash != expected.hash) {
+        fuzz_fail("deserialize: %ld counters differ from the reference's %ld",
+                  got.count, expected.count);
+    }
+    counters_reader_t reader;
+    counters_entry_t out[7];
+    int n;
+    got = (listing_t){0, 0};
+    if (!counters_reader_init(&reader, buf, len)) {
+        fuzz_fail("reader: rejects a buffer from counters_serialize");
+    }
+    while ((n = counters_reader_next(&reader, out, 7)) > 0) {
+        for (int i = 0; i < n; i++) {
+            list64(&got, out[i].key, out[i].count);
+        }
+    }
+    if (n < 0 || got.count != expected.count || got.hash != expected.hash) {
+        fuzz_fail("reader: %ld counters differ from the reference's %ld",
+                  got.count, expected.count);
+    }
+
+    // freeze; a frozen count stops at INT_MAX, as counters_iterate's does
+    frozen_t* fz = frozen_new(ref);
+    expected = listing(ref, false);
+    got = (listing_t){0, 0};
+    frozen_iterate(fz, &got, list);
+    if (fz == NULL || got.count != expected.count || got.hash != expected.hash
+        || frozen_size(fz) != expected.count) {
+        fuzz_fail("frozen: %ld counters differ from the reference's %ld",
+                  got.count, expected.count);
+    }
+    check_gets(ref, fz, ops, nops);
+    check_intersect(loaded, fz, prev);
+
+    counters_delete(prev->ctrs);
+    frozen_delete(prev->fz);
+    *prev = (freeze_t){ loaded, fz };
+    counters_delete(copy);
+    free(buf);
+}
+
+/**************** check_gets() ****************/
+/* frozen_get must agree with counters_get on every key in ops */
+static void
+check_gets(counters_t* ref, frozen_t* fz, op_t* ops, const int nops)
+{
+    int* expected = malloc(nops * sizeof(int) + 1);
+    int* got = malloc(nops * sizeof(int) + 1);
+    if (expected == NULL || got == NULL) {
+        fprintf(stderr, "countersfuzz: out of memory\n");
+        exit(2);
+    }
+    uint64_t t0 = fuzz_now();
+    for (int i = 0; i < nops; i++) {
+        expected[i] = counters_get(ref, ops[i].key);
+    }
+    fuzz_time("counters", "get", nops, fuzz_now() - t0);
+    t0 = fuzz_now();
+    for (int i = 0; i < nops; i++) {
+        got[i] = frozen_get(fz, ops[i].key);
+    }
+    fuzz_time("frozen", "get", nops, fuzz_now() - t0);
+
+    for (int i = 0; i < nops; i++) {
+        if (got[i] != expected[i]) {
+            fuzz_fail("frozen: get(%d) gave %d, reference %d",
+                      ops[i].key, got[i], expected[i]);
+        }
+    }
+    free(expected);
+    free(got);
+}
+
+/**************** check_intersect() ****************/
+/* intersect with the previous freeze, if any, both ways */
+static void
+check_intersect(counters_t* ctrs, frozen_t* fz, freeze_t* prev)
+{
+    if (prev->ctrs == NULL) {
+        return;
+    }
+    long n = listing(ctrs, false).count + listing(prev->ctrs, false).count;
+    counters_t* dest = counters_new();
+    uint64_t t0 = fuzz_now();
+    bool ok = counters_intersect(dest, ctrs, prev->ctrs);
+    fuzz_time("counters", "intersect", n, fuzz_now() - t0);
+    t0 = fuzz_now();
+    frozen_t* both = frozen_intersect(fz, prev->fz);
+    fuzz_time("frozen", "intersect", n, fuzz_now() - t0);
+
+    listing_t expected = listing(dest, false), got = {0, 0};
+    frozen_iterate(both, &got, list);
+    if (!ok || both == NULL || got.count != expected.count || got.hash != expected.hash) {
+        fuzz_fail("frozen: intersect gave %ld counters, reference %ld",
+                  got.count, expected.count);
+    }
+    counters_delete(dest);
+    frozen_delete(both);
+}
+
+/**************** check_merge() ****************/
+/* deal the adds out to SHARDS countersets, and merge them into a copy of ref */
+static void
+check_merge(counters_t* ref, op_t* ops, const int nops)
+{
+    counters_t* shards[SHARDS];
+    for (int s = 0; s < SHARDS; s++) {
+        shards[s] = counters_new();
+    }
+    for (int i = 0; i < nops; i++) {
+        if (ops[i].type == OP_ADD) {
+            counters_add(shards[i % SHARDS], ops[i].key);
+        } else if (ops[i].type == OP_ADDN) {
+            counters_add_n(shards[i % SHARDS], ops[i].key, ops[i].value);
+        }
+    }
+    counters_t* expected = counters_new();
+    counters_t* got = counters_new();
+    counters_iterate64(ref, expected, sum);
+    counters_iterate64(ref, got, sum);
+    long n = 0;
+    for (int s = 0; s < SHARDS; s++) {
+        n += listing(shards[s], true).count;
+    }
+
+    uint64_t t0 = fuzz_now();
+    for (int s = 0; s < SHARDS; s++) {
+        counters_iterate64(shards[s], expected, sum);
+    }
+    fuzz_time("counters", "merge", n, fuzz_now() - t0);
+    t0 = fuzz_now();
+    bool ok = counters_merge_many(got, shards, SHARDS, 2, NULL, NULL);
+    fuzz_time("merge_many", "merge", n, fuzz_now() - t0);
+
+    listing_t want = listing(expected, true), have = listing(got, true);
+    if (!ok || have.count != want.count || have.hash != want.hash) {
+        fuzz_fail("merge_many: %ld counters differ from the reference's %ld",
+                  have.count, want.count);
+    }
+    for (int s = 0; s < SHARDS; s++) {
+        counters_delete(shards[s]);
+    }
+    counters_delete(expected);
+    counters_delete(got);
+}
+
+/**************** listing() ****************/
+/* the listing of a counterset, with full counts if wide, else clamped */
+static listing_t
+listing(counters_t* ctrs, const bool wide)
+{
+    listing_t all = {0, 0};
+    if (wide) {
+        counters_iterate64(ctrs, &all, list64);
+    } else {
+        counters_iterate(ctrs, &all, list);
+    }
+    return all;
+}
+
+/**************** list() ****************/
+/* fold one counter into a listing */
+static void
+list(void* arg, const int key, const int count)
+{
+    list64(arg, key, count);
+}
+
+/**************** list64() ****************/
+/* fold one counter into a listing; FNV-1a over key and count */
+static void
+list64(void* arg, const int key, const int64_t count)
+{
+    listing_t* listing = arg;
+    listing->hash = (listing->hash ^ (uint32_t)key) * 0x100000001b3ULL;
+    listing->hash = (listing->hash ^ (uint64_t)count) * 0x100000001b3ULL;
+    listing->count++;
+}
+
+/**************** sum() ****************/
+/* add one counter into the counterset arg; a zero counter is made, if
+ * missing, with counters_set, since counters_add_n refuses a zero delta */
+static void
+sum(void* arg, const int key, const int64_t count)
+{
+    if (count > 0) {
+        counters_add_n(arg, key, count);
+    } else if (counters_get64(arg, key) == 0) {
+        counters_set(arg, key, 0);
+    }
+}
@@ -12,12 +12,41 @@
 
  #include <stdio.h>
  #include <stdlib.h>
+ #include <stddef.h>
  #include <string.h>
  #include "counters.h"
+ #include "frozen.h"
+ #include "heavy.h"
+ #include "sketch.h"
+ #include "window.h"
+ #include "journal.h"
  #include "file.h"
 
  
+ /* what checkcount has seen of a merged counterset */
+ typedef struct merged {
+   int64_t* expect;      // the count each key should have
+   long keys;
+   int mismatches;
+   int last;             // the last key seen
+ } merged_t;
+
+ /* what frozencheck has seen of a frozen copy */
+ typedef struct thawed {
+   counters_t* ctrs;     // the counterset it was frozen from
+   int seen;
+   int mismatches;
+ } thawed_t;
+
  static void itemcount(void* arg, const int key, const int count);
+ static void checkcount(void* arg, const int key, const int64_t count);
+ static void frozencheck(void* arg, const int key, const int count);
+ static int64_t maxcount(void* arg, const int key, const int64_t count, const int64_t other);
+ static int64_t lastcount(void* arg, const int key, const int64_t count, const int64_t other);
+ static void* countalloc(size_t size);
+ static void countfree(void* ptr);
+
+ static size_t livebytes = 0;   // bytes countalloc has handed out and not had back
  
  /* **************************************** */
  int main() 
@@ -120,11 +149,379 @@
    counters_print(ctrs2, stdout);
    printf("\n");
  
+   //counter algebra, against a small counter of our own
+   counters_t* small = counters_new();
+   counters_t* both = counters_new();
+   counters_t* either = counters_new();
+   counters_t* only = counters_new();
+   counters_set(small, 1, 100);
+   counters_set(small, 0, 5);
+   printf("\nCounter algebra:\n");
+   printf("Intersect into non-empty counter (should be 0): %d\n",
+          counters_intersect(ctrs2, ctrs2, small));
+   counters_intersect(both, ctrs2, small);
+   counters_union(either, ctrs2, small);
+   counters_difference(only, small, ctrs2);
+   printf("Intersection: ");
+   counters_print(both, stdout);
+   printf("\nUnion: ");
+   counters_print(either, stdout);
+   printf("\nDifference: ");
+   counters_print(only, stdout);
+   printf("\n");
+   counters_delete(small);
+   counters_delete(both);
+   counters_delete(either);
+   counters_delete(only);
+
+   //frozen copies: the small counter, and two big overlapping ones
+   printf("\nFrozen counters:\n");
+   frozen_t* cold = frozen_new(ctrs2);
+   printf("Frozen: ");
+   frozen_print(cold, stdout);
+   printf("\nFrozen get 1 (should be %d): %d\n", counters_get(ctrs2, 1), frozen_get(cold, 1));
+   printf("Frozen get missing (should be 0): %d\n", frozen_get(cold, 12345));
+   frozen_delete(cold);
+   counters_t* zero = counters_new();     // one key, count 0: a block of no words
+   counters_set(zero, 5, 0);
+   cold = frozen_new(zero);
+   printf("Frozen zero count (should be {5=0}): ");
+   frozen_print(cold, stdout);
+   printf("\n");
+   frozen_delete(cold);
+   counters_delete(zero);
+   int widewrong = 0;
+   for (int width = 1; width <= 31; width++) {  // every count width, in a full and a partial block
+     counters_t* wide = counters_new();
+     int key = 0;
+     for (int i = 0; i < FROZEN_BLOCK + 5; i++) {
+       unsigned mix = (unsigned)i * 2654435761u;
+       key += 1 + (mix & ((1u << (width < 23 ? width : 23)) - 1));
+       counters_set(wide, key, i == 0 ? (int)((1u << width) - 1) : (int)(mix & ((1u << width) - 1)));
+     }
+     thawed_t thawed = { wide, 0, 0 };
+     cold = frozen_new(wide);
+     frozen_iterate(cold, &thawed, frozencheck);
+     widewrong += thawed.mismatches + (thawed.seen != FROZEN_BLOCK + 5);
+     frozen_delete(cold);
+     counters_delete(wide);
+   }
+   printf("Wrong after freezing at widths 1 to 31 (should be 0): %d\n", widewrong);
+   counters_t* evens = counters_new();    // multiples of 2, count 1..7
+   counters_t* threes = counters_new();   // multiples of 3, count 3
+   for (int k = 59999; k >= 0; k--) {   // descending, so each goes at the head
+     counters_set(evens, 2 * k, k % 7 + 1);
+     counters_set(threes, 3 * k + 90000, 3);
+   }
+   frozen_t* fevens = frozen_new(evens);
+   frozen_t* fthrees = frozen_new(threes);
+   frozen_t* fsixes = frozen_intersect(fevens, fthrees);
+   printf("Frozen size (should be 60000): %d\n", frozen_size(fevens));
+   printf("Frozen get 1000 (should be %d): %d\n", counters_get(evens, 1000), frozen_get(fevens, 1000));
+   printf("Frozen get 1001 (should be 0): %d\n", frozen_get(fevens, 1001));
+   printf("Frozen intersect size (should be 5000): %d\n", frozen_size(fsixes));
+   printf("Frozen intersect get 90000 (should be 3): %d\n", frozen_get(fsixes, 90000));
+   printf("Frozen intersect get 119994 (should be 1): %d\n", frozen_get(fsixes, 119994));
+   printf("Frozen at least 5x smaller (should be 1): %d\n",
+          5 * frozen_memory_usage(fevens) < counters_memory_usage(evens));
+   frozen_delete(fevens);
+   frozen_delete(fthrees);
+   frozen_delete(fsixes);
+   counters_delete(evens);
+   counters_delete(threes);
+
+   //64-bit counts, bulk adds and saturation
+   printf("\n64-bit counts:\n");
+   counters_t* big = counters_new();
+   printf("Add 3000000000 (should be 3000000000): %lld\n",
+          (long long)counters_add_n(big, 7, 3000000000LL));
+   printf("Add one more (should be 2147483647): %d\n", counters_add(big, 7));
+   printf("Get64 (should be 3000000001): %lld\n", (long long)counters_get64(big, 7));
+   printf("Negative delta (should be 0): %lld\n", (long long)counters_add_n(big, 7, -1));
+   printf("Zero delta, new and existing key (should be 0 0): %lld %lld\n",
+          (long long)counters_add_n(big, 8, 0), (long long)counters_add_n(big, 7, 0));
+   printf("Overflow refused (should be 0): %lld\n",
+          (long long)counters_add_n(big, 7, INT64_MAX));
+   printf("Count unchanged (should be 3000000001): %lld\n", (long long)counters_get64(big, 7));
+   counters_saturate(big, true);
+   printf("Overflow saturates (should be 9223372036854775807): %lld\n",
+          (long long)counters_add_n(big, 7, INT64_MAX));
+   printf("Big counter: ");
+   counters_print(big, stdout);
+   printf("\n");
+   counters_delete(big);
+
+   //top-k: counts are key % 10, so keys 9, 19, 29... lead
+   printf("\nTop-k:\n");
+   counters_t* mods = counters_new();
+   counters_entry_t top[5];
+   for (int k = 99; k >= 0; k--) {
+     counters_set(mods, k, k % 10);
+   }
+   printf("Top 0 (should be 0): %d\n", counters_topk(mods, 0, top));
+   int ntop = counters_topk(mods, 3, top);
+   printf("Top 3 (should be 9=9,19=9,29=9):");
+   for (int i = 0; i < ntop; i++) {
+     printf(" %d=%lld", top[i].key, (long long)top[i].count);
+   }
+   printf("\nTop 5 of the small counter (should be 1): %d\n", counters_topk(ctrs2, 5, top));
+   counters_delete(mods);
+
+   //heavy hitters: keys 1 and 2 stand out from 5000 keys seen once
+   printf("\nHeavy hitters:\n");
+   heavy_t* hh = heavy_new(50);
+   for (int i = 0; i < 5000; i++) {
+     heavy_add(hh, 100 + i);
+     if (i % 5 == 0) {
+       heavy_add(hh, 1);         // 1000 times
+     }
+     if (i % 10 == 0) {
+       heavy_add(hh, 2);         // 500 times
+     }
+   }
+   ntop = heavy_topk(hh, 2, top);
+   printf("Top 2 keys (should be 1 2): %d %d\n", top[0].key, top[1].key);
+   printf("Key 1 within bounds (should be 1): %d\n",
+          ntop == 2 && heavy_get(hh, 1) - heavy_error(hh, 1) <= 1000 && heavy_get(hh, 1) >= 1000);
+   printf("Key 2 within bounds (should be 1): %d\n",
+          heavy_get(hh, 2) - heavy_error(hh, 2) <= 500 && heavy_get(hh, 2) >= 500);
+   printf("Error at most N/capacity (should be 1): %d\n", heavy_error(hh, 1) <= 6500 / 50);
+   heavy_delete(hh);
+
+   //Count-Min sketch, checked against exact counts in an array
+   printf("\nSketch:\n");
+   const double epsilon = 0.001, delta = 0.01;
+   const int nkeys = 10000, nadds = 200000;
+   int* exact = calloc(nkeys, sizeof(int));
+   sketch_t* sk = sketch_new(epsilon, delta);
+   printf("Bad bounds (should be 1): %d\n", sketch_new(0, delta) == NULL && sketch_new(epsilon, 1) == NULL);
+   unsigned int r = 1;
+   for (int i = 0; i < nadds; i++) {
+     r = r * 1103515245 + 12345;            // skewed keys: a few are common
+     int key = (i % 4 == 0) ? (int)(r >> 16) % 20 : (int)(r >> 8) % nkeys;
+     exact[key]++;
+     sketch_add(sk, key);
+   }
+   int under = 0, over = 0;
+   for (int key = 0; key < nkeys; key++) {
+     int estimate = sketch_get(sk, key);
+     if (estimate < exact[key]) {
+       under++;
+     }
+     if (estimate - exact[key] > epsilon * nadds) {
+       over++;
+     }
+   }
+   sketch_print(sk, stdout);
+   printf("\nTotal (should be %d): %ld\n", nadds, sketch_total(sk));
+   printf("Underestimates (should be 0): %d\n", under);
+   printf("Over by more than epsilon*N at most delta of the time (should be 1): %d\n",
+          over <= delta * nkeys);
+   printf("Sketch smaller than the exact counts (should be 1): %d\n",
+          sketch_memory_usage(sk) < nkeys * 16);
+   sketch_delete(sk);
+   free(exact);
+
+   //windowed counters: a 3-interval window, halving every interval
+   printf("\nWindow:\n");
+   window_t* win = window_new(3, 0.5);
+   printf("Bad window (should be 1): %d\n", window_new(0, 0.5) == NULL && window_new(3, 0) == NULL);
+   window_add_n(win, 4, 8);                // interval 0: 8 events
+   window_advance(win, 1);
+   window_add(win, 4);                     // interval 1: 1 event
+   window_add(win, 5);
+   window_advance(win, 2);
+   printf("Count at 2 (should be 9): %lld\n", (long long)window_get(win, 4));
+   printf("Decayed at 2 (should be 2.50): %.2f\n", window_decayed(win, 4));
+   window_advance(win, 3);
+   printf("Count at 3 (should be 1): %lld\n", (long long)window_get(win, 4));
+   printf("Going back in time (should be 0): %d\n", window_advance(win, 2));
+   window_advance(win, 1000);
+   printf("Count at 1000 (should be 0): %lld\n", (long long)window_get(win, 4));
+   for (int k = 0; k < 1000; k++) {          // enough keys to grow the table
+     window_add(win, k);
+   }
+   printf("Count after growth (should be 1): %lld\n", (long long)window_get(win, 999));
+   printf("Zero delta (should be 0 0): %lld %lld\n",
+          (long long)window_add_n(win, 5000, 0), (long long)window_get(win, 5000));
+   window_add_n(win, 5000, INT64_MAX);
+   printf("Overflowing add (should be 0): %lld\n", (long long)window_add_n(win, 5000, INT64_MAX));
+   printf("Count unchanged (should be 1): %d\n", window_get(win, 5000) == INT64_MAX);
+   window_delete(win);
+
+   //a journal of changes, replayed into a new counterset
+   printf("\nJournal:\n");
+   remove("test.journal");
+   journal_t* journal = journal_open("test.journal", 1 << 20, 1000, true);
+   counters_t* logged = counters_new();
+   counters_journal(logged, journal);
+   for (int i = 0; i < 3; i++) {
+     counters_add(logged, 1);
+   }
+   counters_set(logged, 2, 7);
+   counters_add_n(logged, 3, 5);
+   counters_set(logged, 1, 4);
+   counters_journal(logged, NULL);
+   counters_add(logged, 9);                  // not logged
+   printf("Sync (should be 1): %d\n", journal_sync(journal));
+   journal_stats_t jstats;
+   journal_stats(journal, &jstats);
+   printf("Records %lu (should be 6) in %lu write (should be 1)\n", jstats.records, jstats.writes);
+   printf("Close (should be 1): %d\n", journal_close(journal));
+   counters_t* replayed = counters_new();
+   printf("Replayed records (should be 6): %ld\n", counters_replay(replayed, "test.journal"));
+   printf("Replayed (should be {1=4,2=7,3=5}): ");
+   counters_print(replayed, stdout);
+   printf("\n");
+   printf("Missing journal (should be -1): %ld\n", counters_replay(replayed, "no-such.journal"));
+   counters_delete(logged);
+   counters_delete(replayed);
+   remove("test.journal");
+
+   //serialize, read back whole and in batches, and detect damage
+   printf("\nSerialize:\n");
+   counters_t* wide = counters_new();
+   for (int k = 0; k < 30000; k += 3) {
+     counters_set(wide, k, k % 300);
+   }
+   counters_add_n(wide, 5, 5000000000LL);     // past 32 bits
+   counters_add_n(wide, 2000000000, 1);       // a long gap, at the top
+   size_t need = counters_serialize(wide, NULL, 0);
+   unsigned char* ser = malloc(need);
+   printf("Too small a buffer (should be %zu): %zu\n", need, counters_serialize(wide, ser, need - 1));
+   printf("Written (should be %zu): %zu\n", need, counters_serialize(wide, ser, need));
+   printf("Under 4 bytes a counter (should be 1): %d\n", need < 4 * 10002);
+   counters_t* back = counters_deserialize(ser, need);
+   int mismatches = 0;
+   for (int k = 0; k < 30000; k++) {
+     if (counters_get64(back, k) != counters_get64(wide, k)) {
+       mismatches++;
+     }
+   }
+   printf("Mismatches (should be 0): %d\n", mismatches);
+   printf("Big counts (should be 5000000000 1): %lld %d\n",
+          (long long)counters_get64(back, 5), counters_get(back, 2000000000));
+   counters_reader_t reader;
+   counters_entry_t batch[7];
+   long nread = 0, sum = 0;
+   int got, last = -1, ordered = 1;
+   printf("Reader init (should be 1): %d\n", counters_reader_init(&reader, ser, need));
+   while ((got = counters_reader_next(&reader, batch, 7)) > 0) {
+     for (int i = 0; i < got; i++) {
+       ordered &= batch[i].key > last;
+       last = batch[i].key;
+       sum += batch[i].count % 1000;
+     }
+     nread += got;
+   }
+   long expect = 0;
+   for (int k = 0; k < 30000; k += 3) {
+     expect += k % 300;
+   }
+   expect += 5000000000LL % 1000 + 1;
+   printf("Read (should be 10002, in order, sum %ld): %ld %d %ld, then %d\n",
+          expect, nread, ordered, sum, got);
+   ser[need / 2] ^= 0x10;
+   printf("Damaged (should be 1): %d\n", counters_deserialize(ser, need) == NULL);
+   ser[need / 2] ^= 0x10;
+   printf("Truncated (should be 1): %d\n", counters_deserialize(ser, need - 1) == NULL
+          && !counters_reader_init(&reader, ser, need - 1));
+   counters_t* empty = counters_new();
+   unsigned char tiny[64];
+   size_t nsmall = counters_serialize(empty, tiny, sizeof(tiny));
+   counters_delete(empty);
+   empty = counters_deserialize(tiny, nsmall);
+   printf("Empty round trip (should be 24 bytes, {}): %zu ", nsmall);
+   counters_print(empty, stdout);
+   printf("\n");
+   counters_delete(empty);
+   counters_delete(back);
+   counters_delete(wide);
+   free(ser);
+
+   //merge many shards at once, on several threads
+   printf("\nMerge many:\n");
+   const int nmerged = 60000;
+   counters_t* shards[6];
+   int64_t* sums = calloc(nmerged, sizeof(int64_t));
+   int64_t* maxes = calloc(nmerged, sizeof(int64_t));
+   for (int s = 0; s < 6; s++) {
+     shards[s] = counters_new();
+     for (int k = nmerged - 1; k >= 0; k--) {      // descending: each add is at the head
+       if (k % (s + 2) == 0) {
+         counters_add_n(shards[s], k, s + 1);
+         sums[k] += s + 1;
+         maxes[k] = s + 1;
+       }
+     }
+   }
+   counters_t* summed = counters_new();
+   counters_set(summed, 3, 1000);              // dest's own counts fold in too
+   sums[3] += 1000;
+   maxes[3] = 1000;
+   printf("Null dest (should be 0): %d\n", counters_merge_many(NULL, shards, 6, 4, NULL, NULL));
+   printf("Dest among sources (should be 0): %d\n", counters_merge_many(shards[0], shards, 6, 4, NULL, NULL));
+   printf("No threads (should be 0): %d\n", counters_merge_many(summed, shards, 6, 0, NULL, NULL));
+   printf("Summed (should be 1): %d\n", counters_merge_many(summed, shards, 6, 4, NULL, NULL));
+   counters_t* maxed = counters_new();
+   counters_set(maxed, 3, 1000);
+   printf("Maxed (should be 1): %d\n", counters_merge_many(maxed, shards, 6, 3, NULL, maxcount));
+   merged_t check = { sums, 0, 0, -1 };
+   counters_iterate64(summed, &check, checkcount);
+   printf("Summed keys, mismatches (should be 46286 0): %ld %d\n", check.keys, check.mismatches);
+   check = (merged_t){ maxes, 0, 0, -1 };
+   counters_iterate64(maxed, &check, checkcount);
+   printf("Maxed keys, mismatches (should be 46286 0): %ld %d\n", check.keys, check.mismatches);
+   counters_delete(maxed);
+   maxed = counters_new();
+   counters_set(maxed, 3, 1000);
+   counters_merge_many(maxed, shards, 6, 4, NULL, lastcount);
+   maxes[3] = 2;                              // the last to hold key 3 is shards[1]
+   check = (merged_t){ maxes, 0, 0, -1 };
+   counters_iterate64(maxed, &check, checkcount);
+   printf("Last wins, mismatches (should be 0): %d\n", check.mismatches);
+   counters_t* one[3] = { counters_new(), counters_new(), counters_new() };
+   for (int s = 0; s < 3; s++) {
+     counters_set(one[s], 1, 10 * (s + 1));
+   }
+   counters_t* folded = counters_new();
+   counters_set(folded, 1, 5);
+   counters_merge_many(folded, one, 3, 2, NULL, lastcount);
+   printf("Folded in order, dest first (should be 30): %d\n", counters_get(folded, 1));
+   for (int s = 0; s < 6; s++) {
+     counters_delete(shards[s]);
+   }
+   for (int s = 0; s < 3; s++) {
+     counters_delete(one[s]);
+   }
+   counters_delete(summed);
+   counters_delete(maxed);
+   counters_delete(folded);
+   free(sums);
+   free(maxes);
+
    //delete the counters
    printf("\ndelete the counters...\n");
    counters_delete(ctrs1);
    counters_delete(ctrs2);
- 
+
+   //memory accounting, through an allocator that counts what it hands out
+   printf("\nMemory accounting:\n");
+   printf("Usage of NULL (should be 0): %zu\n", counters_memory_usage(NULL));
+   counters_allocator(countalloc, countfree, NULL);  // no sizefn: no slack to count
+   counters_t* counted = counters_new();
+   size_t bare = counters_memory_usage(counted);
+   for (int k = 0; k < 100; k++) {
+     counters_add(counted, k);
+   }
+   printf("Usage is what the allocator holds (should be 1): %d\n",
+          counters_memory_usage(counted) == livebytes);
+   printf("Grows by a node per counter (should be 1): %d\n",
+          (counters_memory_usage(counted) - bare) % 100 == 0
+          && counters_memory_usage(counted) > bare + 100 * sizeof(int64_t));
+   counters_delete(counted);
+   printf("All freed through the allocator (should be 0): %zu\n", livebytes);
+   counters_allocator(NULL, NULL, NULL);
    return 0;
  }
  
@@ -145,7 +542,57 @@
      fprintf(stderr, "itemcount: null argument\n");
    }
   }
- 
 
+ /* check a merged counter against its expected count, and key order */
+ static void checkcount(void* arg, const int key, const int64_t count)
+ {
+   merged_t* check = arg;
+   check->keys++;
+   if (key <= check->last || count != check->expect[key]) {
+     check->mismatches++;
+   }
+   check->last = key;
+ }
 
- 
+ /* check a counter of a frozen copy against the counterset it came from */
+ static void frozencheck(void* arg, const int key, const int count)
+ {
+   thawed_t* check = arg;
+   check->seen++;
+   if (count != counters_get(check->ctrs, key)) {
+     check->mismatches++;
+   }
+ }
+
+ /* merge callbacks: keep the larger count, or the later one */
+ static int64_t maxcount(void* arg, const int key, const int64_t count, const int64_t other)
+ {
+   return count > other ? count : other;
+ }
+
+ static int64_t lastcount(void* arg, const int key, const int64_t count, const int64_t other)
+ {
+   return other;
+ }
+
+ // allocate size bytes, remembering the size in front of them
+ static void* countalloc(size_t size)
+ {
+   max_align_t* block = malloc(sizeof(max_align_t) + size);
+   if (block == NULL) {
+     return NULL;
+   }
+   *(size_t*)block = size;
+   livebytes += size;
+   return block + 1;
+ }
+
+ // free a block from countalloc
+ static void countfree(void* ptr)
+ {
+   if (ptr != NULL) {
+     max_align_t* block = (max_align_t*)ptr - 1;
+     livebytes -= *(size_t*)block;
+     free(block);
+   }
+ }
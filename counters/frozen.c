@@ -0,0 +1,511 @@
+/*
+ * frozen.c - source file for frozen counters module
+ *
+ * A *frozen* counterset is a read-only, compressed copy of a counterset;
+ * see frozen.h for the format.  All packed values of the counterset live
+ * in one array of 64-bit words; each block header says where its key
+ * distances and its counts begin, and how many bits each one takes.
+ *
+ * Adwiteeya Rupantee Paul, April 2025
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include "frozen.h"
+#include "counters.h"
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>   // AVX2 gather, to unpack four values at once
+#define HAVE_GATHER 1
+#endif
+
+/**************** file-local global variables ****************/
+/* zero words after the packed data: extract reads the word after a
+ * value's, and a last block of width 0 starts at the end of the data */
+static const size_t PAD_WORDS = 2;
+
+/**************** local types ****************/
+typedef struct frozenblock {
+    int first;               // smallest key in the block
+    int last;                // largest key in the block
+    uint32_t offset;         // word where the packed key distances begin
+    uint16_t n;              // number of counters in the block
+    uint8_t keybits;         // bits per key distance
+    uint8_t countbits;       // bits per count
+} frozenblock_t;
+
+/* the arrays a counterset is copied into before packing */
+typedef struct frozenlist {
+    int* keys;               // keys, in increasing order
+    int* counts;             // counts, matching keys
+    int n;                   // number of counters filled in
+} frozenlist_t;
+
+/**************** global types ****************/
+typedef struct frozen {
+    int num_keys;            // number of counters
+    int num_blocks;          // number of blocks
+    size_t num_words;        // number of packed words, not counting the pad
+    frozenblock_t* blocks;   // one header per block
+    uint64_t* words;         // packed data, plus PAD_WORDS zero words
+} frozen_t;
+
+/**************** global functions ****************/
+/* that is, visible outside this file */
+/* see frozen.h for comments about exported functions */
+
+/**************** local functions ****************/
+/* not visible outside this file */
+static frozen_t* frozen_build(const int* keys, const int* counts, const int n);
+static int bitwidth(uint32_t value);
+static size_t packed_words(const int n, const int width);
+static void pack(uint64_t* dst, const int width, const int n, const uint32_t* values);
+static inline uint32_t extract(const uint64_t* src, const int width, const int i);
+static void unpack(const uint64_t* src, const int width, const int n, uint32_t* values);
+#ifdef HAVE_GATHER
+static int unpack_gather(const uint64_t* src, const int width, const int n, uint32_t* values);
+static bool have_gather(void);
+#endif
+static void decode_block(frozen_t* fz, const int b, int* keys, int* counts);
+static void listcount(void* arg, const int key, const int count);
+static void listfill(void* arg, const int key, const int count);
+
+/**************** frozen_new() ****************/
+/* see frozen.h for description */
+frozen_t*
+frozen_new(counters_t* ctrs)
+{
+    if (ctrs == NULL) {
+        return NULL;
+    }
+    // copy the counters, already in key order, into two arrays
+    int n = 0;
+    counters_iterate(ctrs, &n, listcount);
+    frozenlist_t list = { malloc((n + 1) * sizeof(int)), malloc((n + 1) * sizeof(int)), 0 };
+    frozen_t* fz = NULL;
+    if (list.keys != NULL && list.counts != NULL) {
+        counters_iterate(ctrs, &list, listfill);
+        fz = frozen_build(list.keys, list.counts, list.n);
+    }
+    free(list.keys);
+    free(list.counts);
+    return fz;
+}
+
+/**************** frozen_build() ****************/
+/* pack n counters, with distinct keys in increasing order, into a new
+ * frozen counterset; NULL if out of memory */
+static frozen_t*
+frozen_build(const int* keys, const int* counts, const int n)
+{
+    frozen_t* fz = malloc(sizeof(frozen_t));
+    if (fz == NULL) {
+        return NULL;
+    }
+    fz->num_keys = n;
+    fz->num_blocks = (n + FROZEN_BLOCK - 1) / FROZEN_BLOCK;
+    fz->blocks = malloc((fz->num_blocks + 1) * sizeof(frozenblock_t));
+    if (fz->blocks == NULL) {
+        free(fz);
+        return NULL;
+    }
+
+    // first pass: choose each block's widths, and so its place in words
+    size_t offset = 0;
+    for (int b = 0; b < fz->num_blocks; b++) {
+        frozenblock_t* block = &fz->blocks[b];
+        int start = b * FROZEN_BLOCK;
+        block->n = n - start < FROZEN_BLOCK ? n - start : FROZEN_BLOCK;
+        block->first = keys[start];
+        block->last = keys[start + block->n - 1];
+        uint32_t maxdist = 0, maxcount = 0;
+        for (int i = 1; i < block->n; i++) {
+            uint32_t dist = keys[start + i] - keys[start + i - 1];
+            maxdist = dist > maxdist ? dist : maxdist;
+        }
+        for (int i = 0; i < block->n; i++) {
+            maxcount = (uint32_t)counts[start + i] > maxcount ? counts[start + i] : maxcount;
+        }
+        block->keybits = bitwidth(maxdist);
+        block->countbits = bitwidth(maxcount);
+        block->offset = offset;
+        offset += packed_words(block->n, block->keybits)
+                + packed_words(block->n, block->countbits);
+    }
+    fz->num_words = offset;
+    fz->words = calloc(offset + PAD_WORDS, sizeof(uint64_t));  // the pad is zero
+    if (fz->words == NULL) {
+        free(fz->blocks);
+        free(fz);
+        return NULL;
+    }
+
+    // second pass: pack the distances, then the counts, of each block
+    uint32_t values[FROZEN_BLOCK];
+    for (int b = 0; b < fz->num_blocks; b++) {
+        frozenblock_t* block = &fz->blocks[b];
+        int start = b * FROZEN_BLOCK;
+        uint64_t* dst = fz->words + block->offset;
+        values[0] = 0;                    // the first key is in the header
+        for (int i = 1; i < block->n; i++) {
+            values[i] = keys[start + i] - keys[start + i - 1];
+        }
+        pack(dst, block->keybits, block->n, values);
+        dst += packed_words(block->n, block->keybits);
+        for (int i = 0; i < block->n; i++) {
+            values[i] = counts[start + i];
+        }
+        pack(dst, block->countbits, block->n, values);
+    }
+    return fz;
+}
+
+/**************** frozen_get() ****************/
+/* see frozen.h for description */
+int
+frozen_get(frozen_t* fz, const int key)
+{
+    if (fz == NULL || key < 0) {
+        return 0;
+    }
+    // find the first block whose last key is >= key
+    int lo = 0, hi = fz->num_blocks;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (fz->blocks[mid].last < key) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == fz->num_blocks || fz->blocks[lo].first > key) {
+        return 0;                 // key falls outside, or between, blocks
+    }
+    // walk the block's distances until we reach or pass key
+    frozenblock_t* block = &fz->blocks[lo];
+    const uint64_t* dists = fz->words + block->offset;
+    int k = block->first;
+    for (int i = 0; i < block->n; i++) {
+        k += extract(dists, block->keybits, i);
+        if (k == key) {
+            const uint64_t* counts = dists + packed_words(block->n, block->keybits);
+            return extract(counts, block->countbits, i);
+        }
+        if (k > key) {
+            break;
+        }
+    }
+    return 0;                     // key not found
+}
+
+/**************** frozen_intersect() ****************/
+/* see frozen.h for description */
+frozen_t*
+frozen_intersect(frozen_t* a, frozen_t* b)
+{
+    if (a == NULL || b == NULL) {
+        return NULL;
+    }
+    int max = a->num_keys < b->num_keys ? a->num_keys : b->num_keys;
+    int* keys = malloc((max + 1) * sizeof(int));
+    int* counts = malloc((max + 1) * sizeof(int));
+    frozen_t* fz = NULL;
+    if (keys != NULL && counts != NULL) {
+        int akeys[FROZEN_BLOCK], acounts[FROZEN_BLOCK];
+        int bkeys[FROZEN_BLOCK], bcounts[FROZEN_BLOCK];
+        int adecoded = -1, bdecoded = -1;   // which block is in akeys, bkeys
+        int ai = 0, bi = 0;                 // position within those blocks
+        int ia = 0, ib = 0;                 // current block of a, b
+        int n = 0;
+        while (ia < a->num_blocks && ib < b->num_blocks) {
+            frozenblock_t* ablock = &a->blocks[ia];
+            frozenblock_t* bblock = &b->blocks[ib];
+            // skip a block that lies wholly before the other one
+            if (ablock->last < bblock->first) {
+                ia++;
+                continue;
+            }
+            if (bblock->last < ablock->first) {
+                ib++;
+                continue;
+            }
+            // the ranges overlap: decode both blocks (once), and merge
+            if (adecoded != ia) {
+                decode_block(a, ia, akeys, acounts);
+                adecoded = ia;
+                ai = 0;
+            }
+            if (bdecoded != ib) {
+                decode_block(b, ib, bkeys, bcounts);
+                bdecoded = ib;
+                bi = 0;
+            }
+            while (ai < ablock->n && bi < bblock->n) {
+                if (akeys[ai] < bkeys[bi]) {
+                    ai++;
+                } else if (bkeys[bi] < akeys[ai]) {
+                    bi++;
+                } else {
+                    keys[n] = akeys[ai];
+                    counts[n] = acounts[ai] < bcounts[bi] ? acounts[ai] : bcounts[bi];
+                    n++;
+                    ai++;
+                    bi++;
+                }
+            }
+            // move on from whichever block ran out
+            if (ai == ablock->n) {
+                ia++;
+            }
+            if (bi == bblock->n) {
+                ib++;
+            }
+        }
+        fz = frozen_build(keys, counts, n);
+    }
+    free(keys);
+    free(counts);
+    return fz;
+}
+
+/**************** frozen_print() ****************/
+/* see frozen.h for description */
+void
+frozen_print(frozen_t* fz, FILE* fp)
+{
+    if (fp == NULL) {
+        return;
+    }
+    if (fz == NULL) {
+        fputs("(null)", fp);
+        return;
+    }
+    int keys[FROZEN_BLOCK], counts[FROZEN_BLOCK];
+    fputc('{', fp);
+    for (int b = 0; b < fz->num_blocks; b++) {
+        decode_block(fz, b, keys, counts);
+        for (int i = 0; i < fz->blocks[b].n; i++) {
+            if (b > 0 || i > 0) {
+                fputc(',', fp);
+            }
+            fprintf(fp, "%d=%d", keys[i], counts[i]);
+        }
+    }
+    fputc('}', fp);
+}
+
+/**************** frozen_iterate() ****************/
+/* see frozen.h for description */
+void
+frozen_iterate(frozen_t* fz, void* arg,
+               void (*itemfunc)(void* arg, const int key, const int count))
+{
+    if (fz != NULL && itemfunc != NULL) {
+        int keys[FROZEN_BLOCK], counts[FROZEN_BLOCK];
+        for (int b = 0; b < fz->num_blocks; b++) {
+            decode_block(fz, b, keys, counts);
+            for (int i = 0; i < fz->blocks[b].n; i++) {
+                (*itemfunc)(arg, keys[i], counts[i]);
+            }
+        }
+    }
+}
+
+/**************** frozen_size() ****************/
+/* see frozen.h for description */
+int
+frozen_size(frozen_t* fz)
+{
+    return fz == NULL ? 0 : fz->num_keys;
+}
+
+/**************** frozen_memory_usage() ****************/
+/* see frozen.h for description */
+size_t
+frozen_memory_usage(frozen_t* fz)
+{
+    if (fz == NULL) {
+        return 0;
+    }
+    return sizeof(frozen_t)
+         + (fz->num_blocks + 1) * sizeof(frozenblock_t)
+         + (fz->num_words + PAD_WORDS) * sizeof(uint64_t);
+}
+
+/**************** frozen_delete() ****************/
+/* see frozen.h for description */
+void
+frozen_delete(frozen_t* fz)
+{
+    if (fz != NULL) {
+        free(fz->blocks);
+        free(fz->words);
+        free(fz);
+    }
+}
+
+/**************** bitwidth() ****************/
+/* the number of bits needed to hold value; 0 for 0 */
+static int
+bitwidth(uint32_t value)
+{
+    int width = 0;
+    while (value != 0) {
+        width++;
+        value >>= 1;
+    }
+    return width;
+}
+
+/**************** packed_words() ****************/
+/* the number of 64-bit words that n values of the given width fill */
+static size_t
+packed_words(const int n, const int width)
+{
+    return ((size_t)n * width + 63) / 64;
+}
+
+/**************** pack() ****************/
+/* pack n values, each at most width bits, into the zeroed words at dst;
+ * value i starts at bit i*width, and may straddle two words */
+static void
+pack(uint64_t* dst, const int width, const int n, const uint32_t* values)
+{
+    if (width == 0) {
+        return;                   // all zero; nothing to store
+    }
+    for (int i = 0; i < n; i++) {
+        size_t bit = (size_t)i * width;
+        int shift = bit & 63;
+        dst[bit >> 6] |= (uint64_t)values[i] << shift;
+        if (shift + width > 64) {
+            dst[(bit >> 6) + 1] |= (uint64_t)values[i] >> (64 - shift);
+        }
+    }
+}
+
+/**************** extract() ****************/
+/* Return value i of those packed at src with the given width.
+ * Always reads the word after the value's first word, and splices it in
+ * with two shifts (so a shift of 0 does not become an undefined shift by
+ * 64); the zero pad words at the end of the array keep that read in
+ * bounds, even for a last block of width 0, which fills no words.
+ */
+static inline uint32_t
+extract(const uint64_t* src, const int width, const int i)
+{
+    size_t bit = (size_t)i * width;
+    int shift = bit & 63;
+    uint64_t lo = src[bit >> 6] >> shift;
+    uint64_t hi = (src[(bit >> 6) + 1] << 1) << (63 - shift);
+    return (uint32_t)((lo | hi) & ((1ULL << width) - 1));
+}
+
+/**************** unpack() ****************/
+/* extract all n values packed at src with the given width; four at a
+ * time where the processor has AVX2, since compilers leave this loop
+ * scalar (its loads depend on i * width) */
+static void
+unpack(const uint64_t* src, const int width, const int n, uint32_t* values)
+{
+    int i = 0;
+#ifdef HAVE_GATHER
+    if (have_gather()) {
+        i = unpack_gather(src, width, n, values);
+    }
+#endif
+    for (; i < n; i++) {
+        values[i] = extract(src, width, i);
+    }
+}
+
+#ifdef HAVE_GATHER
+/**************** unpack_gather() ****************/
+/* Unpack values 0, 1, ... of those at src, four at a time, and return
+ * how many were done (a multiple of 4); unpack does the rest.  Each lane
+ * loads the 8 bytes from the byte its value starts in, which on x86 (a
+ * little-endian machine) holds the value's width (<= 32) bits at a shift
+ * of at most 7; those bytes end within the word after the value's, as
+ * extract's reads do, so the pad keeps them in bounds too.
+ */
+__attribute__((target("avx2")))
+static int
+unpack_gather(const uint64_t* src, const int width, const int n, uint32_t* values)
+{
+    const __m256i step = _mm256_set1_epi64x(4 * (long long)width);
+    const __m256i seven = _mm256_set1_epi64x(7);
+    const __m256i mask = _mm256_set1_epi64x((1LL << width) - 1);
+    const __m256i evens = _mm256_setr_epi32(0, 2, 4, 6, 0, 0, 0, 0);
+    __m256i bit = _mm256_setr_epi64x(0, width, 2 * (long long)width, 3 * (long long)width);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i word = _mm256_i64gather_epi64((const long long*)src,
+                                              _mm256_srli_epi64(bit, 3), 1);
+        __m256i v = _mm256_and_si256(_mm256_srlv_epi64(word, _mm256_and_si256(bit, seven)), mask);
+        // the low halves of the four lanes, into four 32-bit values
+        _mm_storeu_si128((__m128i*)(values + i),
+                         _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(v, evens)));
+        bit = _mm256_add_epi64(bit, step);
+    }
+    return i;
+}
+
+/**************** have_gather() ****************/
+/* true if the processor has AVX2; asked once, then remembered */
+static bool
+have_gather(void)
+{
+    static atomic_int state = 0;  // 0 not asked yet, 1 no, 2 yes
+    int known = atomic_load_explicit(&state, memory_order_relaxed);
+    if (known == 0) {
+        __builtin_cpu_init();
+        known = __builtin_cpu_supports("avx2") ? 2 : 1;
+        atomic_store_explicit(&state, known, memory_order_relaxed);
+    }
+    return known == 2;
+}
+#endif
+
+/**************** decode_block() ****************/
+/* decode block b into arrays of keys and counts */
+static void
+decode_block(frozen_t* fz, const int b, int* keys, int* counts)
+{
+    frozenblock_t* block = &fz->blocks[b];
+    const uint64_t* src = fz->words + block->offset;
+    uint32_t values[FROZEN_BLOCK];
+
+    unpack(src, block->keybits, block->n, values);
+    int k = block->first;
+    for (int i = 0; i < block->n; i++) {
+        k += values[i];           // distances to absolute keys
+        keys[i] = k;
+    }
+    unpack(src + packed_words(block->n, block->keybits), block->countbits,
+           block->n, values);
+    for (int i = 0; i < block->n; i++) {
+        counts[i] = values[i];
+    }
+}
+
+/**************** listcount() ****************/
+/* count the counters, to size the arrays */
+static void
+listcount(void* arg, const int key, const int count)
+{
+    int* n = arg;
+    (*n)++;
+}
+
+/**************** listfill() ****************/
+/* append one counter to the arrays */
+static void
+listfill(void* arg, const int key, const int count)
+{
+    frozenlist_t* list = arg;
+    list->keys[list->n] = key;
+    list->counts[list->n] = count;
+    list->n++;
+}
@@ -0,0 +1,139 @@
+/*
+ * frozen.h - header file for frozen counters module
+ *
+ * A *frozen* counterset is a read-only, compressed copy of a counterset.
+ * It answers the same questions as a counterset - what is the count for
+ * this key? - but cannot be changed after it is made.  It suits large,
+ * finished countersets such as postings lists (document ID -> frequency).
+ *
+ * Keys are kept sorted and split into blocks of FROZEN_BLOCK counters.
+ * Within a block, each key is stored as its distance from the previous
+ * key, and the distances and the counts are each bit-packed at the
+ * smallest width that holds the block's largest value.  A small header
+ * per block records its first and last key, so lookups and intersections
+ * skip whole blocks without decoding them.  Dense keys with small counts
+ * take a few bits per counter, instead of a 24-byte list node plus its
+ * malloc overhead.
+ *
+ * Adwiteeya Rupantee Paul, April 2025
+ */
+
+#ifndef __FROZEN_H
+#define __FROZEN_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "counters.h"
+
+/**************** global types ****************/
+typedef struct frozen frozen_t;  // opaque to users of the module
+
+/* counters per block; a block is the unit of skipping and decoding */
+#define FROZEN_BLOCK 128
+
+/**************** functions ****************/
+
+/**************** frozen_new ****************/
+/* Make a frozen copy of a counterset.
+ *
+ * Caller provides:
+ *   valid pointer to a counterset.
+ * We return:
+ *   pointer to a new frozen counterset holding the same counters
+ *   (a count above INT_MAX is frozen as INT_MAX);
+ *   NULL if ctrs is NULL or out of memory.
+ * Caller is responsible for:
+ *   later calling frozen_delete; the counterset itself is unchanged,
+ *   and may be deleted as soon as we return.
+ */
+frozen_t* frozen_new(counters_t* ctrs);
+
+/**************** frozen_get ****************/
+/* Return current value of counter associated with the given key.
+ *
+ * Caller provides:
+ *   valid pointer to frozen counterset,
+ *   key that must be non-negative.
+ * We return:
+ *   current value of counter associated with the given key, if present,
+ *   0 if fz is NULL, key is negative, or key is not found.
+ * We do:
+ *   binary search the block headers, then decode at most one block.
+ */
+int frozen_get(frozen_t* fz, const int key);
+
+/**************** frozen_intersect ****************/
+/* Intersect two frozen countersets.
+ *
+ * Caller provides:
+ *   valid pointers to frozen countersets a and b.
+ * We return:
+ *   pointer to a new frozen counterset with the keys found in both a and b,
+ *   each with the smaller of its two counts, like counters_intersect;
+ *   NULL if a or b is NULL or out of memory.
+ * We do:
+ *   skip every block whose key range does not overlap a block of the
+ *   other counterset, so disjoint stretches cost nothing to decode.
+ * Caller is responsible for:
+ *   later calling frozen_delete on the result.
+ */
+frozen_t* frozen_intersect(frozen_t* a, frozen_t* b);
+
+/**************** frozen_print ****************/
+/* Print the frozen counterset, like counters_print.
+ *
+ * Caller provides:
+ *   valid pointer to frozen counterset,
+ *   FILE open for writing.
+ * We print:
+ *   Nothing if NULL fp.
+ *   "(null)" if NULL fz.
+ *   otherwise, comma=separated list of key=counter pairs, all in {brackets}.
+ */
+void frozen_print(frozen_t* fz, FILE* fp);
+
+/**************** frozen_iterate ****************/
+/* Iterate over all counters in the frozen counterset, in increasing key order.
+ *
+ * Caller provides:
+ *   valid pointer to frozen counterset,
+ *   arbitrary void*arg,
+ *   valid pointer to itemfunc that can handle one item.
+ * We do:
+ *   nothing, if fz==NULL or itemfunc==NULL.
+ *   otherwise, call itemfunc once for each item, with (arg, key, count).
+ */
+void frozen_iterate(frozen_t* fz, void* arg,
+                    void (*itemfunc)(void* arg, const int key, const int count));
+
+/**************** frozen_size ****************/
+/* Return the number of counters in the frozen counterset; 0 if fz is NULL. */
+int frozen_size(frozen_t* fz);
+
+/**************** frozen_memory_usage ****************/
+/* Return the number of bytes of memory the frozen counterset uses.
+ *
+ * Caller provides:
+ *   valid pointer to frozen counterset.
+ * We return:
+ *   0 if fz is NULL;
+ *   otherwise the bytes in the structure, its block headers and its
+ *   packed data, comparable with counters_memory_usage.
+ * Note:
+ *   this call is O(1).
+ */
+size_t frozen_memory_usage(frozen_t* fz);
+
+/**************** frozen_delete ****************/
+/* Delete the whole frozen counterset.
+ *
+ * Caller provides:
+ *   a valid pointer to frozen counterset.
+ * We do:
+ *   we ignore NULL fz.
+ *   we free all memory we allocate for this frozen counterset.
+ */
+void frozen_delete(frozen_t* fz);
+
+#endif // __FROZEN_H
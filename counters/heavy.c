@@ -0,0 +1,342 @@
+/*
+ * heavy.c - source file for heavy-hitters module
+ *
+ * The tracked keys are kept in a min-heap ordered by count, so the key to
+ * replace is always at the root, and in an open-addressing index from key
+ * to heap position, so a tracked key is found in O(1).  Both arrays, and
+ * a scratch array for heavy_topk, are sized by heavy_new and never grow.
+ * See heavy.h for the algorithm and its guarantees.
+ *
+ * Adwiteeya Rupantee Paul, April 2025
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <limits.h>
+#include "heavy.h"
+#include "counters.h"
+
+/**************** local types ****************/
+typedef struct heavyentry {
+    int key;                 // tracked key
+    int count;               // estimated count
+    int error;               // most by which count may be too high
+    int slot;                // where key sits in the index
+} heavyentry_t;
+
+typedef struct heavyslot {
+    int key;                 // tracked key, or -1 if the slot is empty
+    int pos;                 // its position in the heap
+} heavyslot_t;
+
+/**************** global types ****************/
+typedef struct heavy {
+    int capacity;            // most keys tracked
+    int size;                // keys tracked now
+    int mask;                // index slots - 1 (a power of two - 1)
+    int shift;               // 32 - log2(index slots), for hashing
+    heavyentry_t* heap;      // min-heap by count, capacity entries
+    heavyslot_t* index;      // key -> heap position, mask+1 slots
+    counters_entry_t* scratch;  // capacity entries, for heavy_topk
+} heavy_t;
+
+/**************** global functions ****************/
+/* that is, visible outside this file */
+/* see heavy.h for comments about exported functions */
+
+/**************** local functions ****************/
+/* not visible outside this file */
+static inline int home_slot(heavy_t* hh, const int key);
+static int index_find(heavy_t* hh, const int key);
+static int index_insert(heavy_t* hh, const int key, const int pos);
+static void index_remove(heavy_t* hh, int slot);
+static void heap_place(heavy_t* hh, const int pos, const heavyentry_t* entry);
+static void sift_up(heavy_t* hh, int pos);
+static void sift_down(heavy_t* hh, int pos);
+static int entry_compare(const void* a, const void* b);
+
+/**************** heavy_new() ****************/
+/* see heavy.h for description */
+heavy_t*
+heavy_new(const int capacity)
+{
+    if (capacity <= 0 || capacity > INT_MAX / 4) {
+        return NULL;
+    }
+    heavy_t* hh = malloc(sizeof(heavy_t));
+    if (hh == NULL) {
+        return NULL;
+    }
+    // the index is at least twice the capacity, so probes stay short
+    int slots = 2, bits = 1;
+    while (slots < 2 * capacity) {
+        slots *= 2;
+        bits++;
+    }
+    hh->capacity = capacity;
+    hh->size = 0;
+    hh->mask = slots - 1;
+    hh->shift = 32 - bits;
+    hh->heap = malloc(capacity * sizeof(heavyentry_t));
+    hh->index = malloc(slots * sizeof(heavyslot_t));
+    hh->scratch = malloc(capacity * sizeof(counters_entry_t));
+    if (hh->heap == NULL || hh->index == NULL || hh->scratch == NULL) {
+        heavy_delete(hh);
+        return NULL;
+    }
+    for (int i = 0; i < slots; i++) {
+        hh->index[i].key = -1;
+    }
+    return hh;
+}
+
+/**************** heavy_add() ****************/
+/* see heavy.h for description */
+int
+heavy_add(heavy_t* hh, const int key)
+{
+    if (hh == NULL || key < 0) {
+        return 0;
+    }
+    int slot = index_find(hh, key);
+    if (slot >= 0) {
+        // tracked: count it, and let it sink below smaller counts
+        int pos = hh->index[slot].pos;
+        heavyentry_t* entry = &hh->heap[pos];
+        if (entry->count < INT_MAX) {
+            entry->count++;
+        }
+        int count = entry->count;
+        sift_down(hh, pos);
+        return count;
+    }
+    if (hh->size < hh->capacity) {
+        // room left: track it with an exact count of 1
+        int pos = hh->size++;
+        heavyentry_t entry = { key, 1, 0, -1 };
+        entry.slot = index_insert(hh, key, pos);
+        heap_place(hh, pos, &entry);
+        sift_up(hh, pos);
+        return 1;
+    }
+    // full: the key with the smallest count gives up its place
+    heavyentry_t* root = &hh->heap[0];
+    index_remove(hh, root->slot);
+    root->key = key;
+    root->error = root->count;
+    if (root->count < INT_MAX) {
+        root->count++;
+    }
+    root->slot = index_insert(hh, key, 0);
+    int count = root->count;
+    sift_down(hh, 0);
+    return count;
+}
+
+/**************** heavy_get() ****************/
+/* see heavy.h for description */
+int
+heavy_get(heavy_t* hh, const int key)
+{
+    if (hh == NULL || key < 0) {
+        return 0;
+    }
+    int slot = index_find(hh, key);
+    return slot < 0 ? 0 : hh->heap[hh->index[slot].pos].count;
+}
+
+/**************** heavy_error() ****************/
+/* see heavy.h for description */
+int
+heavy_error(heavy_t* hh, const int key)
+{
+    if (hh == NULL || key < 0) {
+        return 0;
+    }
+    int slot = index_find(hh, key);
+    return slot < 0 ? 0 : hh->heap[hh->index[slot].pos].error;
+}
+
+/**************** heavy_topk() ****************/
+/* see heavy.h for description */
+int
+heavy_topk(heavy_t* hh, const int k, counters_entry_t* out)
+{
+    if (hh == NULL || out == NULL || k <= 0) {
+        return 0;
+    }
+    // sort a copy of the tracked keys; there are at most capacity of them
+    for (int i = 0; i < hh->size; i++) {
+        hh->scratch[i].key = hh->heap[i].key;
+        hh->scratch[i].count = hh->heap[i].count;
+    }
+    qsort(hh->scratch, hh->size, sizeof(counters_entry_t), entry_compare);
+    int n = k < hh->size ? k : hh->size;
+    for (int i = 0; i < n; i++) {
+        out[i] = hh->scratch[i];
+    }
+    return n;
+}
+
+/**************** heavy_print() ****************/
+/* see heavy.h for description */
+void
+heavy_print(heavy_t* hh, FILE* fp)
+{
+    if (fp == NULL) {
+        return;
+    }
+    if (hh == NULL) {
+        fputs("(null)", fp);
+        return;
+    }
+    fputc('{', fp);
+    for (int i = 0; i < hh->size; i++) {
+        fprintf(fp, "%d=%d", hh->heap[i].key, hh->heap[i].count);
+        if (i + 1 < hh->size) {
+            fputc(',', fp);
+        }
+    }
+    fputc('}', fp);
+}
+
+/**************** heavy_memory_usage() ****************/
+/* see heavy.h for description */
+size_t
+heavy_memory_usage(heavy_t* hh)
+{
+    if (hh == NULL) {
+        return 0;
+    }
+    return sizeof(heavy_t)
+         + hh->capacity * (sizeof(heavyentry_t) + sizeof(counters_entry_t))
+         + (hh->mask + 1) * sizeof(heavyslot_t);
+}
+
+/**************** heavy_delete() ****************/
+/* see heavy.h for description */
+void
+heavy_delete(heavy_t* hh)
+{
+    if (hh != NULL) {
+        free(hh->heap);
+        free(hh->index);
+        free(hh->scratch);
+        free(hh);
+    }
+}
+
+/**************** home_slot() ****************/
+/* the index slot where key's probe begins (Fibonacci hashing) */
+static inline int
+home_slot(heavy_t* hh, const int key)
+{
+    return ((uint32_t)key * 2654435769u) >> hh->shift;
+}
+
+/**************** index_find() ****************/
+/* the index slot holding key; -1 if key is not tracked */
+static int
+index_find(heavy_t* hh, const int key)
+{
+    for (int i = home_slot(hh, key); hh->index[i].key != -1; i = (i + 1) & hh->mask) {
+        if (hh->index[i].key == key) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**************** index_insert() ****************/
+/* record untracked key at heap position pos; return its slot */
+static int
+index_insert(heavy_t* hh, const int key, const int pos)
+{
+    int i = home_slot(hh, key);
+    while (hh->index[i].key != -1) {
+        i = (i + 1) & hh->mask;   // never full: slots >= 2 * capacity
+    }
+    hh->index[i].key = key;
+    hh->index[i].pos = pos;
+    return i;
+}
+
+/**************** index_remove() ****************/
+/* Empty the given slot.  Rather than leave a tombstone, pull back any
+ * later key in the same run whose probe would otherwise pass over the
+ * hole, and tell its heap entry where it moved.
+ */
+static void
+index_remove(heavy_t* hh, int slot)
+{
+    for (int j = (slot + 1) & hh->mask; hh->index[j].key != -1; j = (j + 1) & hh->mask) {
+        int home = home_slot(hh, hh->index[j].key);
+        if (((j - home) & hh->mask) >= ((j - slot) & hh->mask)) {
+            // home is at or before the hole: move j back into it
+            hh->index[slot] = hh->index[j];
+            hh->heap[hh->index[slot].pos].slot = slot;
+            slot = j;
+        }
+    }
+    hh->index[slot].key = -1;
+}
+
+/**************** heap_place() ****************/
+/* put entry at heap position pos, and point its index slot there */
+static void
+heap_place(heavy_t* hh, const int pos, const heavyentry_t* entry)
+{
+    hh->heap[pos] = *entry;
+    hh->index[entry->slot].pos = pos;
+}
+
+/**************** sift_up() ****************/
+/* move the entry at pos up past parents with larger counts */
+static void
+sift_up(heavy_t* hh, int pos)
+{
+    heavyentry_t entry = hh->heap[pos];
+    while (pos > 0 && hh->heap[(pos - 1) / 2].count > entry.count) {
+        heap_place(hh, pos, &hh->heap[(pos - 1) / 2]);
+        pos = (pos - 1) / 2;
+    }
+    heap_place(hh, pos, &entry);
+}
+
+/**************** sift_down() ****************/
+/* move the entry at pos down past children with smaller counts */
+static void
+sift_down(heavy_t* hh, int pos)
+{
+    heavyentry_t entry = hh->heap[pos];
+    for (;;) {
+        int child = 2 * pos + 1;
+        if (child >= hh->size) {
+            break;
+        }
+        if (child + 1 < hh->size && hh->heap[child + 1].count < hh->heap[child].count) {
+            child++;              // the smaller of the two children
+        }
+        if (hh->heap[child].count >= entry.count) {
+            break;
+        }
+        heap_place(hh, pos, &hh->heap[child]);
+        pos = child;
+    }
+    heap_place(hh, pos, &entry);
+}
+
+/**************** entry_compare() ****************/
+/* qsort order for heavy_topk: decreasing count, then increasing key */
+static int
+entry_compare(const void* a, const void* b)
+{
+    const counters_entry_t* ea = a;
+    const counters_entry_t* eb = b;
+    if (ea->count != eb->count) {
+        return ea->count > eb->count ? -1 : 1;
+    }
+    return (ea->key > eb->key) - (ea->key < eb->key);
+}
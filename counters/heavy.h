@@ -0,0 +1,104 @@
+/*
+ * heavy.h - header file for heavy-hitters module
+ *
+ * A *heavy* counterset finds the most frequent keys in a stream of keys
+ * too large, or with too many distinct keys, to count exactly.  It uses
+ * the Space-Saving algorithm (Metwally, Agrawal and El Abbadi, 2005):
+ * it tracks at most `capacity` keys, chosen when it is made, and never
+ * allocates again.  When a new key arrives and every place is taken, the
+ * key with the smallest count is replaced by the new one, which inherits
+ * that count plus one.
+ *
+ * So a tracked key's count may overestimate its true count, never
+ * underestimate it, and the overestimate is at most heavy_error for that
+ * key, which is at most N/capacity after N adds.  Every key that occurs
+ * more than N/capacity times is guaranteed to be tracked.
+ *
+ * Adwiteeya Rupantee Paul, April 2025
+ */
+
+#ifndef __HEAVY_H
+#define __HEAVY_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "counters.h"
+
+/**************** global types ****************/
+typedef struct heavy heavy_t;  // opaque to users of the module
+
+/**************** functions ****************/
+
+/**************** heavy_new ****************/
+/* Create a new (empty) heavy-hitters counterset.
+ *
+ * Caller provides:
+ *   the number of keys to track (must be > 0).
+ * We return:
+ *   pointer to the new heavy counterset; NULL if error.
+ * We guarantee:
+ *   all memory is allocated here; heavy_add never allocates.
+ * Caller is responsible for:
+ *   later calling heavy_delete.
+ */
+heavy_t* heavy_new(const int capacity);
+
+/**************** heavy_add ****************/
+/* Count one more occurrence of key.
+ *
+ * Caller provides:
+ *   valid pointer to heavy counterset, key that must be non-negative.
+ * We return:
+ *   the key's estimated count after the add; 0 on error.
+ * We do:
+ *   if key is tracked, increment its count; otherwise track it, in an
+ *   unused place or in place of the key with the smallest count.
+ *   O(log capacity) time.
+ */
+int heavy_add(heavy_t* hh, const int key);
+
+/**************** heavy_get ****************/
+/* Return the estimated count of key.
+ *
+ * We return:
+ *   the estimated count if key is tracked; 0 if it is not, or hh is NULL,
+ *   or key is negative.  An untracked key occurred at most as many times
+ *   as the smallest tracked count.
+ */
+int heavy_get(heavy_t* hh, const int key);
+
+/**************** heavy_error ****************/
+/* Return the most by which key's estimated count may exceed its true count;
+ * 0 if the key is not tracked (or hh is NULL).
+ */
+int heavy_error(heavy_t* hh, const int key);
+
+/**************** heavy_topk ****************/
+/* Find the k tracked keys with the largest estimated counts.
+ *
+ * Caller provides:
+ *   valid pointer to heavy counterset, k >= 0,
+ *   valid pointer to an array out with room for k entries.
+ * We return:
+ *   the number of entries filled in, like counters_topk.
+ * We do:
+ *   fill out[0..] in decreasing order of count, like counters_topk.
+ */
+int heavy_topk(heavy_t* hh, const int k, counters_entry_t* out);
+
+/**************** heavy_print ****************/
+/* Print the tracked keys, like counters_print: {key=count,...} in no
+ * particular order; "(null)" if hh is NULL; nothing if fp is NULL.
+ */
+void heavy_print(heavy_t* hh, FILE* fp);
+
+/**************** heavy_memory_usage ****************/
+/* Return the bytes the heavy counterset uses; fixed when it is made. */
+size_t heavy_memory_usage(heavy_t* hh);
+
+/**************** heavy_delete ****************/
+/* Delete the whole heavy counterset; ignore NULL hh. */
+void heavy_delete(heavy_t* hh);
+
+#endif // __HEAVY_H
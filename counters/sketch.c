@@ -0,0 +1,188 @@
+/*
+ * sketch.c - source file for sketch module
+ *
+ * The counters form one depth x width array, row after row.  Row i hashes
+ * a key with its own multiply-shift hash, (a_i * key + b_i) >> 32 for
+ * random odd 64-bit a_i and random b_i, then scales the 32-bit result
+ * into [0, width) by multiplying rather than taking a remainder.  The
+ * hash constants come from a fixed seed, so runs are reproducible.
+ * See sketch.h for the guarantees.
+ *
+ * Adwiteeya Rupantee Paul, April 2025
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <limits.h>
+#include "sketch.h"
+
+/**************** file-local global variables ****************/
+static const double EULER = 2.718281828459045;  // e, for the width
+static const uint64_t SEED = 0x5EED5EED5EED5EEDULL;  // for the hash constants
+
+/**************** global types ****************/
+typedef struct sketch {
+    int width;               // counters per row
+    int depth;               // rows
+    long total;              // adds so far
+    uint64_t* hashes;        // a_i, b_i for each row i
+    int* table;              // depth * width counters
+} sketch_t;
+
+/**************** global functions ****************/
+/* that is, visible outside this file */
+/* see sketch.h for comments about exported functions */
+
+/**************** local functions ****************/
+/* not visible outside this file */
+static inline int* cell(sketch_t* sk, const int row, const int key);
+static uint64_t splitmix64(uint64_t* state);
+
+/**************** sketch_new() ****************/
+/* see sketch.h for description */
+sketch_t*
+sketch_new(const double epsilon, const double delta)
+{
+    if (!(epsilon > 0 && epsilon < 1 && delta > 0 && delta < 1)) {
+        return NULL;              // bad bounds (this also catches NaN)
+    }
+    double width = EULER / epsilon;
+    if (width > INT_MAX / 64) {
+        return NULL;              // far too fine to allocate
+    }
+    sketch_t* sk = malloc(sizeof(sketch_t));
+    if (sk == NULL) {
+        return NULL;
+    }
+    sk->width = (int)width + ((int)width < width ? 1 : 0);   // ceil
+    // depth = ceil(ln(1/delta)), the least d with e^-d <= delta
+    sk->depth = 0;
+    for (double p = 1.0; p > delta; p /= EULER) {
+        sk->depth++;
+    }
+    sk->total = 0;
+    sk->hashes = malloc(2 * sk->depth * sizeof(uint64_t));
+    sk->table = calloc((size_t)sk->depth * sk->width, sizeof(int));
+    if (sk->hashes == NULL || sk->table == NULL) {
+        sketch_delete(sk);
+        return NULL;
+    }
+    uint64_t state = SEED;
+    for (int i = 0; i < sk->depth; i++) {
+        sk->hashes[2 * i] = splitmix64(&state) | 1;   // a_i must be odd
+        sk->hashes[2 * i + 1] = splitmix64(&state);
+    }
+    return sk;
+}
+
+/**************** sketch_add() ****************/
+/* see sketch.h for description */
+int
+sketch_add(sketch_t* sk, const int key)
+{
+    if (sk == NULL || key < 0) {
+        return 0;
+    }
+    // conservative update: raise each row's counter only as far as the
+    // new estimate, one more than the current smallest
+    int estimate = sketch_get(sk, key);
+    if (estimate < INT_MAX) {
+        estimate++;
+    }
+    for (int i = 0; i < sk->depth; i++) {
+        int* counter = cell(sk, i, key);
+        if (*counter < estimate) {
+            *counter = estimate;
+        }
+    }
+    sk->total++;
+    return estimate;
+}
+
+/**************** sketch_get() ****************/
+/* see sketch.h for description */
+int
+sketch_get(sketch_t* sk, const int key)
+{
+    if (sk == NULL || key < 0) {
+        return 0;
+    }
+    int estimate = INT_MAX;
+    for (int i = 0; i < sk->depth; i++) {
+        int counter = *cell(sk, i, key);
+        if (counter < estimate) {
+            estimate = counter;
+        }
+    }
+    return estimate;
+}
+
+/**************** sketch_total() ****************/
+/* see sketch.h for description */
+long
+sketch_total(sketch_t* sk)
+{
+    return sk == NULL ? 0 : sk->total;
+}
+
+/**************** sketch_print() ****************/
+/* see sketch.h for description */
+void
+sketch_print(sketch_t* sk, FILE* fp)
+{
+    if (fp == NULL) {
+        return;
+    }
+    if (sk == NULL) {
+        fputs("(null)", fp);
+        return;
+    }
+    fprintf(fp, "{width=%d,depth=%d,total=%ld}", sk->width, sk->depth, sk->total);
+}
+
+/**************** sketch_memory_usage() ****************/
+/* see sketch.h for description */
+size_t
+sketch_memory_usage(sketch_t* sk)
+{
+    if (sk == NULL) {
+        return 0;
+    }
+    return sizeof(sketch_t)
+         + 2 * sk->depth * sizeof(uint64_t)
+         + (size_t)sk->depth * sk->width * sizeof(int);
+}
+
+/**************** sketch_delete() ****************/
+/* see sketch.h for description */
+void
+sketch_delete(sketch_t* sk)
+{
+    if (sk != NULL) {
+        free(sk->hashes);
+        free(sk->table);
+        free(sk);
+    }
+}
+
+/**************** cell() ****************/
+/* the counter for key in the given row */
+static inline int*
+cell(sketch_t* sk, const int row, const int key)
+{
+    uint64_t h = (sk->hashes[2 * row] * (uint64_t)key + sk->hashes[2 * row + 1]) >> 32;
+    return &sk->table[(size_t)row * sk->width + ((h * (uint64_t)sk->width) >> 32)];
+}
+
+/**************** splitmix64() ****************/
+/* the next value of a splitmix64 stream, as in ../lib/bench.c */
+static uint64_t
+splitmix64(uint64_t* state)
+{
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
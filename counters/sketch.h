@@ -0,0 +1,90 @@
+/*
+ * sketch.h - header file for sketch module
+ *
+ * A *sketch* is an approximate counterset: like a counterset, it counts
+ * how many times each non-negative integer key is added, but it uses
+ * memory fixed when it is made, however many distinct keys arrive.  It
+ * is a Count-Min sketch (Cormode and Muthukrishnan, 2005): `depth` rows
+ * of `width` counters, each row with its own hash function.  Adding a
+ * key bumps one counter per row; the estimate is the smallest of them.
+ *
+ * Estimates never fall below the true count.  After N adds, with
+ * probability at least 1 - delta, an estimate exceeds the true count by
+ * at most epsilon * N, where width = ceil(e / epsilon) and depth =
+ * ceil(ln(1 / delta)).  We use conservative update - a row's counter
+ * is only raised as far as the new estimate - which keeps the same
+ * guarantee and in practice shrinks the overestimate considerably.
+ *
+ * Adwiteeya Rupantee Paul, April 2025
+ */
+
+#ifndef __SKETCH_H
+#define __SKETCH_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/**************** global types ****************/
+typedef struct sketch sketch_t;  // opaque to users of the module
+
+/**************** functions ****************/
+
+/**************** sketch_new ****************/
+/* Create a new (empty) sketch with the given error bounds.
+ *
+ * Caller provides:
+ *   epsilon, the error per add, 0 < epsilon < 1;
+ *   delta, the probability an estimate is off by more, 0 < delta < 1.
+ * We return:
+ *   pointer to the new sketch; NULL if either bound is out of range
+ *   or out of memory.
+ * We guarantee:
+ *   all memory is allocated here; the sketch never grows.
+ * Caller is responsible for:
+ *   later calling sketch_delete.
+ */
+sketch_t* sketch_new(const double epsilon, const double delta);
+
+/**************** sketch_add ****************/
+/* Increment the counter indicated by key, like counters_add.
+ *
+ * Caller provides:
+ *   valid pointer to sketch, key that must be non-negative.
+ * We return:
+ *   the key's estimated count after the add; 0 on error.
+ * We do:
+ *   O(depth) work; counters saturate at INT_MAX.
+ */
+int sketch_add(sketch_t* sk, const int key);
+
+/**************** sketch_get ****************/
+/* Return the estimated count of key, like counters_get.
+ *
+ * We return:
+ *   an estimate at least the true count (see above); 0 if sk is NULL
+ *   or key is negative.
+ * Note:
+ *   the sketch is unchanged by this operation.
+ */
+int sketch_get(sketch_t* sk, const int key);
+
+/**************** sketch_total ****************/
+/* Return N, the number of adds so far; 0 if sk is NULL. */
+long sketch_total(sketch_t* sk);
+
+/**************** sketch_print ****************/
+/* Print the sketch's shape and total: {width=W,depth=D,total=N};
+ * "(null)" if sk is NULL; nothing if fp is NULL.
+ */
+void sketch_print(sketch_t* sk, FILE* fp);
+
+/**************** sketch_memory_usage ****************/
+/* Return the bytes the sketch uses; fixed when it is made. */
+size_t sketch_memory_usage(sketch_t* sk);
+
+/**************** sketch_delete ****************/
+/* Delete the whole sketch; ignore NULL sk. */
+void sketch_delete(sketch_t* sk);
+
+#endif // __SKETCH_H
@@ -0,0 +1,393 @@
+/*
+ * window.c - source file for windowed counters module
+ *
+ * The keys live in an open-addressing table (linear probing, Fibonacci
+ * hashing) of slots; slot i's ring of buckets is row i of one array of
+ * intervals-wide rows, so a key's whole history is one cache-friendly
+ * run.  A slot remembers the interval it was last brought up to date,
+ * and catch_up clears the buckets that have fallen out of the window
+ * since then.  The table doubles when half full, and drops keys with no
+ * count left while it copies.  See window.h for the semantics.
+ *
+ * Adwiteeya Rupantee Paul, April 2025
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "window.h"
+
+/**************** file-local global variables ****************/
+static const int MIN_SLOTS = 16;         // smallest table
+static const double DECAY_FLOOR = 1e-6;  // decayed counts below this are gone
+
+/**************** local types ****************/
+typedef struct windowslot {
+    int key;                 // key, or -1 if the slot is empty
+    int64_t last;            // interval the slot was last brought up to date
+    int64_t sum;             // sum of the ring's buckets
+    double decayed;          // exponentially decayed count, as of last
+} windowslot_t;
+
+/**************** global types ****************/
+typedef struct window {
+    int intervals;           // buckets per key
+    double decay;            // decay factor per interval
+    int64_t now;             // current interval
+    int num_slots;           // slots in the table, a power of two
+    int shift;               // 32 - log2(num_slots), for hashing
+    int used;                // slots holding a key
+    windowslot_t* slots;     // the table
+    int64_t* rings;          // num_slots rows of intervals buckets
+} window_t;
+
+/**************** global functions ****************/
+/* that is, visible outside this file */
+/* see window.h for comments about exported functions */
+
+/**************** local functions ****************/
+/* not visible outside this file */
+static bool table_alloc(window_t* w, const int num_slots);
+static inline int home_slot(window_t* w, const int key);
+static int find_slot(window_t* w, const int key);
+static int insert_slot(window_t* w, const int key);
+static bool grow(window_t* w);
+static inline bool is_live(const windowslot_t* slot);
+static void catch_up(window_t* w, const int i);
+static double decay_pow(double decay, int64_t n);
+
+/**************** window_new() ****************/
+/* see window.h for description */
+window_t*
+window_new(const int intervals, const double decay)
+{
+    if (intervals <= 0 || !(decay > 0 && decay <= 1)) {
+        return NULL;              // bad window (this also catches NaN)
+    }
+    window_t* w = malloc(sizeof(window_t));
+    if (w == NULL) {
+        return NULL;
+    }
+    w->intervals = intervals;
+    w->decay = decay;
+    w->now = 0;
+    if (!table_alloc(w, MIN_SLOTS)) {
+        free(w);
+        return NULL;
+    }
+    return w;
+}
+
+/**************** window_advance() ****************/
+/* see window.h for description */
+bool
+window_advance(window_t* w, const int64_t now)
+{
+    if (w == NULL || now < w->now) {
+        return false;
+    }
+    w->now = now;                 // keys catch up when next touched
+    return true;
+}
+
+/**************** window_add() ****************/
+/* see window.h for description */
+int64_t
+window_add(window_t* w, const int key)
+{
+    return window_add_n(w, key, 1);
+}
+
+/**************** window_add_n() ****************/
+/* see window.h for description */
+int64_t
+window_add_n(window_t* w, const int key, const int64_t delta)
+{
+    if (w == NULL || key < 0 || delta <= 0) {
+        return 0;                 // a zero delta would make a zero count
+    }
+    int i = find_slot(w, key);
+    if (i < 0) {
+        i = insert_slot(w, key);
+        if (i < 0) {
+            return 0;             // out of memory
+        }
+    }
+    catch_up(w, i);
+    windowslot_t* slot = &w->slots[i];
+    if (slot->sum > INT64_MAX - delta) {
+        return 0;                 // would overflow; no bucket exceeds the sum
+    }
+    w->rings[(size_t)i * w->intervals + w->now % w->intervals] += delta;
+    slot->sum += delta;
+    slot->decayed += delta;
+    return slot->sum;
+}
+
+/**************** window_get() ****************/
+/* see window.h for description */
+int64_t
+window_get(window_t* w, const int key)
+{
+    if (w == NULL || key < 0) {
+        return 0;
+    }
+    int i = find_slot(w, key);
+    if (i < 0) {
+        return 0;
+    }
+    catch_up(w, i);
+    return w->slots[i].sum;
+}
+
+/**************** window_decayed() ****************/
+/* see window.h for description */
+double
+window_decayed(window_t* w, const int key)
+{
+    if (w == NULL || key < 0) {
+        return 0;
+    }
+    int i = find_slot(w, key);
+    if (i < 0) {
+        return 0;
+    }
+    catch_up(w, i);
+    return w->slots[i].decayed;
+}
+
+/**************** window_iterate() ****************/
+/* see window.h for description */
+void
+window_iterate(window_t* w, void* arg,
+               void (*itemfunc)(void* arg, const int key, const int64_t count))
+{
+    if (w != NULL && itemfunc != NULL) {
+        for (int i = 0; i < w->num_slots; i++) {
+            if (w->slots[i].key >= 0) {
+                catch_up(w, i);
+                if (w->slots[i].sum > 0) {
+                    (*itemfunc)(arg, w->slots[i].key, w->slots[i].sum);
+                }
+            }
+        }
+    }
+}
+
+/**************** window_print() ****************/
+/* see window.h for description */
+void
+window_print(window_t* w, FILE* fp)
+{
+    if (fp == NULL) {
+        return;
+    }
+    if (w == NULL) {
+        fputs("(null)", fp);
+        return;
+    }
+    bool first = true;
+    fputc('{', fp);
+    for (int i = 0; i < w->num_slots; i++) {
+        if (w->slots[i].key >= 0) {
+            catch_up(w, i);
+            if (w->slots[i].sum > 0) {
+                fprintf(fp, "%s%d=%lld", first ? "" : ",",
+                        w->slots[i].key, (long long)w->slots[i].sum);
+                first = false;
+            }
+        }
+    }
+    fputc('}', fp);
+}
+
+/**************** window_memory_usage() ****************/
+/* see window.h for description */
+size_t
+window_memory_usage(window_t* w)
+{
+    if (w == NULL) {
+        return 0;
+    }
+    return sizeof(window_t)
+         + w->num_slots * (sizeof(windowslot_t) + w->intervals * sizeof(int64_t));
+}
+
+/**************** window_delete() ****************/
+/* see window.h for description */
+void
+window_delete(window_t* w)
+{
+    if (w != NULL) {
+        free(w->slots);
+        free(w->rings);
+        free(w);
+    }
+}
+
+/**************** table_alloc() ****************/
+/* give w an empty table of num_slots (a power of two) slots; false if
+ * out of memory, leaving w's fields for the table unchanged */
+static bool
+table_alloc(window_t* w, const int num_slots)
+{
+    windowslot_t* slots = malloc(num_slots * sizeof(windowslot_t));
+    int64_t* rings = calloc((size_t)num_slots * w->intervals, sizeof(int64_t));
+    if (slots == NULL || rings == NULL) {
+        free(slots);
+        free(rings);
+        return false;
+    }
+    for (int i = 0; i < num_slots; i++) {
+        slots[i].key = -1;
+    }
+    int bits = 0;
+    while ((1 << bits) < num_slots) {
+        bits++;
+    }
+    w->num_slots = num_slots;
+    w->shift = 32 - bits;
+    w->used = 0;
+    w->slots = slots;
+    w->rings = rings;
+    return true;
+}
+
+/**************** home_slot() ****************/
+/* the slot where key's probe begins (Fibonacci hashing) */
+static inline int
+home_slot(window_t* w, const int key)
+{
+    return ((uint32_t)key * 2654435769u) >> w->shift;
+}
+
+/**************** find_slot() ****************/
+/* the slot holding key; -1 if none */
+static int
+find_slot(window_t* w, const int key)
+{
+    int mask = w->num_slots - 1;
+    for (int i = home_slot(w, key); w->slots[i].key != -1; i = (i + 1) & mask) {
+        if (w->slots[i].key == key) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**************** insert_slot() ****************/
+/* give key (not in the table) a fresh slot, growing the table first if it
+ * is half full; return the slot, or -1 if out of memory */
+static int
+insert_slot(window_t* w, const int key)
+{
+    if (2 * (w->used + 1) > w->num_slots && !grow(w)) {
+        return -1;
+    }
+    int mask = w->num_slots - 1;
+    int i = home_slot(w, key);
+    while (w->slots[i].key != -1) {
+        i = (i + 1) & mask;
+    }
+    windowslot_t* slot = &w->slots[i];
+    slot->key = key;
+    slot->last = w->now;
+    slot->sum = 0;
+    slot->decayed = 0;
+    memset(&w->rings[(size_t)i * w->intervals], 0, w->intervals * sizeof(int64_t));
+    w->used++;
+    return i;
+}
+
+/**************** grow() ****************/
+/* rebuild the table with room for four times its live keys (those with
+ * any count left), dropping the rest; false if out of memory */
+static bool
+grow(window_t* w)
+{
+    int live = 0;
+    for (int i = 0; i < w->num_slots; i++) {
+        if (w->slots[i].key >= 0) {
+            catch_up(w, i);
+            if (is_live(&w->slots[i])) {
+                live++;
+            }
+        }
+    }
+    int num_slots = MIN_SLOTS;
+    while (num_slots < 4 * (live + 1)) {
+        num_slots *= 2;
+    }
+    window_t old = *w;
+    if (!table_alloc(w, num_slots)) {
+        return false;             // the old table is untouched
+    }
+    int mask = w->num_slots - 1;
+    for (int i = 0; i < old.num_slots; i++) {
+        if (old.slots[i].key >= 0 && is_live(&old.slots[i])) {
+            int j = home_slot(w, old.slots[i].key);
+            while (w->slots[j].key != -1) {
+                j = (j + 1) & mask;
+            }
+            w->slots[j] = old.slots[i];
+            memcpy(&w->rings[(size_t)j * w->intervals],
+                   &old.rings[(size_t)i * w->intervals],
+                   w->intervals * sizeof(int64_t));
+            w->used++;
+        }
+    }
+    free(old.slots);
+    free(old.rings);
+    return true;
+}
+
+/**************** is_live() ****************/
+/* true if an up-to-date slot still has a count worth keeping */
+static inline bool
+is_live(const windowslot_t* slot)
+{
+    return slot->sum > 0 || slot->decayed >= DECAY_FLOOR;
+}
+
+/**************** catch_up() ****************/
+/* bring slot i up to the current interval: clear the buckets that have
+ * left the window since it was last touched, and decay its count */
+static void
+catch_up(window_t* w, const int i)
+{
+    windowslot_t* slot = &w->slots[i];
+    int64_t gap = w->now - slot->last;
+    if (gap == 0) {
+        return;
+    }
+    int64_t* ring = &w->rings[(size_t)i * w->intervals];
+    if (gap >= w->intervals) {
+        memset(ring, 0, w->intervals * sizeof(int64_t));
+        slot->sum = 0;
+    } else {
+        for (int64_t t = slot->last + 1; t <= w->now; t++) {
+            slot->sum -= ring[t % w->intervals];
+            ring[t % w->intervals] = 0;
+        }
+    }
+    slot->decayed *= decay_pow(w->decay, gap);
+    slot->last = w->now;
+}
+
+/**************** decay_pow() ****************/
+/* decay to the power n >= 0, by repeated squaring */
+static double
+decay_pow(double decay, int64_t n)
+{
+    double result = 1;
+    while (n > 0 && result > 0) {
+        if (n & 1) {
+            result *= decay;
+        }
+        decay *= decay;
+        n >>= 1;
+    }
+    return result;
+}
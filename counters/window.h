@@ -0,0 +1,114 @@
+/*
+ * window.h - header file for windowed counters module
+ *
+ * A *window* counterset counts events per non-negative integer key, like
+ * a counterset, but only over recent time: its count for a key is the
+ * number of adds in the last `intervals` intervals, the current one
+ * included.  Time is an interval number the caller supplies with
+ * window_advance - seconds since start, say, or minutes - so a window
+ * never reads a clock itself.
+ *
+ * Each key keeps a ring of `intervals` buckets and their running sum.
+ * Advancing the window is O(1); a key's expired buckets are cleared the
+ * next time the key is touched, at most `intervals` buckets at a time,
+ * so a get is a lookup, never a scan of history.
+ *
+ * Each key also keeps an exponentially decayed count: every interval,
+ * the count is multiplied by `decay`, and each add contributes 1.  That
+ * gives a smooth rate estimate with no window edge.
+ *
+ * Adwiteeya Rupantee Paul, April 2025
+ */
+
+#ifndef __WINDOW_H
+#define __WINDOW_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**************** global types ****************/
+typedef struct window window_t;  // opaque to users of the module
+
+/**************** functions ****************/
+
+/**************** window_new ****************/
+/* Create a new (empty) window counterset, at interval 0.
+ *
+ * Caller provides:
+ *   intervals, the length of the window (must be > 0);
+ *   decay, the factor each interval applies to the decayed count
+ *   (0 < decay <= 1; 1 means no decay).
+ * We return:
+ *   pointer to the new window counterset; NULL if error.
+ * Caller is responsible for:
+ *   later calling window_delete.
+ */
+window_t* window_new(const int intervals, const double decay);
+
+/**************** window_advance ****************/
+/* Move the window to interval now.
+ *
+ * Caller provides:
+ *   valid pointer to window counterset, now >= the current interval.
+ * We return:
+ *   false if w is NULL or now is in the past; true otherwise.
+ * We do:
+ *   O(1) work: counts from intervals that fall out of the window stop
+ *   counting at once, but are cleared from each key lazily.
+ */
+bool window_advance(window_t* w, const int64_t now);
+
+/**************** window_add ****************/
+/* Count one event for key in the current interval, like counters_add.
+ *
+ * We return:
+ *   the key's count over the window after the add; 0 on error (w is
+ *   NULL, key is negative, or out of memory).
+ */
+int64_t window_add(window_t* w, const int key);
+
+/**************** window_add_n ****************/
+/* Count delta (> 0) events for key in the current interval at once,
+ * like counters_add_n; return as window_add, and 0 too, with the count
+ * unchanged, if the key's count over the window would pass INT64_MAX.
+ */
+int64_t window_add_n(window_t* w, const int key, const int64_t delta);
+
+/**************** window_get ****************/
+/* Return the key's count over the last `intervals` intervals, the current
+ * one included; 0 if w is NULL, key is negative, or the key has no events
+ * in the window.
+ */
+int64_t window_get(window_t* w, const int key);
+
+/**************** window_decayed ****************/
+/* Return the key's exponentially decayed count as of the current
+ * interval; 0 as window_get.
+ */
+double window_decayed(window_t* w, const int key);
+
+/**************** window_iterate ****************/
+/* Call itemfunc(arg, key, count) for each key with a nonzero count in the
+ * window, in undefined order; nothing if w or itemfunc is NULL.
+ */
+void window_iterate(window_t* w, void* arg,
+                    void (*itemfunc)(void* arg, const int key, const int64_t count));
+
+/**************** window_print ****************/
+/* Print the keys with a nonzero count in the window, like counters_print:
+ * {key=count,...} in undefined order; "(null)" if w is NULL; nothing if
+ * fp is NULL.
+ */
+void window_print(window_t* w, FILE* fp);
+
+/**************** window_memory_usage ****************/
+/* Return the bytes the window counterset uses; 0 if w is NULL. */
+size_t window_memory_usage(window_t* w);
+
+/**************** window_delete ****************/
+/* Delete the whole window counterset; ignore NULL w. */
+void window_delete(window_t* w);
+
+#endif // __WINDOW_H
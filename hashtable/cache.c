@@ -0,0 +1,257 @@
+/*
+ * cache.c - source file for cache module
+ *
+ * A hashtable maps each key to its entry; the entries also form a
+ * doubly-linked ring, the clock, with a hand pointing at the next entry
+ * to consider for eviction.  New entries join the ring just behind the
+ * hand, so the hand reaches them last.  Each entry carries a copy of its
+ * key, so an evicted entry can be removed from the hashtable.  See
+ * cache.h for the semantics.
+ *
+ * Adwiteeya Rupantee Paul, April 2025
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "cache.h"
+#include "hashtable.h"
+
+/**************** local types ****************/
+typedef struct cacheentry {
+    bool referenced;             // found since the hand last passed
+    void* item;                  // the caller's item
+    size_t bytes;                // what the item costs against max_bytes
+    struct cacheentry* prev;     // ring neighbours
+    struct cacheentry* next;
+    char key[];                  // copy of the key
+} cacheentry_t;
+
+/**************** global types ****************/
+typedef struct cache {
+    hashtable_t* ht;             // key -> entry
+    cacheentry_t* hand;          // next entry to consider; NULL if empty
+    long max_entries;            // 0 if no limit
+    size_t max_bytes;            // 0 if no limit
+    long entries;                // entries in the ring
+    size_t bytes;                // their bytes
+    unsigned long hits, misses, evictions;
+    void (*itemdelete)(void* item);
+} cache_t;
+
+/**************** global functions ****************/
+/* that is, visible outside this file */
+/* see cache.h for comments about exported functions */
+
+/**************** local functions ****************/
+/* not visible outside this file */
+static bool is_full(cache_t* cache, const size_t bytes);
+static void evict(cache_t* cache);
+static void ring_unlink(cache_t* cache, cacheentry_t* entry);
+
+/**************** cache_new() ****************/
+/* see cache.h for description */
+cache_t*
+cache_new(const int num_slots, const long max_entries,
+          const size_t max_bytes, void (*itemdelete)(void* item))
+{
+    if (num_slots <= 0 || max_entries < 0 || (max_entries == 0 && max_bytes == 0)) {
+        return NULL;              // bad size, or no limit at all
+    }
+    cache_t* cache = malloc(sizeof(cache_t));
+    if (cache == NULL) {
+        return NULL;
+    }
+    cache->ht = hashtable_new(num_slots);
+    if (cache->ht == NULL) {
+        free(cache);
+        return NULL;
+    }
+    cache->hand = NULL;
+    cache->max_entries = max_entries;
+    cache->max_bytes = max_bytes;
+    cache->entries = 0;
+    cache->bytes = 0;
+    cache->hits = cache->misses = cache->evictions = 0;
+    cache->itemdelete = itemdelete;
+    return cache;
+}
+
+/**************** cache_insert() ****************/
+/* see cache.h for description */
+bool
+cache_insert(cache_t* cache, const char* key, void* item, const size_t bytes)
+{
+    if (cache == NULL || key == NULL || item == NULL) {
+        return false;
+    }
+    if (cache->max_bytes > 0 && bytes > cache->max_bytes) {
+        return false;             // could never fit
+    }
+    if (hashtable_find(cache->ht, key) != NULL) {
+        return false;             // key exists
+    }
+    size_t len = strlen(key) + 1;
+    cacheentry_t* entry = malloc(sizeof(cacheentry_t) + len);
+    if (entry == NULL) {
+        return false;
+    }
+    memcpy(entry->key, key, len);
+    if (!hashtable_insert(cache->ht, entry->key, entry)) {
+        free(entry);
+        return false;             // out of memory, and nothing evicted
+    }
+    // only now make room: the entry is not in the ring yet, so it is
+    // never its own victim, and evicting always makes room for an item
+    // no bigger than max_bytes
+    while (is_full(cache, bytes)) {
+        evict(cache);
+    }
+    entry->referenced = false;
+    entry->item = item;
+    entry->bytes = bytes;
+    // join the ring just behind the hand, where the hand gets to it last
+    if (cache->hand == NULL) {
+        entry->prev = entry->next = entry;
+        cache->hand = entry;
+    } else {
+        entry->next = cache->hand;
+        entry->prev = cache->hand->prev;
+        entry->prev->next = entry;
+        cache->hand->prev = entry;
+    }
+    cache->entries++;
+    cache->bytes += bytes;
+    return true;
+}
+
+/**************** cache_find() ****************/
+/* see cache.h for description */
+void*
+cache_find(cache_t* cache, const char* key)
+{
+    if (cache == NULL || key == NULL) {
+        return NULL;
+    }
+    cacheentry_t* entry = hashtable_find(cache->ht, key);
+    if (entry == NULL) {
+        cache->misses++;
+        return NULL;
+    }
+    cache->hits++;
+    entry->referenced = true;
+    return entry->item;
+}
+
+/**************** cache_remove() ****************/
+/* see cache.h for description */
+void*
+cache_remove(cache_t* cache, const char* key)
+{
+    if (cache == NULL || key == NULL) {
+        return NULL;
+    }
+    cacheentry_t* entry = hashtable_remove(cache->ht, key);
+    if (entry == NULL) {
+        return NULL;
+    }
+    ring_unlink(cache, entry);
+    void* item = entry->item;
+    free(entry);
+    return item;
+}
+
+/**************** cache_stats() ****************/
+/* see cache.h for description */
+bool
+cache_stats(cache_t* cache, cache_stats_t* stats)
+{
+    if (cache == NULL || stats == NULL) {
+        return false;
+    }
+    stats->hits = cache->hits;
+    stats->misses = cache->misses;
+    stats->evictions = cache->evictions;
+    stats->entries = cache->entries;
+    stats->bytes = cache->bytes;
+    stats->hit_ratio = 0;
+    if (cache->hits + cache->misses > 0) {
+        stats->hit_ratio = (double)cache->hits / (cache->hits + cache->misses);
+    }
+    return true;
+}
+
+/**************** cache_delete() ****************/
+/* see cache.h for description */
+void
+cache_delete(cache_t* cache)
+{
+    if (cache != NULL) {
+        // hand the items back round the ring, then free the entries
+        if (cache->itemdelete != NULL && cache->hand != NULL) {
+            cacheentry_t* entry = cache->hand;
+            do {
+                (*cache->itemdelete)(entry->item);
+                entry = entry->next;
+            } while (entry != cache->hand);
+        }
+        hashtable_delete(cache->ht, free);
+        free(cache);
+    }
+}
+
+/**************** is_full() ****************/
+/* true if a new entry of the given bytes would break a limit */
+static bool
+is_full(cache_t* cache, const size_t bytes)
+{
+    if (cache->entries == 0) {
+        return false;             // cache_insert checked the item fits alone
+    }
+    if (cache->max_entries > 0 && cache->entries >= cache->max_entries) {
+        return true;
+    }
+    return cache->max_bytes > 0 && bytes > cache->max_bytes - cache->bytes;
+}
+
+/**************** evict() ****************/
+/* advance the hand past at most CACHE_SWEEP referenced entries, clearing
+ * their bits, and evict the entry it then points at; the cache must not
+ * be empty */
+static void
+evict(cache_t* cache)
+{
+    cacheentry_t* victim = cache->hand;
+    for (int i = 0; i < CACHE_SWEEP && victim->referenced; i++) {
+        victim->referenced = false;   // a second chance
+        victim = victim->next;
+    }
+    cache->hand = victim;
+    ring_unlink(cache, victim);
+    hashtable_remove(cache->ht, victim->key);
+    if (cache->itemdelete != NULL) {
+        (*cache->itemdelete)(victim->item);
+    }
+    free(victim);
+    cache->evictions++;
+}
+
+/**************** ring_unlink() ****************/
+/* take an entry out of the ring and the counts, moving the hand on if it
+ * points at the entry */
+static void
+ring_unlink(cache_t* cache, cacheentry_t* entry)
+{
+    if (entry->next == entry) {
+        cache->hand = NULL;       // it was the last one
+    } else {
+        entry->prev->next = entry->next;
+        entry->next->prev = entry->prev;
+        if (cache->hand == entry) {
+            cache->hand = entry->next;
+        }
+    }
+    cache->entries--;
+    cache->bytes -= entry->bytes;
+}
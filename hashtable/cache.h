@@ -0,0 +1,123 @@
+/*
+ * cache.h - header file for cache module
+ *
+ * A *cache* is a hashtable of (key,item) pairs with a capacity: once it
+ * is full, each insert evicts an old pair to make room, handing its item
+ * to the caller's itemdelete function.  It suits a hashtable put in front
+ * of an expensive backend, which would otherwise grow without bound.
+ *
+ * The capacity is a number of entries, a number of bytes (each insert
+ * says how many bytes its item costs), or both.  Pairs are evicted in
+ * CLOCK order, a cheap approximation of least-recently-used: the pairs
+ * form a ring, a hit only sets the pair's reference bit, and the clock
+ * hand passes over - and clears - referenced pairs, evicting the first
+ * pair it finds unreferenced.  The hand clears at most CACHE_SWEEP bits
+ * per eviction, so an eviction is O(1) even when every pair is hot.
+ *
+ * Adwiteeya Rupantee Paul, April 2025
+ */
+
+#ifndef __CACHE_H
+#define __CACHE_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/**************** global types ****************/
+typedef struct cache cache_t;  // opaque to users of the module
+
+/* reference bits the clock hand may clear in one eviction */
+#define CACHE_SWEEP 32
+
+/* statistics filled in by cache_stats */
+typedef struct cache_stats {
+  unsigned long hits;            // cache_find calls that found their key
+  unsigned long misses;          // cache_find calls that did not
+  unsigned long evictions;       // pairs evicted to make room
+  long entries;                  // pairs in the cache now
+  size_t bytes;                  // bytes of the pairs in the cache now
+  double hit_ratio;              // hits / (hits + misses)
+} cache_stats_t;
+
+/**************** functions ****************/
+
+/**************** cache_new ****************/
+/* Create a new (empty) cache.
+ *
+ * Caller provides:
+ *   number of slots for its hashtable (must be > 0);
+ *   max_entries, the most pairs it may hold, or 0 for no limit;
+ *   max_bytes, the most bytes its pairs may cost, or 0 for no limit
+ *   (at least one limit must be set);
+ *   itemdelete, called on each item the cache evicts or deletes
+ *   (may be NULL).
+ * We return:
+ *   pointer to the new cache; NULL if error.
+ * Caller is responsible for:
+ *   later calling cache_delete.
+ */
+cache_t* cache_new(const int num_slots, const long max_entries,
+                   const size_t max_bytes, void (*itemdelete)(void* item));
+
+/**************** cache_insert ****************/
+/* Insert item, identified by key (string), into the cache.
+ *
+ * Caller provides:
+ *   valid pointer to cache, valid string for key, valid pointer for item,
+ *   the bytes the item costs against max_bytes (ignored if no byte limit).
+ * We return:
+ *   false if key exists in the cache, any pointer is NULL, the item alone
+ *   is bigger than max_bytes, or out of memory; the item is then still
+ *   the caller's, and nothing was evicted.  true iff the pair was inserted.
+ * We do:
+ *   once the pair is in, evict others in CLOCK order until it fits; each
+ *   eviction calls itemdelete on the evicted item.
+ * Notes:
+ *   the key string is copied, as in hashtable_insert.  A new pair starts
+ *   unreferenced, so a pair that is never found again is the first to go.
+ */
+bool cache_insert(cache_t* cache, const char* key, void* item, const size_t bytes);
+
+/**************** cache_find ****************/
+/* Return the item associated with the given key, and count a hit or miss.
+ *
+ * Caller provides:
+ *   valid pointer to cache, valid string for key.
+ * We return:
+ *   pointer to the item, if found; NULL if cache or key is NULL, or key
+ *   is not found.
+ * We do:
+ *   set the pair's reference bit, so the clock hand spares it once.
+ * Notes:
+ *   the item stays in the cache, and may be evicted by a later insert;
+ *   do not hold on to it across inserts.
+ */
+void* cache_find(cache_t* cache, const char* key);
+
+/**************** cache_remove ****************/
+/* Remove the pair with the given key, e.g. when the backend changes it.
+ *
+ * We return:
+ *   the item, now the caller's again (itemdelete is not called);
+ *   NULL if cache or key is NULL, or key is not found.
+ */
+void* cache_remove(cache_t* cache, const char* key);
+
+/**************** cache_stats ****************/
+/* Copy out the hit, miss and eviction counts and the current size.
+ *
+ * We return:
+ *   false if either pointer is NULL; true otherwise.
+ * Note:
+ *   this call is O(1).
+ */
+bool cache_stats(cache_t* cache, cache_stats_t* stats);
+
+/**************** cache_delete ****************/
+/* Delete the cache, calling itemdelete (if any) on each item it holds;
+ * ignore NULL cache.
+ */
+void cache_delete(cache_t* cache);
+
+#endif // __CACHE_H
@@ -7,8 +7,12 @@
  */
 
 #include <string.h>
+#include <stdint.h>
 #include "hash.h" 
 
+static inline uint64_t rotl(const uint64_t x, const int b);
+static inline void sipround(uint64_t v[4]);
+
 // hash_jenkins - see header file for usage
 unsigned long
 hash_jenkins(const char* str, const unsigned long mod)
@@ -32,3 +36,64 @@ hash_jenkins(const char* str, const unsigned long mod)
 
   return (hash % mod);
 }
+
+// hash_siphash - see header file for usage
+unsigned long
+hash_siphash(const char* str, const uint64_t seed, const unsigned long mod)
+{
+  if (str == NULL || mod <= 1) {
+    return 0;
+  }
+
+  // a 128-bit key from the seed
+  uint64_t k0 = seed;
+  uint64_t k1 = seed * 0x9E3779B97F4A7C15ULL ^ 0x5851F42D4C957F2DULL;
+  uint64_t v[4] = {
+    0x736f6d6570736575ULL ^ k0, 0x646f72616e646f6dULL ^ k1,
+    0x6c7967656e657261ULL ^ k0, 0x7465646279746573ULL ^ k1,
+  };
+
+  size_t len = strlen(str);
+  const unsigned char* p = (const unsigned char*)str;
+  const unsigned char* end = p + (len & ~(size_t)7);
+  for (; p != end; p += 8) {
+    uint64_t m = 0;
+    for (int i = 0; i < 8; i++) {
+      m |= (uint64_t)p[i] << (8 * i);   // little-endian, on any host
+    }
+    v[3] ^= m;
+    sipround(v);
+    v[0] ^= m;
+  }
+  uint64_t last = (uint64_t)len << 56;  // the tail bytes, and the length
+  for (int i = 0; i < (int)(len & 7); i++) {
+    last |= (uint64_t)p[i] << (8 * i);
+  }
+  v[3] ^= last;
+  sipround(v);
+  v[0] ^= last;
+
+  v[2] ^= 0xff;
+  sipround(v);
+  sipround(v);
+  sipround(v);
+
+  return (unsigned long)(v[0] ^ v[1] ^ v[2] ^ v[3]) % mod;
+}
+
+// rotate x left by b bits
+static inline uint64_t
+rotl(const uint64_t x, const int b)
+{
+  return (x << b) | (x >> (64 - b));
+}
+
+// one SipRound of the state
+static inline void
+sipround(uint64_t v[4])
+{
+  v[0] += v[1]; v[1] = rotl(v[1], 13); v[1] ^= v[0]; v[0] = rotl(v[0], 32);
+  v[2] += v[3]; v[3] = rotl(v[3], 16); v[3] ^= v[2];
+  v[0] += v[3]; v[3] = rotl(v[3], 21); v[3] ^= v[0];
+  v[2] += v[1]; v[1] = rotl(v[1], 17); v[1] ^= v[2]; v[2] = rotl(v[2], 32);
+}
@@ -9,6 +9,8 @@
 #ifndef HASH_H
 #define HASH_H
 
+#include <stdint.h>
+
 /*
  * hash_jenkins - Bob Jenkins' one_at_a_time hash function
  * str: char buffer to hash (non-NULL)
@@ -18,4 +20,15 @@
  */
 unsigned long hash_jenkins(const char* str, const unsigned long mod);
 
+/*
+ * hash_siphash - SipHash-1-3 (Aumasson and Bernstein), keyed by seed
+ * str: char buffer to hash (non-NULL)
+ * seed: secret key; a different seed scatters the same strings differently
+ * mod: desired hash modulus (>0)
+ *
+ * Returns hash(seed, str) % mod.  Without the seed, nobody can choose
+ * strings that collide, as they can for hash_jenkins.
+ */
+unsigned long hash_siphash(const char* str, const uint64_t seed, const unsigned long mod);
+
 #endif // HASH_H
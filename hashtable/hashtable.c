@@ -1,9 +1,26 @@
-* 
+/* 
  * hashtable.c - source file for hashtable module
  *
  * A *hashtable* is a set of (key,item) pairs.  It acts just like a set, 
  * but is far more efficient for large collections.
  *
+ * Snapshots freeze layers.  A snapshot pins the table's newest layer,
+ * and every layer above it is already frozen; once the newest layer is
+ * pinned, writes go to a fresh layer beneath it (its `delta`).  Every
+ * key lives in exactly one layer, and all layers have the same number of
+ * slots, so slot i of a layer can be merged into slot i of the layer
+ * above.  When the newest layer and the one above it are both unpinned,
+ * each write folds a few slots of the newest layer up into its parent,
+ * until it is empty and can be freed.  Pinning a layer partly folded
+ * restarts its fold from the first slot.
+ *
+ * Each table hashes with SipHash under its own random seed, so nobody
+ * who does not know the seed can choose keys that share a slot.  Should
+ * a chain still grow far longer than the mean, the table picks a new
+ * seed and rehashes every key (see guard_chain); a reseed is paid for by
+ * the inserts since the last one, and waits while snapshots exist, since
+ * they share the table's slots.
+ *
  * Adwiteeya Rupantee Paul, April 2025
  */
 
@@ -11,13 +28,65 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <limits.h>
+#include <time.h>
+#include <pthread.h>
 #include "hashtable.h"
 #include "hash.h"
 #include "set.h"
+#include "journal.h"
+#ifdef __GLIBC__
+#include <malloc.h>      // malloc_usable_size
+#endif
 
 
 /**************** file-local global variables ****************/
-/* none */
+/* the membership filter: a blocked Bloom filter of 64-byte blocks, each
+ * key setting FILTER_K bits within one block; see hashtable_filter */
+#define FILTER_WORDS 8             // 64-bit words per block (one cache line)
+#define FILTER_BLOCK_BITS 512      // bits per block
+static const int FILTER_K = 6;             // bits set per key
+static const int FILTER_BITS_PER_KEY = 10; // filter bits per expected key
+
+/* staged lookups: the stages, and how many lookups hashtable_find_many
+ * keeps in flight; see hashtable_lookup_start */
+enum { LOOKUP_FILTER, LOOKUP_SLOT, LOOKUP_SET, LOOKUP_NODE, LOOKUP_KEY, LOOKUP_DONE };
+#define LOOKUP_WINDOW 16
+
+/* ask for a cache line ahead of its use, where the compiler can */
+#if defined(__GNUC__)
+#define PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#define PREFETCH(addr) ((void)(addr))
+#endif
+
+/* slots of the newest layer folded into its parent per write */
+static const int FOLD_SLOTS = 64;
+
+/* a chain is pathological once longer than CHAIN_MIN and than
+ * CHAIN_FACTOR times the mean chain plus one; see guard_chain */
+static const long CHAIN_MIN = 32;
+static const long CHAIN_FACTOR = 8;
+
+/* the parallel merge; see hashtable_merge_many */
+#define MAX_THREADS 64                     // most threads one merge uses
+static const long MERGE_MIN_KEYS = 16384;  // fewest keys worth a thread
+
+/* the secret behind every table's seed, read once; see random_seed */
+static atomic_ullong secret;
+static atomic_int secret_state = 0;       // 0 unread, 1 reading, 2 read
+static atomic_ullong seeds_made = 0;      // seeds handed out so far
+
+/* the allocator used for hashtable memory; see hashtable_allocator */
+static void* (*ht_malloc)(size_t size) = malloc;
+static void (*ht_free)(void* ptr) = free;
+#ifdef __GLIBC__
+static size_t (*ht_usable)(void* ptr) = malloc_usable_size;
+#else
+static size_t (*ht_usable)(void* ptr) = NULL;
+#endif
 
 /**************** local types ****************/
 
@@ -35,11 +104,79 @@ typedef struct set{
 /**************** global types ****************/
 
 typedef struct hashtable{
+#ifdef HASHTABLE_STATS
+    atomic_ulong ticks;         // operations seen, sampled or not
+    unsigned long sample_mask;  // record an operation when (ticks & mask) == 0
+    atomic_ulong lookups;       // sampled lookups
+    atomic_ulong hits;          // sampled lookups that found their key
+    atomic_ulong probes;        // keys compared by sampled lookups
+    unsigned long inserts;      // sampled inserts
+    unsigned long insert_collisions; // sampled inserts into a non-empty slot
+#endif
+    uint64_t* filter;         // membership filter blocks; NULL if no filter
+    void* filter_mem;         // the allocation the blocks are aligned within
+    unsigned long filter_blocks;      // number of filter blocks
+    atomic_ulong filter_passes;       // lookups the filter let through
+    atomic_ulong filter_rejects;      // lookups the filter answered alone
+    atomic_ulong filter_false_positives; // passes that found no key
+    journal_t* journal;       // where changes are logged; NULL if nowhere
+    size_t (*itemsize)(void* item);   // bytes of an item, for the journal
+    uint64_t seed;            // the hash seed, random unless hashtable_seed
+    unsigned long generation; // times the keys were rehashed to a new seed
+    long count;               // keys in the table, every layer included
+    long reseed_floor;        // no reseed until count reaches this
+    struct hashtable* delta;  // newer layer, taking writes while this is frozen
+    struct hashtable* above;  // the layer this is the delta of; NULL for the table
+    struct hashtable* bottom; // the newest layer (kept in the table only)
+    atomic_long pins;         // snapshots whose newest layer is this one
+    int fold;                 // slots already folded into the layer above
     int num_slots;      // number of slots in the hashtable
     struct set* slots[]; // array of pointers to hashnodes
 } hashtable_t;
 
 
+/* what hashtable_replay needs while replaying */
+typedef struct replay {
+    hashtable_t* ht;
+    void* (*itemload)(const void* bytes, const size_t len);
+    void (*itemdelete)(void* item);
+} replay_t;
+
+/* a source pair on its way to dest; see hashtable_merge_many */
+typedef struct merge_entry {
+    const char* key;          // the source's own key string
+    void* item;
+    unsigned long hash;       // its full hash, under dest's seed
+    int src;                  // the number of its source
+    bool fresh;               // it was new to dest
+} merge_entry_t;
+
+/* one thread's share of a parallel merge: first the source slots it
+ * reads, then the dest slots it owns, both its index-th of nthreads */
+typedef struct merge_job {
+    hashtable_t* dest;
+    hashtable_t** srcs;
+    int nsrcs;
+    int index;
+    int nthreads;
+    struct merge_job* jobs;   // every job, for their entries
+    void* arg;
+    void* (*merge)(void* arg, const char* key, void* item, void* other);
+    merge_entry_t* entries;   // the pairs read, grouped by owner, each in source order
+    long starts[MAX_THREADS + 1]; // owner p's are entries[starts[p]..starts[p+1])
+    long inserted;            // keys new to dest
+    int longest;              // the longest chain among the slots owned,
+    int longest_slot;         // and its slot
+    bool failed;              // out of memory
+} merge_job_t;
+
+/* a snapshot: the layers from the table down to `last` */
+typedef struct hashtable_snapshot {
+    hashtable_t* table;       // the table, its oldest layer
+    hashtable_t* last;        // the newest layer the snapshot sees
+} hashtable_snapshot_t;
+
+
 /**************** global functions ****************/
 /* that is, visible outside this file */
 /* see set.h for comments about exported functions */
@@ -48,6 +185,37 @@ typedef struct hashtable{
 /* not visible outside this file */
 /* see hashtable.h for comments about exported functions */
 static bool slots_check(hashtable_t* ht, int index);
+static inline uint64_t* filter_block(hashtable_t* ht, const unsigned long hash);
+static inline uint64_t filter_bits(const unsigned long hash);
+static void filter_add(hashtable_t* ht, const unsigned long hash);
+static bool filter_maybe(hashtable_t* ht, const unsigned long hash);
+static void filter_counts_init(hashtable_t* ht);
+static inline unsigned long relaxed_count(atomic_ulong* counter, const unsigned long n);
+static void layer_init(hashtable_t* ht);
+static void* layers_find(hashtable_t* layer, const unsigned long hash, const char* key);
+static hashtable_t* write_layer(hashtable_t* ht);
+static void fold_step(hashtable_t* ht, hashtable_t* layer);
+static bool is_frozen(hashtable_t* layer);
+static void journal_record(hashtable_t* ht, const char op, const char* key, void* item);
+static void replay_one(void* arg, const void* record, const size_t len);
+static inline unsigned long key_hash(hashtable_t* ht, const char* key);
+static uint64_t random_seed(void);
+static void guard_chain(hashtable_t* ht, const unsigned long slot);
+static bool rehash(hashtable_t* ht, const uint64_t seed);
+static bool lookup_done(hashtable_t* ht, hashtable_lookup_t* lookup, void* item);
+static inline void lookup_sample(hashtable_t* ht, hashtable_lookup_t* lookup);
+static unsigned long scan_slot(hashtable_t* ht, const unsigned long cursor);
+static void run_threads(void* (*fn)(void* job), void* jobs, const size_t size,
+                        const int n);
+static inline int merge_owner(merge_job_t* job, const unsigned long hash);
+static void* merge_read(void* arg);
+static void* merge_write(void* arg);
+static bool merge_one(merge_job_t* job, merge_entry_t* entry);
+static unsigned long scan_cursor(hashtable_t* ht, const unsigned long slot);
+#ifdef HASHTABLE_STATS
+static void* find_sampled(hashtable_t* ht, set_t* slot, const char* key);
+static void stats_reset(hashtable_t* ht);
+#endif
 
 
 
@@ -56,40 +224,426 @@ static bool slots_check(hashtable_t* ht, int index);
 static bool slots_check(hashtable_t* ht, int index) {
     if (ht->slots[index] == NULL) {
         for (int j = 0; j < index; j++) {
-            free(ht->slots[j]); // free previously allocated sets
+            set_delete(ht->slots[j], NULL); // free previously allocated sets
         }
-        free(ht->slots); // free the slots array
-        free(ht); // free the hashtable structure
+        ht_free(ht); // free the hashtable structure, slots included
         return false; // error allocating memory for set
     }
     return true; // all slots are allocated successfully
 }
 
+/**************** filter_block() ****************/
+/* the filter block for a key's full hash, chosen by its high bits */
+static inline uint64_t* filter_block(hashtable_t* ht, const unsigned long hash) {
+    uint64_t h = ((uint64_t)hash * 0x9E3779B97F4A7C15ULL) >> 32;
+    return ht->filter + ((h * ht->filter_blocks) >> 32) * FILTER_WORDS;
+}
+
+/**************** filter_bits() ****************/
+/* remix a key's full hash, so the bit positions within the block do not
+ * depend on the bits that chose the block; FILTER_K 9-bit fields */
+static inline uint64_t filter_bits(const unsigned long hash) {
+    uint64_t z = (uint64_t)hash + 0x632BE59BD9B4E019ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/**************** filter_add() ****************/
+/* set a key's bits in its block */
+static void filter_add(hashtable_t* ht, const unsigned long hash) {
+    uint64_t* block = filter_block(ht, hash);
+    uint64_t bits = filter_bits(hash);
+    for (int i = 0; i < FILTER_K; i++, bits >>= 9) {
+        block[(bits & 511) >> 6] |= 1ULL << (bits & 63);
+    }
+}
+
+/**************** filter_maybe() ****************/
+/* false if the key is surely absent; true if it may be present */
+static bool filter_maybe(hashtable_t* ht, const unsigned long hash) {
+    const uint64_t* block = filter_block(ht, hash);
+    uint64_t bits = filter_bits(hash);
+    for (int i = 0; i < FILTER_K; i++, bits >>= 9) {
+        if ((block[(bits & 511) >> 6] & (1ULL << (bits & 63))) == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**************** filter_counts_init() ****************/
+/* zero the filter's counters of a new table or layer */
+static void filter_counts_init(hashtable_t* ht) {
+    atomic_init(&ht->filter_passes, 0);
+    atomic_init(&ht->filter_rejects, 0);
+    atomic_init(&ht->filter_false_positives, 0);
+}
+
+/**************** relaxed_count() ****************/
+/* add n to a counter that finds keep: of the filter, or of sampled
+ * lookups; returns the count before.  Finds may run in parallel under a
+ * reader lock, so the counters are atomic; a relaxed load and store
+ * rather than an atomic add keeps the hot path cheap, at the price of a
+ * count now and then lost between parallel finds */
+static inline unsigned long relaxed_count(atomic_ulong* counter, const unsigned long n) {
+    unsigned long before = atomic_load_explicit(counter, memory_order_relaxed);
+    atomic_store_explicit(counter, before + n, memory_order_relaxed);
+    return before;
+}
+
+/**************** layer_init() ****************/
+/* a new layer has no delta, and is the newest layer of its own table */
+static void layer_init(hashtable_t* ht) {
+    ht->delta = NULL;
+    ht->above = NULL;
+    ht->bottom = ht;
+    atomic_init(&ht->pins, 0);
+    ht->fold = 0;
+}
+
+/**************** layers_find() ****************/
+/* look for the key in the given layer and every newer one */
+static void* layers_find(hashtable_t* layer, const unsigned long hash, const char* key) {
+    for (; layer != NULL; layer = layer->delta) {
+        void* item = set_find(layer->slots[hash % layer->num_slots], key);
+        if (item != NULL) {
+            return item;
+        }
+    }
+    return NULL;
+}
+
+/**************** write_layer() ****************/
+/* the layer a write should change, which no snapshot can see: the
+ * newest layer, its parent while the one folds into the other, or a new
+ * layer if a snapshot has pinned the newest; NULL if out of memory */
+static hashtable_t* write_layer(hashtable_t* ht) {
+    hashtable_t* bottom = ht->bottom;
+    if (atomic_load_explicit(&bottom->pins, memory_order_acquire) == 0) {
+        hashtable_t* above = bottom->above;
+        if (above != NULL
+            && atomic_load_explicit(&above->pins, memory_order_acquire) == 0) {
+            fold_step(ht, bottom);
+            return above;         // writes go where the fold is headed
+        }
+        return bottom;
+    }
+    // a snapshot sees the newest layer; start a newer one
+    hashtable_t* layer = ht_malloc(sizeof(hashtable_t) + ht->num_slots * sizeof(set_t*));
+    if (layer == NULL) {
+        return NULL;
+    }
+    layer->num_slots = ht->num_slots;
+    layer->filter = NULL;
+    layer->filter_mem = NULL;
+    layer->filter_blocks = 0;
+    filter_counts_init(layer);
+    layer->journal = NULL;    // the table logs for all its layers
+    layer->itemsize = NULL;
+    layer->seed = ht->seed;   // the table hashes for all its layers
+    layer->generation = 0;
+    layer->count = 0;
+    layer->reseed_floor = 0;
+#ifdef HASHTABLE_STATS
+    layer->sample_mask = 0;
+    stats_reset(layer);
+#endif
+    layer_init(layer);
+    for (int i = 0; i < layer->num_slots; i++) {
+        layer->slots[i] = set_new();
+        if (slots_check(layer, i) == false) {
+            return NULL;
+        }
+    }
+    layer->above = bottom;
+    bottom->delta = layer;
+    ht->bottom = layer;
+    return layer;
+}
+
+/**************** fold_step() ****************/
+/* merge the next FOLD_SLOTS slots of the newest layer into the same slots
+ * of its parent, both unpinned; free the layer once it is all merged */
+static void fold_step(hashtable_t* ht, hashtable_t* layer) {
+    hashtable_t* above = layer->above;
+    int end = layer->fold + FOLD_SLOTS < layer->num_slots
+            ? layer->fold + FOLD_SLOTS : layer->num_slots;
+    for (int i = layer->fold; i < end; i++) {
+        // merge two sorted lists, moving the nodes, not copying them
+        setnode_t** prev = &above->slots[i]->head;
+        setnode_t* node = layer->slots[i]->head;
+        while (node != NULL) {
+            while (*prev != NULL && strcmp((*prev)->key, node->key) < 0) {
+                prev = &(*prev)->next;
+            }
+            setnode_t* next = node->next;
+            node->next = *prev;
+            *prev = node;
+            prev = &node->next;
+            node = next;
+        }
+        layer->slots[i]->head = NULL;
+    }
+    layer->fold = end;
+    if (end == layer->num_slots) {
+        above->delta = NULL;      // the layer is empty; drop it
+        ht->bottom = above;
+        hashtable_delete(layer, NULL);
+    }
+}
+
+/**************** is_frozen() ****************/
+/* true if some snapshot can see this layer: one has pinned it or a newer one */
+static bool is_frozen(hashtable_t* layer) {
+    for (; layer != NULL; layer = layer->delta) {
+        if (atomic_load_explicit(&layer->pins, memory_order_acquire) > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**************** journal_record() ****************/
+/* log one change: the op ('I' insert, 'R' remove or 'U' replace), the
+ * key with its NUL, then for an insert or replace the item's bytes; a
+ * replace is one record, so a crash can't keep its remove without its
+ * insert; failures show up later, in journal_sync or journal_close */
+static void journal_record(hashtable_t* ht, const char op, const char* key, void* item) {
+    journal_part_t parts[3] = {
+        { &op, 1 },
+        { key, strlen(key) + 1 },
+        { item, item != NULL ? (*ht->itemsize)(item) : 0 },
+    };
+    journal_append(ht->journal, parts, 3);
+}
+
+/**************** replay_one() ****************/
+/* apply one journal record, as journal_record wrote it */
+static void replay_one(void* arg, const void* record, const size_t len) {
+    replay_t* replay = arg;
+    const char* bytes = record;
+    if (len < 2) {
+        return;
+    }
+    const char* key = bytes + 1;
+    const char* nul = memchr(key, '\0', len - 1);
+    if (nul == NULL) {
+        return;                   // no NUL: not one of ours
+    }
+    size_t keylen = nul - key;
+    if (bytes[0] == 'R' || bytes[0] == 'U') {
+        void* item = hashtable_remove(replay->ht, key);
+        if (item != NULL && replay->itemdelete != NULL) {
+            (*replay->itemdelete)(item);
+        }
+    }
+    if (bytes[0] == 'I' || bytes[0] == 'U') {
+        void* item = (*replay->itemload)(key + keylen + 1, len - keylen - 2);
+        if (item != NULL && !hashtable_insert(replay->ht, key, item)
+            && replay->itemdelete != NULL) {
+            (*replay->itemdelete)(item);
+        }
+    }
+}
+
+/**************** key_hash() ****************/
+/* a key's full hash, under the table's seed; the slot is this modulo
+ * num_slots, and the filter uses all of it */
+static inline unsigned long key_hash(hashtable_t* ht, const char* key) {
+    return hash_siphash(key, ht->seed, ~0UL);
+}
+
+/**************** random_seed() ****************/
+/* a fresh seed for each call: a secret read once from /dev/urandom (or,
+ * failing that, made from the clock and where we are loaded), mixed with
+ * a count of the seeds made so far by splitmix64 */
+static uint64_t random_seed(void) {
+    if (atomic_load_explicit(&secret_state, memory_order_acquire) != 2) {
+        int expected = 0;
+        if (atomic_compare_exchange_strong(&secret_state, &expected, 1)) {
+            uint64_t s = (uint64_t)time(NULL) ^ (uint64_t)clock() << 32
+                       ^ (uint64_t)(uintptr_t)&secret;
+            FILE* fp = fopen("/dev/urandom", "rb");
+            if (fp != NULL) {
+                uint64_t r;
+                if (fread(&r, sizeof(r), 1, fp) == 1) {
+                    s ^= r;
+                }
+                fclose(fp);
+            }
+            atomic_store_explicit(&secret, s, memory_order_relaxed);
+            atomic_store_explicit(&secret_state, 2, memory_order_release);
+        } else {
+            while (atomic_load_explicit(&secret_state, memory_order_acquire) != 2) {
+                ;                 // another thread is reading it
+            }
+        }
+    }
+    uint64_t n = atomic_fetch_add_explicit(&seeds_made, 1, memory_order_relaxed);
+    uint64_t z = atomic_load_explicit(&secret, memory_order_relaxed)
+               + (n + 1) * 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/**************** guard_chain() ****************/
+/* After an insert into the table's own slot, check that slot's chain;
+ * if it is pathological (see CHAIN_MIN) rehash under a new seed, unless
+ * snapshots share the slots or the last reseed is not yet paid for: the
+ * table must have doubled since.  The walk stops at the limit, so it
+ * costs no more than the insert did. */
+static void guard_chain(hashtable_t* ht, const unsigned long slot) {
+    long limit = CHAIN_FACTOR * (ht->count / ht->num_slots + 1);
+    if (limit < CHAIN_MIN) {
+        limit = CHAIN_MIN;
+    }
+    long len = 0;
+    for (setnode_t* node = ht->slots[slot]->head; node != NULL && len <= limit;
+         node = node->next) {
+        len++;
+    }
+    if (len > limit && ht->count >= ht->reseed_floor
+        && ht->bottom == ht && atomic_load_explicit(&ht->pins, memory_order_acquire) == 0) {
+        if (rehash(ht, random_seed())) {
+            ht->reseed_floor = 2 * ht->count;
+        }
+    }
+}
+
+/**************** rehash() ****************/
+/* Move every key of a one-layer table to its slot under a new seed,
+ * keeping each chain sorted, and rebuild the filter to match; the nodes
+ * move, nothing is copied or allocated.  O(items x mean chain).
+ * False, doing nothing, if the generation would no longer fit a scan
+ * cursor (see scan_cursor). */
+static bool rehash(hashtable_t* ht, const uint64_t seed) {
+    if (ht->generation + 1 > ULONG_MAX / ht->num_slots - 1) {
+        return false;
+    }
+    setnode_t* all = NULL;        // every node, on one list
+    for (int i = 0; i < ht->num_slots; i++) {
+        setnode_t* node = ht->slots[i]->head;
+        while (node != NULL) {
+            setnode_t* next = node->next;
+            node->next = all;
+            all = node;
+            node = next;
+        }
+        ht->slots[i]->head = NULL;
+    }
+    ht->seed = seed;
+    ht->generation++;             // scans in progress start over
+    if (ht->filter != NULL) {
+        memset(ht->filter, 0, ht->filter_blocks * FILTER_WORDS * sizeof(uint64_t));
+    }
+    while (all != NULL) {
+        setnode_t* node = all;
+        all = node->next;
+        unsigned long full = key_hash(ht, node->key);
+        setnode_t** prev = &ht->slots[full % ht->num_slots]->head;
+        while (*prev != NULL && strcmp((*prev)->key, node->key) < 0) {
+            prev = &(*prev)->next;
+        }
+        node->next = *prev;
+        *prev = node;
+        if (ht->filter != NULL) {
+            filter_add(ht, full);
+        }
+    }
+    return true;
+}
+
+/**************** scan_slot() ****************/
+/* the slot a scan cursor resumes at: 0 if the table was rehashed since
+ * the cursor was made, so the scan starts over; num_slots if the cursor
+ * is past the end */
+static unsigned long scan_slot(hashtable_t* ht, const unsigned long cursor) {
+    unsigned long generation = cursor / ht->num_slots;
+    if (generation > ht->generation) {
+        return ht->num_slots;
+    }
+    return generation < ht->generation ? 0 : cursor % ht->num_slots;
+}
+
+/**************** scan_cursor() ****************/
+/* the cursor for a scan to resume at slot: the slot, plus the table's
+ * generation times num_slots; 0 if the scan is complete */
+static unsigned long scan_cursor(hashtable_t* ht, const unsigned long slot) {
+    if (slot >= (unsigned long)ht->num_slots) {
+        return 0;
+    }
+    return ht->generation * ht->num_slots + slot;
+}
+
+#ifdef HASHTABLE_STATS
+/**************** find_sampled() ****************/
+/* set_find, but counting the keys compared; used for sampled lookups */
+static void* find_sampled(hashtable_t* ht, set_t* slot, const char* key) {
+    relaxed_count(&ht->lookups, 1);
+    unsigned long probes = 0;
+    for (setnode_t* node = slot->head; node != NULL; node = node->next) {
+        probes++;
+        if (strcmp(node->key, key) == 0) {
+            relaxed_count(&ht->probes, probes);
+            relaxed_count(&ht->hits, 1);
+            return node->item; // found the item
+        }
+    }
+    relaxed_count(&ht->probes, probes);
+    return NULL; // key not found
+}
+
+/**************** stats_reset() ****************/
+/* zero the operation counters */
+static void stats_reset(hashtable_t* ht) {
+    atomic_store_explicit(&ht->ticks, 0, memory_order_relaxed);
+    atomic_store_explicit(&ht->lookups, 0, memory_order_relaxed);
+    atomic_store_explicit(&ht->hits, 0, memory_order_relaxed);
+    atomic_store_explicit(&ht->probes, 0, memory_order_relaxed);
+    ht->inserts = 0;
+    ht->insert_collisions = 0;
+}
+#endif
+
 
 /**************** hashtable_new() ****************/
 /* see hashtable.h for description */
 hashtable_t*
 hashtable_new(const int num_slots)
 {
-    hashtable_t* ht = malloc(sizeof(hashtable_t));
+    if (num_slots <= 0) {
+        return NULL;              // bad number of slots
+    }
+    // the slots array is a flexible array member; allocate it with the table
+    hashtable_t* ht = ht_malloc(sizeof(hashtable_t) + num_slots * sizeof(set_t*));
     if (ht == NULL) {
         return NULL;              // error allocating hashtable
     } else {
         // initialize contents of hashtable structure
         ht->num_slots = num_slots;
-        if (ht->slots == NULL) {
-            free(ht); // free the hashtable if slots allocation fails
-            return NULL; // error allocating memory for slots
-        }
-        ht->slots[num_slots]; // initialize slots to NULL
-
-        for (int i = 0; i <= num_slots; i++) {
+        ht->filter = NULL;   // no membership filter until hashtable_filter
+        ht->filter_mem = NULL;
+        ht->filter_blocks = 0;
+        filter_counts_init(ht);
+        ht->journal = NULL;  // no journal until hashtable_journal
+        ht->itemsize = NULL;
+        ht->seed = random_seed();
+        ht->generation = 0;
+        ht->count = 0;
+        ht->reseed_floor = 0;
+        layer_init(ht);      // no snapshots yet, so just the one layer
+#ifdef HASHTABLE_STATS
+        ht->sample_mask = 0; // record every operation
+        stats_reset(ht);
+#endif
+        for (int i = 0; i < num_slots; i++) {
             ht->slots[i] = set_new(); // create a new set for each slot
             if (slots_check(ht, i) == false) {
                 return NULL; // check if sets are allocated successfully
             }
         }
-        // check if the hashtable, key, and item are not NULL
         return ht;
     }
 }
@@ -100,10 +654,45 @@ hashtable_new(const int num_slots)
 bool hashtable_insert(hashtable_t* ht, const char* key, void* item){
     // check if the hashtable, key, and item are not NULL
     if (ht != NULL && key != NULL && item != NULL){
-        // calculate the hash value for the key
-        unsigned long hash = hash_jenkins(key, ht->num_slots);  
+        // calculate the full hash for the key, and from it the slot
+        unsigned long full = key_hash(ht, key);
+        unsigned long hash = full % ht->num_slots;
+#ifdef HASHTABLE_STATS
+        if ((relaxed_count(&ht->ticks, 1) & ht->sample_mask) == 0) {
+            ht->inserts++;
+            if (ht->slots[hash]->head != NULL) {
+                ht->insert_collisions++; // slot already holds a key
+            }
+        }
+#endif
+        hashtable_t* layer = ht;
+        if (ht->bottom != ht
+            || atomic_load_explicit(&ht->pins, memory_order_acquire) > 0) {
+            // snapshots in play: the key may be in any layer, and only
+            // a layer no snapshot sees may change
+            if (layers_find(ht, full, key) != NULL) {
+                return false;
+            }
+            layer = write_layer(ht);
+            if (layer == NULL) {
+                return false;     // out of memory
+            }
+        }
         // insert the item into the appropriate slot
-        return set_insert(ht->slots[hash], key, item); //if key exists, return false
+        if (!set_insert(layer->slots[hash], key, item)) {
+            return false; //if key exists, return false
+        }
+        ht->count++;
+        if (ht->filter != NULL) {
+            filter_add(ht, full); // keep the filter up to date
+        }
+        if (ht->journal != NULL) {
+            journal_record(ht, 'I', key, item);
+        }
+        if (layer == ht) {
+            guard_chain(ht, hash); // may rehash; the key is in by now
+        }
+        return true;
         } else {
             return false; 
         }
@@ -118,15 +707,269 @@ bool hashtable_insert(hashtable_t* ht, const char* key, void* item){
 void* hashtable_find(hashtable_t* ht, const char* key){
     // check if the hashtable and key are not NULL
     if (ht != NULL && key != NULL) {
-        // calculate the hash value for the key
-        unsigned long hash = hash_jenkins(key, ht->num_slots);
+        // calculate the full hash for the key, and from it the slot
+        unsigned long full = key_hash(ht, key);
+        unsigned long hash = full % ht->num_slots;
+        if (ht->filter != NULL) {
+            if (!filter_maybe(ht, full)) {
+                relaxed_count(&ht->filter_rejects, 1);
+                return NULL;      // surely absent; no chain to walk
+            }
+            relaxed_count(&ht->filter_passes, 1);
+        }
         // find the item in the appropriate slot
-        return set_find(ht->slots[hash], key); //if key exists, return item
+        void* item;
+#ifdef HASHTABLE_STATS
+        if ((relaxed_count(&ht->ticks, 1) & ht->sample_mask) == 0) {
+            item = find_sampled(ht, ht->slots[hash], key);
+        } else {
+            item = set_find(ht->slots[hash], key);
+        }
+#else
+        item = set_find(ht->slots[hash], key); //if key exists, return item
+#endif
+        if (item == NULL && ht->delta != NULL) {
+            item = layers_find(ht->delta, full, key); // written since a snapshot
+        }
+        if (item == NULL && ht->filter != NULL) {
+            relaxed_count(&ht->filter_false_positives, 1);
+        }
+        return item;
     } else {
         return NULL; // failure
     }
 }
 
+/**************** hashtable_lookup_start() ****************/
+/* see hashtable.h for description */
+
+bool hashtable_lookup_start(hashtable_t* ht, hashtable_lookup_t* lookup, const char* key){
+    if (lookup == NULL) {
+        return true;
+    }
+    lookup->key = key;
+    lookup->item = NULL;
+    lookup->sampled = false;
+    if (ht == NULL || key == NULL) {
+        lookup->stage = LOOKUP_DONE;
+        return true;
+    }
+    lookup->hash = key_hash(ht, key);
+    if (ht->filter != NULL) {
+        lookup->next = filter_block(ht, lookup->hash);
+        lookup->stage = LOOKUP_FILTER;
+    } else {
+        lookup->next = &ht->slots[lookup->hash % ht->num_slots];
+        lookup->stage = LOOKUP_SLOT;
+        lookup_sample(ht, lookup);
+    }
+    PREFETCH(lookup->next);
+    return false;
+}
+
+/**************** hashtable_lookup_step() ****************/
+/* see hashtable.h for description */
+
+bool hashtable_lookup_step(hashtable_t* ht, hashtable_lookup_t* lookup){
+    if (ht == NULL || lookup == NULL) {
+        return true;
+    }
+    const setnode_t* node;
+    switch (lookup->stage) {
+    case LOOKUP_FILTER:
+        // the filter block is here: is the key surely absent?
+        if (!filter_maybe(ht, lookup->hash)) {
+            relaxed_count(&ht->filter_rejects, 1);
+            lookup->stage = LOOKUP_DONE;
+            return true;
+        }
+        relaxed_count(&ht->filter_passes, 1);
+        lookup->next = &ht->slots[lookup->hash % ht->num_slots];
+        lookup->stage = LOOKUP_SLOT;
+        lookup_sample(ht, lookup);
+        break;
+    case LOOKUP_SLOT:
+        // the slot is here: on to its set
+        lookup->next = *(set_t* const*)lookup->next;
+        lookup->stage = LOOKUP_SET;
+        break;
+    case LOOKUP_SET:
+        // the set is here: on to the head of its chain
+        lookup->next = ((const set_t*)lookup->next)->head;
+        if (lookup->next == NULL) {
+            return lookup_done(ht, lookup, NULL);
+        }
+        lookup->stage = LOOKUP_NODE;
+        break;
+    case LOOKUP_NODE:
+        // the node is here: on to its key
+        PREFETCH(((const setnode_t*)lookup->next)->key);
+        lookup->stage = LOOKUP_KEY;
+        return false;
+    case LOOKUP_KEY: {
+        // the key is here: compare; the chain is sorted, so stop once past
+        node = lookup->next;
+#ifdef HASHTABLE_STATS
+        if (lookup->sampled) {
+            relaxed_count(&ht->probes, 1);
+        }
+#endif
+        int cmp = strcmp(node->key, lookup->key);
+        if (cmp == 0) {
+            return lookup_done(ht, lookup, node->item);
+        }
+        if (cmp > 0 || node->next == NULL) {
+            return lookup_done(ht, lookup, NULL);
+        }
+        lookup->next = node->next;
+        lookup->stage = LOOKUP_NODE;
+        break;
+    }
+    default:
+        return true;              // done already
+    }
+    PREFETCH(lookup->next);
+    return false;
+}
+
+/**************** lookup_done() ****************/
+/* finish a staged lookup with the item found in the table's own layer,
+ * looking in the newer layers if it was not there; true */
+static bool lookup_done(hashtable_t* ht, hashtable_lookup_t* lookup, void* item) {
+#ifdef HASHTABLE_STATS
+    if (lookup->sampled && item != NULL) {
+        relaxed_count(&ht->hits, 1);  // as find_sampled, hits in the table's own layer
+    }
+#endif
+    if (item == NULL && ht->delta != NULL) {
+        item = layers_find(ht->delta, lookup->hash, lookup->key); // written since a snapshot
+    }
+    if (item == NULL && ht->filter != NULL) {
+        relaxed_count(&ht->filter_false_positives, 1);
+    }
+    lookup->item = item;
+    lookup->stage = LOOKUP_DONE;
+    return true;
+}
+
+/**************** lookup_sample() ****************/
+/* a lookup past the filter is an operation, as in hashtable_find: tick,
+ * and if this one is sampled, count it as a lookup */
+static inline void lookup_sample(hashtable_t* ht, hashtable_lookup_t* lookup) {
+#ifdef HASHTABLE_STATS
+    if ((relaxed_count(&ht->ticks, 1) & ht->sample_mask) == 0) {
+        lookup->sampled = true;
+        relaxed_count(&ht->lookups, 1);
+    }
+#endif
+}
+
+/**************** hashtable_find_many() ****************/
+/* see hashtable.h for description */
+
+void hashtable_find_many(hashtable_t* ht, const char** keys, void** items, const int n){
+    if (items == NULL || n <= 0) {
+        return;
+    }
+    if (ht == NULL || keys == NULL) {
+        for (int i = 0; i < n; i++) {
+            items[i] = NULL;
+        }
+        return;
+    }
+    // ring[0..live) are lookups in flight, for keys[index[0..live)]
+    hashtable_lookup_t ring[LOOKUP_WINDOW];
+    int index[LOOKUP_WINDOW];
+    int live = 0, next = 0;
+    while (live < LOOKUP_WINDOW && next < n) {
+        index[live] = next;
+        if (hashtable_lookup_start(ht, &ring[live], keys[next++])) {
+            items[index[live]] = ring[live].item;
+        } else {
+            live++;
+        }
+    }
+    while (live > 0) {
+        for (int w = 0; w < live; ) {
+            if (!hashtable_lookup_step(ht, &ring[w])) {
+                w++;              // its next line is on the way
+                continue;
+            }
+            items[index[w]] = ring[w].item;
+            // start the next key in its place, or close up the ring
+            bool started = false;
+            while (!started && next < n) {
+                index[w] = next;
+                started = !hashtable_lookup_start(ht, &ring[w], keys[next++]);
+                if (!started) {
+                    items[index[w]] = ring[w].item;
+                }
+            }
+            if (started) {
+                w++;
+            } else {
+                live--;
+                ring[w] = ring[live];
+                index[w] = index[live];
+            }
+        }
+    }
+}
+
+/**************** hashtable_remove() ****************/
+/* see hashtable.h for description */
+
+void* hashtable_remove(hashtable_t* ht, const char* key){
+    if (ht == NULL || key == NULL) {
+        return NULL;
+    }
+    // the key can only be in the slot it hashes to, in one layer
+    unsigned long hash = key_hash(ht, key) % ht->num_slots;
+    for (hashtable_t* layer = ht; layer != NULL; layer = layer->delta) {
+        if (set_find(layer->slots[hash], key) != NULL) {
+            if (is_frozen(layer)) {
+                return NULL;      // a snapshot still sees it
+            }
+            if (ht->journal != NULL) {
+                journal_record(ht, 'R', key, NULL);
+            }
+            ht->count--;
+            return set_remove(layer->slots[hash], key);
+        }
+    }
+    return NULL;
+}
+
+/**************** hashtable_replace() ****************/
+/* see hashtable.h for description */
+
+void* hashtable_replace(hashtable_t* ht, const char* key, void* item){
+    if (ht == NULL || key == NULL || item == NULL) {
+        return NULL;
+    }
+    // as for hashtable_remove: one slot, in one layer
+    unsigned long hash = key_hash(ht, key) % ht->num_slots;
+    for (hashtable_t* layer = ht; layer != NULL; layer = layer->delta) {
+        int cmp = 1;
+        setnode_t* node = layer->slots[hash]->head;
+        while (node != NULL && (cmp = strcmp(node->key, key)) < 0) {
+            node = node->next;    // chains are sorted
+        }
+        if (node != NULL && cmp == 0) {
+            if (is_frozen(layer)) {
+                return NULL;      // a snapshot still sees it
+            }
+            if (ht->journal != NULL) {
+                journal_record(ht, 'U', key, item);
+            }
+            void* old = node->item;
+            node->item = item;
+            return old;
+        }
+    }
+    return NULL;
+}
+
 /**************** hashtable_print() ****************/
 /* see hashtable.h for description */
 
@@ -134,14 +977,16 @@ void hashtable_print(hashtable_t* ht, FILE* fp,
     void (*itemprint)(FILE* fp, const char* key, void* item)){
     // check if the hashtable and file pointer are not NULL
     if (ht != NULL && fp != NULL) {
-        // print the hashtable
-        for (int i = 0; i < ht->num_slots; i++) {
-            set_print(ht->slots[i], fp, itemprint); // print each slot
-            if (ht->slots[i] != NULL) {
-                fprintf(fp, "\n"); // print newline after each slot
+        // print the hashtable, and any layers written since a snapshot
+        for (hashtable_t* layer = ht; layer != NULL; layer = layer->delta) {
+            for (int i = 0; i < layer->num_slots; i++) {
+                set_print(layer->slots[i], fp, itemprint); // print each slot
+                if (layer->slots[i] != NULL) {
+                    fprintf(fp, "\n"); // print newline after each slot
+                }
             }
         }
-    } else if (fp == NULL) {
+    } else if (fp != NULL) {
         fprintf(fp, "(null)\n"); // print null if hashtable is NULL
     }
 }
@@ -153,11 +998,603 @@ void hashtable_iterate(hashtable_t* ht, void* arg,
     void (*itemfunc)(void* arg, const char* key, void* item) ){
     // check if the hashtable and item function are not NULL
     if (ht != NULL && itemfunc != NULL) {
-        // iterate over each slot in the hashtable
-        for (int i = 0; i < ht->num_slots; i++) {
-            set_iterate(ht->slots[i], arg, itemfunc); // call item function
+        // iterate over each slot in the hashtable, layer by layer
+        for (hashtable_t* layer = ht; layer != NULL; layer = layer->delta) {
+            for (int i = 0; i < layer->num_slots; i++) {
+                set_iterate(layer->slots[i], arg, itemfunc); // call item function
+            }
+        }
+    }
+}
+
+/**************** hashtable_scan() ****************/
+/* see hashtable.h for description */
+
+unsigned long hashtable_scan(hashtable_t* ht, unsigned long cursor, const long budget,
+    void* arg, void (*itemfunc)(void* arg, const char* key, void* item) ){
+    if (ht == NULL || itemfunc == NULL) {
+        return 0;
+    }
+    unsigned long slot = scan_slot(ht, cursor);
+    if (slot >= (unsigned long)ht->num_slots) {
+        return 0;
+    }
+    long spent = 0;
+    do {
+        // the whole slot, in every layer, so no key slips between calls
+        spent++;
+        for (hashtable_t* layer = ht; layer != NULL; layer = layer->delta) {
+            for (setnode_t* node = layer->slots[slot]->head; node != NULL; node = node->next) {
+                (*itemfunc)(arg, node->key, node->item);
+                spent++;
+            }
+        }
+        slot++;
+    } while (slot < (unsigned long)ht->num_slots && spent < budget);
+    return scan_cursor(ht, slot);
+}
+
+/**************** hashtable_scan_print() ****************/
+/* see hashtable.h for description */
+
+unsigned long hashtable_scan_print(hashtable_t* ht, unsigned long cursor, const long budget,
+    FILE* fp, void (*itemprint)(FILE* fp, const char* key, void* item)){
+    if (fp == NULL) {
+        return 0;
+    }
+    if (ht == NULL) {
+        fprintf(fp, "(null)\n");
+        return 0;
+    }
+    unsigned long slot = scan_slot(ht, cursor);
+    if (slot >= (unsigned long)ht->num_slots) {
+        return 0;
+    }
+    // hashtable_print goes layer by layer; with more than one layer, the
+    // lines come slot by slot instead
+    long spent = 0;
+    do {
+        spent++;
+        for (hashtable_t* layer = ht; layer != NULL; layer = layer->delta) {
+            set_print(layer->slots[slot], fp, itemprint);
+            fprintf(fp, "\n");
+            for (setnode_t* node = layer->slots[slot]->head; node != NULL; node = node->next) {
+                spent++;
+            }
+        }
+        slot++;
+    } while (slot < (unsigned long)ht->num_slots && spent < budget);
+    return scan_cursor(ht, slot);
+}
+
+/**************** hashtable_merge_many() ****************/
+/* see hashtable.h for description */
+
+bool hashtable_merge_many(hashtable_t* dest, hashtable_t** srcs, const int nsrcs,
+                          const int nthreads, void* arg,
+                          void* (*merge)(void* arg, const char* key, void* item, void* other)){
+    if (dest == NULL || nsrcs < 0 || (srcs == NULL && nsrcs > 0) || nthreads < 1
+        || dest->bottom != dest
+        || atomic_load_explicit(&dest->pins, memory_order_acquire) > 0) {
+        return false;
+    }
+    long total = 0;
+    for (int i = 0; i < nsrcs; i++) {
+        if (srcs[i] == NULL || srcs[i] == dest) {
+            return false;
+        }
+        total += srcs[i]->count;
+    }
+    int threads = nthreads < MAX_THREADS ? nthreads : MAX_THREADS;
+    if (total / MERGE_MIN_KEYS + 1 < threads) {
+        threads = total / MERGE_MIN_KEYS + 1;      // too little work to share
+    }
+    merge_job_t* jobs = ht_malloc(threads * sizeof(merge_job_t));
+    if (jobs == NULL) {
+        return false;
+    }
+    for (int j = 0; j < threads; j++) {
+        merge_job_t* job = &jobs[j];
+        job->dest = dest;
+        job->srcs = srcs;
+        job->nsrcs = nsrcs;
+        job->index = j;
+        job->nthreads = threads;
+        job->jobs = jobs;
+        job->arg = arg;
+        job->merge = merge;
+        job->entries = NULL;
+        job->inserted = 0;
+        job->longest = -1;
+        job->longest_slot = 0;
+        job->failed = false;
+    }
+    // hash the source pairs, then hand each to the thread owning its slot
+    run_threads(merge_read, jobs, sizeof(merge_job_t), threads);
+    bool ok = true;
+    for (int j = 0; j < threads; j++) {
+        ok = ok && !jobs[j].failed;
+    }
+    if (ok) {
+        run_threads(merge_write, jobs, sizeof(merge_job_t), threads);
+    }
+
+    // what the threads could not do: the count, the filter and the guard
+    int longest = -1, slot = 0;
+    for (int j = 0; j < threads; j++) {
+        merge_job_t* job = &jobs[j];
+        ok = ok && !job->failed;
+        dest->count += job->inserted;
+        if (dest->filter != NULL && job->entries != NULL) {
+            for (long e = 0; e < job->starts[threads]; e++) {
+                if (job->entries[e].fresh) {
+                    filter_add(dest, job->entries[e].hash);
+                }
+            }
+        }
+        if (job->longest > longest) {
+            longest = job->longest;
+            slot = job->longest_slot;
+        }
+        if (job->entries != NULL) {
+            ht_free(job->entries);
+        }
+    }
+    ht_free(jobs);
+    if (longest >= 0) {
+        guard_chain(dest, slot);
+    }
+    return ok;
+}
+
+/**************** run_threads() ****************/
+/* call fn on each of n jobs, size bytes apart: the first on this thread,
+ * the others each on a thread of its own; a job whose thread cannot be
+ * started runs here too, after the first */
+static void run_threads(void* (*fn)(void* job), void* jobs, const size_t size,
+                        const int n) {
+    pthread_t threads[MAX_THREADS];
+    bool started[MAX_THREADS];
+    for (int i = 1; i < n; i++) {
+        started[i] = pthread_create(&threads[i], NULL, fn, (char*)jobs + i * size) == 0;
+    }
+    (*fn)(jobs);
+    for (int i = 1; i < n; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        } else {
+            (*fn)((char*)jobs + i * size);
+        }
+    }
+}
+
+/**************** merge_owner() ****************/
+/* the job that owns a key's slot of dest: slots are split into nthreads
+ * runs of about equal length */
+static inline int merge_owner(merge_job_t* job, const unsigned long hash) {
+    unsigned long slot = hash % job->dest->num_slots;
+    return slot * job->nthreads / job->dest->num_slots;
+}
+
+/**************** merge_read() ****************/
+/* gather the pairs in the job's share of every source's slots, every
+ * layer, hashed under dest's seed; then group them by owner, stably, so
+ * each owner's stay in source order */
+static void* merge_read(void* arg) {
+    merge_job_t* job = arg;
+    long n = 0;
+    for (int s = 0; s < job->nsrcs; s++) {
+        hashtable_t* src = job->srcs[s];
+        long lo = (long)src->num_slots * job->index / job->nthreads;
+        long hi = (long)src->num_slots * (job->index + 1) / job->nthreads;
+        for (hashtable_t* layer = src; layer != NULL; layer = layer->delta) {
+            for (long i = lo; i < hi; i++) {
+                for (setnode_t* node = layer->slots[i]->head; node != NULL; node = node->next) {
+                    n++;
+                }
+            }
+        }
+    }
+    memset(job->starts, 0, sizeof(job->starts));
+    if (n == 0) {
+        return NULL;
+    }
+    merge_entry_t* raw = ht_malloc(n * sizeof(merge_entry_t));
+    job->entries = ht_malloc(n * sizeof(merge_entry_t));
+    if (raw == NULL || job->entries == NULL) {
+        if (raw != NULL) {
+            ht_free(raw);
+        }
+        job->failed = true;
+        return NULL;
+    }
+    long counts[MAX_THREADS] = { 0 };
+    long e = 0;
+    for (int s = 0; s < job->nsrcs; s++) {
+        hashtable_t* src = job->srcs[s];
+        long lo = (long)src->num_slots * job->index / job->nthreads;
+        long hi = (long)src->num_slots * (job->index + 1) / job->nthreads;
+        for (hashtable_t* layer = src; layer != NULL; layer = layer->delta) {
+            for (long i = lo; i < hi; i++) {
+                for (setnode_t* node = layer->slots[i]->head; node != NULL; node = node->next) {
+                    merge_entry_t* entry = &raw[e++];
+                    entry->key = node->key;
+                    entry->item = node->item;
+                    entry->hash = key_hash(job->dest, node->key);
+                    entry->src = s;
+                    entry->fresh = false;
+                    counts[merge_owner(job, entry->hash)]++;
+                }
+            }
+        }
+    }
+    // counting sort by owner
+    for (int p = 0; p < job->nthreads; p++) {
+        job->starts[p + 1] = job->starts[p] + counts[p];
+        counts[p] = job->starts[p];
+    }
+    for (e = 0; e < n; e++) {
+        job->entries[counts[merge_owner(job, raw[e].hash)]++] = raw[e];
+    }
+    ht_free(raw);
+    return NULL;
+}
+
+/**************** merge_write() ****************/
+/* merge into the job's own slots of dest the pairs every job read for
+ * it, in source order: each job's run is in source order already, so
+ * take the next from whichever run is at the earliest source; then note
+ * the longest chain */
+static void* merge_write(void* arg) {
+    merge_job_t* job = arg;
+    int p = job->index;
+    long next[MAX_THREADS];
+    for (int t = 0; t < job->nthreads; t++) {
+        next[t] = job->jobs[t].starts[p];
+    }
+    for (;;) {
+        int best = -1;
+        for (int t = 0; t < job->nthreads; t++) {
+            if (next[t] < job->jobs[t].starts[p + 1]
+                && (best < 0 || job->jobs[t].entries[next[t]].src
+                                < job->jobs[best].entries[next[best]].src)) {
+                best = t;
+            }
+        }
+        if (best < 0) {
+            break;                // every run is done
+        }
+        if (!merge_one(job, &job->jobs[best].entries[next[best]++])) {
+            job->failed = true;
+            break;
+        }
+    }
+    hashtable_t* dest = job->dest;
+    unsigned long T = job->nthreads, S = dest->num_slots;
+    for (unsigned long i = (p * S + T - 1) / T; i < ((p + 1) * S + T - 1) / T; i++) {
+        int len = 0;
+        for (setnode_t* node = dest->slots[i]->head; node != NULL; node = node->next) {
+            len++;
+        }
+        if (len > job->longest) {
+            job->longest = len;
+            job->longest_slot = i;
+        }
+    }
+    return NULL;
+}
+
+/**************** merge_one() ****************/
+/* merge one pair into its slot of dest, logging the change; false if out
+ * of memory */
+static bool merge_one(merge_job_t* job, merge_entry_t* entry) {
+    hashtable_t* dest = job->dest;
+    set_t* slot = dest->slots[entry->hash % dest->num_slots];
+    setnode_t* node = slot->head;
+    int cmp = 1;
+    while (node != NULL && (cmp = strcmp(node->key, entry->key)) < 0) {
+        node = node->next;    // chains are sorted
+    }
+    if (node != NULL && cmp == 0) {
+        // a key dest has already: merge the items
+        void* item = job->merge == NULL ? NULL
+                   : (*job->merge)(job->arg, entry->key, node->item, entry->item);
+        if (item != NULL && item != node->item) {
+            if (dest->journal != NULL) {
+                journal_record(dest, 'U', entry->key, item);
+            }
+            node->item = item;
+        }
+        return true;
+    }
+    if (!set_insert(slot, entry->key, entry->item)) {
+        return false;
+    }
+    if (dest->journal != NULL) {
+        journal_record(dest, 'I', entry->key, entry->item);
+    }
+    entry->fresh = true;
+    job->inserted++;
+    return true;
+}
+
+/**************** hashtable_seed() ****************/
+/* see hashtable.h for description */
+
+bool hashtable_seed(hashtable_t* ht, const uint64_t seed){
+    if (ht == NULL || ht->bottom != ht
+        || atomic_load_explicit(&ht->pins, memory_order_acquire) > 0) {
+        return false;             // snapshots share the slots
+    }
+    return rehash(ht, seed);
+}
+
+/**************** hashtable_stats() ****************/
+/* see hashtable.h for description */
+
+bool hashtable_stats(hashtable_t* ht, hashtable_stats_t* stats){
+    if (ht == NULL || stats == NULL) {
+        return false;
+    }
+    memset(stats, 0, sizeof(*stats));
+    stats->num_slots = ht->num_slots;
+    // walk each slot's chain, across the layers
+    for (hashtable_t* layer = ht; layer != NULL; layer = layer->delta) {
+        stats->layers++;
+    }
+    for (int i = 0; i < ht->num_slots; i++) {
+        int len = 0;
+        for (hashtable_t* layer = ht; layer != NULL; layer = layer->delta) {
+            for (setnode_t* node = layer->slots[i]->head; node != NULL; node = node->next) {
+                len++;
+            }
+        }
+        stats->items += len;
+        stats->chain_hist[len < HASHTABLE_HIST ? len : HASHTABLE_HIST - 1]++;
+        if (len > stats->max_chain) {
+            stats->max_chain = len;
+        }
+        if (len > 1) {
+            stats->collisions += len - 1;
+        }
+    }
+    stats->load_factor = (double)stats->items / ht->num_slots;
+    stats->reseeds = ht->generation;
+
+    // the membership filter, if any
+    if (ht->filter != NULL) {
+        stats->filter_bytes = ht->filter_blocks * FILTER_WORDS * sizeof(uint64_t);
+    }
+    stats->filter_passes = atomic_load_explicit(&ht->filter_passes, memory_order_relaxed);
+    stats->filter_rejects = atomic_load_explicit(&ht->filter_rejects, memory_order_relaxed);
+    stats->filter_false_positives
+        = atomic_load_explicit(&ht->filter_false_positives, memory_order_relaxed);
+    if (stats->filter_false_positives + stats->filter_rejects > 0) {
+        stats->filter_fp_rate = (double)stats->filter_false_positives
+            / (stats->filter_false_positives + stats->filter_rejects);
+    }
+
+#ifdef HASHTABLE_STATS
+    // scale the sampled counts back up to estimates
+    unsigned long rate = ht->sample_mask + 1;
+    stats->sample_rate = rate;
+    unsigned long lookups = atomic_load_explicit(&ht->lookups, memory_order_relaxed);
+    unsigned long hits = atomic_load_explicit(&ht->hits, memory_order_relaxed);
+    unsigned long probes = atomic_load_explicit(&ht->probes, memory_order_relaxed);
+    stats->lookups = lookups * rate;
+    stats->hits = hits * rate;
+    stats->misses = (lookups - hits) * rate;
+    stats->inserts = ht->inserts * rate;
+    stats->insert_collisions = ht->insert_collisions * rate;
+    if (lookups > 0) {
+        stats->hit_ratio = (double)hits / lookups;
+        stats->mean_probes = (double)probes / lookups;
+    }
+#endif
+    return true;
+}
+
+/**************** hashtable_stats_sample() ****************/
+/* see hashtable.h for description */
+
+bool hashtable_stats_sample(hashtable_t* ht, const int rate){
+    if (ht == NULL || rate < 1 || (rate & (rate - 1)) != 0) {
+        return false; // bad table or rate
+    }
+#ifdef HASHTABLE_STATS
+    ht->sample_mask = rate - 1;
+    stats_reset(ht);
+    return true;
+#else
+    return false; // no counters to sample
+#endif
+}
+
+/**************** hashtable_filter() ****************/
+/* see hashtable.h for description */
+
+bool hashtable_filter(hashtable_t* ht, const long expected){
+    if (ht == NULL || expected < 0) {
+        return false;
+    }
+    // drop any old filter, and its counts
+    if (ht->filter_mem != NULL) {
+        ht_free(ht->filter_mem);
+    }
+    ht->filter = NULL;
+    ht->filter_mem = NULL;
+    ht->filter_blocks = 0;
+    atomic_store_explicit(&ht->filter_passes, 0, memory_order_relaxed);
+    atomic_store_explicit(&ht->filter_rejects, 0, memory_order_relaxed);
+    atomic_store_explicit(&ht->filter_false_positives, 0, memory_order_relaxed);
+    if (expected == 0) {
+        return true;              // no filter wanted
+    }
+    unsigned long blocks = (expected * FILTER_BITS_PER_KEY + FILTER_BLOCK_BITS - 1)
+                         / FILTER_BLOCK_BITS;
+    if (blocks > UINT32_MAX) {
+        return false;             // more than filter_block can index
+    }
+    // allocate one extra block, so the blocks can start on a cache line
+    size_t bytes = blocks * FILTER_WORDS * sizeof(uint64_t);
+    void* mem = ht_malloc(bytes + FILTER_WORDS * sizeof(uint64_t));
+    if (mem == NULL) {
+        return false;
+    }
+    uintptr_t line = FILTER_WORDS * sizeof(uint64_t);
+    ht->filter = (uint64_t*)(((uintptr_t)mem + line - 1) & ~(line - 1));
+    ht->filter_mem = mem;
+    ht->filter_blocks = blocks;
+    memset(ht->filter, 0, bytes);
+    // add the keys already in the table, in every layer
+    for (hashtable_t* layer = ht; layer != NULL; layer = layer->delta) {
+        for (int i = 0; i < layer->num_slots; i++) {
+            for (setnode_t* node = layer->slots[i]->head; node != NULL; node = node->next) {
+                filter_add(ht, key_hash(ht, node->key));
+            }
         }
     }
+    return true;
+}
+
+/**************** hashtable_memory_usage() ****************/
+/* see hashtable.h for description */
+
+size_t hashtable_memory_usage(hashtable_t* ht){
+    if (ht == NULL) {
+        return 0;
+    }
+    // the structure and its slot array are one block
+    size_t requested = sizeof(hashtable_t) + ht->num_slots * sizeof(set_t*);
+    size_t bytes = requested;
+    if (ht_usable != NULL && ht_usable(ht) > requested) {
+        bytes = ht_usable(ht);  // requested bytes plus slack
+    }
+    if (ht->filter_mem != NULL) {
+        bytes += (ht->filter_blocks + 1) * FILTER_WORDS * sizeof(uint64_t);
+    }
+    for (int i = 0; i < ht->num_slots; i++) {
+        bytes += set_memory_usage(ht->slots[i]);
+    }
+    if (ht->delta != NULL) {
+        bytes += hashtable_memory_usage(ht->delta); // layers kept for snapshots
+    }
+    return bytes;
+}
+
+/**************** hashtable_allocator() ****************/
+/* see hashtable.h for description */
+
+void hashtable_allocator(void* (*allocfn)(size_t size), void (*freefn)(void* ptr),
+                         size_t (*sizefn)(void* ptr)){
+    if (allocfn == NULL || freefn == NULL) {
+        ht_malloc = malloc;
+        ht_free = free;
+#ifdef __GLIBC__
+        ht_usable = malloc_usable_size;
+#else
+        ht_usable = NULL;
+#endif
+    } else {
+        ht_malloc = allocfn;
+        ht_free = freefn;
+        ht_usable = sizefn;
+    }
+    set_allocator(allocfn, freefn, sizefn); // the slot sets follow suit
+}
+
+/**************** hashtable_journal() ****************/
+/* see hashtable.h for description */
+
+bool hashtable_journal(hashtable_t* ht, journal_t* journal, size_t (*itemsize)(void* item)){
+    if (ht == NULL || (journal != NULL && itemsize == NULL)) {
+        return false;
+    }
+    ht->journal = journal;
+    ht->itemsize = itemsize;
+    return true;
+}
+
+/**************** hashtable_replay() ****************/
+/* see hashtable.h for description */
+
+long hashtable_replay(hashtable_t* ht, const char* path,
+    void* (*itemload)(const void* bytes, const size_t len),
+    void (*itemdelete)(void* item)){
+    if (ht == NULL || path == NULL || itemload == NULL) {
+        return -1;
+    }
+    replay_t replay = { ht, itemload, itemdelete };
+    journal_t* journal = ht->journal;
+    ht->journal = NULL;           // don't log the changes we replay
+    long records = journal_replay(path, &replay, replay_one);
+    ht->journal = journal;
+    return records;
+}
+
+/**************** hashtable_snapshot() ****************/
+/* see hashtable.h for description */
+
+hashtable_snapshot_t* hashtable_snapshot(hashtable_t* ht){
+    if (ht == NULL) {
+        return NULL;
+    }
+    hashtable_snapshot_t* snap = ht_malloc(sizeof(hashtable_snapshot_t));
+    if (snap == NULL) {
+        return NULL;
+    }
+    snap->table = ht;
+    snap->last = ht->bottom;
+    // a layer partly folded up may get its folded slots back from a
+    // newer layer before it folds again, so it starts over from slot 0
+    snap->last->fold = 0;
+    // from now on, writes leave the newest layer alone
+    atomic_fetch_add_explicit(&snap->last->pins, 1, memory_order_acq_rel);
+    return snap;
+}
+
+/**************** hashtable_snapshot_find() ****************/
+/* see hashtable.h for description */
+
+void* hashtable_snapshot_find(hashtable_snapshot_t* snap, const char* key){
+    if (snap == NULL || key == NULL) {
+        return NULL;
+    }
+    unsigned long hash = key_hash(snap->table, key) % snap->table->num_slots;
+    for (hashtable_t* layer = snap->table; ; layer = layer->delta) {
+        void* item = set_find(layer->slots[hash], key);
+        if (item != NULL || layer == snap->last) {
+            return item;
+        }
+    }
+}
+
+/**************** hashtable_snapshot_iterate() ****************/
+/* see hashtable.h for description */
+
+void hashtable_snapshot_iterate(hashtable_snapshot_t* snap, void* arg,
+    void (*itemfunc)(void* arg, const char* key, void* item) ){
+    if (snap != NULL && itemfunc != NULL) {
+        for (hashtable_t* layer = snap->table; ; layer = layer->delta) {
+            for (int i = 0; i < layer->num_slots; i++) {
+                set_iterate(layer->slots[i], arg, itemfunc);
+            }
+            if (layer == snap->last) {
+                break;
+            }
+        }
+    }
+}
+
+/**************** hashtable_snapshot_release() ****************/
+/* see hashtable.h for description */
+
+void hashtable_snapshot_release(hashtable_snapshot_t* snap){
+    if (snap != NULL) {
+        // our reads of the layers happen before the writer's next change
+        atomic_fetch_sub_explicit(&snap->last->pins, 1, memory_order_release);
+        ht_free(snap);
+    }
 }
 
 /**************** hashtable_delete() ****************/
@@ -166,12 +1603,15 @@ void hashtable_iterate(hashtable_t* ht, void* arg,
 
 void hashtable_delete(hashtable_t* ht, void (*itemdelete)(void* item)){
     // check if the hashtable is not NULL
-    if (ht != NULL && itemdelete != NULL) {
-        // iterate over each slot in the hashtable
+    if (ht != NULL) {
+        // iterate over each slot in the hashtable; itemdelete may be NULL
         for (int i = 0; i < ht->num_slots; i++) { 
             set_delete(ht->slots[i],itemdelete); // delete each slot
         }
+        if (ht->filter_mem != NULL) {
+            ht_free(ht->filter_mem);
+        }
+        hashtable_delete(ht->delta, itemdelete); // any newer layers
+        ht_free(ht);   // the slots array lives inside the hashtable structure
     }
-    free(ht->slots);
-    free(ht);
 }
@@ -13,9 +13,56 @@
 
 #include <stdio.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "journal.h"
 
 /**************** global types ****************/
 typedef struct hashtable hashtable_t;  // opaque to users of the module
+typedef struct hashtable_snapshot hashtable_snapshot_t;  // see hashtable_snapshot
+
+/* chain lengths of HASHTABLE_HIST-1 or more share the last histogram bucket */
+#define HASHTABLE_HIST 16
+
+/* statistics filled in by hashtable_stats */
+typedef struct hashtable_stats {
+  // computed from the slots on each call; always available
+  int num_slots;                 // number of slots
+  long items;                    // number of (key,item) pairs
+  double load_factor;            // items / num_slots
+  long chain_hist[HASHTABLE_HIST]; // chain_hist[i] = slots holding i items
+  int max_chain;                 // longest chain
+  long collisions;               // items sharing a slot with another item
+  int layers;                    // 1, plus layers kept for snapshots
+  unsigned long reseeds;         // rehashes under a new seed (see hashtable_seed)
+  // counted on the hot path; all zero unless built with -DHASHTABLE_STATS
+  int sample_rate;               // 1 in sample_rate operations is recorded
+  unsigned long lookups;         // calls to hashtable_find (estimated)
+  unsigned long hits;            // lookups that found their key (estimated)
+  unsigned long misses;          // lookups that did not (estimated)
+  double hit_ratio;              // hits / lookups
+  double mean_probes;            // keys compared per sampled lookup
+  unsigned long inserts;         // calls to hashtable_insert (estimated)
+  unsigned long insert_collisions; // inserts into a non-empty slot (estimated)
+  // the membership filter; all zero unless hashtable_filter turned it on
+  size_t filter_bytes;           // size of the filter
+  unsigned long filter_passes;   // lookups the filter passed on to the slots
+  unsigned long filter_rejects;  // lookups the filter answered "absent" alone
+  unsigned long filter_false_positives; // passes that then found no key
+  double filter_fp_rate;         // false positives / (false positives + rejects)
+} hashtable_stats_t;
+
+/* one lookup done in stages; see hashtable_lookup_start.  A plain struct,
+ * so callers can keep one in each request; only key and item are theirs
+ * to read, and none of it theirs to write */
+typedef struct hashtable_lookup {
+  const char* key;               // the key sought
+  void* item;                    // its item once done; NULL if not found
+  unsigned long hash;            // the key's full hash
+  const void* next;              // what the next stage reads
+  int stage;                     // the next stage
+  bool sampled;                  // recorded in the stats (-DHASHTABLE_STATS)
+} hashtable_lookup_t;
 
 /**************** functions ****************/
 
@@ -30,6 +77,13 @@ typedef struct hashtable hashtable_t;  // opaque to users of the module
  *   hashtable is initialized empty.
  * Caller is responsible for:
  *   later calling hashtable_delete.
+ * Notes:
+ *   Each table hashes keys with SipHash under its own random seed, so
+ *   which keys share a slot, and the order of hashtable_print and
+ *   hashtable_iterate, differ from table to table and run to run; see
+ *   hashtable_seed.  If a chain still grows far past the mean, as when
+ *   keys are chosen to collide, the table rehashes itself under a new
+ *   seed, bounding the work of every lookup.
  */
 hashtable_t* hashtable_new(const int num_slots);
 
@@ -58,10 +112,96 @@ bool hashtable_insert(hashtable_t* ht, const char* key, void* item);
  *   pointer to the item corresponding to the given key, if found;
  *   NULL if hashtable is NULL, key is NULL, or key is not found.
  * Notes:
- *   the hashtable is unchanged by this operation.
+ *   the hashtable is unchanged by this operation, but for the filter's
+ *   counts and, with -DHASHTABLE_STATS, the lookup counts (see
+ *   hashtable_stats), which are relaxed atomics: finds may run in
+ *   parallel with each other, and then may miss a few counts.
  */
 void* hashtable_find(hashtable_t* ht, const char* key);
 
+/**************** hashtable_lookup_start ****************/
+/* Start finding key in stages, so that many lookups can share the wait
+ * for memory: each stage asks for the next cache line it will need, and
+ * returns, rather than waiting for it (as in AMAC, Kocberber et al., 2015).
+ *
+ * Caller provides:
+ *   valid pointer to hashtable, a lookup to fill in, the key sought.
+ * We return:
+ *   true if the lookup is already done (lookup->item holds the result;
+ *   ht or key is NULL); false if it needs hashtable_lookup_step.
+ * We do:
+ *   hash the key and prefetch the first line the lookup will need: the
+ *   filter block if there is a filter, else the slot.
+ * Notes:
+ *   Between start and done, do other work, such as the next stages of
+ *   other lookups, while the line arrives.  The table must not change
+ *   until every unfinished lookup is done.
+ */
+bool hashtable_lookup_start(hashtable_t* ht, hashtable_lookup_t* lookup, const char* key);
+
+/**************** hashtable_lookup_step ****************/
+/* Run the next stage of a lookup: read the line the last stage
+ * prefetched, and prefetch the one after.
+ *
+ * We return:
+ *   true once the lookup is done, when lookup->item holds the item found,
+ *   or NULL; false if it needs another step.  A lookup takes about four
+ *   steps, one per line: the filter block, the slot, its set, and each
+ *   key compared.
+ * Notes:
+ *   Like hashtable_find, changes nothing but the counts.
+ */
+bool hashtable_lookup_step(hashtable_t* ht, hashtable_lookup_t* lookup);
+
+/**************** hashtable_find_many ****************/
+/* Find n keys at once: items[i] = hashtable_find(ht, keys[i]), but with
+ * up to 16 lookups in flight, each stepped in turn, so that their
+ * memory stalls overlap instead of adding up.
+ *
+ * We do:
+ *   nothing if items is NULL or n <= 0; set every items[i] to NULL if ht
+ *   or keys is NULL.
+ * Notes:
+ *   Much faster than n calls to hashtable_find when the table is larger
+ *   than the caches (about 4x at a million keys), but about 2x slower
+ *   when it fits in them, where the bookkeeping costs more than the
+ *   stalls it hides; use hashtable_find on small tables.  Counted in the
+ *   stats as n calls to hashtable_find.
+ */
+void hashtable_find_many(hashtable_t* ht, const char** keys, void** items, const int n);
+
+/**************** hashtable_remove ****************/
+/* Remove the pair with the given key, and return its item.
+ *
+ * Caller provides:
+ *   valid pointer to hashtable, valid string for key.
+ * We return:
+ *   the item that was paired with key, now the caller's again;
+ *   NULL if hashtable is NULL, key is NULL, or key is not found.
+ * We do:
+ *   free our copy of the key.
+ * Notes:
+ *   a filter (see hashtable_filter) cannot forget a key, so lookups of
+ *   removed keys count as filter false positives until it is rebuilt.
+ */
+void* hashtable_remove(hashtable_t* ht, const char* key);
+
+/**************** hashtable_replace ****************/
+/* Pair key with a new item, and return the old one.
+ *
+ * Caller provides:
+ *   valid pointer to hashtable, valid string for key, valid pointer for item.
+ * We return:
+ *   the item that was paired with key, now the caller's again;
+ *   NULL if any parameter is NULL, key is not found, or a snapshot sees
+ *   the key (see hashtable_snapshot), and then nothing changes.
+ * Notes:
+ *   One lookup and no allocation, unlike a remove and an insert; a
+ *   journal logs it as one record, replayed as both, so a crash keeps
+ *   the old item or the new one, never neither.
+ */
+void* hashtable_replace(hashtable_t* ht, const char* key, void* item);
+
 /**************** hashtable_print ****************/
 /* Print the whole table; provide the output file and func to print each item.
  * 
@@ -98,6 +238,280 @@ void hashtable_print(hashtable_t* ht, FILE* fp,
 void hashtable_iterate(hashtable_t* ht, void* arg,
                        void (*itemfunc)(void* arg, const char* key, void* item) );
 
+/**************** hashtable_scan ****************/
+/* Iterate over the table a little at a time, like Redis SCAN, so that a
+ * long walk can be interleaved with other work on the table.
+ *
+ * Caller provides:
+ *   valid pointer to hashtable,
+ *   cursor: 0 to start a scan, else the cursor the last call returned,
+ *   budget: roughly how much work to do in this call (at least 1),
+ *   arbitrary void*arg pointer, and itemfunc as for hashtable_iterate.
+ * We return:
+ *   the cursor to pass to the next call; 0 once the scan is complete,
+ *   or if ht or itemfunc is NULL or the cursor is past the end.
+ * We do:
+ *   call itemfunc on every pair in the next few slots.  Each slot
+ *   visited and each pair handled costs 1, and we stop once we have
+ *   spent budget, but only between slots, so a long chain may overspend.
+ * Notes:
+ *   The cursor is a slot number, and a key's slot only changes when the
+ *   table is rehashed under a new seed: layers started for snapshots,
+ *   and folded back later, share the table's slots.  So the table may
+ *   change between calls: every pair that is in the table from the first
+ *   call to the last is handled exactly once; pairs inserted or removed
+ *   meanwhile may or may not be.  The cursor also records how often the
+ *   table had been rehashed; if it has been rehashed since, the scan
+ *   starts over from the first slot, and every such pair is handled at
+ *   least once.  Within a call, itemfunc must not insert or remove pairs.
+ */
+unsigned long hashtable_scan(hashtable_t* ht, unsigned long cursor, const long budget,
+                             void* arg,
+                             void (*itemfunc)(void* arg, const char* key, void* item) );
+
+/**************** hashtable_scan_print ****************/
+/* Print the table a little at a time: hashtable_scan, but printing each
+ * slot visited as hashtable_print does.  If the table has one layer (see
+ * hashtable_stats) and does not change between calls, a whole scan prints
+ * exactly what hashtable_print does.
+ * We return:
+ *   the next cursor, as hashtable_scan; 0 if fp is NULL, and 0 after
+ *   printing "(null)" if ht is NULL.
+ */
+unsigned long hashtable_scan_print(hashtable_t* ht, unsigned long cursor, const long budget,
+                                   FILE* fp,
+                                   void (*itemprint)(FILE* fp, const char* key, void* item));
+
+/**************** hashtable_merge_many ****************/
+/* Merge many hashtables into dest at once, on several threads.
+ *
+ * Caller provides:
+ *   valid pointer to hashtable dest, empty or not, without snapshots;
+ *   an array of nsrcs valid pointers to hashtables, none of them dest;
+ *   nthreads >= 1, the most threads to use;
+ *   merge(arg, key, item, other), which returns the item to keep when
+ *   key is in more than one table (NULL to keep item), or NULL to keep
+ *   the first item.
+ * We return:
+ *   false if dest is NULL or has snapshots, srcs is NULL (nsrcs > 0), a
+ *   source is NULL or dest, nsrcs < 0, nthreads < 1, or out of memory
+ *   (dest may then hold part of the merge); true otherwise.
+ * We do:
+ *   leave in dest every key of dest and the sources.  A key in several
+ *   of them gets their items folded by merge in order: dest's first,
+ *   then the sources' in array order.
+ *   hash every source key on the thread that reads it, then hand it to
+ *   the thread that owns its slot of dest: each thread owns a range of
+ *   dest's slots, and no other thread touches them.
+ * Notes:
+ *   dest holds the sources' item pointers, not copies; delete the
+ *   sources with a NULL itemdelete, and have merge free any item it
+ *   drops.  merge is called from several threads at once, each key on
+ *   one of them; so is the allocator, which must then be thread-safe
+ *   (malloc is).  Small merges use fewer threads.  The sources are
+ *   unchanged, and none may change during the call.
+ */
+bool hashtable_merge_many(hashtable_t* dest, hashtable_t** srcs, const int nsrcs,
+                          const int nthreads, void* arg,
+                          void* (*merge)(void* arg, const char* key, void* item, void* other));
+
+/**************** hashtable_seed ****************/
+/* Rehash every key under the given seed, instead of the random one.
+ *
+ * Caller provides:
+ *   valid pointer to hashtable, and any seed.
+ * We return:
+ *   false if ht is NULL or has snapshots (see hashtable_snapshot), which
+ *   share its slots; true otherwise.
+ * Notes:
+ *   Tables with the same seed, slots and keys print and iterate in the
+ *   same order, for tests and reproducible runs.  A seed known to others
+ *   lets them choose colliding keys again, though the chain-length guard
+ *   still rehashes under a random seed when a chain grows too long.
+ *   Costs one pass over the keys; a scan in progress starts over.
+ */
+bool hashtable_seed(hashtable_t* ht, const uint64_t seed);
+
+/**************** hashtable_stats ****************/
+/* Report chain lengths, load factor and operation counts.
+ *
+ * Caller provides:
+ *   valid pointer to hashtable, valid pointer to a stats structure.
+ * We return:
+ *   false if either pointer is NULL; true otherwise.
+ * We do:
+ *   walk every slot to compute the structural statistics, and copy out
+ *   the operation counters.
+ * Notes:
+ *   This call is O(items); the hashtable is unchanged.
+ *   Operation counters exist only when the module is compiled with
+ *   -DHASHTABLE_STATS (see Makefile); otherwise they cost nothing and
+ *   read as zero.  In sampled mode the counts are estimates: the
+ *   recorded counts multiplied by the sample rate.
+ */
+bool hashtable_stats(hashtable_t* ht, hashtable_stats_t* stats);
+
+/**************** hashtable_stats_sample ****************/
+/* Record only one in every `rate` operations, for low-overhead use in
+ * production.
+ *
+ * Caller provides:
+ *   valid pointer to hashtable, rate (a power of 2, >= 1).
+ * We return:
+ *   false if ht is NULL, rate is not a power of 2, or the module was
+ *   built without -DHASHTABLE_STATS; true otherwise.
+ * Notes:
+ *   the default rate is 1, meaning every operation is recorded.
+ *   changing the rate resets the operation counters.
+ */
+bool hashtable_stats_sample(hashtable_t* ht, const int rate);
+
+/**************** hashtable_filter ****************/
+/* Put a membership filter in front of the slots, so that most lookups
+ * of absent keys are answered without walking a chain.
+ *
+ * Caller provides:
+ *   valid pointer to hashtable,
+ *   the number of keys the table is expected to hold, or 0 for no filter.
+ * We return:
+ *   false if ht is NULL, expected < 0, or out of memory (the table is
+ *   then left with no filter); true otherwise.
+ * We do:
+ *   replace any earlier filter with a blocked Bloom filter of about 10
+ *   bits per expected key, in 64-byte blocks; add every key already in
+ *   the table; from then on, add each key hashtable_insert inserts.
+ *   hashtable_find checks one block, and returns NULL at once if the
+ *   key is surely absent.
+ * Notes:
+ *   At the expected size, about 1 in 100 absent keys gets past the
+ *   filter (see filter_fp_rate in hashtable_stats); beyond it, the
+ *   rate grows, and it is worth calling hashtable_filter again with a
+ *   larger size.  Present keys always get past it.  Turning the filter
+ *   on or off resets its counts.
+ */
+bool hashtable_filter(hashtable_t* ht, const long expected);
+
+/**************** hashtable_memory_usage ****************/
+/* Return the number of bytes of memory the hashtable uses.
+ *
+ * Caller provides:
+ *   valid pointer to hashtable.
+ * We return:
+ *   0 if ht is NULL;
+ *   otherwise the bytes in the hashtable structure and its slot array,
+ *   its filter, if any,
+ *   the set in each slot, every node and key string, plus allocator
+ *   slack when the allocator can report it.
+ * Notes:
+ *   Items are not counted; they belong to the caller.
+ *   The hashtable is unchanged; this call is O(items + slots).
+ */
+size_t hashtable_memory_usage(hashtable_t* ht);
+
+/**************** hashtable_allocator ****************/
+/* Replace the functions used to allocate and free all hashtable memory.
+ *
+ * Caller provides:
+ *   allocfn and freefn, a matching pair like malloc and free;
+ *   sizefn, which returns the usable size of a block (may be NULL).
+ * We do:
+ *   if allocfn or freefn is NULL, go back to malloc and free.
+ *   otherwise, use allocfn/freefn for the tables, slot sets, nodes and
+ *   keys allocated from now on, and sizefn (if any) to count allocator
+ *   slack in hashtable_memory_usage.
+ * Notes:
+ *   The allocator is shared by all hashtables (and their sets); change
+ *   it only while no hashtable exists.
+ */
+void hashtable_allocator(void* (*allocfn)(size_t size), void (*freefn)(void* ptr),
+                         size_t (*sizefn)(void* ptr));
+
+/**************** hashtable_journal ****************/
+/* Log every later change to the table in a journal (see journal.h), so
+ * that hashtable_replay can rebuild the table after a restart.
+ *
+ * Caller provides:
+ *   valid pointer to hashtable,
+ *   an open journal, or NULL to stop logging,
+ *   itemsize, which returns the number of bytes at an item to log with
+ *   it (such as strlen + 1 for strings); required with a journal.
+ * We return:
+ *   false if ht is NULL, or journal is given without itemsize; true otherwise.
+ * We do:
+ *   from now on, each successful hashtable_insert logs the key and the
+ *   item's bytes, and each successful hashtable_remove logs the key.
+ *   Logging only copies the record into the journal's buffer; the
+ *   journal's thread writes it later, so the table's writer never waits
+ *   for the disk.  Call journal_sync when changes must be durable.
+ * Notes:
+ *   Items are logged as bytes, so they should not hold pointers.
+ *   Close the journal only after detaching it, or deleting the table.
+ */
+bool hashtable_journal(hashtable_t* ht, journal_t* journal, size_t (*itemsize)(void* item));
+
+/**************** hashtable_replay ****************/
+/* Replay a journal file into the table: redo its inserts and removes.
+ *
+ * Caller provides:
+ *   valid pointer to hashtable (usually new and empty),
+ *   path of a journal file written through hashtable_journal,
+ *   itemload, which makes an item from the bytes logged for it (it may
+ *   return NULL to skip the pair),
+ *   itemdelete, for items of removed pairs, or of inserts that fail
+ *   (may be NULL).
+ * We return:
+ *   the number of records replayed; -1 if any pointer but itemdelete is
+ *   NULL, or the file cannot be read.
+ * Notes:
+ *   Replaying is not logged, even if the table has a journal.  The file
+ *   is read sequentially in one pass; a record torn by a crash ends it.
+ */
+long hashtable_replay(hashtable_t* ht, const char* path,
+                      void* (*itemload)(const void* bytes, const size_t len),
+                      void (*itemdelete)(void* item));
+
+/**************** hashtable_snapshot ****************/
+/* Take a consistent, read-only view of the hashtable, in O(1).
+ *
+ * Caller provides:
+ *   valid pointer to hashtable.
+ * We return:
+ *   a snapshot of the pairs in the table now; NULL if ht is NULL or out
+ *   of memory.
+ * We do:
+ *   freeze the table as it is.  Later inserts go to a new layer that the
+ *   snapshot does not see, and are folded back into the table a few slots
+ *   per write once no snapshot needs the old layers.
+ * Notes:
+ *   Take the snapshot on the writer's thread (or under the writer's
+ *   lock); it may then be read and released on any thread, while the
+ *   writer carries on.  Items are shared with the table, not copied.
+ *   While a snapshot is held, hashtable_find checks each layer, and
+ *   hashtable_remove fails (returns NULL) on keys the snapshot sees.
+ * Caller is responsible for:
+ *   later calling hashtable_snapshot_release, before hashtable_delete.
+ */
+hashtable_snapshot_t* hashtable_snapshot(hashtable_t* ht);
+
+/**************** hashtable_snapshot_find ****************/
+/* Like hashtable_find, but in the snapshot; NULL if snap or key is NULL,
+ * or the key was not in the table when the snapshot was taken.
+ */
+void* hashtable_snapshot_find(hashtable_snapshot_t* snap, const char* key);
+
+/**************** hashtable_snapshot_iterate ****************/
+/* Like hashtable_iterate, but over the pairs in the snapshot; nothing if
+ * snap or itemfunc is NULL.
+ */
+void hashtable_snapshot_iterate(hashtable_snapshot_t* snap, void* arg,
+                                void (*itemfunc)(void* arg, const char* key, void* item) );
+
+/**************** hashtable_snapshot_release ****************/
+/* Let go of a snapshot, on any thread; ignore NULL snap.  The snapshot
+ * must not be used afterwards.
+ */
+void hashtable_snapshot_release(hashtable_snapshot_t* snap);
+
 /**************** hashtable_delete ****************/
 /* Delete hashtable, calling a delete function on each item.
  *
@@ -111,6 +525,7 @@ void hashtable_iterate(hashtable_t* ht, void* arg,
  * Notes:
  *   We free the strings that represent key for each item, because 
  *   this module allocated that memory in hashtable_insert.
+ *   Release every snapshot of the table first.
  */
 void hashtable_delete(hashtable_t* ht, void (*itemdelete)(void* item) );
 
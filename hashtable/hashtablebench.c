@@ -0,0 +1,802 @@
+/*
+ * hashtablebench.c - benchmark driver for hashtable module
+ *
+ * usage: hashtablebench [maxsize [seed]]
+ *
+ * For each size n = 10, 100, ... maxsize, builds a hashtable of n slots
+ * holding n string keys and times insert, hit-find, miss-find, iterate
+ * and delete, with uniform and Zipfian lookup streams, then repeats the
+ * lookups in batches with hashtable_find_many (module `batched`) and
+ * with a membership filter (module `filtered`; see hashtable_filter),
+ * and runs a Zipfian read-through stream against a bounded cache (module
+ * `cache`; see cache.h).  Finally it rebuilds the table with the page
+ * allocator of ../lib/pages.h, once per placement (modules `pages_*`),
+ * and repeats the uniform hit lookups, so the effect of huge pages and
+ * NUMA placement shows against plain mmap'd pages.  Module `journaled`
+ * times inserts logged to a journal (see ../lib/journal.h), and replaying
+ * that journal into an empty table.  Module `shmtable` times copying
+ * the table into shared memory, attaching to it, and uniform hit lookups
+ * through the attached, read-only mapping (see shmtable.h).  Last, it
+ * merges SHARDS tables of about n keys each, by hashtable_iterate into
+ * the destination and by hashtable_merge_many on 1 and MERGE_THREADS
+ * threads.  Module `ingest` feeds n updates from INGEST_PRODUCERS threads
+ * to a table owned by the main thread, through a mutex-protected list
+ * with one insert per message (op `mutex_list`) and through an ingest
+ * queue drained in batches (op `ring`; see ingest.h).
+ * Prints CSV (see bench.h) to stdout.
+ * The same seed always produces the same workload.
+ *
+ * Adwiteeya Rupantee Paul, April 2025
+ */
+
+#define _POSIX_C_SOURCE 200809L   // sched_yield, for the ingest rows
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+#include "hashtable.h"
+#include "inttable.h"
+#include "cache.h"
+#include "shmtable.h"
+#include "ingest.h"
+#include "bench.h"
+#include "pages.h"
+#include "journal.h"
+
+/**************** file-local global variables ****************/
+static const uint64_t MINOPS = 100000;  // time at least this many ops per row
+static const int CHUNK = 4096;          // lookups generated per timed chunk
+static const double THETA = 0.99;       // Zipfian skew
+static const int SHARDS = 8;            // tables merged by the merge rows
+static const int MERGE_THREADS = 4;     // threads for the parallel merge row
+#define INGEST_PRODUCERS 2              // producer threads for the ingest rows
+static const long INGEST_CAPACITY = 4096;  // cells in the ingest ring
+
+/**************** file-local global types ****************/
+/* one message on the mutex-protected list of the ingest baseline */
+typedef struct message {
+    const char* key;
+    void* item;
+    struct message* next;
+} message_t;
+
+/* what one ingest producer thread sends, and where */
+typedef struct producer {
+    const char* keys;            // the bench's key arena
+    uint64_t n;                  // keys in it
+    uint64_t count;              // messages to send
+    uint64_t seed;               // which keys, uniformly
+    ingest_t* queue;             // the ring; NULL to use the list below
+    pthread_mutex_t* lock;       // guards head and tail
+    message_t** head;
+    message_t*** tail;
+} producer_t;
+
+/**************** local functions ****************/
+static void bench_size(const uint64_t n, const uint64_t seed);
+static void bench_find(hashtable_t* ht, const char* module, const char* keys,
+                       const uint64_t* popular, const uint64_t n, const bool hit,
+                       const bool zipf, const uint64_t seed);
+static void bench_find_many(hashtable_t* ht, const char* keys, const uint64_t* popular,
+                            const uint64_t n, const bool hit, const bool zipf,
+                            const uint64_t seed);
+static void bench_cache(const char* keys, const uint64_t* popular,
+                        const uint64_t n, const uint64_t seed);
+static void bench_placement(const char* keys, const uint64_t* order,
+                            const uint64_t* popular, const uint64_t n,
+                            const uint64_t seed);
+static void bench_journal(const char* keys, const uint64_t* order, const uint64_t n);
+static void bench_shared(const char* keys, const uint64_t* order, const uint64_t* popular,
+                         const uint64_t n, const uint64_t seed);
+static void bench_merge(const uint64_t n, const uint64_t seed);
+static void bench_ingest(const char* keys, const uint64_t n, const uint64_t seed);
+static void* produce(void* arg);
+static void mergeinsert(void* arg, const char* key, void* item);
+static size_t itemsize(void* item);
+static void* itemload(const void* bytes, const size_t len);
+static void itemcount(void* arg, const char* key, void* item);
+static void bench_intkeys(const uint64_t n, const uint64_t seed, const bool itoa);
+static bool int_insert(void* table, const bool itoa, const uint64_t key, void* item);
+static void* int_find(void* table, const bool itoa, const uint64_t key);
+
+/* **************************************** */
+int
+main(const int argc, char* argv[])
+{
+    uint64_t maxsize, seed;
+    if (!bench_args(argc, argv, &maxsize, &seed)) {
+        return 1;
+    }
+    bench_header(stdout);
+    for (uint64_t n = 10; n <= maxsize; n *= 10) {
+        bench_size(n, seed);
+        bench_intkeys(n, seed, false);
+        bench_intkeys(n, seed, true);
+    }
+    return 0;
+}
+
+/**************** bench_size() ****************/
+/* run every operation for one structure size */
+static void
+bench_size(const uint64_t n, const uint64_t seed)
+{
+    char* keys = bench_keys(0, n);          // keys that get inserted
+    char* misses = bench_keys(n, n);        // keys that never do
+    uint64_t* order = bench_permutation(n, seed);        // insert order
+    uint64_t* popular = bench_permutation(n, seed + 1);  // rank -> key
+    if (keys == NULL || misses == NULL || order == NULL || popular == NULL) {
+        fprintf(stderr, "hashtablebench: out of memory at n=%llu\n", (unsigned long long)n);
+        exit(2);
+    }
+    uint64_t reps = n < MINOPS ? MINOPS / n : 1;
+    uint64_t tins = 0, ains = 0, tdel = 0, adel = 0;
+    hashtable_t* ht = NULL;
+
+    // insert and delete: rebuild the table reps times
+    for (uint64_t r = 0; r < reps; r++) {
+        if (ht != NULL) {
+            uint64_t a0 = bench_allocs(), t0 = bench_now();
+            hashtable_delete(ht, NULL);
+            tdel += bench_now() - t0;
+            adel += bench_allocs() - a0;
+        }
+        uint64_t a0 = bench_allocs(), t0 = bench_now();
+        ht = hashtable_new(n);
+        hashtable_seed(ht, seed);           // the same slots every run
+        for (uint64_t i = 0; i < n; i++) {
+            hashtable_insert(ht, keys + order[i] * BENCH_KEYLEN, keys);
+        }
+        tins += bench_now() - t0;
+        ains += bench_allocs() - a0;
+    }
+    bench_report(stdout, "hashtable", "insert", "uniform", n, n * reps, tins, ains);
+
+    // lookups
+    bench_find(ht, "hashtable", keys, popular, n, true, false, seed);
+    bench_find(ht, "hashtable", keys, popular, n, true, true, seed);
+    bench_find(ht, "hashtable", misses, popular, n, false, false, seed);
+    bench_find(ht, "hashtable", misses, popular, n, false, true, seed);
+
+    // the same lookups, sixteen in flight at a time
+    bench_find_many(ht, keys, popular, n, true, false, seed);
+    bench_find_many(ht, keys, popular, n, true, true, seed);
+    bench_find_many(ht, misses, popular, n, false, false, seed);
+
+    // the same lookups behind a membership filter
+    hashtable_filter(ht, n);
+    bench_find(ht, "filtered", keys, popular, n, true, false, seed);
+    bench_find(ht, "filtered", misses, popular, n, false, false, seed);
+    hashtable_filter(ht, 0);
+
+    // the same keys, read through a cache holding a tenth of them
+    bench_cache(keys, popular, n, seed);
+
+    // iterate
+    uint64_t count = 0;
+    uint64_t a0 = bench_allocs(), t0 = bench_now();
+    for (uint64_t r = 0; r < reps; r++) {
+        hashtable_iterate(ht, &count, itemcount);
+    }
+    bench_report(stdout, "hashtable", "iterate", "uniform", n, n * reps,
+                 bench_now() - t0, bench_allocs() - a0);
+    if (count != n * reps) {
+        fprintf(stderr, "hashtablebench: iterate saw %llu items, expected %llu\n",
+                (unsigned long long)count, (unsigned long long)(n * reps));
+    }
+
+    // the last delete
+    a0 = bench_allocs();
+    t0 = bench_now();
+    hashtable_delete(ht, NULL);
+    tdel += bench_now() - t0;
+    adel += bench_allocs() - a0;
+    bench_report(stdout, "hashtable", "delete", "uniform", n, n * reps, tdel, adel);
+
+    // the same table on placed pages
+    bench_placement(keys, order, popular, n, seed);
+
+    // the same inserts, logged to a journal
+    bench_journal(keys, order, n);
+
+    // the same table, in shared memory
+    bench_shared(keys, order, popular, n, seed);
+
+    // many tables, merged into one
+    bench_merge(n, seed);
+
+    // updates from other threads, handed to the table's owner
+    bench_ingest(keys, n, seed);
+
+    free(keys);
+    free(misses);
+    free(order);
+    free(popular);
+}
+
+/**************** bench_find() ****************/
+/* time a stream of lookups, drawn uniformly or by Zipfian popularity */
+static void
+bench_find(hashtable_t* ht, const char* module, const char* keys,
+           const uint64_t* popular, const uint64_t n, const bool hit,
+           const bool zipf, const uint64_t seed)
+{
+    uint64_t ops = n < MINOPS ? MINOPS : n;
+    uint64_t* batch = malloc(CHUNK * sizeof(uint64_t));
+    bench_rand_t rng;
+    bench_zipf_t zipfgen;
+    if (batch == NULL) {
+        fprintf(stderr, "hashtablebench: out of memory\n");
+        exit(2);
+    }
+    bench_rand_init(&rng, seed + 2);
+    if (zipf) {
+        bench_zipf_init(&zipfgen, n, THETA, seed + 2);
+    }
+
+    uint64_t elapsed = 0, allocs = 0, found = 0;
+    for (uint64_t done = 0; done < ops; done += CHUNK) {
+        int len = ops - done < CHUNK ? ops - done : CHUNK;
+        // generate the next chunk of keys outside the timed region
+        for (int i = 0; i < len; i++) {
+            uint64_t rank = zipf ? bench_zipf_next(&zipfgen) : bench_rand_below(&rng, n);
+            batch[i] = popular[rank];
+        }
+        uint64_t a0 = bench_allocs(), t0 = bench_now();
+        for (int i = 0; i < len; i++) {
+            if (hashtable_find(ht, keys + batch[i] * BENCH_KEYLEN) != NULL) {
+                found++;
+            }
+        }
+        elapsed += bench_now() - t0;
+        allocs += bench_allocs() - a0;
+    }
+    bench_report(stdout, module, hit ? "find_hit" : "find_miss",
+                 zipf ? "zipf" : "uniform", n, ops, elapsed, allocs);
+    if (found != (hit ? ops : 0)) {
+        fprintf(stderr, "hashtablebench: %llu of %llu lookups found\n",
+                (unsigned long long)found, (unsigned long long)ops);
+    }
+    free(batch);
+}
+
+/**************** bench_find_many() ****************/
+/* time the same stream of lookups as bench_find, a chunk at a time
+ * through hashtable_find_many */
+static void
+bench_find_many(hashtable_t* ht, const char* keys, const uint64_t* popular,
+                const uint64_t n, const bool hit, const bool zipf,
+                const uint64_t seed)
+{
+    uint64_t ops = n < MINOPS ? MINOPS : n;
+    const char** batch = malloc(CHUNK * sizeof(char*));
+    void** items = malloc(CHUNK * sizeof(void*));
+    bench_rand_t rng;
+    bench_zipf_t zipfgen;
+    if (batch == NULL || items == NULL) {
+        fprintf(stderr, "hashtablebench: out of memory\n");
+        exit(2);
+    }
+    bench_rand_init(&rng, seed + 2);
+    if (zipf) {
+        bench_zipf_init(&zipfgen, n, THETA, seed + 2);
+    }
+
+    uint64_t elapsed = 0, allocs = 0, found = 0;
+    for (uint64_t done = 0; done < ops; done += CHUNK) {
+        int len = ops - done < CHUNK ? ops - done : CHUNK;
+        // generate the next chunk of keys outside the timed region
+        for (int i = 0; i < len; i++) {
+            uint64_t rank = zipf ? bench_zipf_next(&zipfgen) : bench_rand_below(&rng, n);
+            batch[i] = keys + popular[rank] * BENCH_KEYLEN;
+        }
+        uint64_t a0 = bench_allocs(), t0 = bench_now();
+        hashtable_find_many(ht, batch, items, len);
+        elapsed += bench_now() - t0;
+        allocs += bench_allocs() - a0;
+        for (int i = 0; i < len; i++) {
+            found += items[i] != NULL;
+        }
+    }
+    bench_report(stdout, "batched", hit ? "find_hit" : "find_miss",
+                 zipf ? "zipf" : "uniform", n, ops, elapsed, allocs);
+    if (found != (hit ? ops : 0)) {
+        fprintf(stderr, "hashtablebench: %llu of %llu lookups found\n",
+                (unsigned long long)found, (unsigned long long)ops);
+    }
+    free(batch);
+    free(items);
+}
+
+/**************** bench_cache() ****************/
+/* time a Zipfian stream of reads through a cache of n/10 entries, where
+ * each miss inserts the key, evicting another once the cache is full */
+static void
+bench_cache(const char* keys, const uint64_t* popular, const uint64_t n,
+            const uint64_t seed)
+{
+    uint64_t ops = n < MINOPS ? MINOPS : n;
+    uint64_t* batch = malloc(CHUNK * sizeof(uint64_t));
+    cache_t* cache = cache_new(n, n < 10 ? 1 : n / 10, 0, NULL);
+    bench_zipf_t zipfgen;
+    if (batch == NULL || cache == NULL) {
+        fprintf(stderr, "hashtablebench: out of memory\n");
+        exit(2);
+    }
+    bench_zipf_init(&zipfgen, n, THETA, seed + 2);
+
+    uint64_t elapsed = 0, allocs = 0;
+    for (uint64_t done = 0; done < ops; done += CHUNK) {
+        int len = ops - done < CHUNK ? ops - done : CHUNK;
+        for (int i = 0; i < len; i++) {
+            batch[i] = popular[bench_zipf_next(&zipfgen)];
+        }
+        uint64_t a0 = bench_allocs(), t0 = bench_now();
+        for (int i = 0; i < len; i++) {
+            const char* key = keys + batch[i] * BENCH_KEYLEN;
+            if (cache_find(cache, key) == NULL) {
+                cache_insert(cache, key, (void*)keys, 1);
+            }
+        }
+        elapsed += bench_now() - t0;
+        allocs += bench_allocs() - a0;
+    }
+    bench_report(stdout, "cache", "read_through", "zipf", n, ops, elapsed, allocs);
+    cache_delete(cache);
+    free(batch);
+}
+
+/**************** bench_placement() ****************/
+/* build the table with the page allocator under each placement, and time
+ * uniform hit lookups; `pages_plain` is the baseline, on ordinary pages */
+static void
+bench_placement(const char* keys, const uint64_t* order, const uint64_t* popular,
+                const uint64_t n, const uint64_t seed)
+{
+    static const struct {
+        const char* module;
+        int flags;
+    } placements[] = {
+        { "pages_plain", 0 },
+        { "pages_thp", PAGES_HUGE },
+        { "pages_hugetlb", PAGES_HUGETLB },
+        { "pages_local", PAGES_HUGE | PAGES_LOCAL },
+        { "pages_interleave", PAGES_HUGE | PAGES_INTERLEAVE },
+    };
+    for (size_t p = 0; p < sizeof(placements) / sizeof(placements[0]); p++) {
+        pages_init(placements[p].flags);
+        hashtable_allocator(pages_malloc, pages_free, pages_usable);
+        hashtable_t* ht = hashtable_new(n);
+        if (ht == NULL) {
+            fprintf(stderr, "hashtablebench: out of memory at n=%llu\n", (unsigned long long)n);
+            exit(2);
+        }
+        hashtable_seed(ht, seed);
+        for (uint64_t i = 0; i < n; i++) {
+            hashtable_insert(ht, keys + order[i] * BENCH_KEYLEN, (void*)keys);
+        }
+        bench_find(ht, placements[p].module, keys, popular, n, true, false, seed);
+        hashtable_delete(ht, NULL);
+        hashtable_allocator(NULL, NULL, NULL);
+    }
+    pages_init(0);                // give the arenas back
+}
+
+/**************** bench_journal() ****************/
+/* time inserts into a table logging to a journal, waiting for the
+ * journal once per rebuild, then time replaying the journal */
+static void
+bench_journal(const char* keys, const uint64_t* order, const uint64_t n)
+{
+    const char* path = "hashtablebench.journal";
+    uint64_t reps = n < MINOPS ? MINOPS / n : 1;
+    uint64_t elapsed = 0, allocs = 0;
+    for (uint64_t r = 0; r < reps; r++) {
+        remove(path);
+        journal_t* journal = journal_open(path, 1 << 20, 10, false);
+        hashtable_t* ht = hashtable_new(n);
+        if (journal == NULL || ht == NULL) {
+            fprintf(stderr, "hashtablebench: cannot journal to %s\n", path);
+            exit(2);
+        }
+        hashtable_journal(ht, journal, itemsize);
+        uint64_t a0 = bench_allocs(), t0 = bench_now();
+        for (uint64_t i = 0; i < n; i++) {
+            hashtable_insert(ht, keys + order[i] * BENCH_KEYLEN, (void*)keys);
+        }
+        journal_sync(journal);
+        elapsed += bench_now() - t0;
+        allocs += bench_allocs() - a0;
+        hashtable_delete(ht, NULL);
+        journal_close(journal);
+    }
+    bench_report(stdout, "journaled", "insert", "uniform", n, n * reps, elapsed, allocs);
+
+    hashtable_t* ht = hashtable_new(n);
+    uint64_t a0 = bench_allocs(), t0 = bench_now();
+    long records = hashtable_replay(ht, path, itemload, NULL);
+    bench_report(stdout, "journaled", "replay", "uniform", n, n,
+                 bench_now() - t0, bench_allocs() - a0);
+    if (records != (long)n) {
+        fprintf(stderr, "hashtablebench: replayed %ld records, expected %llu\n",
+                records, (unsigned long long)n);
+    }
+    hashtable_delete(ht, NULL);
+    remove(path);
+}
+
+/**************** bench_shared() ****************/
+/* time copying a table into a shmtable, attaching to it, and uniform hit
+ * lookups through the attached mapping */
+static void
+bench_shared(const char* keys, const uint64_t* order, const uint64_t* popular,
+             const uint64_t n, const uint64_t seed)
+{
+    const char* name = "/hashtablebench";
+    uint64_t reps = n < MINOPS ? MINOPS / n : 1;
+    size_t capacity = n * (64 + BENCH_KEYLEN + sizeof(void*));  // generous per entry
+    hashtable_t* ht = hashtable_new(n);
+    if (ht == NULL) {
+        fprintf(stderr, "hashtablebench: out of memory at n=%llu\n", (unsigned long long)n);
+        exit(2);
+    }
+    hashtable_seed(ht, seed);
+    for (uint64_t i = 0; i < n; i++) {
+        hashtable_insert(ht, keys + order[i] * BENCH_KEYLEN, (void*)keys);
+    }
+    shmtable_t* shm = NULL;
+    uint64_t elapsed = 0, allocs = 0;
+    for (uint64_t r = 0; r < reps; r++) {
+        shmtable_detach(shm);
+        shmtable_unlink(name);
+        uint64_t a0 = bench_allocs(), t0 = bench_now();
+        shm = shmtable_create(name, n, capacity);
+        if (!shmtable_copy(shm, ht, itemsize)) {
+            fprintf(stderr, "hashtablebench: cannot make shared memory %s\n", name);
+            exit(2);
+        }
+        elapsed += bench_now() - t0;
+        allocs += bench_allocs() - a0;
+    }
+    bench_report(stdout, "shmtable", "copy", "uniform", n, n * reps, elapsed, allocs);
+    hashtable_delete(ht, NULL);
+
+    // attach: the same cost whatever n, since nothing is copied
+    uint64_t a0 = bench_allocs(), t0 = bench_now();
+    for (uint64_t r = 0; r < reps; r++) {
+        shmtable_detach(shmtable_attach(name));
+    }
+    bench_report(stdout, "shmtable", "attach", "uniform", n, reps,
+                 bench_now() - t0, bench_allocs() - a0);
+
+    shmtable_t* reader = shmtable_attach(name);
+    uint64_t ops = n < MINOPS ? MINOPS : n;
+    uint64_t* batch = malloc(CHUNK * sizeof(uint64_t));
+    if (reader == NULL || batch == NULL) {
+        fprintf(stderr, "hashtablebench: cannot attach to %s\n", name);
+        exit(2);
+    }
+    bench_rand_t rng;
+    bench_rand_init(&rng, seed + 2);
+    uint64_t found = 0;
+    elapsed = allocs = 0;
+    for (uint64_t done = 0; done < ops; done += CHUNK) {
+        int len = ops - done < CHUNK ? ops - done : CHUNK;
+        for (int i = 0; i < len; i++) {
+            batch[i] = popular[bench_rand_below(&rng, n)];
+        }
+        a0 = bench_allocs();
+        t0 = bench_now();
+        for (int i = 0; i < len; i++) {
+            if (shmtable_find(reader, keys + batch[i] * BENCH_KEYLEN, NULL) != NULL) {
+                found++;
+            }
+        }
+        elapsed += bench_now() - t0;
+        allocs += bench_allocs() - a0;
+    }
+    bench_report(stdout, "shmtable", "find_hit", "uniform", n, ops, elapsed, allocs);
+    if (found != ops) {
+        fprintf(stderr, "hashtablebench: %llu of %llu lookups found\n",
+                (unsigned long long)found, (unsigned long long)ops);
+    }
+    free(batch);
+    shmtable_detach(reader);
+    shmtable_detach(shm);
+    shmtable_unlink(name);
+}
+
+/**************** bench_merge() ****************/
+/* time merging SHARDS tables, each holding about n of 2n keys at random,
+ * so most keys are in several: one by one with hashtable_iterate, as
+ * callers did before hashtable_merge_many, then all at once on one
+ * thread and on several */
+static void
+bench_merge(const uint64_t n, const uint64_t seed)
+{
+    char* keys = bench_keys(0, 2 * n);
+    if (keys == NULL) {
+        fprintf(stderr, "hashtablebench: out of memory at n=%llu\n", (unsigned long long)n);
+        exit(2);
+    }
+    hashtable_t* shards[SHARDS];
+    bench_rand_t rng;
+    bench_rand_init(&rng, seed + 2);
+    uint64_t total = 0;
+    for (int s = 0; s < SHARDS; s++) {
+        shards[s] = hashtable_new(n);
+        hashtable_seed(shards[s], seed + s);
+        for (uint64_t k = 0; k < 2 * n; k++) {
+            if (bench_rand_below(&rng, 2) == 0) {
+                hashtable_insert(shards[s], keys + k * BENCH_KEYLEN, keys);
+                total++;
+            }
+        }
+    }
+    uint64_t reps = total < MINOPS ? MINOPS / total : 1;
+
+    uint64_t a0 = bench_allocs(), t0 = bench_now();
+    for (uint64_t r = 0; r < reps; r++) {
+        hashtable_t* dest = hashtable_new(2 * n);
+        hashtable_seed(dest, seed);
+        for (int s = 0; s < SHARDS; s++) {
+            hashtable_iterate(shards[s], dest, mergeinsert);
+        }
+        hashtable_delete(dest, NULL);
+    }
+    bench_report(stdout, "hashtable", "merge_iterate", "uniform", n, total * reps,
+                 bench_now() - t0, bench_allocs() - a0);
+    const int threads[2] = { 1, MERGE_THREADS };
+    for (int t = 0; t < 2; t++) {
+        char op[32];
+        snprintf(op, sizeof(op), "merge_many_%d", threads[t]);
+        a0 = bench_allocs();
+        t0 = bench_now();
+        for (uint64_t r = 0; r < reps; r++) {
+            hashtable_t* dest = hashtable_new(2 * n);
+            hashtable_seed(dest, seed);
+            hashtable_merge_many(dest, shards, SHARDS, threads[t], NULL, NULL);
+            hashtable_delete(dest, NULL);
+        }
+        bench_report(stdout, "hashtable", op, "uniform", n, total * reps,
+                     bench_now() - t0, bench_allocs() - a0);
+    }
+    for (int s = 0; s < SHARDS; s++) {
+        hashtable_delete(shards[s], NULL);
+    }
+    free(keys);
+}
+
+/**************** bench_ingest() ****************/
+/* time n (at least MINOPS) updates from INGEST_PRODUCERS threads, applied
+ * by this thread, through a locked list and through an ingest queue */
+static void
+bench_ingest(const char* keys, const uint64_t n, const uint64_t seed)
+{
+    uint64_t total = n < MINOPS ? MINOPS : n;
+    uint64_t each = total / INGEST_PRODUCERS;
+    total = each * INGEST_PRODUCERS;
+
+    for (int ring = 0; ring < 2; ring++) {
+        pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+        message_t* head = NULL;
+        message_t** tail = &head;
+        ingest_t* queue = ring ? ingest_new(INGEST_CAPACITY, BENCH_KEYLEN) : NULL;
+        hashtable_t* ht = hashtable_new(n);
+        hashtable_seed(ht, seed);
+        producer_t producers[INGEST_PRODUCERS];
+        pthread_t threads[INGEST_PRODUCERS];
+
+        uint64_t a0 = bench_allocs(), t0 = bench_now();
+        int started = 0;
+        for (int p = 0; p < INGEST_PRODUCERS; p++) {
+            producers[p] = (producer_t){ keys, n, each, seed + 3 + p, queue,
+                                         &lock, &head, &tail };
+            started += pthread_create(&threads[p], NULL, produce, &producers[p]) == 0;
+        }
+        uint64_t applied = 0;
+        while (applied < each * started) {
+            if (ring) {
+                long got = ingest_drain(queue, ht, INGEST_CAPACITY, NULL, NULL, NULL);
+                applied += got > 0 ? got : 0;
+                if (got <= 0) {
+                    sched_yield();
+                }
+                continue;
+            }
+            // the baseline: take the whole list, then one insert per message
+            pthread_mutex_lock(&lock);
+            message_t* msg = head;
+            head = NULL;
+            tail = &head;
+            pthread_mutex_unlock(&lock);
+            if (msg == NULL) {
+                sched_yield();
+            }
+            while (msg != NULL) {
+                message_t* next = msg->next;
+                if (!hashtable_insert(ht, msg->key, msg->item)) {
+                    hashtable_replace(ht, msg->key, msg->item);
+                }
+                free(msg);
+                msg = next;
+                applied++;
+            }
+        }
+        for (int p = 0; p < started; p++) {
+            pthread_join(threads[p], NULL);
+        }
+        bench_report(stdout, "ingest", ring ? "ring" : "mutex_list", "uniform", n,
+                     applied, bench_now() - t0, bench_allocs() - a0);
+        ingest_delete(queue, NULL);
+        hashtable_delete(ht, NULL);
+    }
+}
+
+/**************** produce() ****************/
+/* an ingest producer: send count updates of uniformly drawn keys */
+static void*
+produce(void* arg)
+{
+    producer_t* p = arg;
+    bench_rand_t rng;
+    bench_rand_init(&rng, p->seed);
+    for (uint64_t i = 0; i < p->count; i++) {
+        const char* key = p->keys + bench_rand_below(&rng, p->n) * BENCH_KEYLEN;
+        if (p->queue != NULL) {
+            while (!ingest_put(p->queue, key, (void*)p->keys)) {
+                sched_yield();      // full: let the owner drain it
+            }
+            continue;
+        }
+        message_t* msg = malloc(sizeof(message_t));
+        if (msg == NULL) {
+            fprintf(stderr, "hashtablebench: out of memory in ingest\n");
+            exit(2);
+        }
+        *msg = (message_t){ key, (void*)p->keys, NULL };
+        pthread_mutex_lock(p->lock);
+        **p->tail = msg;
+        *p->tail = &msg->next;
+        pthread_mutex_unlock(p->lock);
+    }
+    return NULL;
+}
+
+/**************** mergeinsert() ****************/
+/* insert a pair into the table given as arg, keeping any item there */
+static void
+mergeinsert(void* arg, const char* key, void* item)
+{
+    hashtable_insert(arg, key, item);
+}
+
+/**************** itemsize() ****************/
+/* the bench's items are all the same pointer; log a pointer's worth */
+static size_t
+itemsize(void* item)
+{
+    return sizeof(void*);
+}
+
+/**************** itemload() ****************/
+/* any non-NULL item will do for the replayed table */
+static void*
+itemload(const void* bytes, const size_t len)
+{
+    static char item;
+    return &item;
+}
+
+/**************** itemcount() ****************/
+/* count the items visited */
+static void
+itemcount(void* arg, const char* key, void* item)
+{
+    uint64_t* nitems = arg;
+    if (nitems != NULL && key != NULL && item != NULL) {
+        (*nitems)++;
+    }
+}
+
+/**************** int_insert() ****************/
+/* insert an integer key into an inttable, or as a string into a hashtable */
+static bool
+int_insert(void* table, const bool itoa, const uint64_t key, void* item)
+{
+    if (itoa) {
+        char buf[24];
+        snprintf(buf, sizeof(buf), "%llu", (unsigned long long)key);
+        return hashtable_insert(table, buf, item);
+    }
+    return inttable_insert(table, key, item);
+}
+
+/**************** int_find() ****************/
+/* find an integer key in an inttable, or as a string in a hashtable */
+static void*
+int_find(void* table, const bool itoa, const uint64_t key)
+{
+    if (itoa) {
+        char buf[24];
+        snprintf(buf, sizeof(buf), "%llu", (unsigned long long)key);
+        return hashtable_find(table, buf);
+    }
+    return inttable_find(table, key);
+}
+
+/**************** bench_intkeys() ****************/
+/* insert and look up n integer keys; itoa selects stringified keys */
+static void
+bench_intkeys(const uint64_t n, const uint64_t seed, const bool itoa)
+{
+    const char* module = itoa ? "hashtable_itoa" : "inttable";
+    uint64_t* order = bench_permutation(n, seed);        // insert order
+    uint64_t* popular = bench_permutation(n, seed + 1);  // rank -> key
+    uint64_t* batch = malloc(CHUNK * sizeof(uint64_t));
+    if (order == NULL || popular == NULL || batch == NULL) {
+        fprintf(stderr, "hashtablebench: out of memory at n=%llu\n", (unsigned long long)n);
+        exit(2);
+    }
+    uint64_t reps = n < MINOPS ? MINOPS / n : 1;
+    uint64_t tins = 0, ains = 0;
+    void* table = NULL;
+
+    // insert: rebuild the table reps times
+    for (uint64_t r = 0; r < reps; r++) {
+        if (table != NULL) {
+            itoa ? hashtable_delete(table, NULL) : inttable_delete(table, NULL);
+        }
+        uint64_t a0 = bench_allocs(), t0 = bench_now();
+        table = itoa ? (void*)hashtable_new(n) : (void*)inttable_new(n);
+        for (uint64_t i = 0; i < n; i++) {
+            int_insert(table, itoa, order[i], order);
+        }
+        tins += bench_now() - t0;
+        ains += bench_allocs() - a0;
+    }
+    bench_report(stdout, module, "insert", "uniform", n, n * reps, tins, ains);
+
+    // lookups: hits uniform and Zipfian, then misses
+    uint64_t ops = n < MINOPS ? MINOPS : n;
+    for (int kind = 0; kind < 3; kind++) {
+        bool zipf = (kind == 1);
+        bool hit = (kind < 2);
+        bench_rand_t rng;
+        bench_zipf_t zipfgen;
+        bench_rand_init(&rng, seed + 2);
+        if (zipf) {
+            bench_zipf_init(&zipfgen, n, THETA, seed + 2);
+        }
+        uint64_t elapsed = 0, allocs = 0, found = 0;
+        for (uint64_t done = 0; done < ops; done += CHUNK) {
+            int len = ops - done < CHUNK ? ops - done : CHUNK;
+            for (int i = 0; i < len; i++) {
+                uint64_t rank = zipf ? bench_zipf_next(&zipfgen) : bench_rand_below(&rng, n);
+                batch[i] = hit ? popular[rank] : n + rank;
+            }
+            uint64_t a0 = bench_allocs(), t0 = bench_now();
+            for (int i = 0; i < len; i++) {
+                if (int_find(table, itoa, batch[i]) != NULL) {
+                    found++;
+                }
+            }
+            elapsed += bench_now() - t0;
+            allocs += bench_allocs() - a0;
+        }
+        bench_report(stdout, module, hit ? "find_hit" : "find_miss",
+                     zipf ? "zipf" : "uniform", n, ops, elapsed, allocs);
+        if (found != (hit ? ops : 0)) {
+            fprintf(stderr, "hashtablebench: %llu of %llu lookups found\n",
+                    (unsigned long long)found, (unsigned long long)ops);
+        }
+    }
+
+    itoa ? hashtable_delete(table, NULL) : inttable_delete(table, NULL);
+    free(order);
+    free(popular);
+    free(batch);
+}
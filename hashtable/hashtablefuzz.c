@@ -0,0 +1,498 @@
+/*
+ * hashtablefuzz.c - differential fuzzing harness for hashtable module
+ *
+ * usage: hashtablefuzz [runs [seed [maxlen]]] | hashtablefuzz file...   (see fuzz.h)
+ *
+ * Decodes each input into a table size and a sequence of inserts, finds
+ * and removes over short keys - many of them repeats of earlier keys -
+ * and runs it against a set, the reference, and against:
+ *
+ *   hashtable    a hashtable of 1 to 64 slots, so chains are long and the
+ *                chain-length guard may rehash, or of 65 to 569 slots,
+ *                more than one fold step covers (see hashtable.c);
+ *   filtered     the same with a fixed seed and a Bloom filter (which
+ *                cannot forget removed keys);
+ *   find_many    the same as hashtable, but each run of finds is looked
+ *                up at once with hashtable_find_many.
+ *
+ * Then the sequence, less its removes, is run against a set again, and
+ * against the engines that cannot remove:
+ *
+ *   typed        a DEFINE_HASHTABLE table from typed.h;
+ *   inttable     an inttable, each key packed into a 64-bit integer;
+ *   snapshot     a hashtable with a snapshot taken halfway through, so
+ *                later inserts go through its delta layers; at the end,
+ *                the snapshot must still hold exactly the first half.
+ *                About one op in 16 also takes another snapshot, or
+ *                releases one (up to MAXSNAPS are held), so layers are
+ *                pinned, unpinned and folded back, partly or wholly, at
+ *                points the input picks; each snapshot must hold exactly
+ *                the reference's pairs when it was taken.
+ *
+ * Every result must match the reference's, as must the final contents.
+ * Prints the time per operation of each (see fuzz.h) to stdout.
+ *
+ * Adwiteeya Rupantee Paul, April 2025
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "set.h"
+#include "hashtable.h"
+#include "hash.h"
+#include "typed.h"
+#include "inttable.h"
+#include "fuzz.h"
+
+/**************** file-local global types ****************/
+typedef enum { OP_INSERT, OP_FIND, OP_REMOVE } optype_t;
+
+#define KEYMAX 7                 // longest key, in bytes; 7 pack into a uint64_t
+typedef struct op {
+    optype_t type;
+    char key[KEYMAX + 1];
+    int item;                    // index into items[], for OP_INSERT
+    bool mark;                   // take or release a snapshot first
+} op_t;
+
+/* the pairs an iteration visited, folded into a hash in any order */
+typedef struct listing {
+    long count;
+    uint64_t hash;
+} listing_t;
+
+/* a run of operations: the table shape, the operations and their results */
+typedef struct run {
+    int slots;                   // slots for each table
+    uint64_t seed;               // seed for the filtered table
+    op_t* ops;
+    int nops;
+    int64_t* results;
+    listing_t half;              // contents after the first nops/2 operations
+    listing_t all;               // contents after all of them
+    listing_t* marks;            // contents before each marked op; NULL if unwanted
+} run_t;
+
+/**************** file-local global variables ****************/
+static const int MAXOPS = 2048;          // operations decoded per input
+#define MAXSNAPS 4                       // snapshots held at once by marked ops
+static int items[256];                   // the items; each op inserts one of these
+
+/**************** typed table ****************/
+static inline unsigned long strhash(const char* key) { return hash_jenkins(key, ~0UL); }
+static inline bool streq(const char* a, const char* b) { return strcmp(a, b) == 0; }
+DEFINE_HASHTABLE(strtable, const char*, int, strhash, streq)
+
+/**************** local functions ****************/
+static void decode(const uint8_t* data, const size_t size, run_t* run);
+static void run_set(run_t* run, const char* op);
+static void run_hashtable(run_t* run, const char* engine);
+static void run_typed(run_t* run);
+static void run_inttable(run_t* run);
+static void run_snapshot(run_t* run);
+static void release(hashtable_snapshot_t* snap, listing_t* want);
+static void compare(const char* engine, run_t* run, run_t* ref);
+static int64_t itemno(void* item);
+static uint64_t pack(const char* key);
+static void list(void* arg, const char* key, void* item);
+static void listtyped(void* arg, const char* key, int* item);
+static void listint(void* arg, const uint64_t key, void* item);
+static void fold(listing_t* listing, const uint64_t key, const int64_t item);
+
+/* **************************************** */
+int
+LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    run_t ref, got, noremove, noremoveref;
+    ref.ops = malloc(MAXOPS * sizeof(op_t));
+    ref.results = malloc(MAXOPS * sizeof(int64_t));
+    got.results = malloc(MAXOPS * sizeof(int64_t));
+    noremove.ops = malloc(MAXOPS * sizeof(op_t));
+    noremove.results = malloc(MAXOPS * sizeof(int64_t));
+    noremoveref.results = malloc(MAXOPS * sizeof(int64_t));
+    noremoveref.marks = malloc(MAXOPS * sizeof(listing_t));
+    if (ref.ops == NULL || ref.results == NULL || got.results == NULL
+        || noremove.ops == NULL || noremove.results == NULL
+        || noremoveref.results == NULL || noremoveref.marks == NULL) {
+        fprintf(stderr, "hashtablefuzz: out of memory\n");
+        exit(2);
+    }
+    decode(data, size, &ref);
+    ref.marks = NULL;
+
+    // the engines that remove
+    got.slots = ref.slots;
+    got.seed = ref.seed;
+    got.ops = ref.ops;
+    got.nops = ref.nops;
+    run_set(&ref, "mixed");
+    run_hashtable(&got, "hashtable");
+    compare("hashtable", &got, &ref);
+    run_hashtable(&got, "filtered");
+    compare("filtered", &got, &ref);
+    run_hashtable(&got, "find_many");
+    compare("find_many", &got, &ref);
+
+    // the engines that do not
+    noremove.slots = noremoveref.slots = ref.slots;
+    noremove.seed = noremoveref.seed = ref.seed;
+    noremove.nops = 0;
+    for (int i = 0; i < ref.nops; i++) {
+        if (ref.ops[i].type != OP_REMOVE) {
+            noremove.ops[noremove.nops++] = ref.ops[i];
+        }
+    }
+    noremoveref.ops = noremove.ops;
+    noremoveref.nops = noremove.nops;
+    run_set(&noremoveref, "no_remove");
+    run_typed(&noremove);
+    compare("typed", &noremove, &noremoveref);
+    run_inttable(&noremove);
+    compare("inttable", &noremove, &noremoveref);
+    noremove.marks = noremoveref.marks;
+    run_snapshot(&noremove);
+    compare("snapshot", &noremove, &noremoveref);
+    if (noremove.half.count != noremoveref.half.count
+        || noremove.half.hash != noremoveref.half.hash) {
+        fuzz_fail("snapshot: holds %ld pairs, but %ld were in the table when taken",
+                  noremove.half.count, noremoveref.half.count);
+    }
+
+    free(ref.ops);
+    free(ref.results);
+    free(got.results);
+    free(noremove.ops);
+    free(noremove.results);
+    free(noremoveref.results);
+    free(noremoveref.marks);
+    return 0;
+}
+
+/**************** decode() ****************/
+/* turn the input into a table shape and at most MAXOPS operations */
+static void
+decode(const uint8_t* data, const size_t size, run_t* run)
+{
+    fuzz_input_t in;
+    fuzz_input_init(&in, data, size);
+    uint8_t config = fuzz_byte(&in);
+    run->slots = (config & 0x40) ? 65 + (config & 0x3f) * 8 : 1 + config % 64;
+    run->seed = config;
+    run->nops = 0;
+
+    while (!fuzz_done(&in) && run->nops < MAXOPS) {
+        uint8_t b = fuzz_byte(&in);
+        op_t* op = &run->ops[run->nops];
+        op->type = (b & 3) == 0 ? OP_INSERT : (b & 3) == 3 ? OP_REMOVE : OP_FIND;
+        op->mark = (b & 0xcc) == 0xcc;
+        op->item = fuzz_byte(&in);
+
+        if (run->nops > 0 && (b & 0x30) != 0) {
+            // reuse an earlier key
+            strcpy(op->key, run->ops[fuzz_below(&in, run->nops)].key);
+        } else {
+            // a fresh key; mostly a 4-letter alphabet, so keys recur
+            int len = fuzz_byte(&in) % (KEYMAX + 1);
+            for (int i = 0; i < len; i++) {
+                uint8_t c = fuzz_byte(&in);
+                op->key[i] = (c & 0x80) ? 'a' + (c & 3) : '!' + c % 94;
+            }
+            op->key[len] = '\0';
+        }
+        run->nops++;
+    }
+}
+
+/**************** run_set() ****************/
+/* the reference: run the operations on a set, timed as op */
+static void
+run_set(run_t* run, const char* op)
+{
+    set_t* set = set_new();
+    run->half = (listing_t){0, 0};
+    uint64_t elapsed = 0, t0 = fuzz_now();
+    for (int i = 0; i < run->nops; i++) {
+        op_t* o = &run->ops[i];
+        if (i == run->nops / 2) {
+            elapsed += fuzz_now() - t0;
+            set_iterate(set, &run->half, list);
+            t0 = fuzz_now();
+        }
+        if (o->mark && run->marks != NULL) {
+            elapsed += fuzz_now() - t0;
+            run->marks[i] = (listing_t){0, 0};
+            set_iterate(set, &run->marks[i], list);
+            t0 = fuzz_now();
+        }
+        switch (o->type) {
+        case OP_INSERT:
+            run->results[i] = set_insert(set, o->key, &items[o->item]);
+            break;
+        case OP_FIND:
+            run->results[i] = itemno(set_find(set, o->key));
+            break;
+        case OP_REMOVE:
+            run->results[i] = itemno(set_remove(set, o->key));
+            break;
+        }
+    }
+    fuzz_time("set", op, run->nops, elapsed + fuzz_now() - t0);
+
+    run->all = (listing_t){0, 0};
+    set_iterate(set, &run->all, list);
+    set_delete(set, NULL);
+}
+
+/**************** run_hashtable() ****************/
+/* run the operations on a hashtable, set up as engine says */
+static void
+run_hashtable(run_t* run, const char* engine)
+{
+    hashtable_t* ht = hashtable_new(run->slots);
+    const bool batched = strcmp(engine, "find_many") == 0;
+    if (strcmp(engine, "filtered") == 0) {
+        hashtable_seed(ht, run->seed);
+        hashtable_filter(ht, run->nops / 4 + 1);
+    }
+    const char** keys = malloc(run->nops * sizeof(char*) + 1);
+    void** found = malloc(run->nops * sizeof(void*) + 1);
+    if (ht == NULL || keys == NULL || found == NULL) {
+        fprintf(stderr, "hashtablefuzz: out of memory\n");
+        exit(2);
+    }
+
+    uint64_t t0 = fuzz_now();
+    for (int i = 0; i < run->nops; i++) {
+        op_t* o = &run->ops[i];
+        switch (o->type) {
+        case OP_INSERT:
+            run->results[i] = hashtable_insert(ht, o->key, &items[o->item]);
+            break;
+        case OP_FIND:
+            if (batched) {
+                // look up this run of finds all at once
+                int n = 0;
+                while (i + n < run->nops && run->ops[i + n].type == OP_FIND) {
+                    keys[n] = run->ops[i + n].key;
+                    n++;
+                }
+                hashtable_find_many(ht, keys, found, n);
+                for (int j = 0; j < n; j++) {
+                    run->results[i + j] = itemno(found[j]);
+                }
+                i += n - 1;
+            } else {
+                run->results[i] = itemno(hashtable_find(ht, o->key));
+            }
+            break;
+        case OP_REMOVE:
+            run->results[i] = itemno(hashtable_remove(ht, o->key));
+            break;
+        }
+    }
+    fuzz_time(engine, "mixed", run->nops, fuzz_now() - t0);
+
+    run->all = (listing_t){0, 0};
+    hashtable_iterate(ht, &run->all, list);
+    hashtable_delete(ht, NULL);
+    free(keys);
+    free(found);
+}
+
+/**************** run_typed() ****************/
+/* run the operations, which remove nothing, on a typed table */
+static void
+run_typed(run_t* run)
+{
+    strtable_t* st = strtable_new(run->slots);
+    uint64_t t0 = fuzz_now();
+    for (int i = 0; i < run->nops; i++) {
+        op_t* o = &run->ops[i];
+        if (o->type == OP_INSERT) {
+            // the table keeps the key pointer; ops outlive it
+            run->results[i] = strtable_insert(st, o->key, o->item);
+        } else {
+            int* item = strtable_find(st, o->key);
+            run->results[i] = item == NULL ? -1 : *item;
+        }
+    }
+    fuzz_time("typed", "no_remove", run->nops, fuzz_now() - t0);
+
+    run->all = (listing_t){0, 0};
+    strtable_iterate(st, &run->all, listtyped);
+    strtable_delete(st);
+}
+
+/**************** run_inttable() ****************/
+/* run the operations, which remove nothing, on an inttable */
+static void
+run_inttable(run_t* run)
+{
+    inttable_t* it = inttable_new(run->slots);
+    uint64_t t0 = fuzz_now();
+    for (int i = 0; i < run->nops; i++) {
+        op_t* o = &run->ops[i];
+        if (o->type == OP_INSERT) {
+            run->results[i] = inttable_insert(it, pack(o->key), &items[o->item]);
+        } else {
+            run->results[i] = itemno(inttable_find(it, pack(o->key)));
+        }
+    }
+    fuzz_time("inttable", "no_remove", run->nops, fuzz_now() - t0);
+
+    run->all = (listing_t){0, 0};
+    inttable_iterate(it, &run->all, listint);
+    inttable_delete(it, NULL);
+}
+
+/**************** run_snapshot() ****************/
+/* run the operations, which remove nothing, on a hashtable with a
+ * snapshot taken halfway through, and others taken and released at the
+ * marked operations */
+static void
+run_snapshot(run_t* run)
+{
+    hashtable_t* ht = hashtable_new(run->slots);
+    hashtable_snapshot_t* snap = NULL;
+    hashtable_snapshot_t* held[MAXSNAPS];
+    int takenat[MAXSNAPS];       // the op each was taken before
+    int nheld = 0;
+    uint64_t t0 = fuzz_now();
+    for (int i = 0; i < run->nops; i++) {
+        op_t* o = &run->ops[i];
+        if (i == run->nops / 2) {
+            snap = hashtable_snapshot(ht);
+        }
+        if (o->mark) {
+            if (nheld < MAXSNAPS && (nheld == 0 || (o->item & 1) == 0)) {
+                takenat[nheld] = i;
+                held[nheld++] = hashtable_snapshot(ht);
+            } else {
+                // release one, once it shows it still holds what it did
+                int s = o->item % nheld;
+                release(held[s], &run->marks[takenat[s]]);
+                held[s] = held[--nheld];
+                takenat[s] = takenat[nheld];
+            }
+        }
+        if (o->type == OP_INSERT) {
+            run->results[i] = hashtable_insert(ht, o->key, &items[o->item]);
+        } else {
+            run->results[i] = itemno(hashtable_find(ht, o->key));
+        }
+    }
+    fuzz_time("snapshot", "no_remove", run->nops, fuzz_now() - t0);
+
+    run->half = (listing_t){0, 0};
+    hashtable_snapshot_iterate(snap, &run->half, list);
+    for (int i = 0; i < run->nops / 2; i++) {
+        // what the first half inserted, the snapshot finds
+        if (run->ops[i].type != OP_INSERT) {
+            continue;
+        }
+        void* item = hashtable_snapshot_find(snap, run->ops[i].key);
+        if (item == NULL || item != hashtable_find(ht, run->ops[i].key)) {
+            fuzz_fail("snapshot: lost \"%s\", inserted before it was taken",
+                      run->ops[i].key);
+        }
+    }
+    hashtable_snapshot_release(snap);
+    while (nheld > 0) {
+        nheld--;
+        release(held[nheld], &run->marks[takenat[nheld]]);
+    }
+    run->all = (listing_t){0, 0};
+    hashtable_iterate(ht, &run->all, list);
+    hashtable_delete(ht, NULL);
+}
+
+/**************** release() ****************/
+/* release a snapshot, failing unless it holds exactly the listing */
+static void
+release(hashtable_snapshot_t* snap, listing_t* want)
+{
+    listing_t has = {0, 0};
+    hashtable_snapshot_iterate(snap, &has, list);
+    if (has.count != want->count || has.hash != want->hash) {
+        fuzz_fail("snapshot: holds %ld pairs at release, but %ld were in the table when taken",
+                  has.count, want->count);
+    }
+    hashtable_snapshot_release(snap);
+}
+
+/**************** compare() ****************/
+/* fail at the first result, or final contents, that differ from ref's */
+static void
+compare(const char* engine, run_t* run, run_t* ref)
+{
+    static const char* names[] = { "insert", "find", "remove" };
+    for (int i = 0; i < ref->nops; i++) {
+        if (run->results[i] != ref->results[i]) {
+            fuzz_fail("%s: op %d (%s \"%s\") gave %lld, reference %lld", engine, i,
+                      names[ref->ops[i].type], ref->ops[i].key,
+                      (long long)run->results[i], (long long)ref->results[i]);
+        }
+    }
+    if (run->all.count != ref->all.count || run->all.hash != ref->all.hash) {
+        fuzz_fail("%s: final contents differ (%ld pairs, reference %ld)",
+                  engine, run->all.count, ref->all.count);
+    }
+}
+
+/**************** itemno() ****************/
+/* which of items[] this is; -1 for NULL */
+static int64_t
+itemno(void* item)
+{
+    return item == NULL ? -1 : (int*)item - items;
+}
+
+/**************** pack() ****************/
+/* a key of up to 8 nonzero bytes, as one integer */
+static uint64_t
+pack(const char* key)
+{
+    uint64_t packed = 0;
+    for (const char* p = key; *p != '\0'; p++) {
+        packed = packed << 8 | (uint8_t)*p;
+    }
+    return packed;
+}
+
+/**************** list() ****************/
+/* fold one (key,item) pair into a listing */
+static void
+list(void* arg, const char* key, void* item)
+{
+    fold(arg, pack(key), itemno(item));
+}
+
+/**************** listtyped() ****************/
+/* fold one pair of a typed table into a listing */
+static void
+listtyped(void* arg, const char* key, int* item)
+{
+    fold(arg, pack(key), *item);
+}
+
+/**************** listint() ****************/
+/* fold one pair of an inttable into a listing */
+static void
+listint(void* arg, const uint64_t key, void* item)
+{
+    fold(arg, key, itemno(item));
+}
+
+/**************** fold() ****************/
+/* add the pair's hash to the listing; a sum, so order does not matter */
+static void
+fold(listing_t* listing, const uint64_t key, const int64_t item)
+{
+    uint64_t z = key * 0x9e3779b97f4a7c15ULL + (uint64_t)item;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;        // splitmix64's finalizer
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    listing->hash += z ^ (z >> 31);
+    listing->count++;
+}
@@ -10,25 +10,77 @@
  * CS50, Adwiteeya Rupantee Paul, April 2025
  */
 
+ #define _POSIX_C_SOURCE 200809L   // fork and waitpid, for the shmtable test
+
  #include <stdio.h>
  #include <stdlib.h>
+ #include <stddef.h>
  #include <string.h>
+ #include <unistd.h>
+ #include <sys/wait.h>
+ #include <sched.h>
+ #include <pthread.h>
  #include "set.h"
  #include "hashtable.h"
  #include "hash.h"
+ #include "typed.h"
+ #include "inttable.h"
+ #include "cache.h"
+ #include "shmtable.h"
+ #include "ingest.h"
+ #include "pages.h"
+ #include "journal.h"
  #include "file.h"
 
 
  static void nameprint(FILE* fp, const char* key, void* item) ;
  static void namedelete(void* item);
  static void itemcount(void* arg, const char* key, void* item);
+ static void typedinsert(void* arg, const char* key, void* item);
+ static void typedcount(void* arg, const char* key, int* count);
+ static void intcount(void* arg, const uint64_t key, void* item);
+ static void evictcount(void* item);
+ static void scancount(void* arg, const char* key, void* item);
+ static void* lastitem(void* arg, const char* key, void* item, void* other);
+ static bool samefile(FILE* a, FILE* b);
+ static size_t namesize(void* item);
+ static void* nameload(const void* bytes, const size_t len);
+ static void shmcompare(void* arg, const char* key, const void* item, const size_t len);
+ static void* addcount(void* arg, const char* key, void* item, void* other);
+ static void* produce(void* arg);
+ static void sumcount(void* arg, const char* key, void* item);
+ static void* countalloc(size_t size);
+ static void countfree(void* ptr);
+ static void* flakyalloc(size_t size);
+
+ static size_t livebytes = 0;   // bytes countalloc has handed out and not had back
+ static bool outofmemory = false; // flakyalloc fails while this is set
+
+ // what shmcompare compares a shmtable with
+ typedef struct shmcheck {
+   hashtable_t* ht;
+   int wrong;
+ } shmcheck_t;
+
+ // what each producer thread of the ingest test puts
+ typedef struct producer {
+   ingest_t* queue;
+   int id;
+ } producer_t;
+ static const int PRODUCERS = 4;
+ static const int PUTS = 20000;   // per producer, over 500 keys each
+
+ // a typed hashtable from names to counts, generated by typed.h
+ static inline unsigned long namehash(const char* key) { return hash_jenkins(key, ~0UL); }
+ static inline bool nameeq(const char* a, const char* b) { return strcmp(a, b) == 0; }
+ DEFINE_HASHTABLE(namecount, const char*, int, namehash, nameeq)
  
 
  int main() 
  {
    hashtable_t* hash1;           // one hashtable
    hashtable_t* hash2;           // another hashtable
-   char* key = NULL;            // a key in the hashtable
+   char key[100];               // a key in the hashtable
    const int num_slots = 10;       // number of slots put in the bag
    int hashcount = 0;             // number of slots found in a bag
  
@@ -43,6 +95,8 @@
     fprintf(stderr, "set_new failed for set1\n");
     return 1;
   }
+   hashtable_seed(hash1, 1);    // fixed seeds, so every run prints the same
+   hashtable_seed(hash2, 1);
 
 
   // test the hashtable with unacceptable parameters
@@ -65,12 +119,18 @@
    int keycount = 0;
 
    FILE* fp = fopen("fp", "w"); //copy the keys in a different file
-   char* keys;
-   char* items;
-    while(scanf("%s %s", &keys, &items) != EOF) { 
-      hashtable_insert(hash1, &keys, &items); //inserting from the test file
-      fprintf(fp, "%s\n", &keys); 
-      keycount = keycount + 1;   
+   char keys[100];              // key read from the test file
+   char items[100];             // item read from the test file
+    while(scanf("%99s %99s", keys, items) == 2) {
+      char* item = malloc(strlen(items) + 1); // the hashtable holds its own copy
+      if (item != NULL) {
+        strcpy(item, items);
+        if (!hashtable_insert(hash1, keys, item)) { //inserting from the test file
+          free(item);                 // not inserted; don't leak it
+        }
+      }
+      fprintf(fp, "%s\n", keys);
+      keycount = keycount + 1;
     }
     fclose(fp);
 
@@ -86,14 +146,21 @@
    hashtable_print(hash1, stdout, nameprint);
    printf("\n");
 
+ //check the statistics agree with the count
+   hashtable_stats_t stats;
+   hashtable_stats(hash1, &stats);
+   printf("\nStats: %ld items (should be %d) in %d slots, load %.2f, longest chain %d, %ld collisions\n",
+          stats.items, keycount, stats.num_slots, stats.load_factor,
+          stats.max_chain, stats.collisions);
+
    FILE *fs = fopen("fp", "r");
    char* value;
 
    //copy the hashtable to another hashtable
 
-   while(fscanf(fs, "%s", &key) != EOF) {
-     value = hashtable_find(hash1, &key);
-     hashtable_insert(hash2, &key, value);
+   while(fscanf(fs, "%99s", key) == 1) {
+     value = hashtable_find(hash1, key);
+     hashtable_insert(hash2, key, value);
    }
 
    fclose(fs);
@@ -109,10 +176,752 @@
    hashtable_print(hash2, stdout, nameprint);
    printf("\n");
 
+   //copy the keys into a typed hashtable; the keys stay owned by hash1
+   printf("\nThe typed hashtable:\n");
+   namecount_t* typed = namecount_new(num_slots);
+   hashtable_iterate(hash1, typed, typedinsert);
+   printf("Count (should be %d): ", keycount);
+   hashcount = 0;
+   namecount_iterate(typed, &hashcount, typedcount);
+   printf("%d\n", hashcount);
+   printf("Duplicate insert (should be 0): %d\n",
+          namecount_insert(typed, "Dartmouth", 1) && namecount_insert(typed, "Dartmouth", 2));
+   printf("Find missing key (should be 1): %d\n", namecount_find(typed, "College") == NULL);
+   namecount_delete(typed);
+
+   //integer keys, in an inttable
+   printf("\nThe inttable:\n");
+   inttable_t* ints = inttable_new(num_slots);
+   for (uint64_t i = 0; i < 100; i++) {
+     inttable_insert(ints, i * 1000003, "College");
+   }
+   printf("Duplicate insert (should be 0): %d\n", inttable_insert(ints, 1000003, "College"));
+   printf("Null item insert (should be 0): %d\n", inttable_insert(ints, 7, NULL));
+   printf("Find 99*1000003 (should be College): %s\n", (char*)inttable_find(ints, 99 * 1000003));
+   printf("Find missing key (should be 1): %d\n", inttable_find(ints, 5) == NULL);
+   printf("Count (should be 100): ");
+   hashcount = 0;
+   inttable_iterate(ints, &hashcount, intcount);
+   printf("%d\n", hashcount);
+   inttable_delete(ints, NULL);
+
+   //a membership filter in front of the second hashtable
+   printf("\nThe filter:\n");
+   printf("Filter on (should be 1): %d\n", hashtable_filter(hash2, 10000));
+   printf("Find absent key (should be 1): %d\n", hashtable_find(hash2, "no-such-key") == NULL);
+   int wrong = 0;
+   char probe[32];
+   for (int i = 0; i < 10000; i++) {
+     sprintf(probe, "absent%d", i);
+     if (hashtable_find(hash2, probe) != NULL) {
+       wrong++;
+     }
+   }
+   FILE* fk = fopen("fp", "r");         // every inserted key gets past it
+   while (fk != NULL && fscanf(fk, "%99s", key) == 1) {
+     if (hashtable_find(hash2, key) == NULL) {
+       wrong++;
+     }
+   }
+   if (fk != NULL) {
+     fclose(fk);
+   }
+   printf("Wrong answers (should be 0): %d\n", wrong);
+   hashtable_stats(hash2, &stats);
+   printf("False-positive rate under 3%% (should be 1): %d\n",
+          stats.filter_rejects > 0 && stats.filter_fp_rate < 0.03);
+   hashtable_insert(hash2, "late-arrival", "College");
+   printf("Find key inserted after the filter (should be College): %s\n",
+          (char*)hashtable_find(hash2, "late-arrival"));
+   printf("Filter off (should be 1): %d\n", hashtable_filter(hash2, 0));
+
+   //remove a pair, then put it back
+   printf("\nRemove:\n");
+   printf("Remove absent key (should be 1): %d\n", hashtable_remove(hash2, "no-such-key") == NULL);
+   printf("Remove late-arrival (should be College): %s\n",
+          (char*)hashtable_remove(hash2, "late-arrival"));
+   printf("Find it again (should be 1): %d\n", hashtable_find(hash2, "late-arrival") == NULL);
+   printf("Insert it again (should be 1): %d\n", hashtable_insert(hash2, "late-arrival", "College"));
+
+   //snapshots: frozen views while the table keeps changing
+   printf("\nSnapshots:\n");
+   hashtable_t* hash3 = hashtable_new(1000);
+   for (int i = 0; i < 100; i++) {
+     sprintf(probe, "snap%d", i);
+     hashtable_insert(hash3, probe, "College");
+   }
+   hashtable_snapshot_t* snap1 = hashtable_snapshot(hash3);
+   for (int i = 100; i < 200; i++) {
+     sprintf(probe, "snap%d", i);
+     hashtable_insert(hash3, probe, "College");
+   }
+   hashtable_snapshot_t* snap2 = hashtable_snapshot(hash3);
+   hashtable_insert(hash3, "snap200", "College");
+   printf("Duplicate of a frozen key (should be 0): %d\n", hashtable_insert(hash3, "snap5", "College"));
+   printf("Remove a frozen key (should be 1): %d\n", hashtable_remove(hash3, "snap5") == NULL);
+   printf("Remove a key no snapshot sees (should be College): %s\n",
+          (char*)hashtable_remove(hash3, "snap200"));
+   printf("Counts (should be 100 200 200): ");
+   hashcount = 0;
+   hashtable_snapshot_iterate(snap1, &hashcount, itemcount);
+   printf("%d ", hashcount);
+   hashcount = 0;
+   hashtable_snapshot_iterate(snap2, &hashcount, itemcount);
+   printf("%d ", hashcount);
+   hashcount = 0;
+   hashtable_iterate(hash3, &hashcount, itemcount);
+   printf("%d\n", hashcount);
+   printf("Find snap150 in the snapshots (should be 1 0): %d %d\n",
+          hashtable_snapshot_find(snap1, "snap150") == NULL,
+          hashtable_snapshot_find(snap2, "snap150") == NULL);
+   printf("Find snap150 in the table (should be College): %s\n",
+          (char*)hashtable_find(hash3, "snap150"));
+   hashtable_stats(hash3, &stats);
+   printf("Layers (should be 3): %d\n", stats.layers);
+   hashtable_snapshot_release(snap1);
+   hashtable_snapshot_release(snap2);
+   for (int i = 300; i < 400; i++) {    // each write folds a few slots back
+     sprintf(probe, "snap%d", i);
+     hashtable_insert(hash3, probe, "College");
+   }
+   hashtable_stats(hash3, &stats);
+   printf("After release: %d layers (should be 1), %ld items (should be 300)\n",
+          stats.layers, stats.items);
+   printf("Remove snap5 (should be College): %s\n", (char*)hashtable_remove(hash3, "snap5"));
+   hashtable_delete(hash3, NULL);
+   // a snapshot taken while a layer of more slots than one fold step
+   // covers is only partly folded back
+   hash3 = hashtable_new(1000);
+   snap1 = hashtable_snapshot(hash3);
+   hashtable_insert(hash3, "part0", "College");
+   hashtable_snapshot_release(snap1);
+   hashtable_insert(hash3, "part1", "College");   // folds the first few slots
+   snap1 = hashtable_snapshot(hash3);
+   for (int i = 2; i < 52; i++) {
+     sprintf(probe, "part%d", i);
+     hashtable_insert(hash3, probe, "College");
+   }
+   hashtable_snapshot_release(snap1);
+   for (int i = 52; i < 252; i++) {
+     sprintf(probe, "part%d", i);
+     hashtable_insert(hash3, probe, "College");
+   }
+   wrong = 0;
+   for (int i = 0; i < 252; i++) {
+     sprintf(probe, "part%d", i);
+     wrong += hashtable_find(hash3, probe) == NULL;
+   }
+   hashtable_stats(hash3, &stats);
+   printf("Partly folded, then snapshot: %d keys lost (should be 0), %d layers (should be 1)\n",
+          wrong, stats.layers);
+   hashtable_delete(hash3, NULL);
+
+   //a scan a few slots at a time, while the table changes under it
+   printf("\nScan:\n");
+   hashtable_t* hash4 = hashtable_new(100);
+   for (int i = 0; i < 500; i++) {
+     sprintf(probe, "scan%d", i);
+     hashtable_insert(hash4, probe, "College");
+   }
+   int seen[500] = {0};
+   int calls = 0;
+   hashtable_snapshot_t* snap3 = NULL;
+   unsigned long cursor = 0;
+   do {
+     cursor = hashtable_scan(hash4, cursor, 20, seen, scancount);
+     sprintf(probe, "late%d", calls);  // new keys, seen or not
+     hashtable_insert(hash4, probe, "College");
+     if (calls == 5) {
+       snap3 = hashtable_snapshot(hash4);  // later inserts go to a new layer
+     } else if (calls == 15) {
+       hashtable_snapshot_release(snap3);  // and then fold back
+     }
+     calls++;
+   } while (cursor != 0);
+   wrong = 0;
+   for (int i = 0; i < 500; i++) {
+     if (seen[i] != 1) {
+       wrong++;
+     }
+   }
+   printf("Keys not seen exactly once (should be 0): %d\n", wrong);
+   printf("Took several calls (should be 1): %d\n", calls > 5);
+   printf("Scan of NULL, past the end (should be 0 0): %lu %lu\n",
+          hashtable_scan(NULL, 0, 20, seen, scancount),
+          hashtable_scan(hash4, 100, 20, seen, scancount));
+   hashtable_delete(hash4, NULL);
+   FILE* whole = tmpfile();
+   FILE* scanned = tmpfile();
+   if (whole != NULL && scanned != NULL) {
+     hashtable_print(hash1, whole, nameprint);
+     cursor = 0;
+     do {
+       cursor = hashtable_scan_print(hash1, cursor, 2, scanned, nameprint);
+     } while (cursor != 0);
+     printf("Scanned print matches (should be 1): %d\n", samefile(whole, scanned));
+   }
+   if (whole != NULL) {
+     fclose(whole);
+   }
+   if (scanned != NULL) {
+     fclose(scanned);
+   }
+
+   //seeds: the same seed prints the same; colliding keys force a reseed
+   printf("\nSeeds:\n");
+   hashtable_t* seeded = hashtable_new(1000);
+   printf("Seed NULL (should be 0): %d\n", hashtable_seed(NULL, 42));
+   printf("Seed (should be 1): %d\n", hashtable_seed(seeded, 42));
+   char floods[200][16];
+   for (int i = 0, n = 0; i < 200; n++) {   // keys that all land in slot 0
+     sprintf(floods[i], "flood%d", n);
+     if (hash_siphash(floods[i], 42, 1000) == 0) {
+       i++;
+     }
+   }
+   hashtable_t* pinned = hashtable_new(1000);
+   hashtable_seed(pinned, 42);
+   hashtable_snapshot_t* snap4 = hashtable_snapshot(pinned);
+   printf("Seed while a snapshot exists (should be 0): %d\n", hashtable_seed(pinned, 7));
+   for (int i = 0; i < 200; i++) {
+     hashtable_insert(seeded, floods[i], "College");
+     hashtable_insert(pinned, floods[i], "College");
+   }
+   hashtable_stats_t sstats;
+   hashtable_stats(seeded, &sstats);
+   printf("Reseeded (should be 2, counting ours): %lu\n", sstats.reseeds);
+   printf("Longest chain now short (should be 1): %d\n", sstats.max_chain < 32);
+   hashtable_stats(pinned, &sstats);
+   printf("Reseed waits for snapshots (should be 1 200): %lu %d\n", sstats.reseeds, sstats.max_chain);
+   wrong = 0;
+   for (int i = 0; i < 200; i++) {
+     if (hashtable_find(seeded, floods[i]) == NULL || hashtable_find(pinned, floods[i]) == NULL) {
+       wrong++;
+     }
+   }
+   printf("Wrong answers (should be 0): %d\n", wrong);
+   hashtable_snapshot_release(snap4);
+   hashtable_delete(pinned, NULL);
+   FILE* first = tmpfile();
+   FILE* second = tmpfile();
+   if (first != NULL && second != NULL) {
+     hashtable_t* again = hashtable_new(1000);
+     for (int i = 199; i >= 0; i--) {
+       hashtable_insert(again, floods[i], "College");
+     }
+     hashtable_seed(seeded, 5);
+     hashtable_seed(again, 5);
+     hashtable_print(seeded, first, nameprint);
+     hashtable_print(again, second, nameprint);
+     printf("Same seed, same print (should be 1): %d\n", samefile(first, second));
+     hashtable_delete(again, NULL);
+   }
+   if (first != NULL) {
+     fclose(first);
+   }
+   if (second != NULL) {
+     fclose(second);
+   }
+   hashtable_delete(seeded, NULL);
+   hash4 = hashtable_new(100);
+   for (int i = 0; i < 500; i++) {
+     sprintf(probe, "scan%d", i);
+     hashtable_insert(hash4, probe, "College");
+   }
+   memset(seen, 0, sizeof(seen));
+   cursor = 0;
+   calls = 0;
+   do {
+     cursor = hashtable_scan(hash4, cursor, 20, seen, scancount);
+     if (++calls == 5) {
+       hashtable_seed(hash4, 3);     // keys move: the scan starts over
+     }
+   } while (cursor != 0);
+   wrong = 0;
+   for (int i = 0; i < 500; i++) {
+     if (seen[i] < 1) {
+       wrong++;
+     }
+   }
+   printf("Keys missed by a scan across a reseed (should be 0): %d\n", wrong);
+   hashtable_delete(hash4, NULL);
+
+   //lookups in stages, interleaved, and many at once
+   printf("\nStaged lookups:\n");
+   static int shardno[6] = { 0, 1, 2, 3, 4, 5 };   // items, here and below
+   hashtable_t* staged = hashtable_new(500);
+   hashtable_seed(staged, 1);
+   for (int i = 0; i < 2000; i++) {
+     sprintf(probe, "s%d", i);
+     hashtable_insert(staged, probe, &shardno[i % 5]);
+   }
+   hashtable_filter(staged, 3000);
+   hashtable_snapshot_t* snap6 = hashtable_snapshot(staged);
+   for (int i = 2000; i < 2500; i++) {          // into a newer layer
+     sprintf(probe, "s%d", i);
+     hashtable_insert(staged, probe, &shardno[i % 5]);
+   }
+   hashtable_lookup_t la, lb;
+   printf("Start with NULL table (should be 1 (nil)): %d %p\n",
+          hashtable_lookup_start(NULL, &la, "s1"), la.item);
+   bool adone = hashtable_lookup_start(staged, &la, "s7");
+   bool bdone = hashtable_lookup_start(staged, &lb, "s2222");
+   int steps = 0;
+   while (!adone || !bdone) {                   // two lookups, taking turns
+     adone = adone || hashtable_lookup_step(staged, &la);
+     bdone = bdone || hashtable_lookup_step(staged, &lb);
+     steps++;
+   }
+   printf("Interleaved (should be 2 2, in under 40 steps): %d %d, %d\n",
+          *(int*)la.item, *(int*)lb.item, steps < 40);
+   const char* many[3000];
+   void* found[3000];
+   static char manykeys[3000][16];
+   for (int i = 0; i < 3000; i++) {
+     sprintf(manykeys[i], "s%d", (i * 7) % 3000);  // a sixth of them absent
+     many[i] = manykeys[i];
+   }
+   hashtable_find_many(staged, many, found, 3000);
+   wrong = 0;
+   int hits = 0;
+   for (int i = 0; i < 3000; i++) {
+     wrong += found[i] != hashtable_find(staged, many[i]);
+     hits += found[i] != NULL;
+   }
+   printf("Found many (should be 2500 found, 0 wrong): %d found, %d wrong\n", hits, wrong);
+   hashtable_stats_sample(staged, 1);           // counted only with -DHASHTABLE_STATS
+   hashtable_find_many(staged, many, found, 3000);
+   hashtable_stats(staged, &stats);
+   unsigned long manylookups = stats.lookups, manyhits = stats.hits;
+   hashtable_stats_sample(staged, 1);
+   for (int i = 0; i < 3000; i++) {
+     hashtable_find(staged, many[i]);
+   }
+   hashtable_stats(staged, &stats);
+   printf("Counted like finds (should be 1): %d\n",
+          manylookups == stats.lookups && manyhits == stats.hits);
+   many[1] = NULL;
+   hashtable_find_many(NULL, many, found, 2);
+   printf("Many in a NULL table (should be (nil) (nil)): %p %p\n", found[0], found[1]);
+   hashtable_snapshot_release(snap6);
+   hashtable_delete(staged, NULL);
+
+   //merge many shards at once, on several threads
+   printf("\nMerge many:\n");
+   hashtable_t* shards[5];
+   for (int s = 0; s < 5; s++) {
+     shards[s] = hashtable_new(1000);                // each with its own seed
+     for (int i = 0; i < 40000; i++) {
+       if (i % (s + 2) == 0) {
+         sprintf(probe, "m%d", i);
+         hashtable_insert(shards[s], probe, &shardno[s]);
+       }
+     }
+   }
+   hashtable_t* merged = hashtable_new(5000);
+   hashtable_insert(merged, "m0", &shardno[5]);     // dest's own items fold first
+   printf("Null dest (should be 0): %d\n", hashtable_merge_many(NULL, shards, 5, 4, NULL, NULL));
+   printf("Dest among sources (should be 0): %d\n", hashtable_merge_many(shards[0], shards, 5, 4, NULL, NULL));
+   hashtable_snapshot_t* snap5 = hashtable_snapshot(merged);
+   printf("Dest with a snapshot (should be 0): %d\n", hashtable_merge_many(merged, shards, 5, 4, NULL, NULL));
+   hashtable_snapshot_release(snap5);
+   printf("Merged (should be 1): %d\n", hashtable_merge_many(merged, shards, 5, 4, NULL, NULL));
+   hashtable_t* latest = hashtable_new(5000);
+   hashtable_insert(latest, "m0", &shardno[5]);
+   hashtable_filter(latest, 40000);                // merged keys must pass it too
+   printf("Merged, last wins (should be 1): %d\n", hashtable_merge_many(latest, shards, 5, 3, NULL, lastitem));
+   int expect = 0, firstwrong = 0, lastwrong = 0;
+   for (int i = 0; i < 40000; i++) {
+     int firstsrc = -1, lastsrc = -1;
+     for (int s = 0; s < 5; s++) {
+       if (i % (s + 2) == 0) {
+         firstsrc = firstsrc < 0 ? s : firstsrc;
+         lastsrc = s;
+       }
+     }
+     firstsrc = i == 0 ? 5 : firstsrc;
+     expect += firstsrc >= 0;
+     sprintf(probe, "m%d", i);
+     int* a = hashtable_find(merged, probe);
+     int* b = hashtable_find(latest, probe);
+     firstwrong += firstsrc < 0 ? a != NULL : a == NULL || *a != firstsrc;
+     lastwrong += lastsrc < 0 ? b != NULL : b == NULL || *b != lastsrc;
+   }
+   int npairs = 0;
+   hashtable_iterate(merged, &npairs, itemcount);
+   printf("Keys (should be %d): %d\n", expect, npairs);
+   printf("Wrong items, first and last wins (should be 0 0): %d %d\n", firstwrong, lastwrong);
+   for (int s = 0; s < 5; s++) {
+     hashtable_delete(shards[s], NULL);
+   }
+   hashtable_delete(merged, NULL);
+   hashtable_delete(latest, NULL);
+
+   //a journal of changes, replayed into a new table, and again after a torn write
+   printf("\nJournal:\n");
+   remove("test.journal");
+   journal_t* journal = journal_open("test.journal", 1 << 20, 1000, true);
+   hashtable_t* logged = hashtable_new(100);
+   printf("Journal without itemsize (should be 0): %d\n", hashtable_journal(logged, journal, NULL));
+   hashtable_journal(logged, journal, namesize);
+   for (int i = 0; i < 1000; i++) {
+     sprintf(probe, "log%d", i);
+     hashtable_insert(logged, probe, "College");
+   }
+   for (int i = 0; i < 100; i++) {
+     sprintf(probe, "log%d", i);
+     hashtable_remove(logged, probe);
+   }
+   printf("Sync (should be 1): %d\n", journal_sync(journal));
+   journal_stats_t jstats;
+   journal_stats(journal, &jstats);
+   printf("Records %lu (should be 1100) in fewer writes (should be 1): %d\n",
+          jstats.records, jstats.writes < jstats.records);
+   hashtable_journal(logged, NULL, NULL);
+   printf("Close (should be 1): %d\n", journal_close(journal));
+   hashtable_t* replayed = hashtable_new(100);
+   printf("Replayed records (should be 1100): %ld\n",
+          hashtable_replay(replayed, "test.journal", nameload, namedelete));
+   printf("Count (should be 900): ");
+   hashcount = 0;
+   hashtable_iterate(replayed, &hashcount, itemcount);
+   printf("%d\n", hashcount);
+   printf("Find log500, log50 (should be College 1): %s %d\n",
+          (char*)hashtable_find(replayed, "log500"), hashtable_find(replayed, "log50") == NULL);
+   FILE* torn = fopen("test.journal", "ab");   // half a record, as a crash leaves
+   if (torn != NULL) {
+     fwrite("\x20\0\0\0\x01\x02\x03\x04I", 1, 9, torn);
+     fclose(torn);
+   }
+   hashtable_t* again = hashtable_new(100);
+   printf("Replayed after a torn write (should be 1100): %ld\n",
+          hashtable_replay(again, "test.journal", nameload, namedelete));
+   journal = journal_open("test.journal", 1 << 20, 1000, true);  // a restart
+   hashtable_t* restarted = hashtable_new(100);
+   hashtable_journal(restarted, journal, namesize);
+   hashtable_insert(restarted, "after0", "College");
+   hashtable_insert(restarted, "after1", "College");
+   hashtable_insert(restarted, "after2", "College");
+   printf("Close after the restart (should be 1): %d\n", journal_close(journal));
+   hashtable_delete(restarted, NULL);
+   hashtable_t* third = hashtable_new(100);
+   printf("Replayed after the restart (should be 1103): %ld\n",
+          hashtable_replay(third, "test.journal", nameload, namedelete));
+   printf("Find after2 (should be College): %s\n", (char*)hashtable_find(third, "after2"));
+   hashtable_delete(third, namedelete);
+   journal = journal_open("test.journal", 1 << 20, 1000, true);  // a replace, and a crash inside it
+   hashtable_t* replacing = hashtable_new(100);
+   hashtable_journal(replacing, journal, namesize);
+   hashtable_insert(replacing, "swapped", "College");
+   journal_sync(journal);
+   journal_stats(journal, &jstats);
+   size_t inserted = jstats.bytes;
+   hashtable_replace(replacing, "swapped", "University");
+   journal_sync(journal);
+   journal_stats(journal, &jstats);
+   printf("One record for the replace (should be 2): %lu\n", jstats.records);
+   printf("Close after the replace (should be 1): %d\n", journal_close(journal));
+   hashtable_delete(replacing, NULL);
+   hashtable_t* swapped = hashtable_new(100);
+   printf("Replayed with the replace (should be 1105): %ld\n",
+          hashtable_replay(swapped, "test.journal", nameload, namedelete));
+   printf("Find swapped (should be University): %s\n", (char*)hashtable_find(swapped, "swapped"));
+   hashtable_delete(swapped, namedelete);
+   FILE* full = fopen("test.journal", "rb");
+   long size = 0;
+   if (full != NULL) {
+     fseek(full, 0, SEEK_END);
+     size = ftell(full);
+     fclose(full);
+   }
+   if (truncate("test.journal", size - (long)(jstats.bytes - inserted) / 2) != 0) {  // half the replace
+     printf("truncate failed\n");
+   }
+   swapped = hashtable_new(100);
+   printf("Replayed with half the replace (should be 1104): %ld\n",
+          hashtable_replay(swapped, "test.journal", nameload, namedelete));
+   printf("Find swapped (should be College): %s\n", (char*)hashtable_find(swapped, "swapped"));
+   hashtable_delete(swapped, namedelete);
+   remove("test.journal");
+   journal = journal_open("test.journal", 1 << 20, 1000, true);  // a merge logs its replaces whole too
+   hashtable_t* mergedest = hashtable_new(100);
+   hashtable_t* mergesrc = hashtable_new(100);
+   hashtable_journal(mergedest, journal, namesize);
+   hashtable_insert(mergedest, "shared", "College");
+   hashtable_insert(mergesrc, "shared", "University");
+   hashtable_insert(mergesrc, "fresh", "College");
+   hashtable_merge_many(mergedest, &mergesrc, 1, 2, NULL, lastitem);
+   journal_sync(journal);
+   journal_stats(journal, &jstats);
+   printf("Records for the merge (should be 3): %lu\n", jstats.records);
+   printf("Close after the merge (should be 1): %d\n", journal_close(journal));
+   hashtable_delete(mergedest, NULL);
+   hashtable_delete(mergesrc, NULL);
+   swapped = hashtable_new(100);
+   printf("Replayed the merge (should be 3): %ld\n",
+          hashtable_replay(swapped, "test.journal", nameload, namedelete));
+   printf("Find shared (should be University): %s\n", (char*)hashtable_find(swapped, "shared"));
+   hashtable_delete(swapped, namedelete);
+   hashtable_delete(logged, NULL);
+   hashtable_delete(replayed, namedelete);
+   hashtable_delete(again, namedelete);
+   remove("test.journal");
+
+   //a table on huge, interleaved pages; any placement the system refuses falls back
+   printf("\nPlaced pages:\n");
+   printf("Contradictory flags (should be 0): %d\n", pages_init(PAGES_LOCAL | PAGES_INTERLEAVE));
+   printf("Huge, interleaved (should be 1): %d\n", pages_init(PAGES_HUGE | PAGES_INTERLEAVE));
+   hashtable_allocator(pages_malloc, pages_free, pages_usable);
+   hashtable_t* placed = hashtable_new(100000);   // a slot array of its own mapping
+   wrong = 0;
+   for (int i = 0; i < 1000; i++) {
+     sprintf(probe, "placed%d", i);
+     hashtable_insert(placed, probe, "College");
+   }
+   for (int i = 0; i < 1000; i++) {
+     sprintf(probe, "placed%d", i);
+     if (hashtable_find(placed, probe) == NULL) {
+       wrong++;
+     }
+   }
+   printf("Wrong answers (should be 0): %d\n", wrong);
+   pages_stats_t pstats;
+   pages_stats(&pstats);
+   printf("Mapped at least the slot array (should be 1): %d\n",
+          pstats.mapped >= 100000 * sizeof(void*) && pstats.mappings >= 2);
+   printf("Memory usage counts the slack (should be 1): %d\n",
+          hashtable_memory_usage(placed) > 100000 * sizeof(void*));
+   hashtable_delete(placed, NULL);
+   hashtable_allocator(NULL, NULL, NULL);
+   pages_init(0);
+
+   //a bounded cache of 4 entries, then of 100 bytes
+   printf("\nThe cache:\n");
+   int evicted = 0;
+   cache_t* cache = cache_new(num_slots, 4, 0, NULL);
+   printf("Cache with no limit (should be 1): %d\n", cache_new(num_slots, 0, 0, NULL) == NULL);
+   cache_delete(cache);
+   cache = cache_new(num_slots, 4, 0, evictcount);
+   evicted = 0;
+   for (int i = 0; i < 4; i++) {
+     sprintf(probe, "key%d", i);
+     cache_insert(cache, probe, &evicted, 1);
+   }
+   printf("Duplicate insert (should be 0): %d\n", cache_insert(cache, "key0", &evicted, 1));
+   cache_find(cache, "key0");              // key0 and key2 are referenced
+   cache_find(cache, "key2");
+   cache_insert(cache, "key4", &evicted, 1);  // evicts key1, sparing key0
+   cache_insert(cache, "key5", &evicted, 1);  // evicts key3, sparing key2
+   printf("Evictions (should be 2): %d\n", evicted);
+   printf("Find key0, key2 (should be 1): %d\n",
+          cache_find(cache, "key0") != NULL && cache_find(cache, "key2") != NULL);
+   printf("Find key1, key3 (should be 1): %d\n",
+          cache_find(cache, "key1") == NULL && cache_find(cache, "key3") == NULL);
+   printf("Remove key5 (should be 1): %d\n", cache_remove(cache, "key5") == &evicted);
+   cache_stats_t cstats;
+   cache_stats(cache, &cstats);
+   printf("Stats: %lu hits (should be 4), %lu misses (should be 2), %lu evictions (should be 2), %ld entries (should be 3)\n",
+          cstats.hits, cstats.misses, cstats.evictions, cstats.entries);
+   for (int i = 0; i < 1000; i++) {        // every key hot: eviction still bounded
+     sprintf(probe, "hot%d", i);
+     cache_insert(cache, probe, &evicted, 1);
+     cache_find(cache, probe);
+   }
+   cache_stats(cache, &cstats);
+   printf("Entries after 1000 hot inserts (should be 4): %ld\n", cstats.entries);
+   evicted = 0;
+   cache_delete(cache);
+   printf("Items handed back by delete (should be 4): %d\n", evicted);
+   cache = cache_new(num_slots, 0, 100, evictcount);
+   evicted = 0;
+   for (int i = 0; i < 10; i++) {
+     sprintf(probe, "big%d", i);
+     cache_insert(cache, probe, &evicted, 30);
+   }
+   printf("Too big an item (should be 0): %d\n", cache_insert(cache, "huge", &evicted, 101));
+   cache_stats(cache, &cstats);
+   printf("Bytes %zu (should be 90), evictions (should be 7): %d\n", cstats.bytes, evicted);
+   cache_delete(cache);
+   hashtable_allocator(flakyalloc, free, NULL);   // a full cache, then out of memory
+   cache = cache_new(num_slots, 0, 100, evictcount);
+   evicted = 0;
+   for (int i = 0; i < 3; i++) {
+     sprintf(probe, "big%d", i);
+     cache_insert(cache, probe, &evicted, 30);
+   }
+   outofmemory = true;
+   printf("Insert out of memory (should be 0): %d\n", cache_insert(cache, "late", &evicted, 30));
+   outofmemory = false;
+   cache_stats(cache, &cstats);
+   printf("Nothing evicted for it (should be 0 3): %d %ld\n", evicted, cstats.entries);
+   cache_delete(cache);
+   hashtable_allocator(NULL, NULL, NULL);
+
+   //a shared-memory copy of hash1, read by a second mapping and a child process
+   printf("\nShared memory:\n");
+   char shmname[64];
+   snprintf(shmname, sizeof(shmname), "/hashtabletest.%ld", (long)getpid());
+   shmtable_unlink(shmname);
+   shmtable_t* shm = shmtable_create(shmname, 100, 1 << 20);
+   printf("Create twice (should be 1): %d\n",
+          shm != NULL && shmtable_create(shmname, 100, 1 << 20) == NULL);
+   printf("Copy (should be 1): %d\n", shmtable_copy(shm, hash1, namesize));
+   hashcount = 0;
+   hashtable_iterate(hash1, &hashcount, itemcount);
+   printf("Size (should be %d): %ld\n", hashcount, shmtable_size(shm));
+   shmtable_t* reader = shmtable_attach(shmname);
+   printf("Reader may not insert (should be 0): %d\n", shmtable_insert(reader, "x", "y", 2));
+   shmcheck_t check = { hash1, 0 };
+   shmtable_iterate(reader, &check, shmcompare);
+   printf("Reader disagrees with hash1 (should be 0): %d\n", check.wrong);
+   shmtable_insert(shm, "shared", "Dartmouth", 10);
+   size_t shmlen = 0;
+   const char* shmitem = shmtable_find(reader, "shared", &shmlen);
+   printf("Reader sees a later insert (should be Dartmouth 10): %s %zu\n",
+          shmitem == NULL ? "(null)" : shmitem, shmlen);
+   fflush(stdout);
+   pid_t child = fork();
+   if (child == 0) {
+     shmtable_t* other = shmtable_attach(shmname);   // a process of its own
+     _exit(shmtable_find(other, "shared", NULL) != NULL ? 0 : 1);
+   }
+   int status = -1;
+   waitpid(child, &status, 0);
+   printf("Child process finds it (should be 1): %d\n",
+          child > 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+   printf("Remove (should be 1): %d\n", shmtable_remove(shm, "shared"));
+   printf("Reader sees the remove (should be 1): %d\n", shmtable_find(reader, "shared", NULL) == NULL);
+   printf("Usage shared (should be 1): %d\n",
+          shmtable_memory_usage(reader) == shmtable_memory_usage(shm));
+   shmtable_detach(reader);
+   shmtable_detach(shm);
+   printf("Unlink (should be 1): %d\n", shmtable_unlink(shmname));
+   printf("Attach after unlink (should be 1): %d\n", shmtable_attach(shmname) == NULL);
+   shm = shmtable_create(shmname, 1, 64);
+   printf("Full segment (should be 0): %d\n", shmtable_insert(shm, "key", key, sizeof(key)));
+   shmtable_detach(shm);
+   shmtable_unlink(shmname);
+
+   //updates queued by several threads, drained into a table by one
+   printf("\nIngest:\n");
+   printf("Bad capacity (should be 1): %d\n", ingest_new(0, 8) == NULL);
+   ingest_t* queue = ingest_new(5, 8);          // rounded up to 8
+   int puts = 0;
+   for (int i = 0; i < 9; i++) {
+     int* one = malloc(sizeof(int));
+     *one = 1;
+     snprintf(key, sizeof(key), "k%d", i % 3);
+     if (ingest_put(queue, key, one)) {
+       puts++;
+     } else {
+       free(one);
+     }
+   }
+   printf("Puts into 8 cells (should be 8): %d\n", puts);
+   printf("Size (should be 8): %ld\n", ingest_size(queue));
+   printf("Key too long (should be 0): %d\n", ingest_put(queue, "ninechars", &puts));
+   hashtable_t* counts = hashtable_new(10);
+   printf("Drain 3 (should be 3): %ld\n", ingest_drain(queue, counts, 3, NULL, addcount, free));
+   printf("Drain the rest (should be 5): %ld\n", ingest_drain(queue, counts, 100, NULL, addcount, free));
+   printf("Drain empty (should be 0): %ld\n", ingest_drain(queue, counts, 100, NULL, addcount, free));
+   int* k0 = hashtable_find(counts, "k0");
+   int* k2 = hashtable_find(counts, "k2");
+   printf("Counts of k0 and k2 (should be 3 2): %d %d\n", k0 == NULL ? 0 : *k0, k2 == NULL ? 0 : *k2);
+   int* put1 = malloc(sizeof(int));
+   int* put2 = malloc(sizeof(int));
+   int* old = malloc(sizeof(int));
+   *put1 = 1;
+   *put2 = 2;
+   *old = 0;
+   ingest_put(queue, "k2", put1);
+   ingest_put(queue, "k2", put2);
+   hashtable_t* lastput = hashtable_new(10);
+   hashtable_insert(lastput, "k2", old);
+   ingest_drain(queue, lastput, 100, NULL, NULL, free);  // NULL merge: last put wins
+   int* last = hashtable_find(lastput, "k2");
+   printf("Last put wins (should be 2): %d\n", last == NULL ? 0 : *last);
+   hashtable_delete(lastput, free);
+   int* late = malloc(sizeof(int));
+   *late = 5;
+   ingest_put(queue, "k1", late);
+   hashtable_snapshot_t* held = hashtable_snapshot(counts);
+   printf("Drain under a snapshot (should be -1 1): %ld ",
+          ingest_drain(queue, counts, 100, NULL, NULL, free));
+   printf("%ld\n", ingest_size(queue));
+   hashtable_snapshot_release(held);
+   printf("Drain after release (should be 1): %ld\n", ingest_drain(queue, counts, 100, NULL, NULL, free));
+   int* k1 = hashtable_find(counts, "k1");
+   printf("Replaced k1 (should be 5): %d\n", k1 == NULL ? 0 : *k1);
+   int before = 0, after = 0;
+   printf("Replace missing key (should be 1): %d\n", hashtable_replace(counts, "k9", &after) == NULL);
+   printf("Wrap around the ring (should be 1): %d\n",
+          ingest_put(queue, "k0", &before) && ingest_drain(queue, counts, 1, &before, lastitem, NULL) == 1
+          && hashtable_replace(counts, "k0", k0) == &before);
+   ingest_delete(queue, NULL);
+   hashtable_delete(counts, free);
+
+   // now from PRODUCERS threads at once, into a small ring
+   queue = ingest_new(256, 16);
+   counts = hashtable_new(100);
+   producer_t producers[PRODUCERS];
+   pthread_t threads[PRODUCERS];
+   int started = 0;
+   for (int t = 0; t < PRODUCERS; t++) {
+     producers[t] = (producer_t){ queue, t };
+     started += pthread_create(&threads[t], NULL, produce, &producers[t]) == 0;
+   }
+   long drained = 0;
+   while (drained < (long)started * PUTS) {
+     long n = ingest_drain(queue, counts, 1000, NULL, addcount, free);
+     if (n > 0) {
+       drained += n;
+     } else {
+       sched_yield();             // let the producers run
+     }
+   }
+   for (int t = 0; t < started; t++) {
+     pthread_join(threads[t], NULL);
+   }
+   long total = 0;
+   hashcount = 0;
+   hashtable_iterate(counts, &total, sumcount);
+   hashtable_iterate(counts, &hashcount, itemcount);
+   printf("Producers started (should be %d): %d\n", PRODUCERS, started);
+   printf("Keys and total count (should be %d %d): %d %ld\n",
+          PRODUCERS * 500, PRODUCERS * PUTS, hashcount, total);
+   printf("Queue empty (should be 0): %ld\n", ingest_size(queue));
+   ingest_delete(queue, free);
+   hashtable_delete(counts, free);
+
    //delete the hashtables
    printf("\ndelete the hashtables...\n");
    hashtable_delete(hash1, namedelete);
-   hashtable_delete(hash2, namedelete); 
+   hashtable_delete(hash2, NULL);    // hash2 shares its items with hash1
+
+   //memory accounting, through an allocator that counts what it hands out
+   printf("\nMemory accounting:\n");
+   printf("Usage of NULL (should be 0): %zu\n", hashtable_memory_usage(NULL));
+   hashtable_allocator(countalloc, countfree, NULL);  // no sizefn: no slack to count
+   hashtable_t* counted = hashtable_new(10);
+   size_t empty = hashtable_memory_usage(counted);
+   hashtable_insert(counted, "Dartmouth", "College");
+   hashtable_insert(counted, "Hanover", "NH");
+   printf("Usage is what the allocator holds (should be 1): %d\n",
+          hashtable_memory_usage(counted) == livebytes);
+   printf("Keys counted, items not (should be 1): %d\n",
+          hashtable_memory_usage(counted) >= empty + sizeof("Dartmouth") + sizeof("Hanover")
+          && hashtable_memory_usage(counted) < empty + 200);
+   hashtable_filter(counted, 1000);
+   printf("With a filter (should be 1): %d\n", hashtable_memory_usage(counted) == livebytes);
+   hashtable_snapshot_t* countsnap = hashtable_snapshot(counted);
+   hashtable_insert(counted, "Lebanon", "NH");       // into a new layer
+   hashtable_snapshot_release(countsnap);            // the layer stays until folded
+   hashtable_stats(counted, &stats);
+   printf("Layers, and usage with them (should be 2 1): %d %d\n", stats.layers,
+          hashtable_memory_usage(counted) == livebytes);
+   hashtable_delete(counted, NULL);
+   printf("All freed through the allocator (should be 0): %zu\n", livebytes);
+   hashtable_allocator(NULL, NULL, NULL);
    return 0;
   }
 
@@ -152,3 +961,145 @@
      free(item);    
  }
  
+
+ // insert a key into the typed hashtable with count 1
+ static void typedinsert(void* arg, const char* key, void* item)
+ {
+   namecount_insert(arg, key, 1);
+ }
+
+ // count the items in the typed hashtable
+ static void typedcount(void* arg, const char* key, int* count)
+ {
+   int* nitems = arg;
+   if (nitems != NULL && key != NULL && *count == 1) {
+     (*nitems)++;
+   }
+ }
+
+ // count the items a cache evicts or deletes; the item is the counter
+ static void evictcount(void* item)
+ {
+   (*(int*)item)++;
+ }
+
+ // count each scan%d key seen, in the array given as arg
+ static void scancount(void* arg, const char* key, void* item)
+ {
+   int* seen = arg;
+   int i;
+   if (sscanf(key, "scan%d", &i) == 1 && i >= 0 && i < 500) {
+     seen[i]++;
+   }
+ }
+
+ // a merge that keeps the later table's item
+ static void* lastitem(void* arg, const char* key, void* item, void* other)
+ {
+   return other;
+ }
+
+ // an ingest merge that adds the update's count into the table's
+ static void* addcount(void* arg, const char* key, void* item, void* other)
+ {
+   *(int*)item += *(int*)other;
+   return item;                   // the drain frees other
+ }
+
+ // put PUTS counts of 1, over the producer's own 500 keys, retrying when full
+ static void* produce(void* arg)
+ {
+   producer_t* producer = arg;
+   char key[32];
+   for (int i = 0; i < PUTS; i++) {
+     int* one = malloc(sizeof(int));
+     *one = 1;
+     snprintf(key, sizeof(key), "p%d-%d", producer->id, i % 500);
+     while (!ingest_put(producer->queue, key, one)) {
+       sched_yield();             // full: let the consumer drain it
+     }
+   }
+   return NULL;
+ }
+
+ // add each count to the total at arg
+ static void sumcount(void* arg, const char* key, void* item)
+ {
+   *(long*)arg += *(int*)item;
+ }
+
+ // true if two files hold the same bytes; reads both from the start
+ static bool samefile(FILE* a, FILE* b)
+ {
+   rewind(a);
+   rewind(b);
+   int ca, cb;
+   do {
+     ca = getc(a);
+     cb = getc(b);
+   } while (ca == cb && ca != EOF);
+   return ca == cb;
+ }
+
+ // the bytes of a name, for the journal
+ static size_t namesize(void* item)
+ {
+   return strlen(item) + 1;
+ }
+
+ // a name from the bytes the journal logged for it
+ static void* nameload(const void* bytes, const size_t len)
+ {
+   char* name = malloc(len);
+   if (name != NULL) {
+     memcpy(name, bytes, len);
+   }
+   return name;
+ }
+
+ // count the pairs of a shmtable whose item differs from the hashtable's
+ static void shmcompare(void* arg, const char* key, const void* item, const size_t len)
+ {
+   shmcheck_t* check = arg;
+   const char* name = hashtable_find(check->ht, key);
+   if (name == NULL || strlen(name) + 1 != len || memcmp(name, item, len) != 0) {
+     check->wrong++;
+   }
+ }
+
+ // count the items in the inttable
+ static void intcount(void* arg, const uint64_t key, void* item)
+ {
+   int* nitems = arg;
+   if (nitems != NULL && item != NULL) {
+     (*nitems)++;
+   }
+ }
+
+ // allocate size bytes, remembering the size in front of them
+ static void* countalloc(size_t size)
+ {
+   max_align_t* block = malloc(sizeof(max_align_t) + size);
+   if (block == NULL) {
+     return NULL;
+   }
+   *(size_t*)block = size;
+   livebytes += size;
+   return block + 1;
+ }
+
+ // free a block from countalloc
+ static void countfree(void* ptr)
+ {
+   if (ptr != NULL) {
+     max_align_t* block = (max_align_t*)ptr - 1;
+     livebytes -= *(size_t*)block;
+     free(block);
+   }
+ }
+
+ // malloc, unless the test has us pretend to be out of memory
+ static void* flakyalloc(size_t size)
+ {
+   return outofmemory ? NULL : malloc(size);
+ }
@@ -0,0 +1,280 @@
+/*
+ * ingest.c - source file for ingest queue module
+ *
+ * The ring is an array of cells, a power of 2 of them.  Producers take
+ * positions from `tail` and the consumer from `head`, both counting up
+ * forever; position pos lives in cell pos % capacity.  A cell's `seq`
+ * is pos when the cell is free for the producer of position pos, pos+1
+ * once that producer has filled it, and pos+capacity once the consumer
+ * has emptied it for the next lap.  A producer claims position pos by
+ * advancing tail from pos with a compare-and-swap, and only if the cell
+ * says it is free; so a full ring is seen, and refused, without waiting.
+ * See Vyukov, "Bounded MPMC queue" (1024cores.net, 2010); with one
+ * consumer, head needs no compare-and-swap.  See ingest.h for the
+ * semantics.
+ *
+ * Adwiteeya Rupantee Paul, April 2025
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include "ingest.h"
+#include "hashtable.h"
+
+/**************** local types ****************/
+typedef struct cell {
+    atomic_size_t seq;           // whose turn it is; see above
+    void* item;                  // the update's item
+    uint32_t tag;                // hash of the key, made by the producer
+    char key[];                  // copy of the key, keymax+1 bytes
+} cell_t;
+
+/**************** global types ****************/
+/* tail and head on cache lines of their own, so producers bumping one
+ * do not slow the consumer reading the other */
+typedef struct ingest {
+    _Alignas(64) atomic_size_t tail;   // next position a producer takes
+    _Alignas(64) atomic_size_t head;   // next position the consumer takes
+    size_t mask;                       // capacity - 1
+    size_t stride;                     // bytes per cell, a multiple of 64
+    size_t keymax;                     // longest key, in bytes
+    char* cells;
+} ingest_t;
+
+/**************** global functions ****************/
+/* that is, visible outside this file */
+/* see ingest.h for comments about exported functions */
+
+/**************** local functions ****************/
+/* not visible outside this file */
+static inline cell_t* cell_at(ingest_t* q, const size_t pos);
+static inline uint32_t key_tag(const char* key, size_t* len);
+
+/**************** cell_at() ****************/
+/* the cell that holds position pos */
+static inline cell_t*
+cell_at(ingest_t* q, const size_t pos)
+{
+    return (cell_t*)(q->cells + (pos & q->mask) * q->stride);
+}
+
+/**************** key_tag() ****************/
+/* FNV-1a of the key, and its length in *len */
+static inline uint32_t
+key_tag(const char* key, size_t* len)
+{
+    uint32_t h = 2166136261u;
+    const char* p = key;
+    for (; *p != '\0'; p++) {
+        h = (h ^ (uint8_t)*p) * 16777619u;
+    }
+    *len = p - key;
+    return h;
+}
+
+/**************** ingest_new() ****************/
+/* see ingest.h for description */
+ingest_t*
+ingest_new(const long capacity, const size_t keymax)
+{
+    if (capacity <= 0 || capacity > (1L << 30) || keymax == 0 || keymax > (1 << 20)) {
+        return NULL;
+    }
+    size_t cap = 1;
+    while (cap < (size_t)capacity) {
+        cap <<= 1;
+    }
+    ingest_t* q = aligned_alloc(64, sizeof(ingest_t));
+    if (q == NULL) {
+        return NULL;
+    }
+    q->mask = cap - 1;
+    q->stride = (sizeof(cell_t) + keymax + 1 + 63) / 64 * 64;
+    q->keymax = keymax;
+    q->cells = aligned_alloc(64, cap * q->stride);
+    if (q->cells == NULL) {
+        free(q);
+        return NULL;
+    }
+    for (size_t pos = 0; pos < cap; pos++) {
+        atomic_init(&cell_at(q, pos)->seq, pos);    // free for the first lap
+    }
+    atomic_init(&q->tail, 0);
+    atomic_init(&q->head, 0);
+    return q;
+}
+
+/**************** ingest_put() ****************/
+/* see ingest.h for description */
+bool
+ingest_put(ingest_t* q, const char* key, void* item)
+{
+    if (q == NULL || key == NULL || item == NULL) {
+        return false;
+    }
+    size_t len;
+    uint32_t tag = key_tag(key, &len);
+    if (len > q->keymax) {
+        return false;
+    }
+
+    // claim a position whose cell is free
+    size_t pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    cell_t* cell;
+    for (;;) {
+        cell = cell_at(q, pos);
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t lag = (intptr_t)(seq - pos);
+        if (lag == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->tail, &pos, pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                break;              // ours; on failure pos is the new tail
+            }
+        } else if (lag < 0) {
+            return false;           // the consumer has not emptied it: full
+        } else {
+            pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+        }
+    }
+
+    // fill it, then hand it to the consumer
+    memcpy(cell->key, key, len + 1);
+    cell->item = item;
+    cell->tag = tag;
+    atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+    return true;
+}
+
+/**************** ingest_drain() ****************/
+/* see ingest.h for description */
+long
+ingest_drain(ingest_t* q, hashtable_t* ht, const long max, void* arg,
+             void* (*merge)(void* arg, const char* key, void* item, void* other),
+             void (*itemdelete)(void* item))
+{
+    if (q == NULL || ht == NULL || max <= 0) {
+        return -1;
+    }
+    const char* keys[INGEST_BATCH];
+    void* found[INGEST_BATCH];
+    cell_t* cells[INGEST_BATCH];
+    size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    long done = 0;
+
+    while (done < max) {
+        // take the filled cells at the head, up to a batch
+        int n = 0;
+        while (n < INGEST_BATCH && done + n < max) {
+            cell_t* cell = cell_at(q, head + n);
+            if (atomic_load_explicit(&cell->seq, memory_order_acquire) != head + n + 1) {
+                break;              // empty, or its producer is still filling it
+            }
+            cells[n] = cell;
+            keys[n] = cell->key;
+            n++;
+        }
+        if (n == 0) {
+            break;
+        }
+        hashtable_find_many(ht, keys, found, n);
+
+        // apply them in order; a key written earlier in the batch has a
+        // stale lookup, so keys whose tag bit is set are looked up again
+        uint64_t written[4] = {0, 0, 0, 0};
+        int applied;
+        for (applied = 0; applied < n; applied++) {
+            cell_t* cell = cells[applied];
+            void* item = found[applied];
+            unsigned bit = cell->tag & 255;
+            if ((written[bit >> 6] >> (bit & 63)) & 1) {
+                item = hashtable_find(ht, cell->key);
+            }
+            if (item == NULL) {
+                if (!hashtable_insert(ht, cell->key, cell->item)) {
+                    break;          // out of memory: retry it next drain
+                }
+            } else {
+                void* other = cell->item;
+                void* keep = merge == NULL ? other : (*merge)(arg, cell->key, item, other);
+                if (keep == NULL) {
+                    keep = item;
+                }
+                if (keep != item) {
+                    void* old = hashtable_replace(ht, cell->key, keep);
+                    if (old == NULL) {
+                        // a snapshot sees the key: retry it next drain
+                        if (keep != other && itemdelete != NULL) {
+                            (*itemdelete)(keep);
+                        }
+                        break;
+                    }
+                    if (itemdelete != NULL) {
+                        (*itemdelete)(old);     // displaced from the table
+                    }
+                }
+                if (other != keep && other != item && itemdelete != NULL) {
+                    (*itemdelete)(other);       // folded in, or not kept
+                }
+                if (keep == item) {
+                    continue;       // nothing written
+                }
+            }
+            written[bit >> 6] |= 1ULL << (bit & 63);
+        }
+
+        // give the applied cells back to the producers, for the next lap
+        for (int i = 0; i < applied; i++) {
+            atomic_store_explicit(&cells[i]->seq, head + i + q->mask + 1,
+                                  memory_order_release);
+        }
+        head += applied;
+        done += applied;
+        atomic_store_explicit(&q->head, head, memory_order_relaxed);
+        if (applied < n) {
+            return done > 0 ? done : -1;
+        }
+    }
+    return done;
+}
+
+/**************** ingest_size() ****************/
+/* see ingest.h for description */
+long
+ingest_size(ingest_t* q)
+{
+    if (q == NULL) {
+        return 0;
+    }
+    size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    intptr_t size = (intptr_t)(tail - head);
+    // claimed positions count, filled or not; a stale pair may be off
+    return size < 0 ? 0 : size > (intptr_t)(q->mask + 1) ? (long)(q->mask + 1) : (long)size;
+}
+
+/**************** ingest_delete() ****************/
+/* see ingest.h for description */
+void
+ingest_delete(ingest_t* q, void (*itemdelete)(void* item))
+{
+    if (q == NULL) {
+        return;
+    }
+    if (itemdelete != NULL) {
+        size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+        for (;; head++) {
+            cell_t* cell = cell_at(q, head);
+            if (atomic_load_explicit(&cell->seq, memory_order_acquire) != head + 1) {
+                break;
+            }
+            (*itemdelete)(cell->item);
+        }
+    }
+    free(q->cells);
+    free(q);
+}
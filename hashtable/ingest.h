@@ -0,0 +1,117 @@
+/*
+ * ingest.h - header file for ingest queue module
+ *
+ * An *ingest* queue carries (key,item) updates from many producer
+ * threads to the one thread that owns a hashtable, so the table keeps a
+ * single writer and needs no lock.  Producers put updates into a bounded
+ * ring, and never block: when the ring is full, a put fails at once and
+ * the producer decides what to do (retry, drop, or count it).  The owner
+ * drains the ring into its table from time to time, many updates at once.
+ *
+ * The ring is Vyukov's bounded queue: each cell carries a sequence
+ * number that says whose turn it is, producers claim cells with one
+ * compare-and-swap on the tail, and the single consumer needs no atomic
+ * read-modify-write at all.  Keys are copied into the cells, so a put
+ * allocates nothing, and a drain reads them where they lie.
+ *
+ * Adwiteeya Rupantee Paul, April 2025
+ */
+
+#ifndef __INGEST_H
+#define __INGEST_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "hashtable.h"
+
+/**************** global types ****************/
+typedef struct ingest ingest_t;  // opaque to users of the module
+
+/* updates a drain looks up in the table at once (see hashtable_find_many) */
+#define INGEST_BATCH 64
+
+/**************** functions ****************/
+
+/**************** ingest_new ****************/
+/* Create a new (empty) ingest queue.
+ *
+ * Caller provides:
+ *   capacity, the most updates it may hold (> 0; rounded up to a power
+ *   of 2, at most 2^30);
+ *   keymax, the longest key it accepts, in bytes (> 0).
+ * We return:
+ *   pointer to the new queue; NULL if a parameter is bad or out of memory.
+ * Notes:
+ *   Each cell takes keymax plus about 24 bytes, rounded up to a 64-byte
+ *   cache line, so producers filling neighbouring cells do not share one.
+ * Caller is responsible for:
+ *   later calling ingest_delete.
+ */
+ingest_t* ingest_new(const long capacity, const size_t keymax);
+
+/**************** ingest_put ****************/
+/* Queue an update of key to item; producers only, from any thread.
+ *
+ * Caller provides:
+ *   valid pointer to queue, valid string for key, valid pointer for item.
+ * We return:
+ *   true if the update was queued; false if the queue is full, the key
+ *   is longer than keymax, or a parameter is NULL.
+ * We do:
+ *   copy the key into the queue; the caller may reuse it at once.
+ *   never wait for the consumer, or for a lock.
+ * Notes:
+ *   Lock-free, not wait-free: a producer stopped between claiming a cell
+ *   and filling it holds up the consumer at that cell (but not the other
+ *   producers) until it resumes.  Updates from one producer are drained
+ *   in the order it put them.
+ */
+bool ingest_put(ingest_t* q, const char* key, void* item);
+
+/**************** ingest_drain ****************/
+/* Apply up to max queued updates to ht; the consumer only, one thread.
+ *
+ * Caller provides:
+ *   valid pointer to queue, valid pointer to hashtable with no snapshot
+ *   held (see hashtable_snapshot), max > 0;
+ *   merge(arg, key, item, other), which returns the item to keep when
+ *   key is already in ht with item and an update brings other (NULL to
+ *   keep item), or NULL to let other replace item;
+ *   itemdelete(item), which frees an item the drain lets go of, or NULL
+ *   if items need no freeing.
+ * We return:
+ *   the number of updates applied (0 if the queue is empty); -1 if a
+ *   parameter is bad, or if the first update could not be applied.
+ * We do:
+ *   insert each update's key with its item if the key is new, or fold
+ *   the item in with merge, in queue order.  Look up INGEST_BATCH keys
+ *   at once with hashtable_find_many, so their cache misses overlap.
+ * Notes:
+ *   Once an update is applied, the drain calls itemdelete on whichever of
+ *   item and other is no longer kept (both, if merge returns a new item);
+ *   merge itself frees neither.  Items change through hashtable_insert and
+ *   hashtable_replace, so a journal logs them like any others.  If the
+ *   table runs out of memory, or a snapshot taken despite the above sees
+ *   a key the update would replace, the update stays at the head of the
+ *   queue for the next drain to retry, and merge may see it again; an
+ *   item merge made for it is freed with itemdelete meanwhile.
+ */
+long ingest_drain(ingest_t* q, hashtable_t* ht, const long max, void* arg,
+                  void* (*merge)(void* arg, const char* key, void* item, void* other),
+                  void (*itemdelete)(void* item));
+
+/**************** ingest_size ****************/
+/* Return the number of updates queued now; 0 if q is NULL.
+ * Exact on the consumer's thread when no producer is mid-put; otherwise
+ * a snapshot that may already be stale, fit for backpressure decisions.
+ */
+long ingest_size(ingest_t* q);
+
+/**************** ingest_delete ****************/
+/* Delete the queue, calling itemdelete (if not NULL) on the item of each
+ * update still queued; ignore NULL q.  No producer may be using it.
+ */
+void ingest_delete(ingest_t* q, void (*itemdelete)(void* item));
+
+#endif // __INGEST_H
@@ -0,0 +1,136 @@
+/*
+ * inttable.c - source file for inttable module
+ *
+ * An *inttable* is a hashtable of (key,item) pairs whose keys are
+ * 64-bit unsigned integers.  The engine is the hashtable generated by
+ * typed.h: an array of slots, each a list of nodes holding the key and
+ * the item pointer inline.
+ *
+ * Adwiteeya Rupantee Paul, April 2025
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "inttable.h"
+#include "typed.h"
+
+/**************** local functions ****************/
+/* not visible outside this file */
+static inline unsigned long fibhash(const uint64_t key);
+static inline bool inteq(const uint64_t a, const uint64_t b);
+static void itemdelete_each(void* arg, const uint64_t key, void** item);
+
+/**************** fibhash() ****************/
+/* Fibonacci hashing: multiply by 2^64/phi and keep the well-mixed high bits */
+static inline unsigned long
+fibhash(const uint64_t key)
+{
+    return (unsigned long)((key * 0x9E3779B97F4A7C15ULL) >> 32);
+}
+
+/**************** inteq() ****************/
+/* integer keys are equal iff their values are */
+static inline bool
+inteq(const uint64_t a, const uint64_t b)
+{
+    return a == b;
+}
+
+/**************** local types ****************/
+/* struct intslots, the inttable_t of inttable.h, and its slot lists */
+DEFINE_HASHTABLE(intslots, uint64_t, void*, fibhash, inteq)
+
+/**************** inttable_new() ****************/
+/* see inttable.h for description */
+inttable_t*
+inttable_new(const int num_slots)
+{
+    return intslots_new(num_slots);
+}
+
+/**************** inttable_insert() ****************/
+/* see inttable.h for description */
+bool
+inttable_insert(inttable_t* it, const uint64_t key, void* item)
+{
+    if (it == NULL || item == NULL) {
+        return false;             // bad table or item
+    }
+    return intslots_insert(it, key, item);  // false if key exists
+}
+
+/**************** inttable_find() ****************/
+/* see inttable.h for description */
+void*
+inttable_find(inttable_t* it, const uint64_t key)
+{
+    void** item = intslots_find(it, key);
+    return item == NULL ? NULL : *item;
+}
+
+/**************** inttable_print() ****************/
+/* see inttable.h for description */
+void
+inttable_print(inttable_t* it, FILE* fp,
+               void (*itemprint)(FILE* fp, const uint64_t key, void* item))
+{
+    if (fp == NULL) {
+        return;
+    }
+    if (it == NULL) {
+        fprintf(fp, "(null)\n");
+        return;
+    }
+    // print one line per slot, like hashtable_print
+    for (int i = 0; i < it->num_slots; i++) {
+        fputc('{', fp);
+        for (intslots_slot_node_t* node = it->slots[i].head; node != NULL; node = node->next) {
+            if (itemprint != NULL) {
+                (*itemprint)(fp, node->key, node->val);
+                if (node->next != NULL) {
+                    fputc(',', fp);
+                }
+            }
+        }
+        fputs("}\n", fp);
+    }
+}
+
+/**************** inttable_iterate() ****************/
+/* see inttable.h for description */
+void
+inttable_iterate(inttable_t* it, void* arg,
+                 void (*itemfunc)(void* arg, const uint64_t key, void* item))
+{
+    if (it != NULL && itemfunc != NULL) {
+        for (int i = 0; i < it->num_slots; i++) {
+            for (intslots_slot_node_t* node = it->slots[i].head; node != NULL; node = node->next) {
+                (*itemfunc)(arg, node->key, node->val);
+            }
+        }
+    }
+}
+
+/**************** itemdelete_each() ****************/
+/* call the itemdelete function passed in arg on one item */
+static void
+itemdelete_each(void* arg, const uint64_t key, void** item)
+{
+    void (**itemdelete)(void* item) = arg;
+    (**itemdelete)(*item);
+}
+
+/**************** inttable_delete() ****************/
+/* see inttable.h for description */
+void
+inttable_delete(inttable_t* it, void (*itemdelete)(void* item))
+{
+    if (it != NULL) {
+        if (itemdelete != NULL) {
+            intslots_iterate(it, &itemdelete, itemdelete_each);
+        }
+        intslots_delete(it);
+    }
+}
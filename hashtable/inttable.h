@@ -0,0 +1,105 @@
+/*
+ * inttable.h - header file for inttable module
+ *
+ * An *inttable* is a hashtable of (key,item) pairs whose keys are
+ * 64-bit unsigned integers rather than strings.  It acts just like a
+ * hashtable, but the key is stored inline and hashed by multiplication
+ * (Fibonacci hashing), so no key string is formatted, hashed or copied.
+ *
+ * Adwiteeya Rupantee Paul, April 2025
+ */
+
+#ifndef __INTTABLE_H
+#define __INTTABLE_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/**************** global types ****************/
+typedef struct intslots inttable_t;  // opaque to users of the module
+
+/**************** functions ****************/
+
+/**************** inttable_new ****************/
+/* Create a new (empty) inttable.
+ *
+ * Caller provides:
+ *   number of slots to be used for the inttable (must be > 0).
+ * We return:
+ *   pointer to the new inttable; return NULL if error.
+ * We guarantee:
+ *   inttable is initialized empty.
+ * Caller is responsible for:
+ *   later calling inttable_delete.
+ */
+inttable_t* inttable_new(const int num_slots);
+
+/**************** inttable_insert ****************/
+/* Insert item, identified by an integer key, into the given inttable.
+ *
+ * Caller provides:
+ *   valid pointer to inttable, any key, valid pointer for item.
+ * We return:
+ *   false if key exists in it, it or item is NULL, or error;
+ *   true iff new item was inserted.
+ */
+bool inttable_insert(inttable_t* it, const uint64_t key, void* item);
+
+/**************** inttable_find ****************/
+/* Return the item associated with the given key.
+ *
+ * Caller provides:
+ *   valid pointer to inttable, any key.
+ * We return:
+ *   pointer to the item corresponding to the given key, if found;
+ *   NULL if inttable is NULL or key is not found.
+ * Notes:
+ *   the inttable is unchanged by this operation.
+ */
+void* inttable_find(inttable_t* it, const uint64_t key);
+
+/**************** inttable_print ****************/
+/* Print the whole table; provide the output file and func to print each item.
+ *
+ * Caller provides:
+ *   valid pointer to inttable,
+ *   FILE open for writing,
+ *   itemprint that can print a single (key, item) pair.
+ * We print:
+ *   nothing, if NULL fp.
+ *   "(null)" if NULL it.
+ *   one line per hash slot, with no items, if NULL itemprint.
+ *   otherwise, one line per hash slot, listing (key,item) pairs in that slot.
+ */
+void inttable_print(inttable_t* it, FILE* fp,
+                    void (*itemprint)(FILE* fp, const uint64_t key, void* item));
+
+/**************** inttable_iterate ****************/
+/* Iterate over all items in the table; in undefined order.
+ *
+ * Caller provides:
+ *   valid pointer to inttable,
+ *   arbitrary void*arg pointer,
+ *   itemfunc that can handle a single (key, item) pair.
+ * We do:
+ *   nothing, if it==NULL or itemfunc==NULL.
+ *   otherwise, call the itemfunc once for each item, with (arg, key, item).
+ */
+void inttable_iterate(inttable_t* it, void* arg,
+                      void (*itemfunc)(void* arg, const uint64_t key, void* item));
+
+/**************** inttable_delete ****************/
+/* Delete inttable, calling a delete function on each item.
+ *
+ * Caller provides:
+ *   valid inttable pointer,
+ *   valid pointer to function that handles one item (may be NULL).
+ * We do:
+ *   if inttable==NULL, do nothing.
+ *   otherwise, unless itemdelete==NULL, call the itemdelete on each item.
+ *   free the inttable itself.
+ */
+void inttable_delete(inttable_t* it, void (*itemdelete)(void* item));
+
+#endif // __INTTABLE_H
@@ -4,8 +4,11 @@
  * A *set* maintains an unordered collection of (key,item) pairs;
  * any given key can only occur in the set once. It starts out empty 
  * and grows as the caller inserts new (key,item) pairs.  The caller 
- * can retrieve items by asking for their key, but cannot remove or 
- * update pairs.  Items are distinguished by their key.
+ * can retrieve items by asking for their key, and remove pairs, but
+ * cannot update them.  Items are distinguished by their key.
+ *
+ * The set keeps its pairs sorted by key (in strcmp order), so that
+ * set_intersect, set_union and set_difference run in linear time.
  *
  * David Kotz, April 2016, 2017, 2019, 2021
  * updated by Xia Zhou, July 2016
@@ -16,6 +19,7 @@
 
 #include <stdio.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 /**************** global types ****************/
 typedef struct set set_t;  // opaque to users of the module
@@ -66,6 +70,20 @@ bool set_insert(set_t* set, const char* key, void* item);
  */
 void* set_find(set_t* set, const char* key);
 
+/**************** set_remove ****************/
+/* Remove the pair with the given key, and return its item.
+ *
+ * Caller provides:
+ *   valid set pointer, valid string pointer.
+ * We return:
+ *   the item that was stored under key, if found;
+ *   NULL if set is NULL, key is NULL, or key is not found.
+ * We do:
+ *   free the set's copy of the key; the item is not freed, since it
+ *   belongs to the caller, who now holds the only pointer to it.
+ */
+void* set_remove(set_t* set, const char* key);
+
 /**************** set_print ****************/
 /* Print the whole set; provide the output file and func to print each item.
  *
@@ -86,7 +104,7 @@ void set_print(set_t* set, FILE* fp,
                void (*itemprint)(FILE* fp, const char* key, void* item) );
 
 /**************** set_iterate ****************/
-/* Iterate over the set, calling a function on each item.
+/* Iterate over the set, calling a function on each item, in key order.
  * 
  * Caller provides:
  *   valid set pointer,
@@ -96,13 +114,30 @@ void set_print(set_t* set, FILE* fp,
  *   nothing, if set==NULL or itemfunc==NULL.
  *   otherwise, call the itemfunc on each item, with (arg, key, item).
  * Notes:
- *   the order in which set items are handled is undefined.
+ *   items are handled in increasing strcmp order of their keys.
  *   the set and its contents are not changed by this function,
  *   but the itemfunc may change the contents of the item.
  */
 void set_iterate(set_t* set, void* arg,
                  void (*itemfunc)(void* arg, const char* key, void* item) );
 
+/**************** set_prefix_iterate ****************/
+/* Like set_iterate, but only over the keys that start with prefix.
+ *
+ * Caller provides:
+ *   valid set pointer, valid string pointer for prefix ("" matches all),
+ *   arbitrary argument (pointer) that is passed-through to itemfunc,
+ *   valid pointer to function that handles one item.
+ * We do:
+ *   nothing, if any pointer but arg is NULL.
+ *   otherwise, call the itemfunc on each matching item, in key order.
+ * Notes:
+ *   the matching keys are one run of the sorted list, so we stop at the
+ *   first key past them.
+ */
+void set_prefix_iterate(set_t* set, const char* prefix, void* arg,
+                        void (*itemfunc)(void* arg, const char* key, void* item) );
+
 /**************** set_delete ****************/
 /* Delete set, calling a delete function on each item.
  *
@@ -119,4 +154,71 @@ void set_iterate(set_t* set, void* arg,
  */
 void set_delete(set_t* set, void (*itemdelete)(void* item) );
 
+/**************** set_intersect ****************/
+/* Fill dest with the keys found in both a and b.
+ *
+ * Caller provides:
+ *   valid pointer to an empty set dest (e.g., fresh from set_new),
+ *   valid pointers to sets a and b, both different from dest.
+ * We return:
+ *   false if any pointer is NULL, dest is a or b, dest is not empty,
+ *   or out of memory (dest may then hold part of the result);
+ *   true otherwise.
+ * We do:
+ *   insert into dest a copy of each key in both a and b, with a's item.
+ *   run in O(|a| + |b|) time, by merging the sorted lists.
+ * Notes:
+ *   Items are shared, not copied: dest holds the same item pointers as
+ *   a (or b), so delete at most one of those sets with an itemdelete
+ *   function, and the others with NULL.
+ */
+bool set_intersect(set_t* dest, set_t* a, set_t* b);
+
+/**************** set_union ****************/
+/* Fill dest with the keys found in a or b (or both).
+ *
+ * As set_intersect, except that every key in a or b goes into dest;
+ * a key in both gets a's item.
+ */
+bool set_union(set_t* dest, set_t* a, set_t* b);
+
+/**************** set_difference ****************/
+/* Fill dest with the keys found in a but not in b.
+ *
+ * As set_intersect, except that dest gets each key in a that is not in b.
+ */
+bool set_difference(set_t* dest, set_t* a, set_t* b);
+
+/**************** set_memory_usage ****************/
+/* Return the number of bytes of memory the set uses.
+ *
+ * Caller provides:
+ *   valid set pointer.
+ * We return:
+ *   0 if set is NULL;
+ *   otherwise the bytes in the set structure, its nodes and its key
+ *   strings, plus allocator slack when the allocator can report it.
+ * Notes:
+ *   Items are not counted; they belong to the caller.
+ *   The set is unchanged; this call is O(n).
+ */
+size_t set_memory_usage(set_t* set);
+
+/**************** set_allocator ****************/
+/* Replace the functions used to allocate and free all set memory.
+ *
+ * Caller provides:
+ *   allocfn and freefn, a matching pair like malloc and free;
+ *   sizefn, which returns the usable size of a block (may be NULL).
+ * We do:
+ *   if allocfn or freefn is NULL, go back to malloc and free.
+ *   otherwise, use allocfn/freefn for every later allocation, and
+ *   sizefn (if any) to count allocator slack in set_memory_usage.
+ * Notes:
+ *   The allocator is shared by all sets; change it only while no set
+ *   exists, since memory must be freed by the allocator that made it.
+ */
+void set_allocator(void* (*allocfn)(size_t size), void (*freefn)(void* ptr),
+                   size_t (*sizefn)(void* ptr));
+
 #endif // __SET_H
@@ -0,0 +1,361 @@
+/*
+ * shmtable.c - source file for shared-memory hashtable module
+ *
+ * The segment starts with a header and the slot array; entries follow,
+ * handed out from the front of the rest by bumping `used`.  Each slot
+ * holds the offset of its first entry, and each entry the offset of the
+ * next, 0 ending the list (offset 0 is the header, never an entry).
+ *
+ * The writer fills in a whole entry and only then links it in, at the
+ * head of its slot, with a release store; readers load links with
+ * acquire, so any entry they reach is complete.  An entry's key and item
+ * never change once linked, and a removed entry is only unlinked, so a
+ * reader never sees torn or recycled bytes.  The offsets are lock-free
+ * atomics, which work across processes; see shmtable.h.
+ *
+ * Adwiteeya Rupantee Paul, April 2025
+ */
+
+#define _POSIX_C_SOURCE 200809L   // shm_open, ftruncate, mmap
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "shmtable.h"
+#include "hashtable.h"
+#include "hash.h"
+
+/* a lock-based atomic would lock within one process only */
+_Static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "shmtable needs lock-free 64-bit atomics");
+
+/**************** local types ****************/
+/* the start of the segment */
+typedef struct shmheader {
+    atomic_ullong magic;          // SHM_MAGIC once the table is ready
+    unsigned long long size;      // bytes in the segment
+    unsigned long long num_slots;
+    atomic_ullong used;           // bytes handed out, header and slots included
+    atomic_ullong count;          // keys in the table
+    atomic_ullong slots[];        // offset of each slot's first entry; 0 if none
+} shmheader_t;
+
+/* one (key,item) pair; the key, its NUL and the item follow */
+typedef struct shmentry {
+    atomic_ullong next;           // offset of the next entry in the slot; 0 if none
+    unsigned long long itemlen;   // bytes in the item
+    unsigned long long itemoff;   // from the entry to its item
+    char key[];
+} shmentry_t;
+
+/* a process's view of a segment */
+typedef struct shmtable {
+    char* base;                   // where this process mapped the segment
+    size_t size;
+    shmheader_t* hdr;             // == base
+    bool writer;                  // we created it, and may change it
+} shmtable_t;
+
+/* what shmtable_copy passes to copy_one */
+typedef struct shmcopy {
+    shmtable_t* st;
+    size_t (*itemsize)(void* item);
+    bool ok;
+} shmcopy_t;
+
+/**************** file-local global variables ****************/
+static const unsigned long long SHM_MAGIC = 0x3162617468736873ULL;  // "shshtab1"
+static const size_t ALIGN = 16;   // of entries and items
+
+/**************** local functions ****************/
+/* not visible outside this file */
+static shmtable_t* shmtable_map(const int fd, const size_t size, const bool writer);
+static inline size_t align_up(const size_t n);
+static inline shmentry_t* entry_at(shmtable_t* st, const unsigned long long off);
+static inline atomic_ullong* slot_of(shmtable_t* st, const char* key);
+static void copy_one(void* arg, const char* key, void* item);
+
+/**************** shmtable_create() ****************/
+/* see shmtable.h for description */
+shmtable_t*
+shmtable_create(const char* name, const int num_slots, const size_t capacity)
+{
+    if (name == NULL || num_slots <= 0 || capacity > SIZE_MAX / 2) {
+        return NULL;
+    }
+    size_t start = align_up(sizeof(shmheader_t) + (size_t)num_slots * sizeof(atomic_ullong));
+    size_t size = start + align_up(capacity);
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) {
+        return NULL;              // exists already, or not allowed
+    }
+    if (ftruncate(fd, size) != 0) {
+        close(fd);
+        shm_unlink(name);
+        return NULL;
+    }
+    shmtable_t* st = shmtable_map(fd, size, true);
+    close(fd);                    // the mapping keeps the segment
+    if (st == NULL) {
+        shm_unlink(name);
+        return NULL;
+    }
+    // ftruncate zeroed the segment: every slot is empty
+    shmheader_t* hdr = st->hdr;
+    hdr->size = size;
+    hdr->num_slots = num_slots;
+    atomic_init(&hdr->used, start);
+    atomic_init(&hdr->count, 0);
+    atomic_store_explicit(&hdr->magic, SHM_MAGIC, memory_order_release);  // ready
+    return st;
+}
+
+/**************** shmtable_attach() ****************/
+/* see shmtable.h for description */
+shmtable_t*
+shmtable_attach(const char* name)
+{
+    if (name == NULL) {
+        return NULL;
+    }
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat sb;
+    if (fstat(fd, &sb) != 0 || (size_t)sb.st_size < sizeof(shmheader_t)) {
+        close(fd);
+        return NULL;              // not ours, or not set up yet
+    }
+    shmtable_t* st = shmtable_map(fd, sb.st_size, false);
+    close(fd);
+    if (st == NULL) {
+        return NULL;
+    }
+    shmheader_t* hdr = st->hdr;
+    if (atomic_load_explicit(&hdr->magic, memory_order_acquire) != SHM_MAGIC
+        || hdr->size != st->size || hdr->num_slots == 0
+        || sizeof(shmheader_t) + hdr->num_slots * sizeof(atomic_ullong) > st->size) {
+        shmtable_detach(st);
+        return NULL;              // not a finished shmtable
+    }
+    return st;
+}
+
+/**************** shmtable_map() ****************/
+/* map size bytes of the segment open on fd, for writing or only reading,
+ * and make a handle for it; NULL if error */
+static shmtable_t*
+shmtable_map(const int fd, const size_t size, const bool writer)
+{
+    shmtable_t* st = malloc(sizeof(shmtable_t));
+    if (st == NULL) {
+        return NULL;
+    }
+    int prot = writer ? PROT_READ | PROT_WRITE : PROT_READ;
+    void* base = mmap(NULL, size, prot, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        free(st);
+        return NULL;
+    }
+    st->base = base;
+    st->size = size;
+    st->hdr = base;
+    st->writer = writer;
+    return st;
+}
+
+/**************** shmtable_insert() ****************/
+/* see shmtable.h for description */
+bool
+shmtable_insert(shmtable_t* st, const char* key, const void* item, const size_t len)
+{
+    if (st == NULL || key == NULL || (item == NULL && len > 0) || !st->writer) {
+        return false;
+    }
+    if (shmtable_find(st, key, NULL) != NULL) {
+        return false;             // key exists
+    }
+    size_t keylen = strlen(key);
+    size_t itemoff = align_up(sizeof(shmentry_t) + keylen + 1);
+    unsigned long long used = atomic_load_explicit(&st->hdr->used, memory_order_relaxed);
+    if (itemoff > st->size || len > st->size - itemoff
+        || align_up(itemoff + len) > st->size - used) {
+        return false;             // segment full
+    }
+    // fill in the entry where no reader can reach it yet...
+    shmentry_t* entry = (shmentry_t*)(st->base + used);
+    atomic_ullong* slot = slot_of(st, key);
+    atomic_init(&entry->next, atomic_load_explicit(slot, memory_order_relaxed));
+    entry->itemlen = len;
+    entry->itemoff = itemoff;
+    memcpy(entry->key, key, keylen + 1);
+    if (len > 0) {
+        memcpy((char*)entry + itemoff, item, len);
+    }
+    atomic_store_explicit(&st->hdr->used, used + align_up(itemoff + len), memory_order_relaxed);
+    // ...then publish it: a reader that sees the link sees the whole entry
+    atomic_store_explicit(slot, used, memory_order_release);
+    atomic_fetch_add_explicit(&st->hdr->count, 1, memory_order_relaxed);
+    return true;
+}
+
+/**************** shmtable_find() ****************/
+/* see shmtable.h for description */
+const void*
+shmtable_find(shmtable_t* st, const char* key, size_t* len)
+{
+    if (st == NULL || key == NULL) {
+        return NULL;
+    }
+    atomic_ullong* link = slot_of(st, key);
+    shmentry_t* entry;
+    while ((entry = entry_at(st, atomic_load_explicit(link, memory_order_acquire))) != NULL) {
+        if (strcmp(entry->key, key) == 0) {
+            if (len != NULL) {
+                *len = entry->itemlen;
+            }
+            return (char*)entry + entry->itemoff;
+        }
+        link = &entry->next;
+    }
+    return NULL;
+}
+
+/**************** shmtable_remove() ****************/
+/* see shmtable.h for description */
+bool
+shmtable_remove(shmtable_t* st, const char* key)
+{
+    if (st == NULL || key == NULL || !st->writer) {
+        return false;
+    }
+    atomic_ullong* link = slot_of(st, key);
+    shmentry_t* entry;
+    while ((entry = entry_at(st, atomic_load_explicit(link, memory_order_relaxed))) != NULL) {
+        if (strcmp(entry->key, key) == 0) {
+            // skip over it; a reader on it still finds its next entry
+            unsigned long long next = atomic_load_explicit(&entry->next, memory_order_relaxed);
+            atomic_store_explicit(link, next, memory_order_release);
+            atomic_fetch_sub_explicit(&st->hdr->count, 1, memory_order_relaxed);
+            return true;
+        }
+        link = &entry->next;
+    }
+    return false;
+}
+
+/**************** shmtable_iterate() ****************/
+/* see shmtable.h for description */
+void
+shmtable_iterate(shmtable_t* st, void* arg,
+                 void (*itemfunc)(void* arg, const char* key,
+                                  const void* item, const size_t len))
+{
+    if (st == NULL || itemfunc == NULL) {
+        return;
+    }
+    for (unsigned long long i = 0; i < st->hdr->num_slots; i++) {
+        atomic_ullong* link = &st->hdr->slots[i];
+        shmentry_t* entry;
+        while ((entry = entry_at(st, atomic_load_explicit(link, memory_order_acquire))) != NULL) {
+            (*itemfunc)(arg, entry->key, (char*)entry + entry->itemoff, entry->itemlen);
+            link = &entry->next;
+        }
+    }
+}
+
+/**************** shmtable_copy() ****************/
+/* see shmtable.h for description */
+bool
+shmtable_copy(shmtable_t* st, hashtable_t* ht, size_t (*itemsize)(void* item))
+{
+    if (st == NULL || ht == NULL || itemsize == NULL || !st->writer) {
+        return false;
+    }
+    shmcopy_t copy = { st, itemsize, true };
+    hashtable_iterate(ht, &copy, copy_one);
+    return copy.ok;
+}
+
+/**************** copy_one() ****************/
+/* insert one pair of the hashtable, unless its key is there already */
+static void
+copy_one(void* arg, const char* key, void* item)
+{
+    shmcopy_t* copy = arg;
+    if (!shmtable_insert(copy->st, key, item, (*copy->itemsize)(item))
+        && shmtable_find(copy->st, key, NULL) == NULL) {
+        copy->ok = false;         // the segment is full
+    }
+}
+
+/**************** shmtable_size() ****************/
+/* see shmtable.h for description */
+long
+shmtable_size(shmtable_t* st)
+{
+    return st == NULL ? 0 : (long)atomic_load_explicit(&st->hdr->count, memory_order_relaxed);
+}
+
+/**************** shmtable_memory_usage() ****************/
+/* see shmtable.h for description */
+size_t
+shmtable_memory_usage(shmtable_t* st)
+{
+    return st == NULL ? 0 : atomic_load_explicit(&st->hdr->used, memory_order_relaxed);
+}
+
+/**************** shmtable_detach() ****************/
+/* see shmtable.h for description */
+void
+shmtable_detach(shmtable_t* st)
+{
+    if (st != NULL) {
+        munmap(st->base, st->size);
+        free(st);
+    }
+}
+
+/**************** shmtable_unlink() ****************/
+/* see shmtable.h for description */
+bool
+shmtable_unlink(const char* name)
+{
+    return name != NULL && shm_unlink(name) == 0;
+}
+
+/**************** align_up() ****************/
+/* round n up to a multiple of ALIGN */
+static inline size_t
+align_up(const size_t n)
+{
+    return (n + ALIGN - 1) & ~(ALIGN - 1);
+}
+
+/**************** entry_at() ****************/
+/* the entry at offset off; NULL at the end of a list, or if off would
+ * run past the segment, which a reader does not trust blindly */
+static inline shmentry_t*
+entry_at(shmtable_t* st, const unsigned long long off)
+{
+    if (off == 0 || off > st->size - sizeof(shmentry_t)) {
+        return NULL;
+    }
+    return (shmentry_t*)(st->base + off);
+}
+
+/**************** slot_of() ****************/
+/* the head of key's slot */
+static inline atomic_ullong*
+slot_of(shmtable_t* st, const char* key)
+{
+    return &st->hdr->slots[hash_jenkins(key, st->hdr->num_slots)];
+}
@@ -0,0 +1,152 @@
+/*
+ * shmtable.h - header file for shared-memory hashtable module
+ *
+ * A *shmtable* is a hashtable of (key,item) pairs that lives in a POSIX
+ * shared-memory segment, so that several processes on one host share a
+ * single copy instead of each building its own.  One process creates
+ * the table and is its only writer; any number of others attach to it by
+ * name and read it, without locks, while the writer goes on inserting.
+ *
+ * Since each process maps the segment at its own address, nothing in it
+ * is a pointer: entries are linked by their offset from the start of the
+ * segment.  For the same reason an item is not a pointer to the caller's
+ * memory but bytes copied into the segment.
+ *
+ * Adwiteeya Rupantee Paul, April 2025
+ */
+
+#ifndef __SHMTABLE_H
+#define __SHMTABLE_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "hashtable.h"
+
+/**************** global types ****************/
+typedef struct shmtable shmtable_t;  // opaque to users of the module
+
+/**************** functions ****************/
+
+/**************** shmtable_create ****************/
+/* Create a new (empty) shmtable in a new shared-memory segment, and
+ * become its writer.
+ *
+ * Caller provides:
+ *   name of the segment, as for shm_open: "/" and then no other "/";
+ *   number of slots (must be > 0);
+ *   capacity: bytes for the entries, each its key, its item and about
+ *   24 bytes more; the segment never grows.
+ * We return:
+ *   the writer's handle; NULL if a parameter is bad, a segment of that
+ *   name already exists, or the segment cannot be made.
+ * Caller is responsible for:
+ *   later calling shmtable_detach, and shmtable_unlink when no process
+ *   will attach any more.
+ */
+shmtable_t* shmtable_create(const char* name, const int num_slots, const size_t capacity);
+
+/**************** shmtable_attach ****************/
+/* Attach to the shmtable in an existing segment, as a reader.
+ *
+ * We return:
+ *   a reader's handle; NULL if name is NULL or names no finished shmtable.
+ * We do:
+ *   map the segment read-only, in O(1) whatever its size: the pages are
+ *   the writer's, shared, and nothing is copied or rebuilt.
+ * Caller is responsible for:
+ *   later calling shmtable_detach.
+ */
+shmtable_t* shmtable_attach(const char* name);
+
+/**************** shmtable_insert ****************/
+/* Insert a copy of len bytes at item, identified by key, into the table.
+ *
+ * Caller provides:
+ *   the writer's handle, valid key and item pointers (item may be NULL
+ *   if len is 0).
+ * We return:
+ *   false if key exists, a parameter is NULL, the handle is a reader's,
+ *   or the segment is full; true iff the pair was inserted.
+ * Notes:
+ *   Readers see the pair, whole, as soon as this returns.
+ */
+bool shmtable_insert(shmtable_t* st, const char* key, const void* item, const size_t len);
+
+/**************** shmtable_find ****************/
+/* Return the item associated with the given key.
+ *
+ * We return:
+ *   a pointer to the item's bytes in the segment, and (if len is not
+ *   NULL) their number in *len; NULL if st or key is NULL or key is not
+ *   found.
+ * Notes:
+ *   Readers and the writer may call this at any time, without locks.
+ *   The bytes stay put until the segment is detached, even if the key
+ *   is removed meanwhile; readers may not write them.
+ */
+const void* shmtable_find(shmtable_t* st, const char* key, size_t* len);
+
+/**************** shmtable_remove ****************/
+/* Remove key and its item from the table; writer only.
+ *
+ * We return:
+ *   true if key was found and removed; false otherwise.
+ * Notes:
+ *   A reader partway down the same slot finishes its walk safely, since
+ *   the entry is unlinked but never reused: its bytes are not given back
+ *   to the segment.  A shmtable suits read-mostly data.
+ */
+bool shmtable_remove(shmtable_t* st, const char* key);
+
+/**************** shmtable_iterate ****************/
+/* Call itemfunc(arg, key, item, len) on each pair, in undefined order;
+ * nothing if st or itemfunc is NULL.  A pair inserted or removed during
+ * the walk may or may not be seen.
+ */
+void shmtable_iterate(shmtable_t* st, void* arg,
+                      void (*itemfunc)(void* arg, const char* key,
+                                       const void* item, const size_t len));
+
+/**************** shmtable_copy ****************/
+/* Insert a copy of every pair of a hashtable; writer only.
+ *
+ * Caller provides:
+ *   the writer's handle, a hashtable, and itemsize(item), the number of
+ *   bytes of each item to copy, as for hashtable_journal.
+ * We return:
+ *   true if every pair was inserted (or its key was already there);
+ *   false if any parameter is NULL, or the segment filled up.
+ * Notes:
+ *   One process builds the hashtable and copies it once; the rest
+ *   attach, rather than each building the same hashtable.
+ */
+bool shmtable_copy(shmtable_t* st, hashtable_t* ht, size_t (*itemsize)(void* item));
+
+/**************** shmtable_size ****************/
+/* Return the number of keys in the table; 0 if st is NULL. */
+long shmtable_size(shmtable_t* st);
+
+/**************** shmtable_memory_usage ****************/
+/* Return the bytes of the segment used so far: header, slots and every
+ * entry ever inserted; 0 if st is NULL.  This memory is shared, counted
+ * once however many processes attach.
+ */
+size_t shmtable_memory_usage(shmtable_t* st);
+
+/**************** shmtable_detach ****************/
+/* Unmap the segment and free the handle; ignore NULL st.  The segment
+ * and its table live on, for other processes, until shmtable_unlink.
+ */
+void shmtable_detach(shmtable_t* st);
+
+/**************** shmtable_unlink ****************/
+/* Remove the segment's name, so that no process can attach any more; its
+ * memory is freed once the last process detaches.
+ *
+ * We return:
+ *   true if the name was removed; false if name is NULL or not found.
+ */
+bool shmtable_unlink(const char* name);
+
+#endif // __SHMTABLE_H
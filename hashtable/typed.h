@@ -0,0 +1,255 @@
+/*
+ * typed.h - macros that generate type-specialized sets and hashtables
+ *
+ * The set and hashtable modules hold `void*` items under string keys,
+ * and call back through function pointers.  The macros here generate
+ * the same structures for a given key type and value type:
+ *
+ *   DEFINE_SET(name, KeyT, ValT, eqfn)
+ *   DEFINE_HASHTABLE(name, KeyT, ValT, hashfn, eqfn)
+ *
+ * Keys and values live inside the nodes, so an insert is one allocation
+ * and no item needs to be allocated separately; hashfn and eqfn are
+ * named at compile time, so the compiler can inline them.  Each macro
+ * defines the type `name_t` and static inline functions `name_new`,
+ * `name_insert`, `name_find`, `name_print`, `name_iterate` and
+ * `name_delete`, with the same contracts as set.h and hashtable.h except:
+ *
+ *   - keys and values are copied by value (for a pointer type, that
+ *     means the pointer - the pointed-to memory still belongs to the
+ *     caller, unlike set_insert, which copies key strings);
+ *   - any value is acceptable, including zero or NULL;
+ *   - find returns a pointer to the stored value (NULL if not found),
+ *     through which the caller may update the value in place;
+ *   - delete frees only the structure; the caller empties values first
+ *     (e.g. with iterate) if they own memory.
+ *
+ * The functions they need:
+ *   bool eqfn(KeyT a, KeyT b)            - true iff a and b are the same key
+ *   unsigned long hashfn(KeyT key)       - any hash; we take it mod num_slots
+ *
+ * Example:
+ *   static inline unsigned long strhash(const char* s) { return hash_jenkins(s, ~0UL); }
+ *   static inline bool streq(const char* a, const char* b) { return strcmp(a, b) == 0; }
+ *   DEFINE_HASHTABLE(wordcount, const char*, int, strhash, streq)
+ *   ...
+ *   wordcount_t* wc = wordcount_new(100);
+ *   wordcount_insert(wc, "dog", 1);
+ *   int* n = wordcount_find(wc, "dog");   // (*n)++ updates in place
+ *
+ * Adwiteeya Rupantee Paul, April 2025
+ */
+
+#ifndef __TYPED_H
+#define __TYPED_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+/**************** DEFINE_SET ****************/
+/* A linked list of (key,value) nodes, new nodes at the head, like set.c. */
+#define DEFINE_SET(name, KeyT, ValT, eqfn)                                    \
+                                                                              \
+typedef struct name##_node {                                                  \
+    KeyT key;                        /* key, stored by value */               \
+    ValT val;                        /* value, stored by value */             \
+    struct name##_node* next;        /* next node in the list */              \
+} name##_node_t;                                                              \
+                                                                              \
+typedef struct name {                                                         \
+    name##_node_t* head;             /* head of the list of items in set */   \
+} name##_t;                                                                   \
+                                                                              \
+/* a set with no items; NULL if error */                                      \
+static inline name##_t*                                                       \
+name##_new(void)                                                              \
+{                                                                             \
+    name##_t* set = malloc(sizeof(name##_t));                                 \
+    if (set != NULL) {                                                        \
+        set->head = NULL;                                                     \
+    }                                                                         \
+    return set;                                                               \
+}                                                                             \
+                                                                              \
+/* pointer to the value stored under key; NULL if set is NULL or no key */    \
+static inline ValT*                                                           \
+name##_find(name##_t* set, KeyT key)                                          \
+{                                                                             \
+    if (set != NULL) {                                                        \
+        for (name##_node_t* node = set->head; node != NULL; node = node->next) { \
+            if (eqfn(node->key, key)) {                                       \
+                return &node->val;   /* found the item */                     \
+            }                                                                 \
+        }                                                                     \
+    }                                                                         \
+    return NULL;                     /* key not found */                      \
+}                                                                             \
+                                                                              \
+/* false if key exists, set is NULL, or out of memory; true iff inserted */   \
+static inline bool                                                            \
+name##_insert(name##_t* set, KeyT key, ValT val)                              \
+{                                                                             \
+    if (set == NULL || name##_find(set, key) != NULL) {                       \
+        return false;                /* bad set, or key already exists */     \
+    }                                                                         \
+    name##_node_t* node = malloc(sizeof(name##_node_t));                      \
+    if (node == NULL) {                                                       \
+        return false;                /* out of memory */                      \
+    }                                                                         \
+    node->key = key;                                                          \
+    node->val = val;                                                          \
+    node->next = set->head;          /* add it to the head of the list */     \
+    set->head = node;                                                         \
+    return true;                                                              \
+}                                                                             \
+                                                                              \
+/* {comma-separated items}, each printed by itemprint; see set_print */      \
+static inline void                                                            \
+name##_print(name##_t* set, FILE* fp,                                         \
+             void (*itemprint)(FILE* fp, KeyT key, ValT* val))                \
+{                                                                             \
+    if (fp == NULL) {                                                         \
+        return;                                                               \
+    }                                                                         \
+    if (set == NULL) {                                                        \
+        fputs("(null)", fp);                                                  \
+        return;                                                               \
+    }                                                                         \
+    fputc('{', fp);                                                           \
+    for (name##_node_t* node = set->head; node != NULL; node = node->next) {  \
+        if (itemprint != NULL) {                                              \
+            (*itemprint)(fp, node->key, &node->val);                          \
+            if (node->next != NULL) {                                         \
+                fputc(',', fp);                                               \
+            }                                                                 \
+        }                                                                     \
+    }                                                                         \
+    fputc('}', fp);                                                           \
+}                                                                             \
+                                                                              \
+/* call itemfunc(arg, key, &value) on each item; see set_iterate */           \
+static inline void                                                            \
+name##_iterate(name##_t* set, void* arg,                                      \
+               void (*itemfunc)(void* arg, KeyT key, ValT* val))              \
+{                                                                             \
+    if (set != NULL && itemfunc != NULL) {                                    \
+        for (name##_node_t* node = set->head; node != NULL; node = node->next) { \
+            (*itemfunc)(arg, node->key, &node->val);                          \
+        }                                                                     \
+    }                                                                         \
+}                                                                             \
+                                                                              \
+/* free the nodes and the set itself; ignore NULL set */                      \
+static inline void                                                            \
+name##_delete(name##_t* set)                                                  \
+{                                                                             \
+    if (set != NULL) {                                                        \
+        for (name##_node_t* node = set->head; node != NULL; ) {               \
+            name##_node_t* next = node->next;                                 \
+            free(node);                                                       \
+            node = next;                                                      \
+        }                                                                     \
+        free(set);                                                            \
+    }                                                                         \
+}
+
+/**************** DEFINE_HASHTABLE ****************/
+/* An array of slots, each a list of (key,value) nodes, like hashtable.c;
+ * the slot lists are stored inline in the table rather than allocated
+ * one by one.  Also defines the set type name_slot_t it is built from.
+ */
+#define DEFINE_HASHTABLE(name, KeyT, ValT, hashfn, eqfn)                      \
+                                                                              \
+DEFINE_SET(name##_slot, KeyT, ValT, eqfn)                                     \
+                                                                              \
+typedef struct name {                                                         \
+    int num_slots;                   /* number of slots in the hashtable */   \
+    name##_slot_t slots[];           /* one list per slot */                  \
+} name##_t;                                                                   \
+                                                                              \
+/* an empty table of num_slots (> 0) slots; NULL if error */                  \
+static inline name##_t*                                                       \
+name##_new(const int num_slots)                                               \
+{                                                                             \
+    if (num_slots <= 0) {                                                     \
+        return NULL;                                                          \
+    }                                                                         \
+    name##_t* ht = malloc(sizeof(name##_t) + num_slots * sizeof(name##_slot_t)); \
+    if (ht != NULL) {                                                         \
+        ht->num_slots = num_slots;                                            \
+        for (int i = 0; i < num_slots; i++) {                                 \
+            ht->slots[i].head = NULL;                                         \
+        }                                                                     \
+    }                                                                         \
+    return ht;                                                                \
+}                                                                             \
+                                                                              \
+/* the slot that holds key */                                                 \
+static inline name##_slot_t*                                                  \
+name##_slot_of(name##_t* ht, KeyT key)                                        \
+{                                                                             \
+    return &ht->slots[(unsigned long)hashfn(key) % (unsigned long)ht->num_slots]; \
+}                                                                             \
+                                                                              \
+/* pointer to the value stored under key; NULL if ht is NULL or no key */     \
+static inline ValT*                                                           \
+name##_find(name##_t* ht, KeyT key)                                           \
+{                                                                             \
+    return ht == NULL ? NULL : name##_slot_find(name##_slot_of(ht, key), key); \
+}                                                                             \
+                                                                              \
+/* false if key exists, ht is NULL, or out of memory; true iff inserted */    \
+static inline bool                                                            \
+name##_insert(name##_t* ht, KeyT key, ValT val)                               \
+{                                                                             \
+    return ht != NULL && name##_slot_insert(name##_slot_of(ht, key), key, val); \
+}                                                                             \
+                                                                              \
+/* one line per slot, listing its items; see hashtable_print */               \
+static inline void                                                            \
+name##_print(name##_t* ht, FILE* fp,                                          \
+             void (*itemprint)(FILE* fp, KeyT key, ValT* val))                \
+{                                                                             \
+    if (fp == NULL) {                                                         \
+        return;                                                               \
+    }                                                                         \
+    if (ht == NULL) {                                                         \
+        fprintf(fp, "(null)\n");                                              \
+        return;                                                               \
+    }                                                                         \
+    for (int i = 0; i < ht->num_slots; i++) {                                 \
+        name##_slot_print(&ht->slots[i], fp, itemprint);                      \
+        fprintf(fp, "\n");                                                    \
+    }                                                                         \
+}                                                                             \
+                                                                              \
+/* call itemfunc(arg, key, &value) on each item, in undefined order */        \
+static inline void                                                            \
+name##_iterate(name##_t* ht, void* arg,                                       \
+               void (*itemfunc)(void* arg, KeyT key, ValT* val))              \
+{                                                                             \
+    if (ht != NULL && itemfunc != NULL) {                                     \
+        for (int i = 0; i < ht->num_slots; i++) {                             \
+            name##_slot_iterate(&ht->slots[i], arg, itemfunc);                \
+        }                                                                     \
+    }                                                                         \
+}                                                                             \
+                                                                              \
+/* free every node and the table itself; ignore NULL ht */                    \
+static inline void                                                            \
+name##_delete(name##_t* ht)                                                   \
+{                                                                             \
+    if (ht != NULL) {                                                         \
+        for (int i = 0; i < ht->num_slots; i++) {                             \
+            for (name##_slot_node_t* node = ht->slots[i].head; node != NULL; ) { \
+                name##_slot_node_t* next = node->next;                        \
+                free(node);                                                   \
+                node = next;                                                  \
+            }                                                                 \
+        }                                                                     \
+        free(ht);                                                             \
+    }                                                                         \
+}
+
+#endif // __TYPED_H
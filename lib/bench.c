@@ -0,0 +1,252 @@
+/*
+ * bench.c - source file for benchmark support module
+ *
+ * See bench.h for usage.
+ *
+ * Adwiteeya Rupantee Paul, April 2025
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "bench.h"
+
+/**************** file-local global variables ****************/
+static uint64_t nallocs = 0;     // allocations seen by the wrappers below
+
+/**************** local functions ****************/
+/* not visible outside this file */
+static double zeta(const uint64_t n, const double theta);
+
+/**************** allocation wrappers ****************/
+/* Linked in place of malloc/calloc/realloc via -Wl,--wrap=...;
+ * each counts the call and forwards to the real allocator.
+ */
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t nmemb, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+void* __wrap_malloc(size_t size)
+{
+    nallocs++;
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t nmemb, size_t size)
+{
+    nallocs++;
+    return __real_calloc(nmemb, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size)
+{
+    nallocs++;
+    return __real_realloc(ptr, size);
+}
+
+/**************** bench_rand_init() ****************/
+/* see bench.h for description */
+void
+bench_rand_init(bench_rand_t* rng, const uint64_t seed)
+{
+    rng->state = seed;
+}
+
+/**************** bench_rand_next() ****************/
+/* see bench.h for description; this is splitmix64 */
+uint64_t
+bench_rand_next(bench_rand_t* rng)
+{
+    uint64_t z = (rng->state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+/**************** bench_rand_below() ****************/
+/* see bench.h for description */
+uint64_t
+bench_rand_below(bench_rand_t* rng, const uint64_t bound)
+{
+    return bench_rand_next(rng) % bound;
+}
+
+/**************** zeta() ****************/
+/* sum of 1/i^theta for i in [1, n] */
+static double
+zeta(const uint64_t n, const double theta)
+{
+    double sum = 0;
+    for (uint64_t i = 1; i <= n; i++) {
+        sum += 1.0 / pow((double)i, theta);
+    }
+    return sum;
+}
+
+/**************** bench_zipf_init() ****************/
+/* see bench.h for description */
+void
+bench_zipf_init(bench_zipf_t* zipf, const uint64_t n, const double theta,
+                const uint64_t seed)
+{
+    zipf->n = n;
+    zipf->theta = theta;
+    zipf->alpha = 1.0 / (1.0 - theta);
+    zipf->zetan = zeta(n, theta);
+    zipf->eta = (1.0 - pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta(2, theta) / zipf->zetan);
+    bench_rand_init(&zipf->rng, seed);
+}
+
+/**************** bench_zipf_next() ****************/
+/* see bench.h for description */
+uint64_t
+bench_zipf_next(bench_zipf_t* zipf)
+{
+    // 53 random bits give a uniform double in [0,1)
+    double u = (bench_rand_next(&zipf->rng) >> 11) * (1.0 / 9007199254740992.0);
+    double uz = u * zipf->zetan;
+
+    if (uz < 1.0) {
+        return 0;
+    }
+    if (uz < 1.0 + pow(0.5, zipf->theta)) {
+        return zipf->n > 1 ? 1 : 0;
+    }
+    uint64_t rank = (uint64_t)(zipf->n * pow(zipf->eta * u - zipf->eta + 1.0, zipf->alpha));
+    return rank < zipf->n ? rank : zipf->n - 1;
+}
+
+/**************** bench_permutation() ****************/
+/* see bench.h for description */
+uint64_t*
+bench_permutation(const uint64_t n, const uint64_t seed)
+{
+    uint64_t* perm = malloc(n * sizeof(uint64_t));
+    if (perm == NULL) {
+        return NULL;
+    }
+    bench_rand_t rng;
+    bench_rand_init(&rng, seed);
+    for (uint64_t i = 0; i < n; i++) {
+        perm[i] = i;
+    }
+    // Fisher-Yates shuffle
+    for (uint64_t i = n; i > 1; i--) {
+        uint64_t j = bench_rand_below(&rng, i);
+        uint64_t tmp = perm[i - 1];
+        perm[i - 1] = perm[j];
+        perm[j] = tmp;
+    }
+    return perm;
+}
+
+/**************** bench_keys() ****************/
+/* see bench.h for description */
+char*
+bench_keys(const uint64_t first, const uint64_t n)
+{
+    char* arena = malloc(n * BENCH_KEYLEN);
+    if (arena == NULL) {
+        return NULL;
+    }
+    for (uint64_t i = 0; i < n; i++) {
+        snprintf(arena + i * BENCH_KEYLEN, BENCH_KEYLEN, "k%llu",
+                 (unsigned long long)(first + i));
+    }
+    return arena;
+}
+
+/**************** bench_now() ****************/
+/* see bench.h for description */
+uint64_t
+bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/**************** bench_allocs() ****************/
+/* see bench.h for description */
+uint64_t
+bench_allocs(void)
+{
+    return nallocs;
+}
+
+/**************** bench_peak_rss() ****************/
+/* see bench.h for description */
+long
+bench_peak_rss(void)
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return -1;
+    }
+    return usage.ru_maxrss;         // already in kilobytes on Linux
+}
+
+/**************** bench_header() ****************/
+/* see bench.h for description */
+void
+bench_header(FILE* fp)
+{
+    if (fp != NULL) {
+        fprintf(fp, "module,op,dist,n,ops,ns_per_op,allocs_per_op,peak_rss_kb\n");
+    }
+}
+
+/**************** bench_report() ****************/
+/* see bench.h for description */
+void
+bench_report(FILE* fp, const char* module, const char* op,
+             const char* dist, const uint64_t n, const uint64_t ops,
+             const uint64_t elapsed, const uint64_t allocs)
+{
+    if (fp != NULL && ops > 0) {
+        fprintf(fp, "%s,%s,%s,%llu,%llu,%.2f,%.3f,%ld\n", module, op, dist,
+                (unsigned long long)n, (unsigned long long)ops,
+                (double)elapsed / ops, (double)allocs / ops, bench_peak_rss());
+        fflush(fp);
+    }
+}
+
+/**************** bench_args() ****************/
+/* see bench.h for description */
+bool
+bench_args(const int argc, char* argv[], uint64_t* maxsize, uint64_t* seed)
+{
+    *maxsize = 100000;
+    *seed = 1;
+    if (argc > 3) {
+        fprintf(stderr, "usage: %s [maxsize [seed]]\n", argv[0]);
+        return false;
+    }
+    for (int i = 1; i < argc; i++) {
+        char* end;
+        unsigned long long value = strtoull(argv[i], &end, 10);
+        if (*argv[i] == '\0' || *end != '\0') {
+            fprintf(stderr, "usage: %s [maxsize [seed]]\n", argv[0]);
+            return false;
+        }
+        if (i == 1) {
+            *maxsize = value;
+        } else {
+            *seed = value;
+        }
+    }
+    if (*maxsize < 10) {
+        *maxsize = 10;
+    }
+    if (*maxsize > 100000000) {
+        *maxsize = 100000000;
+    }
+    return true;
+}
@@ -0,0 +1,117 @@
+/*
+ * bench.h - header file for benchmark support module
+ *
+ * Helpers shared by the setbench, hashtablebench and countersbench
+ * drivers: a seeded random generator, uniform and Zipfian key streams,
+ * a nanosecond clock, allocation counting and peak-RSS reporting.
+ * Results are printed as CSV, one row per (module, op, dist, n).
+ *
+ * Allocation counting works by wrapping malloc/calloc/realloc at
+ * link time; bench programs must be linked with BENCH_LDFLAGS (see the
+ * module Makefiles).
+ *
+ * Adwiteeya Rupantee Paul, April 2025
+ */
+
+#ifndef __BENCH_H
+#define __BENCH_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/**************** global types ****************/
+
+/* random-number generator state (splitmix64); visible so it can live on the stack */
+typedef struct bench_rand {
+    uint64_t state;
+} bench_rand_t;
+
+/* Zipfian generator over ranks [0, n), following Gray et al. (SIGMOD '94) */
+typedef struct bench_zipf {
+    uint64_t n;          // number of ranks
+    double theta;        // skew; 0.99 is the customary YCSB value
+    double alpha;        // 1 / (1 - theta)
+    double zetan;        // zeta(n, theta)
+    double eta;          // see Gray et al.
+    bench_rand_t rng;    // underlying uniform source
+} bench_zipf_t;
+
+/**************** functions ****************/
+
+/**************** bench_rand_init ****************/
+/* Seed a random generator; the same seed always yields the same stream. */
+void bench_rand_init(bench_rand_t* rng, const uint64_t seed);
+
+/**************** bench_rand_next ****************/
+/* Return the next 64-bit random value. */
+uint64_t bench_rand_next(bench_rand_t* rng);
+
+/**************** bench_rand_below ****************/
+/* Return a uniformly distributed value in [0, bound); bound must be > 0. */
+uint64_t bench_rand_below(bench_rand_t* rng, const uint64_t bound);
+
+/**************** bench_zipf_init ****************/
+/* Prepare a Zipfian generator over n ranks (n > 0) with skew theta (0 < theta < 1).
+ * Rank 0 is the most popular.  Setup is O(n); each draw is O(1).
+ */
+void bench_zipf_init(bench_zipf_t* zipf, const uint64_t n, const double theta,
+                     const uint64_t seed);
+
+/**************** bench_zipf_next ****************/
+/* Return the next Zipfian-distributed rank in [0, n). */
+uint64_t bench_zipf_next(bench_zipf_t* zipf);
+
+/**************** bench_permutation ****************/
+/* Return a malloc'd random permutation of [0, n); NULL if out of memory.
+ * Caller is responsible for free-ing the array.
+ */
+uint64_t* bench_permutation(const uint64_t n, const uint64_t seed);
+
+/**************** bench_keys ****************/
+/* Format n string keys "k<first+i>" into one malloc'd arena of
+ * BENCH_KEYLEN-byte records; key i lives at arena + i*BENCH_KEYLEN.
+ * Returns NULL if out of memory; caller is responsible for free-ing it.
+ */
+#define BENCH_KEYLEN 16
+char* bench_keys(const uint64_t first, const uint64_t n);
+
+/**************** bench_now ****************/
+/* Return a monotonic timestamp in nanoseconds. */
+uint64_t bench_now(void);
+
+/**************** bench_allocs ****************/
+/* Return the number of malloc/calloc/realloc calls made so far. */
+uint64_t bench_allocs(void);
+
+/**************** bench_peak_rss ****************/
+/* Return the peak resident set size of this process, in kilobytes. */
+long bench_peak_rss(void);
+
+/**************** bench_header ****************/
+/* Print the CSV header line matching bench_report. */
+void bench_header(FILE* fp);
+
+/**************** bench_report ****************/
+/* Print one CSV row.
+ *
+ * Caller provides:
+ *   module and op names, key distribution name, structure size n,
+ *   number of operations timed, elapsed nanoseconds, and the number
+ *   of allocations made during those operations.
+ * We print:
+ *   module,op,dist,n,ops,ns_per_op,allocs_per_op,peak_rss_kb
+ */
+void bench_report(FILE* fp, const char* module, const char* op,
+                  const char* dist, const uint64_t n, const uint64_t ops,
+                  const uint64_t elapsed, const uint64_t allocs);
+
+/**************** bench_args ****************/
+/* Parse the common command line: bench [maxsize [seed]].
+ * Defaults are maxsize=100000, seed=1; maxsize is clamped to [10, 1e8].
+ * Returns false (after printing usage) on a malformed argument.
+ */
+bool bench_args(const int argc, char* argv[], uint64_t* maxsize, uint64_t* seed);
+
+#endif // __BENCH_H
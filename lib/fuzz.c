@@ -0,0 +1,271 @@
+/*
+ * fuzz.c - source file for differential fuzzing support module
+ *
+ * See fuzz.h for usage.
+ *
+ * Adwiteeya Rupantee Paul, April 2025
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <time.h>
+#include "fuzz.h"
+
+/**************** file-local global types ****************/
+typedef struct fuzz_row {
+    const char* engine;     // engine name
+    const char* op;         // what was timed
+    uint64_t ops;           // operations timed, in all
+    uint64_t elapsed;       // nanoseconds they took
+} fuzz_row_t;
+
+/**************** file-local global variables ****************/
+static fuzz_row_t rows[FUZZ_ROWS];
+static int nrows = 0;
+static const uint8_t* current = NULL;   // input being run by the standalone driver
+static size_t currentsize = 0;
+
+/**************** fuzz_input_init() ****************/
+/* see fuzz.h for description */
+void
+fuzz_input_init(fuzz_input_t* in, const uint8_t* data, const size_t size)
+{
+    in->data = data;
+    in->size = data == NULL ? 0 : size;
+    in->pos = 0;
+}
+
+/**************** fuzz_done() ****************/
+/* see fuzz.h for description */
+bool
+fuzz_done(fuzz_input_t* in)
+{
+    return in->pos >= in->size;
+}
+
+/**************** fuzz_byte() ****************/
+/* see fuzz.h for description */
+uint8_t
+fuzz_byte(fuzz_input_t* in)
+{
+    return in->pos < in->size ? in->data[in->pos++] : 0;
+}
+
+/**************** fuzz_below() ****************/
+/* see fuzz.h for description */
+uint32_t
+fuzz_below(fuzz_input_t* in, const uint32_t bound)
+{
+    uint32_t hi = fuzz_byte(in);
+    uint32_t lo = fuzz_byte(in);
+    return ((hi << 8) | lo) % bound;
+}
+
+/**************** fuzz_now() ****************/
+/* see fuzz.h for description */
+uint64_t
+fuzz_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/**************** fuzz_time() ****************/
+/* see fuzz.h for description */
+void
+fuzz_time(const char* engine, const char* op, const uint64_t ops,
+          const uint64_t elapsed)
+{
+    for (int i = 0; i < nrows; i++) {
+        if (strcmp(rows[i].engine, engine) == 0 && strcmp(rows[i].op, op) == 0) {
+            rows[i].ops += ops;
+            rows[i].elapsed += elapsed;
+            return;
+        }
+    }
+    if (nrows < FUZZ_ROWS) {
+        rows[nrows++] = (fuzz_row_t){ engine, op, ops, elapsed };
+    }
+}
+
+/**************** fuzz_report() ****************/
+/* see fuzz.h for description */
+void
+fuzz_report(FILE* fp)
+{
+    if (fp == NULL) {
+        return;
+    }
+    fprintf(fp, "engine,op,ops,ns_per_op,speedup\n");
+    for (int i = 0; i < nrows; i++) {
+        // the reference for this op is the first row that timed it
+        int ref = 0;
+        while (strcmp(rows[ref].op, rows[i].op) != 0) {
+            ref++;
+        }
+        double ns = rows[i].ops == 0 ? 0 : (double)rows[i].elapsed / rows[i].ops;
+        double refns = rows[ref].ops == 0 ? 0 : (double)rows[ref].elapsed / rows[ref].ops;
+        fprintf(fp, "%s,%s,%llu,%.1f,%.2f\n", rows[i].engine, rows[i].op,
+                (unsigned long long)rows[i].ops, ns, ns > 0 ? refns / ns : 0);
+    }
+}
+
+/**************** fuzz_fail() ****************/
+/* see fuzz.h for description */
+void
+fuzz_fail(const char* fmt, ...)
+{
+    if (current != NULL) {
+        FILE* fp = fopen("fuzz-crash", "w");
+        if (fp != NULL) {
+            fwrite(current, 1, currentsize, fp);
+            fclose(fp);
+            fprintf(stderr, "fuzz: input saved to fuzz-crash\n");
+        }
+    }
+    va_list ap;
+    va_start(ap, fmt);
+    fprintf(stderr, "fuzz: mismatch: ");
+    vfprintf(stderr, fmt, ap);
+    fprintf(stderr, "\n");
+    va_end(ap);
+    abort();
+}
+
+#ifndef FUZZ_NO_MAIN
+
+/**************** local functions ****************/
+/* not visible outside this file */
+static bool parse(const char* arg, uint64_t* value);
+static uint64_t next(uint64_t* state);
+static uint8_t* slurp(const char* path, size_t* size);
+static void run(const uint8_t* data, const size_t size);
+
+/* **************************************** */
+/* The standalone driver: random inputs, or the named files. */
+int
+main(const int argc, char* argv[])
+{
+    const char* program = argv[0];
+    uint64_t runs = 10000, seed = 1, maxlen = 4096;
+    uint64_t inputs = 0, bytes = 0;
+
+    if (argc > 1 && !parse(argv[1], &runs)) {
+        // replay each file named
+        for (int i = 1; i < argc; i++) {
+            size_t size;
+            uint8_t* data = slurp(argv[i], &size);
+            if (data == NULL) {
+                fprintf(stderr, "%s: cannot read '%s'\n", program, argv[i]);
+                return 1;
+            }
+            LLVMFuzzerTestOneInput(data, size);     // already saved, unlike a random input
+            free(data);
+            inputs++;
+            bytes += size;
+        }
+    } else {
+        if ((argc > 2 && !parse(argv[2], &seed))
+            || (argc > 3 && (!parse(argv[3], &maxlen) || maxlen > 1 << 24))
+            || argc > 4) {
+            fprintf(stderr, "usage: %s [runs [seed [maxlen]]] | %s file...\n",
+                    program, program);
+            return 1;
+        }
+        uint8_t* data = malloc(maxlen + 1);
+        if (data == NULL) {
+            fprintf(stderr, "%s: out of memory\n", program);
+            return 2;
+        }
+        uint64_t state = seed;
+        for (uint64_t r = 0; r < runs; r++) {
+            size_t size = next(&state) % (maxlen + 1);
+            for (size_t i = 0; i < size; i++) {
+                data[i] = (uint8_t)next(&state);
+            }
+            run(data, size);
+            inputs++;
+            bytes += size;
+        }
+        free(data);
+    }
+    fprintf(stderr, "%s: %llu inputs, %llu bytes, no mismatches\n", program,
+            (unsigned long long)inputs, (unsigned long long)bytes);
+    fuzz_report(stdout);
+    return 0;
+}
+
+/**************** parse() ****************/
+/* parse a non-negative decimal number; false if arg is anything else */
+static bool
+parse(const char* arg, uint64_t* value)
+{
+    char* end;
+    if (arg[0] < '0' || arg[0] > '9') {
+        return false;
+    }
+    *value = strtoull(arg, &end, 10);
+    return *end == '\0';
+}
+
+/**************** next() ****************/
+/* splitmix64, as in bench.c */
+static uint64_t
+next(uint64_t* state)
+{
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+/**************** slurp() ****************/
+/* read a whole file into a malloc'd buffer; NULL on error */
+static uint8_t*
+slurp(const char* path, size_t* size)
+{
+    FILE* fp = fopen(path, "rb");
+    if (fp == NULL) {
+        return NULL;
+    }
+    size_t cap = 4096, len = 0;
+    uint8_t* data = malloc(cap);
+    while (data != NULL) {
+        len += fread(data + len, 1, cap - len, fp);
+        if (len < cap) {
+            break;                  // end of file (or error)
+        }
+        uint8_t* bigger = realloc(data, cap *= 2);
+        if (bigger == NULL) {
+            free(data);
+        }
+        data = bigger;
+    }
+    if (data != NULL && ferror(fp)) {
+        free(data);
+        data = NULL;
+    }
+    fclose(fp);
+    *size = len;
+    return data;
+}
+
+/**************** run() ****************/
+/* run one input, remembering it in case fuzz_fail needs to save it */
+static void
+run(const uint8_t* data, const size_t size)
+{
+    current = data;
+    currentsize = size;
+    LLVMFuzzerTestOneInput(data, size);
+    current = NULL;
+}
+
+#endif // FUZZ_NO_MAIN
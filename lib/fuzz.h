@@ -0,0 +1,100 @@
+/*
+ * fuzz.h - header file for differential fuzzing support module
+ *
+ * Helpers shared by the setfuzz, hashtablefuzz and countersfuzz
+ * harnesses.  Each harness turns an input of arbitrary bytes into a
+ * sequence of operations, runs it against the list-based reference
+ * (set.c or counters.c) and against each optimized engine, and stops
+ * the program at the first result that differs.
+ *
+ * A harness defines LLVMFuzzerTestOneInput, so the same file can be
+ * built for libFuzzer (compile fuzz.c with -DFUZZ_NO_MAIN and link with
+ * -fsanitize=fuzzer), or linked with fuzz.c as is, which supplies a
+ * standalone driver:
+ *
+ *   xxxfuzz [runs [seed [maxlen]]]   run random inputs of 0..maxlen bytes
+ *   xxxfuzz file...                  replay saved inputs (e.g. crashes)
+ *
+ * The standalone driver also prints, as CSV, how long each engine took
+ * per operation and how many times faster that is than the reference.
+ *
+ * Adwiteeya Rupantee Paul, April 2025
+ */
+
+#ifndef __FUZZ_H
+#define __FUZZ_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/**************** global types ****************/
+
+/* the bytes of one input, consumed from the front; visible so it can live on the stack */
+typedef struct fuzz_input {
+    const uint8_t* data;  // the input
+    size_t size;          // its length
+    size_t pos;           // bytes consumed so far
+} fuzz_input_t;
+
+/**************** functions ****************/
+
+/**************** LLVMFuzzerTestOneInput ****************/
+/* Run one input through the harness; defined by each harness, not here.
+ * Returns 0; a mismatch ends the program through fuzz_fail.
+ */
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size);
+
+/**************** fuzz_input_init ****************/
+/* Start consuming size bytes of data. */
+void fuzz_input_init(fuzz_input_t* in, const uint8_t* data, const size_t size);
+
+/**************** fuzz_done ****************/
+/* Return true once every byte of the input has been consumed. */
+bool fuzz_done(fuzz_input_t* in);
+
+/**************** fuzz_byte ****************/
+/* Return the next byte of the input; 0 once it is used up. */
+uint8_t fuzz_byte(fuzz_input_t* in);
+
+/**************** fuzz_below ****************/
+/* Return a value in [0, bound) made from the next two bytes; bound must be > 0. */
+uint32_t fuzz_below(fuzz_input_t* in, const uint32_t bound);
+
+/**************** fuzz_now ****************/
+/* Return a monotonic timestamp in nanoseconds. */
+uint64_t fuzz_now(void);
+
+/**************** fuzz_time ****************/
+/* Add ops operations taking elapsed nanoseconds to the row (engine, op).
+ *
+ * Notes:
+ *   The first engine timed for an op is the one the others are compared
+ *   with, so a harness times its reference first.  engine and op must
+ *   be string constants; rows past FUZZ_ROWS are dropped.
+ */
+#define FUZZ_ROWS 32
+void fuzz_time(const char* engine, const char* op, const uint64_t ops,
+               const uint64_t elapsed);
+
+/**************** fuzz_report ****************/
+/* Print one CSV row per (engine, op) timed so far:
+ *   engine,op,ops,ns_per_op,speedup
+ * where speedup is the reference's ns_per_op over this row's.
+ */
+void fuzz_report(FILE* fp);
+
+/**************** fuzz_fail ****************/
+/* Report a mismatch, printf-style, and abort.
+ *
+ * We do:
+ *   print the message to stderr; when the standalone driver made up
+ *   the input that caused it, first save that input to the file
+ *   `fuzz-crash`, which can then be replayed by naming it on the
+ *   command line.  abort() is what libFuzzer expects of a failing
+ *   input.
+ */
+void fuzz_fail(const char* fmt, ...);
+
+#endif // __FUZZ_H
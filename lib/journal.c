@@ -0,0 +1,465 @@
+/*
+ * journal.c - source file for append-only journal module
+ *
+ * Appenders and the thread share two buffers.  Appenders frame their
+ * records into the active buffer under the lock; the thread swaps the
+ * buffers, drops the lock, and writes the full one while appenders fill
+ * the other.  A record is numbered as it is appended; `durable` is the
+ * number of records written so far, and journal_sync waits for it to
+ * pass the number appended when it was called.  See journal.h.
+ *
+ * A frame is the record's length and CRC-32, 4 bytes each, little-endian,
+ * then the record.
+ *
+ * Adwiteeya Rupantee Paul, April 2025
+ */
+
+#define _POSIX_C_SOURCE 200809L   // pthreads, clock_gettime, fdatasync, truncate
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <pthread.h>
+#include "journal.h"
+
+/**************** file-local global variables ****************/
+static const size_t FRAME = 8;            // bytes of framing per record
+static const size_t MIN_BUFFER = 4096;    // smallest buffer we allocate
+static const uint32_t CRC_POLY = 0xEDB88320;   // CRC-32 (IEEE), reflected
+
+/**************** global types ****************/
+typedef struct journal {
+    int fd;                  // the file, opened for appending
+    bool sync;               // fdatasync after each write
+    size_t group_bytes;      // write once this much is buffered
+    long group_ms;           // or once the oldest record is this old
+    pthread_mutex_t lock;    // guards everything below
+    pthread_cond_t wake;     // the thread waits here for records
+    pthread_cond_t done;     // journal_sync waits here for writes
+    char* buf;               // the active buffer, being appended to
+    size_t len, cap;
+    char* spare;             // the other buffer; NULL while being written
+    size_t spare_cap;
+    unsigned long appended;  // records appended
+    unsigned long durable;   // records written
+    unsigned long wanted;    // records some journal_sync waits for
+    bool closing;            // journal_close was called
+    bool failed;             // a write failed; the journal is dead
+    journal_stats_t stats;
+    pthread_t thread;
+    uint32_t crc_table[256];
+} journal_t;
+
+/**************** global functions ****************/
+/* that is, visible outside this file */
+/* see journal.h for comments about exported functions */
+
+/**************** local functions ****************/
+/* not visible outside this file */
+static void* writer(void* arg);
+static bool write_all(const int fd, const char* buf, size_t len);
+static bool drop(journal_t* journal);
+static long read_records(FILE* fp, void* arg, off_t* end,
+                         void (*recordfunc)(void* arg, const void* record, const size_t len));
+static void crc_init(uint32_t* table);
+static uint32_t crc_update(const uint32_t* table, uint32_t crc, const void* data, size_t len);
+static void put32(char* p, const uint32_t v);
+static uint32_t get32(const unsigned char* p);
+
+/**************** journal_open() ****************/
+/* see journal.h for description */
+journal_t*
+journal_open(const char* path, const size_t group_bytes,
+             const int group_ms, const bool sync)
+{
+    if (path == NULL || group_bytes == 0 || group_ms < 0) {
+        return NULL;
+    }
+    // cut off a record torn by a crash, or the records appended from now
+    // on would sit behind it, where replay never reaches them
+    FILE* fp = fopen(path, "rb");
+    if (fp != NULL) {
+        off_t end;
+        read_records(fp, NULL, &end, NULL);
+        bool torn = fseeko(fp, 0, SEEK_END) != 0 || ftello(fp) != end;
+        fclose(fp);
+        if (torn && truncate(path, end) != 0) {
+            return NULL;
+        }
+    }
+    journal_t* journal = calloc(1, sizeof(journal_t));
+    if (journal == NULL) {
+        return NULL;
+    }
+    journal->fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (journal->fd < 0) {
+        free(journal);
+        return NULL;
+    }
+    journal->sync = sync;
+    journal->group_bytes = group_bytes;
+    journal->group_ms = group_ms;
+    crc_init(journal->crc_table);
+    pthread_mutex_init(&journal->lock, NULL);
+    pthread_cond_init(&journal->wake, NULL);
+    pthread_cond_init(&journal->done, NULL);
+    if (pthread_create(&journal->thread, NULL, writer, journal) != 0) {
+        pthread_cond_destroy(&journal->done);
+        pthread_cond_destroy(&journal->wake);
+        pthread_mutex_destroy(&journal->lock);
+        close(journal->fd);
+        free(journal);
+        return NULL;
+    }
+    return journal;
+}
+
+/**************** journal_append() ****************/
+/* see journal.h for description */
+bool
+journal_append(journal_t* journal, const journal_part_t* parts, const int nparts)
+{
+    if (journal == NULL || parts == NULL || nparts < 1) {
+        return false;
+    }
+    size_t len = 0;
+    uint32_t crc = 0;
+    for (int i = 0; i < nparts; i++) {
+        len += parts[i].len;
+        crc = crc_update(journal->crc_table, crc, parts[i].data, parts[i].len);
+    }
+    pthread_mutex_lock(&journal->lock);
+    if (journal->failed) {
+        pthread_mutex_unlock(&journal->lock);
+        return false;
+    }
+    if (len > UINT32_MAX) {
+        return drop(journal);     // too long to frame
+    }
+    if (journal->len + FRAME + len > journal->cap) {
+        // grow rather than wait for the thread to free the other buffer
+        size_t cap = journal->cap < MIN_BUFFER ? MIN_BUFFER : journal->cap;
+        while (journal->len + FRAME + len > cap) {
+            cap *= 2;
+        }
+        char* buf = realloc(journal->buf, cap);
+        if (buf == NULL) {
+            return drop(journal);
+        }
+        journal->buf = buf;
+        journal->cap = cap;
+    }
+    char* frame = journal->buf + journal->len;
+    put32(frame, len);
+    put32(frame + 4, crc);
+    frame += FRAME;
+    for (int i = 0; i < nparts; i++) {
+        if (parts[i].len > 0) {
+            memcpy(frame, parts[i].data, parts[i].len);
+            frame += parts[i].len;
+        }
+    }
+    bool was_empty = journal->len == 0;
+    journal->len += FRAME + len;
+    journal->appended++;
+    journal->stats.records++;
+    if (was_empty || journal->len >= journal->group_bytes) {
+        pthread_cond_signal(&journal->wake);   // start the clock, or write now
+    }
+    pthread_mutex_unlock(&journal->lock);
+    return true;
+}
+
+/**************** journal_sync() ****************/
+/* see journal.h for description */
+bool
+journal_sync(journal_t* journal)
+{
+    if (journal == NULL) {
+        return false;
+    }
+    pthread_mutex_lock(&journal->lock);
+    unsigned long target = journal->appended;
+    if (journal->wanted < target) {
+        journal->wanted = target;
+        pthread_cond_signal(&journal->wake);   // don't wait out group_ms
+    }
+    while (journal->durable < target && !journal->failed) {
+        pthread_cond_wait(&journal->done, &journal->lock);
+    }
+    bool ok = journal->durable >= target;
+    pthread_mutex_unlock(&journal->lock);
+    return ok;
+}
+
+/**************** journal_stats() ****************/
+/* see journal.h for description */
+bool
+journal_stats(journal_t* journal, journal_stats_t* stats)
+{
+    if (journal == NULL || stats == NULL) {
+        return false;
+    }
+    pthread_mutex_lock(&journal->lock);
+    *stats = journal->stats;
+    pthread_mutex_unlock(&journal->lock);
+    return true;
+}
+
+/**************** journal_close() ****************/
+/* see journal.h for description */
+bool
+journal_close(journal_t* journal)
+{
+    if (journal == NULL) {
+        return true;
+    }
+    pthread_mutex_lock(&journal->lock);
+    journal->closing = true;
+    pthread_cond_signal(&journal->wake);
+    pthread_mutex_unlock(&journal->lock);
+    pthread_join(journal->thread, NULL);   // it writes what is left first
+    bool ok = !journal->failed && journal->durable == journal->appended;
+    if (close(journal->fd) != 0) {
+        ok = false;
+    }
+    pthread_cond_destroy(&journal->done);
+    pthread_cond_destroy(&journal->wake);
+    pthread_mutex_destroy(&journal->lock);
+    free(journal->buf);
+    free(journal->spare);
+    free(journal);
+    return ok;
+}
+
+/**************** journal_replay() ****************/
+/* see journal.h for description */
+long
+journal_replay(const char* path, void* arg,
+               void (*recordfunc)(void* arg, const void* record, const size_t len))
+{
+    if (path == NULL || recordfunc == NULL) {
+        return -1;
+    }
+    FILE* fp = fopen(path, "rb");
+    if (fp == NULL) {
+        return -1;
+    }
+    off_t end;
+    long count = read_records(fp, arg, &end, recordfunc);
+    fclose(fp);
+    return count;
+}
+
+/**************** drop() ****************/
+/* journal_append could not take a record: the journal is dead, so that
+ * journal_sync and journal_close report the loss; unlock, return false */
+static bool
+drop(journal_t* journal)
+{
+    journal->failed = true;
+    pthread_cond_broadcast(&journal->done);
+    pthread_mutex_unlock(&journal->lock);
+    return false;
+}
+
+/**************** read_records() ****************/
+/* read the whole records at the front of fp, calling recordfunc on each
+ * if it is not NULL; set *end to the offset just past the last of them,
+ * and return how many there were */
+static long
+read_records(FILE* fp, void* arg, off_t* end,
+             void (*recordfunc)(void* arg, const void* record, const size_t len))
+{
+    uint32_t table[256];
+    crc_init(table);
+    off_t size = fseeko(fp, 0, SEEK_END) == 0 ? ftello(fp) : -1;
+    rewind(fp);
+    unsigned char* record = NULL;
+    size_t cap = 0;
+    long count = 0;
+    off_t pos = 0;
+    unsigned char frame[8];
+    unsigned char chunk[4096];
+    while (fread(frame, 1, FRAME, fp) == FRAME) {
+        size_t len = get32(frame);
+        if (size >= 0 && (off_t)len > size - pos - (off_t)FRAME) {
+            break;                // runs past the end of the file: torn
+        }
+        uint32_t crc = 0;
+        size_t got = 0;
+        if (recordfunc != NULL) {
+            if (len > cap) {
+                unsigned char* bigger = realloc(record, len);
+                if (bigger == NULL) {
+                    break;
+                }
+                record = bigger;
+                cap = len;
+            }
+            got = fread(record, 1, len, fp);
+            crc = crc_update(table, 0, record, got);
+        } else {
+            // only checking: take the record a chunk at a time
+            size_t n;
+            while (got < len
+                   && (n = fread(chunk, 1, len - got < sizeof(chunk) ? len - got
+                                                                     : sizeof(chunk), fp)) > 0) {
+                crc = crc_update(table, crc, chunk, n);
+                got += n;
+            }
+        }
+        if (got != len || crc != get32(frame + 4)) {
+            break;                // torn or corrupt: the end of the log
+        }
+        if (recordfunc != NULL) {
+            (*recordfunc)(arg, record, len);
+        }
+        count++;
+        pos += FRAME + len;
+    }
+    free(record);
+    *end = pos;
+    return count;
+}
+
+/**************** writer() ****************/
+/* the journal's thread: wait for records, gather a group, write it */
+static void*
+writer(void* arg)
+{
+    journal_t* journal = arg;
+    pthread_mutex_lock(&journal->lock);
+    while (true) {
+        while (journal->len == 0 && !journal->closing) {
+            pthread_cond_wait(&journal->wake, &journal->lock);
+        }
+        if (journal->len == 0) {
+            break;                // closing, and all written
+        }
+        if (journal->len < journal->group_bytes && journal->wanted <= journal->durable
+            && !journal->closing && journal->group_ms > 0) {
+            // let the group grow, until it is big enough or someone waits
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += journal->group_ms / 1000;
+            deadline.tv_nsec += (journal->group_ms % 1000) * 1000000L;
+            if (deadline.tv_nsec >= 1000000000L) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            while (journal->len < journal->group_bytes && journal->wanted <= journal->durable
+                   && !journal->closing
+                   && pthread_cond_timedwait(&journal->wake, &journal->lock, &deadline) == 0) {
+                ;
+            }
+        }
+        // take the group, and let appenders carry on in the other buffer
+        char* buf = journal->buf;
+        size_t cap = journal->cap;
+        size_t len = journal->len;
+        unsigned long upto = journal->appended;
+        journal->buf = journal->spare;
+        journal->cap = journal->spare_cap;
+        journal->len = 0;
+        journal->spare = NULL;    // this thread's until written
+        journal->spare_cap = 0;
+        pthread_mutex_unlock(&journal->lock);
+
+        bool ok = write_all(journal->fd, buf, len);
+        if (ok && journal->sync) {
+            ok = fdatasync(journal->fd) == 0;
+        }
+
+        pthread_mutex_lock(&journal->lock);
+        journal->spare = buf;     // the next group goes in it
+        journal->spare_cap = cap;
+        journal->stats.writes++;
+        journal->stats.bytes += len;
+        if (journal->sync) {
+            journal->stats.syncs++;
+        }
+        if (ok) {
+            journal->durable = upto;
+        } else {
+            journal->failed = true;
+        }
+        pthread_cond_broadcast(&journal->done);
+        if (journal->failed) {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&journal->lock);
+    return NULL;
+}
+
+/**************** write_all() ****************/
+/* write len bytes, however many calls it takes; false on error */
+static bool
+write_all(const int fd, const char* buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+/**************** crc_init() ****************/
+/* fill a byte-at-a-time CRC-32 table */
+static void
+crc_init(uint32_t* table)
+{
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) {
+            c = (c & 1) ? CRC_POLY ^ (c >> 1) : c >> 1;
+        }
+        table[i] = c;
+    }
+}
+
+/**************** crc_update() ****************/
+/* the CRC-32 of data, continuing from crc (0 to start) */
+static uint32_t
+crc_update(const uint32_t* table, uint32_t crc, const void* data, size_t len)
+{
+    const unsigned char* p = data;
+    crc = ~crc;
+    while (len-- > 0) {
+        crc = table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+/**************** put32() ****************/
+/* store v little-endian */
+static void
+put32(char* p, const uint32_t v)
+{
+    for (int i = 0; i < 4; i++) {
+        p[i] = (char)(v >> (8 * i));
+    }
+}
+
+/**************** get32() ****************/
+/* load a little-endian value */
+static uint32_t
+get32(const unsigned char* p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
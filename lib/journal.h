@@ -0,0 +1,123 @@
+/*
+ * journal.h - header file for append-only journal module
+ *
+ * A *journal* is an append-only log file of records, written by a
+ * background thread.  journal_append only copies a record into a memory
+ * buffer, so the caller never waits for the disk; the thread takes the
+ * whole buffer at once and writes it in one sequential write, then (if
+ * asked) one fdatasync.  Callers who need their records on disk call
+ * journal_sync, and all the callers waiting at once share one write and
+ * one sync: group commit.  journal_replay reads the records back, in
+ * order, to rebuild a structure at startup.
+ *
+ * The hashtable and counters modules log their changes to a journal
+ * once one is attached (hashtable_journal, counters_journal), and replay
+ * it (hashtable_replay, counters_replay).
+ *
+ * Each record is framed by its length and a CRC-32 of its bytes, so a
+ * record torn by a crash is detected; replay stops there, having
+ * returned every whole record before it, and the next journal_open cuts
+ * it off, so that records appended after a restart are replayed too.
+ *
+ * Adwiteeya Rupantee Paul, April 2025
+ */
+
+#ifndef __JOURNAL_H
+#define __JOURNAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**************** global types ****************/
+typedef struct journal journal_t;  // opaque to users of the module
+
+/* one piece of a record; see journal_append */
+typedef struct journal_part {
+  const void* data;
+  size_t len;
+} journal_part_t;
+
+/* counts filled in by journal_stats */
+typedef struct journal_stats {
+  unsigned long records;         // records appended
+  size_t bytes;                  // bytes written, framing included
+  unsigned long writes;          // write calls: one per group of records
+  unsigned long syncs;           // fdatasync calls
+} journal_stats_t;
+
+/**************** functions ****************/
+
+/**************** journal_open ****************/
+/* Open (or create) a journal file for appending, and start its thread.
+ *
+ * Caller provides:
+ *   path of the file; records are appended after the whole records
+ *   already there, and a torn record after them is cut off first,
+ *   group_bytes: write as soon as this many bytes are buffered,
+ *   group_ms: else write buffered records after at most this long,
+ *   sync: true to fdatasync after each write, so that journal_sync
+ *   means "on disk", not just "handed to the kernel".
+ * We return:
+ *   the journal; NULL if path is NULL, group_bytes is 0, group_ms < 0,
+ *   or the file cannot be opened or cut, or the thread cannot be made.
+ * Caller is responsible for:
+ *   later calling journal_close.
+ */
+journal_t* journal_open(const char* path, const size_t group_bytes,
+                        const int group_ms, const bool sync);
+
+/**************** journal_append ****************/
+/* Append one record, the concatenation of nparts parts.
+ *
+ * We return:
+ *   false if journal or parts is NULL, nparts < 1, out of memory, the
+ *   record is longer than 4GB, or an earlier write failed; true otherwise.
+ * We do:
+ *   copy the record into the buffer, growing the buffer rather than
+ *   waiting if the thread is busy writing; the thread writes it later.
+ * Notes:
+ *   Safe to call from any thread; records from one thread stay in order.
+ *   A record dropped for lack of memory or length fails the journal like
+ *   a failed write: no later record is taken, and journal_sync and
+ *   journal_close return false.
+ */
+bool journal_append(journal_t* journal, const journal_part_t* parts, const int nparts);
+
+/**************** journal_sync ****************/
+/* Wait until every record appended before the call has been written
+ * (and synced, if the journal syncs).
+ *
+ * We return:
+ *   false if journal is NULL or a write failed; true otherwise.
+ */
+bool journal_sync(journal_t* journal);
+
+/**************** journal_stats ****************/
+/* Fill in the journal's counts; false if either pointer is NULL. */
+bool journal_stats(journal_t* journal, journal_stats_t* stats);
+
+/**************** journal_close ****************/
+/* Write every buffered record, stop the thread and close the file;
+ * ignore NULL journal.
+ *
+ * We return:
+ *   true if every record appended was written; false otherwise.
+ */
+bool journal_close(journal_t* journal);
+
+/**************** journal_replay ****************/
+/* Read the journal file at path, calling recordfunc(arg, record, len)
+ * on each whole record in the order appended.
+ *
+ * We return:
+ *   the number of records replayed; -1 if path or recordfunc is NULL, or
+ *   the file cannot be opened.
+ * Notes:
+ *   replay stops at the first torn or corrupt record, the tail of a crash;
+ *   journal_open cuts that tail off before appending more.
+ *   record is valid only until recordfunc returns.
+ */
+long journal_replay(const char* path, void* arg,
+                    void (*recordfunc)(void* arg, const void* record, const size_t len));
+
+#endif // __JOURNAL_H
@@ -0,0 +1,336 @@
+/*
+ * pages.c - source file for page-placement allocator module
+ *
+ * Every block starts with a 16-byte header giving its size class, or
+ * marking it large and giving the length of its mapping.  Small blocks
+ * come in classes of 32 to 256 bytes in steps of 16, then powers of two
+ * up to PAGES_LARGE, headers included; a freed small block goes on the
+ * free list of its class, and the next request of that class takes it.
+ * Mappings that may use huge pages are aligned to HUGE_PAGE, since the
+ * kernel only backs aligned 2 MB extents with huge pages.  A spinlock
+ * guards it all, so blocks may be freed on any thread.  See pages.h.
+ *
+ * Adwiteeya Rupantee Paul, April 2025
+ */
+
+#define _DEFAULT_SOURCE      // mmap flags, madvise and syscall
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#include "pages.h"
+
+/**************** local types ****************/
+typedef struct blockhdr {
+    size_t size;             // mapping length, if large
+    size_t cls;              // size class, or LARGE_CLASS
+} blockhdr_t;
+
+typedef struct arena {
+    struct arena* next;      // the other arenas
+    size_t len;              // length of this arena's mapping
+} arena_t;
+
+/**************** file-local global variables ****************/
+#define NCLASSES 23                       // 15 steps of 16, 8 powers of two
+#define NODE_WORDS 16                     // NUMA node mask: 1024 nodes
+static const size_t HEADER = 16;          // bytes before each block
+static const size_t HUGE_PAGE = 2 * 1024 * 1024;
+static const size_t LARGE_CLASS = (size_t)-1;   // header class of a large block
+
+/* NUMA memory policies, as in <numaif.h>, which may not be installed */
+static const int MPOL_INTERLEAVE_MODE = 3;
+static const int MPOL_LOCAL_MODE = 4;
+static const int MPOL_F_MEMS_ALLOWED_FLAG = 4;
+
+/* the allocator's state, guarded by lock */
+static atomic_flag lock = ATOMIC_FLAG_INIT;
+static int placement = 0;                 // the flags given to pages_init
+static unsigned long nodes[NODE_WORDS];   // NUMA nodes to interleave across
+static bool have_nodes = false;           // nodes is filled in
+static void* free_lists[NCLASSES];        // freed small blocks, by class
+static arena_t* arenas = NULL;            // arenas mapped since pages_init
+static char* bump = NULL;                 // the unused part of the newest arena
+static char* bump_end = NULL;
+static pages_stats_t counts;              // see pages_stats
+
+/**************** local functions ****************/
+/* not visible outside this file */
+static inline void lock_take(void);
+static inline void lock_give(void);
+static int class_of(const size_t total);
+static size_t class_bytes(const int cls);
+static void* map_pages(size_t* len);
+static void* map_aligned(const size_t len);
+static void place(void* addr, const size_t len);
+
+/**************** pages_init() ****************/
+/* see pages.h for description */
+bool
+pages_init(const int flags)
+{
+    int known = PAGES_HUGE | PAGES_HUGETLB | PAGES_LOCAL | PAGES_INTERLEAVE;
+    if ((flags & ~known) != 0
+        || (flags & (PAGES_HUGE | PAGES_HUGETLB)) == (PAGES_HUGE | PAGES_HUGETLB)
+        || (flags & (PAGES_LOCAL | PAGES_INTERLEAVE)) == (PAGES_LOCAL | PAGES_INTERLEAVE)) {
+        return false;
+    }
+    lock_take();
+    while (arenas != NULL) {
+        arena_t* next = arenas->next;
+        munmap(arenas, arenas->len);
+        arenas = next;
+    }
+    memset(free_lists, 0, sizeof(free_lists));
+    bump = bump_end = NULL;
+    memset(&counts, 0, sizeof(counts));
+    placement = flags;
+    have_nodes = false;
+#if defined(__linux__) && defined(SYS_get_mempolicy)
+    if (flags & PAGES_INTERLEAVE) {
+        memset(nodes, 0, sizeof(nodes));
+        have_nodes = syscall(SYS_get_mempolicy, NULL, nodes, NODE_WORDS * 64,
+                             NULL, MPOL_F_MEMS_ALLOWED_FLAG) == 0;
+    }
+#endif
+    lock_give();
+    return true;
+}
+
+/**************** pages_malloc() ****************/
+/* see pages.h for description */
+void*
+pages_malloc(size_t size)
+{
+    if (size > SIZE_MAX - HUGE_PAGE - HEADER) {
+        return NULL;              // no such mapping
+    }
+    size_t total = (size == 0 ? 1 : size) + HEADER;
+    blockhdr_t* block;
+    lock_take();
+    if (total > PAGES_LARGE) {
+        size_t len = total;
+        block = map_pages(&len);
+        if (block != NULL) {
+            block->size = len;
+            block->cls = LARGE_CLASS;
+        }
+    } else {
+        int cls = class_of(total);
+        size_t bytes = class_bytes(cls);
+        block = free_lists[cls];
+        if (block != NULL) {
+            free_lists[cls] = *(void**)block;   // reuse a freed block
+        } else {
+            if (bump == NULL || (size_t)(bump_end - bump) < bytes) {
+                size_t len = PAGES_ARENA;
+                arena_t* arena = map_pages(&len);
+                if (arena == NULL) {
+                    lock_give();
+                    return NULL;
+                }
+                arena->next = arenas;
+                arena->len = len;
+                arenas = arena;
+                bump = (char*)arena + sizeof(arena_t);
+                bump_end = (char*)arena + len;
+            }
+            block = (blockhdr_t*)bump;
+            bump += bytes;
+        }
+        block->cls = cls;
+    }
+    lock_give();
+    return block == NULL ? NULL : (char*)block + HEADER;
+}
+
+/**************** pages_free() ****************/
+/* see pages.h for description */
+void
+pages_free(void* ptr)
+{
+    if (ptr == NULL) {
+        return;
+    }
+    blockhdr_t* block = (blockhdr_t*)((char*)ptr - HEADER);
+    lock_take();
+    if (block->cls == LARGE_CLASS) {
+        counts.mapped -= block->size;
+        munmap(block, block->size);
+    } else {
+        *(void**)block = free_lists[block->cls];
+        free_lists[block->cls] = block;
+    }
+    lock_give();
+}
+
+/**************** pages_usable() ****************/
+/* see pages.h for description */
+size_t
+pages_usable(void* ptr)
+{
+    if (ptr == NULL) {
+        return 0;
+    }
+    blockhdr_t* block = (blockhdr_t*)((char*)ptr - HEADER);
+    if (block->cls == LARGE_CLASS) {
+        return block->size - HEADER;
+    }
+    return class_bytes(block->cls) - HEADER;
+}
+
+/**************** pages_stats() ****************/
+/* see pages.h for description */
+void
+pages_stats(pages_stats_t* stats)
+{
+    if (stats != NULL) {
+        lock_take();
+        *stats = counts;
+        lock_give();
+    }
+}
+
+/**************** lock_take() ****************/
+/* spin until we hold the lock; it is held only for a few instructions,
+ * or a system call */
+static inline void
+lock_take(void)
+{
+    while (atomic_flag_test_and_set_explicit(&lock, memory_order_acquire)) {
+        ;
+    }
+}
+
+/**************** lock_give() ****************/
+/* release the lock */
+static inline void
+lock_give(void)
+{
+    atomic_flag_clear_explicit(&lock, memory_order_release);
+}
+
+/**************** class_of() ****************/
+/* the smallest class holding total bytes, header included */
+static int
+class_of(const size_t total)
+{
+    if (total <= 256) {
+        return (total + 15) / 16 - 2;       // 32, 48, ... 256
+    }
+    int cls = 15;
+    while (class_bytes(cls) < total) {      // 512, 1024, ... PAGES_LARGE
+        cls++;
+    }
+    return cls;
+}
+
+/**************** class_bytes() ****************/
+/* the bytes in a block of the class, header included */
+static size_t
+class_bytes(const int cls)
+{
+    return cls < 15 ? 32 + 16 * (size_t)cls : (size_t)512 << (cls - 15);
+}
+
+/**************** map_pages() ****************/
+/* map at least *len bytes, placed as pages_init asked, and set *len to
+ * the length mapped; NULL if out of memory.  Called with the lock held. */
+static void*
+map_pages(size_t* len)
+{
+    long page = sysconf(_SC_PAGESIZE);
+    size_t unit = (placement & (PAGES_HUGE | PAGES_HUGETLB)) ? HUGE_PAGE : (size_t)page;
+    *len = (*len + unit - 1) / unit * unit;
+    void* addr = NULL;
+#ifdef MAP_HUGETLB
+    if (placement & PAGES_HUGETLB) {
+        addr = mmap(NULL, *len, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (addr == MAP_FAILED) {
+            addr = NULL;          // none reserved; try transparent ones
+        } else {
+            counts.hugetlb++;
+        }
+    }
+#endif
+    if (addr == NULL) {
+        if (placement & PAGES_HUGETLB) {
+            counts.fallbacks++;
+        }
+        addr = unit == HUGE_PAGE ? map_aligned(*len)
+             : mmap(NULL, *len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (addr == MAP_FAILED || addr == NULL) {
+            return NULL;
+        }
+        if (unit == HUGE_PAGE) {
+#ifdef MADV_HUGEPAGE
+            if (madvise(addr, *len, MADV_HUGEPAGE) == 0) {
+                counts.advised++;
+            } else {
+                counts.fallbacks++;   // no transparent huge pages here
+            }
+#else
+            counts.fallbacks++;
+#endif
+        }
+    }
+    place(addr, *len);
+    counts.mappings++;
+    counts.mapped += *len;
+    return addr;
+}
+
+/**************** map_aligned() ****************/
+/* map len bytes (a multiple of HUGE_PAGE) at a HUGE_PAGE boundary, by
+ * mapping one huge page too many and trimming both ends; NULL if out of
+ * memory */
+static void*
+map_aligned(const size_t len)
+{
+    char* raw = mmap(NULL, len + HUGE_PAGE, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) {
+        return NULL;
+    }
+    char* addr = (char*)(((uintptr_t)raw + HUGE_PAGE - 1) & ~(uintptr_t)(HUGE_PAGE - 1));
+    if (addr > raw) {
+        munmap(raw, addr - raw);
+    }
+    if (addr + len < raw + len + HUGE_PAGE) {
+        munmap(addr + len, raw + len + HUGE_PAGE - (addr + len));
+    }
+    return addr;
+}
+
+/**************** place() ****************/
+/* give a fresh, untouched mapping the NUMA policy pages_init asked for */
+static void
+place(void* addr, const size_t len)
+{
+    if ((placement & (PAGES_LOCAL | PAGES_INTERLEAVE)) == 0) {
+        return;
+    }
+#if defined(__linux__) && defined(SYS_mbind)
+    long rc = -1;
+    if (placement & PAGES_LOCAL) {
+        rc = syscall(SYS_mbind, addr, len, MPOL_LOCAL_MODE, NULL, 0, 0);
+    } else if (have_nodes) {
+        rc = syscall(SYS_mbind, addr, len, MPOL_INTERLEAVE_MODE, nodes,
+                     NODE_WORDS * 64, 0);
+    }
+    if (rc == 0) {
+        counts.placed++;
+        return;
+    }
+#endif
+    counts.fallbacks++;           // no NUMA support; first touch decides
+}
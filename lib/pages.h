@@ -0,0 +1,89 @@
+/*
+ * pages.h - header file for page-placement allocator module
+ *
+ * An allocator for big tables, meant to be plugged in with
+ * hashtable_allocator (or counters_allocator):
+ *
+ *   pages_init(PAGES_HUGE | PAGES_INTERLEAVE);
+ *   hashtable_allocator(pages_malloc, pages_free, pages_usable);
+ *
+ * Memory comes straight from mmap, and pages_init chooses how the pages
+ * are placed: on transparent huge pages (madvise), on explicit huge
+ * pages (MAP_HUGETLB), on the NUMA node of the thread that touches them,
+ * or interleaved across nodes.  A table whose slot array and nodes span
+ * gigabytes then takes far fewer TLB misses, and no socket is remote for
+ * every lookup.
+ *
+ * Blocks larger than PAGES_LARGE, such as slot arrays, get a mapping of
+ * their own, returned to the system when freed.  Smaller blocks, such as
+ * nodes and keys, are carved from PAGES_ARENA-byte arenas into size
+ * classes, and recycled through a free list per class; arenas are only
+ * returned by the next pages_init.  Every request that the system cannot
+ * place as asked falls back to the next best placement, so the allocator
+ * works (and the counts in pages_stats say what happened) on any Linux
+ * machine; elsewhere, it places pages as the system does.
+ *
+ * Adwiteeya Rupantee Paul, April 2025
+ */
+
+#ifndef __PAGES_H
+#define __PAGES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**************** global types ****************/
+
+/* placement flags for pages_init; combine at most one of each pair */
+#define PAGES_HUGE       1   // transparent huge pages, by madvise
+#define PAGES_HUGETLB    2   // explicit huge pages; else as PAGES_HUGE
+#define PAGES_LOCAL      4   // NUMA: the node of the first thread to touch
+#define PAGES_INTERLEAVE 8   // NUMA: round-robin across the allowed nodes
+
+#define PAGES_LARGE (64 * 1024)          // bigger blocks get their own mapping
+#define PAGES_ARENA (32 * 1024 * 1024)   // bytes per arena of small blocks
+
+/* counts filled in by pages_stats */
+typedef struct pages_stats {
+  size_t mapped;                 // bytes mapped now, arenas included
+  long mappings;                 // mappings made since pages_init
+  long hugetlb;                  // of which, on explicit huge pages
+  long advised;                  // of which, advised to use huge pages
+  long placed;                   // of which, given a NUMA policy
+  long fallbacks;                // requests the system could not place as asked
+} pages_stats_t;
+
+/**************** functions ****************/
+
+/**************** pages_init ****************/
+/* Choose the placement for all later mappings, and drop every arena.
+ *
+ * Caller provides:
+ *   flags, a combination of the PAGES_ flags above, or 0 for plain pages.
+ * We return:
+ *   false if flags are unknown or contradictory; true otherwise.
+ * Notes:
+ *   Call it only while no block from pages_malloc is live; the hashtable
+ *   allocator may be changed only while no hashtable exists anyway.
+ */
+bool pages_init(const int flags);
+
+/**************** pages_malloc ****************/
+/* Allocate size bytes, 16-byte aligned, like malloc; NULL if out of memory. */
+void* pages_malloc(size_t size);
+
+/**************** pages_free ****************/
+/* Free a block from pages_malloc, like free; ignore NULL ptr. */
+void pages_free(void* ptr);
+
+/**************** pages_usable ****************/
+/* Return the usable bytes in a block from pages_malloc, like
+ * malloc_usable_size; 0 if ptr is NULL.
+ */
+size_t pages_usable(void* ptr);
+
+/**************** pages_stats ****************/
+/* Fill in the counts since the last pages_init; ignore NULL stats. */
+void pages_stats(pages_stats_t* stats);
+
+#endif // __PAGES_H
@@ -4,8 +4,8 @@
  * A *set* maintains an unordered collection of (key,item) pairs;
  * any given key can only occur in the set once. It starts out empty 
  * and grows as the caller inserts new (key,item) pairs.  The caller 
- * can retrieve items by asking for their key, but cannot remove or 
- * update pairs.  Items are distinguished by their key.
+ * can retrieve items by asking for their key, and remove pairs, but
+ * cannot update them.  Items are distinguished by their key.
  *
  * Adwiteeya Rupantee Paul, April 2025
  */
@@ -15,9 +15,19 @@
 #include <string.h>
 #include <stdbool.h>
 #include "set.h"
+#ifdef __GLIBC__
+#include <malloc.h>      // malloc_usable_size
+#endif
 
 /**************** file-local global variables ****************/
-/* none */
+/* the allocator used for all set memory; see set_allocator */
+static void* (*set_malloc)(size_t size) = malloc;
+static void (*set_free)(void* ptr) = free;
+#ifdef __GLIBC__
+static size_t (*set_usable)(void* ptr) = malloc_usable_size;
+#else
+static size_t (*set_usable)(void* ptr) = NULL;
+#endif
 
 /**************** local types ****************/
 typedef struct setnode {
@@ -41,6 +51,9 @@ typedef struct set {
 /* not visible outside this file */
 /* see set.h for comments about exported functions */
 static setnode_t* setnode_new(const char* key, void* item);
+static size_t block_size(void* ptr, size_t requested);
+static bool set_merge(set_t* dest, set_t* a, set_t* b,
+                      const bool keep_a, const bool keep_b, const bool keep_both);
 
 
 /**************** set_new() ****************/
@@ -48,13 +61,13 @@ static setnode_t* setnode_new(const char* key, void* item);
 set_t*
 set_new(void)
 {
-    set_t* set = malloc(sizeof(set_t));
+    set_t* set = set_malloc(sizeof(set_t));
 
     if (set != NULL) {
         // initialize contents of set structure
         set->head = NULL;
-        return set;
     }
+    return set;
 }
 
 
@@ -63,21 +76,20 @@ set_new(void)
 static setnode_t*  // not visible outside this file
 setnode_new(const char* key, void* item)
 {
-    setnode_t* node = malloc(sizeof(setnode_t));
+    setnode_t* node = set_malloc(sizeof(setnode_t));
 
 
     if (node != NULL) {
-        node->key = malloc(strlen(key)); // allocate memory for key
+        node->key = set_malloc(strlen(key) + 1); // allocate memory for key
         if (node->key == NULL) {
-            free(node); // free the node if key allocation fails
+            set_free(node); // free the node if key allocation fails
             return NULL;    // error allocating memory for key
         }
         strcpy(node->key, key);      // copy the key string
         node->item = item;         // set the item pointer
         node->next = NULL;           // initialize next pointer to NULL
-        return node;
-
     }
+    return node;
 }
 
 
@@ -86,24 +98,28 @@ setnode_new(const char* key, void* item)
 bool
 set_insert(set_t* set, const char* key, void* item)
 {
-    if (set == NULL) {
-        return false;             // bad set
+    // check if the set, key, and item are not NULL
+    if (set == NULL || key == NULL || item == NULL) {
+        return false;             // bad set, key or item
     }
-    for (setnode_t* node = set->head; node != NULL; node = node->next) {
-        if (strcmp(node->key, key) == 0) {
+    // find where the key belongs; the list is kept in key order
+    setnode_t** prev = &set->head;
+    while (*prev != NULL) {
+        int cmp = strcmp((*prev)->key, key);
+        if (cmp == 0) {
             return false;         // key already exists
         }
-    }
-    // check if the set, key, and item are not NULL
-    if (set != NULL && key != NULL && item != NULL) {
-        // allocate a new node to be added to the list
-        setnode_t* new = setnode_new(key, item);
-        if (new != NULL) {
-            // add it to the head of the list
-            new->next = set->head;
-            set->head = new;         // success
-            return true;
+        if (cmp > 0) {
+            break;                // key goes before this node
         }
+        prev = &(*prev)->next;
+    }
+    // allocate a new node to be added to the list
+    setnode_t* new = setnode_new(key, item);
+    if (new != NULL) {
+        new->next = *prev;
+        *prev = new;              // success
+        return true;
     }
     return false;             // failure
 }
@@ -117,14 +133,44 @@ set_find(set_t* set, const char* key){
         return NULL;              // bad set or key
     } else {
         for (setnode_t* node = set->head; node != NULL; node = node->next) {
-            if (strcmp(node->key, key) == 0) {
+            int cmp = strcmp(node->key, key);
+            if (cmp == 0) {
                 return node->item; // found the item
             }
+            if (cmp > 0) {
+                break;            // passed where the key would be
+            }
         }
         return NULL;              // key not found
     }
 }
 
+/**************** set_remove() ****************/
+/* see set.h for description */
+void*
+set_remove(set_t* set, const char* key)
+{
+    if (set == NULL || key == NULL) {
+        return NULL;              // bad set or key
+    }
+    for (setnode_t** prev = &set->head; *prev != NULL; prev = &(*prev)->next) {
+        int cmp = strcmp((*prev)->key, key);
+        if (cmp == 0) {
+            // unlink the node, and free it and its key copy
+            setnode_t* node = *prev;
+            void* item = node->item;
+            *prev = node->next;
+            set_free(node->key);
+            set_free(node);
+            return item;
+        }
+        if (cmp > 0) {
+            break;                // passed where the key would be
+        }
+    }
+    return NULL;                  // key not found
+}
+
 /**************** set_print() ****************/
 /* see set.h for description */
 void
@@ -165,6 +211,26 @@ set_iterate(set_t* set, void* arg, void (*itemfunc)(void* arg, const char* key,
         }
     }
 }
+/**************** set_prefix_iterate() ****************/
+/* see set.h for description */
+void
+set_prefix_iterate(set_t* set, const char* prefix, void* arg,
+                   void (*itemfunc)(void* arg, const char* key, void* item) )
+{
+    if (set == NULL || prefix == NULL || itemfunc == NULL) {
+        return;
+    }
+    size_t len = strlen(prefix);
+    for (setnode_t* node = set->head; node != NULL; node = node->next) {
+        int cmp = strncmp(node->key, prefix, len);
+        if (cmp > 0) {
+            break;                // past every key with the prefix
+        }
+        if (cmp == 0) {
+            (*itemfunc)(arg, node->key, node->item);
+        }
+    }
+}
 /**************** set_delete() ****************/
 /* see set.h for description */
 void
@@ -172,17 +238,140 @@ set_delete(set_t* set, void (*itemdelete)(void* item) )
 {
     if (set != NULL) {
         // delete each node in the list
-        for (setnode_t* node = set->head; node != NULL; node = node->next) {
-  // delete the item
+        for (setnode_t* node = set->head; node != NULL; ) {
+            // delete the item
             if (itemdelete != NULL) {
-            node->item = NULL; // set item to NULL
-            (*itemdelete)(node->item);
+                (*itemdelete)(node->item);
             }
             setnode_t* next = node->next; // save next node
-            free(node->key);              // free the key string
-            free(node)    ;              // free the node
+            set_free(node->key);          // free the key string
+            set_free(node);              // free the node
             node = next;                 // move to next node
         }
-        free(set);                      // free the set structure
+        set_free(set);                  // free the set structure
+    }
+}
+
+/**************** block_size() ****************/
+/* bytes a block really occupies: its usable size, if the allocator can tell us */
+static size_t
+block_size(void* ptr, size_t requested)
+{
+    if (set_usable != NULL) {
+        size_t usable = set_usable(ptr);
+        if (usable > requested) {
+            return usable;          // requested bytes plus slack
+        }
+    }
+    return requested;
+}
+
+/**************** set_memory_usage() ****************/
+/* see set.h for description */
+size_t
+set_memory_usage(set_t* set)
+{
+    if (set == NULL) {
+        return 0;
+    }
+    size_t bytes = block_size(set, sizeof(set_t));
+    for (setnode_t* node = set->head; node != NULL; node = node->next) {
+        bytes += block_size(node, sizeof(setnode_t));
+        bytes += block_size(node->key, strlen(node->key) + 1);
+    }
+    return bytes;
+}
+
+/**************** set_allocator() ****************/
+/* see set.h for description */
+void
+set_allocator(void* (*allocfn)(size_t size), void (*freefn)(void* ptr),
+              size_t (*sizefn)(void* ptr))
+{
+    if (allocfn == NULL || freefn == NULL) {
+        set_malloc = malloc;
+        set_free = free;
+#ifdef __GLIBC__
+        set_usable = malloc_usable_size;
+#else
+        set_usable = NULL;
+#endif
+    } else {
+        set_malloc = allocfn;
+        set_free = freefn;
+        set_usable = sizefn;
+    }
+}
+
+/**************** set_merge() ****************/
+/* Walk the sorted lists a and b together, appending to the empty dest a
+ * copy of each key found only in a (if keep_a), only in b (if keep_b),
+ * or in both (if keep_both; with a's item).  Linear in |a| + |b|.
+ */
+static bool
+set_merge(set_t* dest, set_t* a, set_t* b,
+          const bool keep_a, const bool keep_b, const bool keep_both)
+{
+    if (dest == NULL || a == NULL || b == NULL || dest == a || dest == b
+        || dest->head != NULL) {
+        return false;             // bad sets, or dest not empty
+    }
+    setnode_t** tail = &dest->head;   // where the next node goes
+    setnode_t* na = a->head;
+    setnode_t* nb = b->head;
+    while (na != NULL || nb != NULL) {
+        int cmp;
+        if (na == NULL) {
+            cmp = 1;              // only b is left
+        } else if (nb == NULL) {
+            cmp = -1;             // only a is left
+        } else {
+            cmp = strcmp(na->key, nb->key);
+        }
+        setnode_t* from = NULL;   // node to copy into dest, if any
+        if (cmp < 0) {
+            from = keep_a ? na : NULL;
+            na = na->next;
+        } else if (cmp > 0) {
+            from = keep_b ? nb : NULL;
+            nb = nb->next;
+        } else {
+            from = keep_both ? na : NULL;
+            na = na->next;
+            nb = nb->next;
+        }
+        if (from != NULL) {
+            setnode_t* new = setnode_new(from->key, from->item);
+            if (new == NULL) {
+                return false;     // out of memory; dest holds a partial result
+            }
+            *tail = new;          // append, keeping dest in key order
+            tail = &new->next;
+        }
     }
+    return true;
+}
+
+/**************** set_intersect() ****************/
+/* see set.h for description */
+bool
+set_intersect(set_t* dest, set_t* a, set_t* b)
+{
+    return set_merge(dest, a, b, false, false, true);
+}
+
+/**************** set_union() ****************/
+/* see set.h for description */
+bool
+set_union(set_t* dest, set_t* a, set_t* b)
+{
+    return set_merge(dest, a, b, true, true, true);
+}
+
+/**************** set_difference() ****************/
+/* see set.h for description */
+bool
+set_difference(set_t* dest, set_t* a, set_t* b)
+{
+    return set_merge(dest, a, b, true, false, false);
 }
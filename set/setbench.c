@@ -0,0 +1,253 @@
+/*
+ * setbench.c - benchmark driver for set module
+ *
+ * usage: setbench [maxsize [seed]]
+ *
+ * For each size n = 10, 100, ... maxsize, builds a set of n string keys
+ * and times insert, hit-find, miss-find, iterate and delete, with
+ * uniform and Zipfian lookup streams.  Then times insert and find in a
+ * set and a trie on URL-like keys sharing a long prefix (dist "urls").
+ * Prints CSV (see bench.h) to stdout.
+ * The same seed always produces the same workload.
+ *
+ * Adwiteeya Rupantee Paul, April 2025
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "set.h"
+#include "trie.h"
+#include "bench.h"
+
+/**************** file-local global variables ****************/
+static const uint64_t MINOPS = 100000;  // time at least this many ops per row
+static const int CHUNK = 4096;          // lookups generated per timed chunk
+static const double THETA = 0.99;       // Zipfian skew
+static const int URLLEN = 64;           // bytes per URL-like key record
+
+/**************** local functions ****************/
+static void bench_size(const uint64_t n, const uint64_t seed);
+static void bench_find(set_t* set, const char* keys, const uint64_t* popular,
+                       const uint64_t n, const bool hit, const bool zipf,
+                       const uint64_t seed);
+static void bench_urls(const uint64_t n, const uint64_t seed);
+static void itemcount(void* arg, const char* key, void* item);
+
+/* **************************************** */
+int
+main(const int argc, char* argv[])
+{
+    uint64_t maxsize, seed;
+    if (!bench_args(argc, argv, &maxsize, &seed)) {
+        return 1;
+    }
+    bench_header(stdout);
+    for (uint64_t n = 10; n <= maxsize; n *= 10) {
+        bench_size(n, seed);
+        bench_urls(n, seed);
+    }
+    return 0;
+}
+
+/**************** bench_size() ****************/
+/* run every operation for one structure size */
+static void
+bench_size(const uint64_t n, const uint64_t seed)
+{
+    char* keys = bench_keys(0, n);          // keys that get inserted
+    char* misses = bench_keys(n, n);        // keys that never do
+    uint64_t* order = bench_permutation(n, seed);        // insert order
+    uint64_t* popular = bench_permutation(n, seed + 1);  // rank -> key
+    if (keys == NULL || misses == NULL || order == NULL || popular == NULL) {
+        fprintf(stderr, "setbench: out of memory at n=%llu\n", (unsigned long long)n);
+        exit(2);
+    }
+    uint64_t reps = n < MINOPS ? MINOPS / n : 1;
+    uint64_t tins = 0, ains = 0, tdel = 0, adel = 0;
+    set_t* set = NULL;
+
+    // insert and delete: rebuild the set reps times
+    for (uint64_t r = 0; r < reps; r++) {
+        if (set != NULL) {
+            uint64_t a0 = bench_allocs(), t0 = bench_now();
+            set_delete(set, NULL);
+            tdel += bench_now() - t0;
+            adel += bench_allocs() - a0;
+        }
+        uint64_t a0 = bench_allocs(), t0 = bench_now();
+        set = set_new();
+        for (uint64_t i = 0; i < n; i++) {
+            set_insert(set, keys + order[i] * BENCH_KEYLEN, keys);
+        }
+        tins += bench_now() - t0;
+        ains += bench_allocs() - a0;
+    }
+    bench_report(stdout, "set", "insert", "uniform", n, n * reps, tins, ains);
+
+    // lookups
+    bench_find(set, keys, popular, n, true, false, seed);
+    bench_find(set, keys, popular, n, true, true, seed);
+    bench_find(set, misses, popular, n, false, false, seed);
+    bench_find(set, misses, popular, n, false, true, seed);
+
+    // iterate
+    uint64_t count = 0;
+    uint64_t a0 = bench_allocs(), t0 = bench_now();
+    for (uint64_t r = 0; r < reps; r++) {
+        set_iterate(set, &count, itemcount);
+    }
+    bench_report(stdout, "set", "iterate", "uniform", n, n * reps,
+                 bench_now() - t0, bench_allocs() - a0);
+    if (count != n * reps) {
+        fprintf(stderr, "setbench: iterate saw %llu items, expected %llu\n",
+                (unsigned long long)count, (unsigned long long)(n * reps));
+    }
+
+    // the last delete
+    a0 = bench_allocs();
+    t0 = bench_now();
+    set_delete(set, NULL);
+    tdel += bench_now() - t0;
+    adel += bench_allocs() - a0;
+    bench_report(stdout, "set", "delete", "uniform", n, n * reps, tdel, adel);
+
+    free(keys);
+    free(misses);
+    free(order);
+    free(popular);
+}
+
+/**************** bench_find() ****************/
+/* time a stream of lookups, drawn uniformly or by Zipfian popularity */
+static void
+bench_find(set_t* set, const char* keys, const uint64_t* popular,
+           const uint64_t n, const bool hit, const bool zipf,
+           const uint64_t seed)
+{
+    uint64_t ops = n < MINOPS ? MINOPS : n;
+    uint64_t* batch = malloc(CHUNK * sizeof(uint64_t));
+    bench_rand_t rng;
+    bench_zipf_t zipfgen;
+    if (batch == NULL) {
+        fprintf(stderr, "setbench: out of memory\n");
+        exit(2);
+    }
+    bench_rand_init(&rng, seed + 2);
+    if (zipf) {
+        bench_zipf_init(&zipfgen, n, THETA, seed + 2);
+    }
+
+    uint64_t elapsed = 0, allocs = 0, found = 0;
+    for (uint64_t done = 0; done < ops; done += CHUNK) {
+        int len = ops - done < CHUNK ? ops - done : CHUNK;
+        // generate the next chunk of keys outside the timed region
+        for (int i = 0; i < len; i++) {
+            uint64_t rank = zipf ? bench_zipf_next(&zipfgen) : bench_rand_below(&rng, n);
+            batch[i] = popular[rank];
+        }
+        uint64_t a0 = bench_allocs(), t0 = bench_now();
+        for (int i = 0; i < len; i++) {
+            if (set_find(set, keys + batch[i] * BENCH_KEYLEN) != NULL) {
+                found++;
+            }
+        }
+        elapsed += bench_now() - t0;
+        allocs += bench_allocs() - a0;
+    }
+    bench_report(stdout, "set", hit ? "find_hit" : "find_miss",
+                 zipf ? "zipf" : "uniform", n, ops, elapsed, allocs);
+    if (found != (hit ? ops : 0)) {
+        fprintf(stderr, "setbench: %llu of %llu lookups found\n",
+                (unsigned long long)found, (unsigned long long)ops);
+    }
+    free(batch);
+}
+
+/**************** bench_urls() ****************/
+/* time insert and uniform hit-find in a set and a trie, with keys that
+ * share a 38-byte prefix and differ only in their last few bytes */
+static void
+bench_urls(const uint64_t n, const uint64_t seed)
+{
+    char* urls = malloc(n * URLLEN);
+    uint64_t* order = bench_permutation(n, seed);
+    uint64_t* batch = malloc(CHUNK * sizeof(uint64_t));
+    if (urls == NULL || order == NULL || batch == NULL) {
+        fprintf(stderr, "setbench: out of memory at n=%llu\n", (unsigned long long)n);
+        exit(2);
+    }
+    for (uint64_t i = 0; i < n; i++) {
+        snprintf(urls + i * URLLEN, URLLEN, "https://www.example.com/catalog/items/%llu",
+                 (unsigned long long)i);
+    }
+    uint64_t reps = n < MINOPS ? MINOPS / n : 1;
+    uint64_t ops = n < MINOPS ? MINOPS : n;
+    for (int engine = 0; engine < 2; engine++) {
+        const char* module = engine == 0 ? "set" : "trie";
+        set_t* set = NULL;
+        trie_t* trie = NULL;
+        uint64_t elapsed = 0, allocs = 0;
+        for (uint64_t r = 0; r < reps; r++) {
+            set_delete(set, NULL);
+            trie_delete(trie, NULL);
+            uint64_t a0 = bench_allocs(), t0 = bench_now();
+            if (engine == 0) {
+                set = set_new();
+                for (uint64_t i = 0; i < n; i++) {
+                    set_insert(set, urls + order[i] * URLLEN, urls);
+                }
+            } else {
+                trie = trie_new();
+                for (uint64_t i = 0; i < n; i++) {
+                    trie_insert(trie, urls + order[i] * URLLEN, urls);
+                }
+            }
+            elapsed += bench_now() - t0;
+            allocs += bench_allocs() - a0;
+        }
+        bench_report(stdout, module, "insert", "urls", n, n * reps, elapsed, allocs);
+
+        bench_rand_t rng;
+        bench_rand_init(&rng, seed + 2);
+        uint64_t found = 0;
+        elapsed = allocs = 0;
+        for (uint64_t done = 0; done < ops; done += CHUNK) {
+            int len = ops - done < CHUNK ? ops - done : CHUNK;
+            for (int i = 0; i < len; i++) {
+                batch[i] = bench_rand_below(&rng, n);
+            }
+            uint64_t a0 = bench_allocs(), t0 = bench_now();
+            for (int i = 0; i < len; i++) {
+                const char* key = urls + batch[i] * URLLEN;
+                if ((engine == 0 ? set_find(set, key) : trie_find(trie, key)) != NULL) {
+                    found++;
+                }
+            }
+            elapsed += bench_now() - t0;
+            allocs += bench_allocs() - a0;
+        }
+        bench_report(stdout, module, "find_hit", "urls", n, ops, elapsed, allocs);
+        if (found != ops) {
+            fprintf(stderr, "setbench: %s found %llu of %llu URLs\n", module,
+                    (unsigned long long)found, (unsigned long long)ops);
+        }
+        set_delete(set, NULL);
+        trie_delete(trie, NULL);
+    }
+    free(urls);
+    free(order);
+    free(batch);
+}
+
+/**************** itemcount() ****************/
+/* count the items visited */
+static void
+itemcount(void* arg, const char* key, void* item)
+{
+    uint64_t* nitems = arg;
+    if (nitems != NULL && key != NULL && item != NULL) {
+        (*nitems)++;
+    }
+}
@@ -0,0 +1,215 @@
+/*
+ * setfuzz.c - differential fuzzing harness for set module
+ *
+ * usage: setfuzz [runs [seed [maxlen]]] | setfuzz file...   (see fuzz.h)
+ *
+ * Decodes each input into a sequence of inserts, finds and prefix
+ * walks over short keys - many of them repeats, or prefixes, of earlier
+ * keys - and runs it against the set, the reference, and the trie.  Every
+ * result must match, as must the final contents in iteration order.
+ * Prints the time per operation of each (see fuzz.h) to stdout.
+ *
+ * Adwiteeya Rupantee Paul, April 2025
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "set.h"
+#include "trie.h"
+#include "fuzz.h"
+
+/**************** file-local global types ****************/
+typedef enum { OP_INSERT, OP_FIND, OP_PREFIX } optype_t;
+
+#define KEYMAX 8                 // longest key, in bytes
+typedef struct op {
+    optype_t type;
+    char key[KEYMAX + 1];        // key, or prefix for OP_PREFIX
+    int item;                    // index into items[], for OP_INSERT
+} op_t;
+
+/* the pairs an iteration visited, folded in order into a hash */
+typedef struct listing {
+    long count;
+    uint64_t hash;
+} listing_t;
+
+/**************** file-local global variables ****************/
+static const int MAXOPS = 2048;          // operations decoded per input
+static int items[256];                   // the items; each op inserts one of these
+
+/**************** local functions ****************/
+static int decode(const uint8_t* data, const size_t size, op_t* ops);
+static void run_set(op_t* ops, const int nops, int64_t* results, listing_t* all);
+static void run_trie(op_t* ops, const int nops, int64_t* results, listing_t* all);
+static void compare(const char* engine, op_t* ops, const int nops,
+                    int64_t* expected, int64_t* got);
+static int64_t itemno(void* item);
+static void list(void* arg, const char* key, void* item);
+
+/* **************************************** */
+int
+LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    op_t* ops = malloc(MAXOPS * sizeof(op_t));
+    int64_t* expected = malloc(MAXOPS * sizeof(int64_t));
+    int64_t* got = malloc(MAXOPS * sizeof(int64_t));
+    if (ops == NULL || expected == NULL || got == NULL) {
+        fprintf(stderr, "setfuzz: out of memory\n");
+        exit(2);
+    }
+    int nops = decode(data, size, ops);
+    listing_t refall, all;
+
+    run_set(ops, nops, expected, &refall);
+    run_trie(ops, nops, got, &all);
+    compare("trie", ops, nops, expected, got);
+    if (all.count != refall.count || all.hash != refall.hash) {
+        fuzz_fail("trie: final contents differ (%ld pairs, reference %ld)",
+                  all.count, refall.count);
+    }
+
+    free(ops);
+    free(expected);
+    free(got);
+    return 0;
+}
+
+/**************** decode() ****************/
+/* turn the input into at most MAXOPS operations; return how many */
+static int
+decode(const uint8_t* data, const size_t size, op_t* ops)
+{
+    fuzz_input_t in;
+    fuzz_input_init(&in, data, size);
+    int nops = 0;
+
+    while (!fuzz_done(&in) && nops < MAXOPS) {
+        uint8_t b = fuzz_byte(&in);
+        op_t* op = &ops[nops];
+        op->type = (b & 3) == 3 ? OP_PREFIX : (b & 1) ? OP_FIND : OP_INSERT;
+        op->item = fuzz_byte(&in);
+
+        if (nops > 0 && (b & 0x30) != 0) {
+            // reuse an earlier key: whole if 0x10, only a prefix if 0x20
+            strcpy(op->key, ops[fuzz_below(&in, nops)].key);
+            if ((b & 0x20) != 0) {
+                op->key[fuzz_byte(&in) % (strlen(op->key) + 1)] = '\0';
+            }
+        } else {
+            // a fresh key; mostly a 4-letter alphabet, so keys share prefixes
+            int len = fuzz_byte(&in) % (KEYMAX + 1);
+            for (int i = 0; i < len; i++) {
+                uint8_t c = fuzz_byte(&in);
+                op->key[i] = (c & 0x80) ? 'a' + (c & 3) : '!' + c % 94;
+            }
+            op->key[len] = '\0';
+        }
+        nops++;
+    }
+    return nops;
+}
+
+/**************** run_set() ****************/
+/* the reference: run the operations on a set */
+static void
+run_set(op_t* ops, const int nops, int64_t* results, listing_t* all)
+{
+    set_t* set = set_new();
+    uint64_t t0 = fuzz_now();
+    for (int i = 0; i < nops; i++) {
+        listing_t match = {0, 0};
+        switch (ops[i].type) {
+        case OP_INSERT:
+            results[i] = set_insert(set, ops[i].key, &items[ops[i].item]);
+            break;
+        case OP_FIND:
+            results[i] = itemno(set_find(set, ops[i].key));
+            break;
+        case OP_PREFIX:
+            set_prefix_iterate(set, ops[i].key, &match, list);
+            results[i] = (int64_t)(match.hash ^ (uint64_t)match.count);
+            break;
+        }
+    }
+    fuzz_time("set", "mixed", nops, fuzz_now() - t0);
+
+    *all = (listing_t){0, 0};
+    set_iterate(set, all, list);
+    set_delete(set, NULL);
+}
+
+/**************** run_trie() ****************/
+/* the same operations on a trie */
+static void
+run_trie(op_t* ops, const int nops, int64_t* results, listing_t* all)
+{
+    trie_t* trie = trie_new();
+    uint64_t t0 = fuzz_now();
+    for (int i = 0; i < nops; i++) {
+        listing_t match = {0, 0};
+        switch (ops[i].type) {
+        case OP_INSERT:
+            results[i] = trie_insert(trie, ops[i].key, &items[ops[i].item]);
+            break;
+        case OP_FIND:
+            results[i] = itemno(trie_find(trie, ops[i].key));
+            break;
+        case OP_PREFIX:
+            trie_prefix_iterate(trie, ops[i].key, &match, list);
+            results[i] = (int64_t)(match.hash ^ (uint64_t)match.count);
+            break;
+        }
+    }
+    fuzz_time("trie", "mixed", nops, fuzz_now() - t0);
+
+    *all = (listing_t){0, 0};
+    trie_iterate(trie, all, list);
+    if (trie_size(trie) != all->count) {
+        fuzz_fail("trie: size %ld, but iterate visits %ld", trie_size(trie), all->count);
+    }
+    trie_delete(trie, NULL);
+}
+
+/**************** compare() ****************/
+/* fail at the first result that differs from the reference */
+static void
+compare(const char* engine, op_t* ops, const int nops,
+        int64_t* expected, int64_t* got)
+{
+    static const char* names[] = { "insert", "find", "prefix" };
+    for (int i = 0; i < nops; i++) {
+        if (got[i] != expected[i]) {
+            fuzz_fail("%s: op %d (%s \"%s\") gave %lld, reference %lld", engine, i,
+                      names[ops[i].type], ops[i].key,
+                      (long long)got[i], (long long)expected[i]);
+        }
+    }
+}
+
+/**************** itemno() ****************/
+/* which of items[] this is; -1 for NULL */
+static int64_t
+itemno(void* item)
+{
+    return item == NULL ? -1 : (int*)item - items;
+}
+
+/**************** list() ****************/
+/* fold one (key,item) pair into a listing */
+static void
+list(void* arg, const char* key, void* item)
+{
+    listing_t* listing = arg;
+    uint64_t h = listing->hash;
+    for (const char* p = key; ; p++) {
+        h = (h ^ (uint8_t)*p) * 0x100000001b3ULL;     // FNV-1a, NUL included
+        if (*p == '\0') {
+            break;
+        }
+    }
+    listing->hash = (h ^ (uint64_t)itemno(item)) * 0x100000001b3ULL;
+    listing->count++;
+}
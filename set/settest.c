@@ -12,21 +12,30 @@
 
  #include <stdio.h>
  #include <stdlib.h>
+ #include <stddef.h>
  #include <string.h>
  #include "set.h"
+ #include "trie.h"
  #include "file.h"
 
 
  static void nameprint(FILE* fp, const char* key, void* item) ;
  static void namedelete(void* item);
  static void itemcount(void* arg, const char* key, void* item);
+ static void trieinsert(void* arg, const char* key, void* item);
+ static void triecheck(void* arg, const char* key, void* item);
+ static void ordercheck(void* arg, const char* key, void* item);
+ static void* countalloc(size_t size);
+ static void countfree(void* ptr);
+
+ static size_t livebytes = 0;   // bytes countalloc has handed out and not had back
  
 
  int main() 
  {
    set_t* set1;           // one set
    set_t* set2;           // another set
-   char* key = NULL;            // a key in the bag
+   char key[100];               // a key in the bag
    int keycount = 0;            // number of names put in the set
    int setcount = 0;             // number of names found in a set
  
@@ -67,12 +76,18 @@
    printf("\nTesting set_insert...\n");
 
    FILE* fp = fopen("fp", "w"); //copy the keys in a different file
-   char* keys;
-   char* items;
-    while(scanf("%s %s", &keys, &items) != EOF) {
-      set_insert(set1, &keys, &items); //inserting from the test file
-      fprintf(fp, "%s\n", &keys);
-      keycount++;   
+   char keys[100];              // key read from the test file
+   char items[100];             // item read from the test file
+    while(scanf("%99s %99s", keys, items) == 2) {
+      char* item = malloc(strlen(items) + 1); // the set holds its own copy
+      if (item != NULL) {
+        strcpy(item, items);
+        if (!set_insert(set1, keys, item)) { //inserting from the test file
+          free(item);                 // not inserted; don't leak it
+        }
+      }
+      fprintf(fp, "%s\n", keys);
+      keycount++;
     }
     fclose(fp);
 
@@ -93,9 +108,9 @@
    char* value;
 
    //copy the set to another set
-   while(fscanf(fs, "%s", &key) != EOF) {
-     value = set_find(set1, &key);
-     set_insert(set2, &key, value);
+   while(fscanf(fs, "%99s", key) == 1) {
+     value = set_find(set1, key);
+     set_insert(set2, key, value);
    }
 
    fclose(fs);
@@ -112,11 +127,120 @@
    set_print(set2, stdout, nameprint);
    printf("\n");
 
+   //set algebra: set2 has the same keys as set1, plus one more
+   set_insert(set2, "~extra", "College");
+   set_t* both = set_new();
+   set_t* either = set_new();
+   set_t* only = set_new();
+   printf("\nSet algebra:\n");
+   printf("Intersect into non-empty set (should be 0): %d\n", set_intersect(set2, set1, set2));
+   set_intersect(both, set1, set2);
+   set_union(either, set1, set2);
+   set_difference(only, set2, set1);
+   printf("Intersection count (should be %d): ", keycount);
+   setcount = 0;
+   set_iterate(both, &setcount, itemcount);
+   printf("%d\n", setcount);
+   printf("Union count (should be %d): ", keycount + 1);
+   setcount = 0;
+   set_iterate(either, &setcount, itemcount);
+   printf("%d\n", setcount);
+   printf("Difference: ");
+   set_print(only, stdout, nameprint);
+   printf("\n");
+   set_delete(both, NULL);       // these share their items with set1 and set2
+   set_delete(either, NULL);
+   set_delete(only, NULL);
+
+   //remove the extra pair again
+   printf("\nRemove:\n");
+   printf("Remove absent key (should be 1): %d\n", set_remove(set2, "no-such-key") == NULL);
+   printf("Remove ~extra (should be College): %s\n", (char*)set_remove(set2, "~extra"));
+   printf("Count (should be %d): ", keycount);
+   setcount = 0;
+   set_iterate(set2, &setcount, itemcount);
+   printf("%d\n", setcount);
+
+   //the same pairs in a trie
+   printf("\nTrie:\n");
+   trie_t* trie = trie_new();
+   set_iterate(set1, trie, trieinsert);
+   printf("Size (should be %d): %ld\n", keycount, trie_size(trie));
+   set_iterate(set1, trie, triecheck);   // complains about any pair it lacks
+   int misordered = 0;
+   trie_iterate(trie, &misordered, ordercheck);
+   printf("Out-of-order keys (should be 0): %d\n", misordered);
+   printf("The trie (should match the set):\n");
+   trie_print(trie, stdout, nameprint);
+   printf("\n");
+   int prefixcount = 0;
+   set_prefix_iterate(set1, "P", &prefixcount, itemcount);
+   printf("Keys starting with P (should be %d): ", prefixcount);
+   setcount = 0;
+   trie_prefix_iterate(trie, "P", &setcount, itemcount);
+   printf("%d\n", setcount);
+   printf("Insert new key (should be 1): %d\n", trie_insert(trie, "~extra", "College"));
+   printf("Insert it again (should be 0): %d\n", trie_insert(trie, "~extra", "College"));
+   trie_delete(trie, NULL);      // the trie shares its items with set1
+
+   //keys with a long shared prefix, as in a crawler's URL set
+   set_t* urls = set_new();
+   trie_t* urltrie = trie_new();
+   char url[100];
+   for (int i = 0; i < 1000; i++) {
+     sprintf(url, "https://www.example.com/catalog/items/%d", i);
+     set_insert(urls, url, "page");
+     trie_insert(urltrie, url, "page");
+   }
+   printf("URLs (should be 1000): %ld\n", trie_size(urltrie));
+   set_iterate(urls, urltrie, triecheck);
+   printf("Find a prefix of the keys (should be 1): %d\n",
+          trie_find(urltrie, "https://www.example.com/catalog/items/") == NULL);
+   printf("Find past the keys (should be 1): %d\n",
+          trie_find(urltrie, "https://www.example.com/catalog/items/9990") == NULL);
+   printf("URLs under items/1 (should be 111): ");
+   setcount = 0;
+   trie_prefix_iterate(urltrie, "https://www.example.com/catalog/items/1", &setcount, itemcount);
+   printf("%d\n", setcount);
+   printf("URLs under items/1, in the set (should be 111): ");
+   setcount = 0;
+   set_prefix_iterate(urls, "https://www.example.com/catalog/items/1", &setcount, itemcount);
+   printf("%d\n", setcount);
+   printf("URLs under items/999 (should be 1): ");
+   setcount = 0;
+   trie_prefix_iterate(urltrie, "https://www.example.com/catalog/items/999", &setcount, itemcount);
+   printf("%d\n", setcount);
+   printf("URLs under http:// (should be 0): ");
+   setcount = 0;
+   trie_prefix_iterate(urltrie, "http://", &setcount, itemcount);
+   printf("%d\n", setcount);
+   printf("Trie smaller than set (should be 1): %d\n",
+          trie_memory_usage(urltrie) < set_memory_usage(urls));
+   set_delete(urls, NULL);
+   trie_delete(urltrie, NULL);
+
    //delete the sets
 
    printf("\ndelete the sets...\n");
    set_delete(set1, namedelete);
-   set_delete(set2, namedelete); 
+   set_delete(set2, NULL);    // set2 shares its items with set1
+
+   //memory accounting, through an allocator that counts what it hands out
+   printf("\nMemory accounting:\n");
+   printf("Usage of NULL (should be 0): %zu\n", set_memory_usage(NULL));
+   set_allocator(countalloc, countfree, NULL);  // no sizefn: no slack to count
+   set_t* counted = set_new();
+   size_t empty = set_memory_usage(counted);
+   set_insert(counted, "Dartmouth", "College");
+   set_insert(counted, "Hanover", "NH");
+   printf("Usage is what the allocator holds (should be 1): %d\n",
+          set_memory_usage(counted) == livebytes);
+   printf("Keys counted, items not (should be 1): %d\n",
+          set_memory_usage(counted) >= empty + sizeof("Dartmouth") + sizeof("Hanover")
+          && set_memory_usage(counted) < empty + 200);
+   set_delete(counted, NULL);
+   printf("All freed through the allocator (should be 0): %zu\n", livebytes);
+   set_allocator(NULL, NULL, NULL);
    return 0;
   }
   
@@ -157,3 +281,50 @@
      free(item);    
  }
  
+ 
+ // insert a pair into the trie given as arg
+ static void trieinsert(void* arg, const char* key, void* item)
+ {
+   trie_insert(arg, key, item);
+ }
+ 
+ // complain if the trie given as arg lacks a set's pair
+ static void triecheck(void* arg, const char* key, void* item)
+ {
+   if (trie_find(arg, key) != item) {
+     printf("trie_find(%s) differs from the set\n", key);
+   }
+ }
+ 
+ // count the keys that do not come after the previous one
+ static void ordercheck(void* arg, const char* key, void* item)
+ {
+   static char last[100] = "";
+   int* errors = arg;
+   if (last[0] != '\0' && strcmp(last, key) >= 0) {
+     (*errors)++;
+   }
+   snprintf(last, sizeof(last), "%s", key);
+ }
+
+ // allocate size bytes, remembering the size in front of them
+ static void* countalloc(size_t size)
+ {
+   max_align_t* block = malloc(sizeof(max_align_t) + size);
+   if (block == NULL) {
+     return NULL;
+   }
+   *(size_t*)block = size;
+   livebytes += size;
+   return block + 1;
+ }
+
+ // free a block from countalloc
+ static void countfree(void* ptr)
+ {
+   if (ptr != NULL) {
+     max_align_t* block = (max_align_t*)ptr - 1;
+     livebytes -= *(size_t*)block;
+     free(block);
+   }
+ }
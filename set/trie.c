@@ -0,0 +1,666 @@
+/*
+ * trie.c - source file for trie module
+ *
+ * Inner nodes come in four sizes.  Node4 and Node16 keep up to 4 or 16
+ * key bytes, sorted, beside their children; Node48 maps each byte to one
+ * of 48 child slots; Node256 has a child for every byte.  A node grows
+ * to the next size when full.  Each inner node also holds its prefix:
+ * the bytes every key below it shares before the node branches.
+ *
+ * A key's terminating NUL is a branch byte like any other, so a key that
+ * is a prefix of another is just a child on byte 0, and every key ends
+ * in a leaf.  A leaf holds the item and the key bytes below its parent's
+ * branch, its suffix.  Child pointers to leaves have their low bit set.
+ * Children are visited in byte order, and NUL sorts first, so iteration
+ * yields keys in strcmp order, rebuilding each key in one buffer.
+ *
+ * Adwiteeya Rupantee Paul, April 2025
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "trie.h"
+#ifdef __GLIBC__
+#include <malloc.h>      // malloc_usable_size
+#endif
+#ifdef __SSE2__
+#include <emmintrin.h>   // Node16 search, 16 bytes at once
+#endif
+
+/**************** local types ****************/
+enum { NODE4, NODE16, NODE48, NODE256 };
+
+typedef struct trienode {
+    uint8_t type;            // NODE4 ... NODE256
+    uint16_t count;          // children
+    uint32_t prefix_len;     // bytes in the prefix
+} trienode_t;
+
+typedef struct node4 {
+    trienode_t h;
+    unsigned char keys[4];   // branch bytes, sorted
+    void* children[4];
+    char prefix[];
+} node4_t;
+
+typedef struct node16 {
+    trienode_t h;
+    unsigned char keys[16];  // branch bytes, sorted
+    void* children[16];
+    char prefix[];
+} node16_t;
+
+typedef struct node48 {
+    trienode_t h;
+    unsigned char index[256];   // byte -> child slot + 1; 0 if none
+    void* children[48];
+    char prefix[];
+} node48_t;
+
+typedef struct node256 {
+    trienode_t h;
+    void* children[256];     // by byte
+    char prefix[];
+} node256_t;
+
+typedef struct trieleaf {
+    void* item;
+    char suffix[];           // the key bytes below the parent's branch
+} trieleaf_t;
+
+/* the state of a walk that rebuilds keys, for iterate and print */
+typedef struct triewalk {
+    char* buf;               // the key so far
+    void* arg;
+    void (*itemfunc)(void* arg, const char* key, void* item);
+} triewalk_t;
+
+/* the state of trie_print */
+typedef struct trieprint {
+    FILE* fp;
+    void (*itemprint)(FILE* fp, const char* key, void* item);
+    bool first;              // no pair printed yet
+} trieprint_t;
+
+/**************** global types ****************/
+typedef struct trie {
+    void* root;              // node or tagged leaf; NULL if empty
+    long count;              // keys
+    size_t max_key;          // length of the longest key, for walk buffers
+} trie_t;
+
+/**************** global functions ****************/
+/* that is, visible outside this file */
+/* see trie.h for comments about exported functions */
+
+/**************** local functions ****************/
+/* not visible outside this file */
+static inline bool is_leaf(const void* ref);
+static inline trieleaf_t* as_leaf(const void* ref);
+static inline char* node_prefix(trienode_t* node);
+static size_t node_bytes(const int type, const size_t prefix_len);
+static trienode_t* node_new(const int type, const char* prefix, const size_t prefix_len);
+static void* leaf_new(const char* suffix, void* item);
+static void** find_child(trienode_t* node, const unsigned char c);
+static bool add_child(void** ref, const unsigned char c, void* child);
+static trienode_t* grow(trienode_t* node);
+static void walk(triewalk_t* w, void* ref, size_t len);
+static void printone(void* arg, const char* key, void* item);
+static size_t block_size(void* ptr, size_t requested);
+static size_t ref_memory(void* ref);
+static void ref_delete(void* ref, void (*itemdelete)(void* item));
+
+/**************** trie_new() ****************/
+/* see trie.h for description */
+trie_t*
+trie_new(void)
+{
+    trie_t* trie = malloc(sizeof(trie_t));
+    if (trie != NULL) {
+        trie->root = NULL;
+        trie->count = 0;
+        trie->max_key = 0;
+    }
+    return trie;
+}
+
+/**************** trie_insert() ****************/
+/* see trie.h for description */
+bool
+trie_insert(trie_t* trie, const char* key, void* item)
+{
+    if (trie == NULL || key == NULL || item == NULL) {
+        return false;
+    }
+    void** ref = &trie->root;     // the pointer to the subtree we are in
+    size_t depth = 0;             // key bytes matched above it
+    size_t len = strlen(key);
+    while (true) {
+        if (*ref == NULL) {
+            // the empty trie: the key is one leaf
+            if ((*ref = leaf_new(key, item)) == NULL) {
+                return false;
+            }
+            break;
+        }
+        const char* rest = key + depth;
+        if (is_leaf(*ref)) {
+            trieleaf_t* leaf = as_leaf(*ref);
+            char* suffix = leaf->suffix;
+            size_t p = 0;
+            while (suffix[p] == rest[p] && suffix[p] != '\0') {
+                p++;
+            }
+            if (suffix[p] == rest[p]) {
+                return false;     // key exists
+            }
+            // split the leaf: a Node4 holding the shared bytes, branching
+            // to the old leaf and the new one
+            trienode_t* node = node_new(NODE4, rest, p);
+            void* new = leaf_new(rest[p] != '\0' ? rest + p + 1 : "", item);
+            if (node == NULL || new == NULL) {
+                free(node);
+                free(as_leaf(new));
+                return false;
+            }
+            unsigned char old_c = suffix[p];
+            if (old_c != '\0') {
+                memmove(suffix, suffix + p + 1, strlen(suffix + p + 1) + 1);
+            } else {
+                suffix[0] = '\0';
+            }
+            void* old = *ref;
+            *ref = node;
+            add_child(ref, old_c, old);
+            add_child(ref, rest[p], new);
+            break;
+        }
+        trienode_t* node = *ref;
+        char* prefix = node_prefix(node);
+        size_t p = 0;
+        while (p < node->prefix_len && prefix[p] == rest[p]) {
+            p++;
+        }
+        if (p < node->prefix_len) {
+            // the key leaves the prefix: split the prefix at p
+            trienode_t* parent = node_new(NODE4, prefix, p);
+            void* new = leaf_new(rest[p] != '\0' ? rest + p + 1 : "", item);
+            if (parent == NULL || new == NULL) {
+                free(parent);
+                free(as_leaf(new));
+                return false;
+            }
+            unsigned char old_c = prefix[p];
+            memmove(prefix, prefix + p + 1, node->prefix_len - p - 1);
+            node->prefix_len -= p + 1;
+            *ref = parent;
+            add_child(ref, old_c, node);
+            add_child(ref, rest[p], new);
+            break;
+        }
+        depth += node->prefix_len;
+        unsigned char c = key[depth];
+        void** child = find_child(node, c);
+        if (child == NULL) {
+            // a new branch from this node
+            void* new = leaf_new(c != '\0' ? key + depth + 1 : "", item);
+            if (new == NULL || !add_child(ref, c, new)) {
+                free(as_leaf(new));
+                return false;
+            }
+            break;
+        }
+        if (c == '\0') {
+            return false;         // the key ends here, and exists
+        }
+        ref = child;
+        depth++;
+    }
+    trie->count++;
+    if (len > trie->max_key) {
+        trie->max_key = len;
+    }
+    return true;
+}
+
+/**************** trie_find() ****************/
+/* see trie.h for description */
+void*
+trie_find(trie_t* trie, const char* key)
+{
+    if (trie == NULL || key == NULL) {
+        return NULL;
+    }
+    void* ref = trie->root;
+    while (ref != NULL) {
+        if (is_leaf(ref)) {
+            trieleaf_t* leaf = as_leaf(ref);
+            return strcmp(leaf->suffix, key) == 0 ? leaf->item : NULL;
+        }
+        trienode_t* node = ref;
+        const char* prefix = node_prefix(node);
+        for (uint32_t i = 0; i < node->prefix_len; i++) {
+            if (key[i] != prefix[i]) {
+                return NULL;      // (a prefix holds no NUL, so we stop in time)
+            }
+        }
+        key += node->prefix_len;
+        void** child = find_child(node, *key);
+        if (child == NULL) {
+            return NULL;
+        }
+        if (*key == '\0') {
+            return as_leaf(*child)->item;
+        }
+        ref = *child;
+        key++;
+    }
+    return NULL;
+}
+
+/**************** trie_print() ****************/
+/* see trie.h for description */
+void
+trie_print(trie_t* trie, FILE* fp,
+           void (*itemprint)(FILE* fp, const char* key, void* item) )
+{
+    if (fp == NULL) {
+        return;
+    }
+    if (trie == NULL) {
+        fputs("(null)", fp);
+        return;
+    }
+    fputc('{', fp);
+    if (itemprint != NULL) {
+        trieprint_t state = { fp, itemprint, true };
+        trie_iterate(trie, &state, printone);
+    }
+    fputc('}', fp);
+}
+
+/**************** trie_iterate() ****************/
+/* see trie.h for description */
+void
+trie_iterate(trie_t* trie, void* arg,
+             void (*itemfunc)(void* arg, const char* key, void* item) )
+{
+    trie_prefix_iterate(trie, "", arg, itemfunc);
+}
+
+/**************** trie_prefix_iterate() ****************/
+/* see trie.h for description */
+void
+trie_prefix_iterate(trie_t* trie, const char* prefix, void* arg,
+                    void (*itemfunc)(void* arg, const char* key, void* item) )
+{
+    if (trie == NULL || prefix == NULL || itemfunc == NULL) {
+        return;
+    }
+    // find the subtree holding exactly the keys with the prefix
+    size_t qlen = strlen(prefix);
+    void* ref = trie->root;
+    size_t depth = 0;
+    while (ref != NULL && depth < qlen && !is_leaf(ref)) {
+        trienode_t* node = ref;
+        const char* np = node_prefix(node);
+        for (uint32_t i = 0; i < node->prefix_len && depth + i < qlen; i++) {
+            if (np[i] != prefix[depth + i]) {
+                return;           // no key has the prefix
+            }
+        }
+        if (depth + node->prefix_len >= qlen) {
+            break;                // the prefix ends inside this node's prefix
+        }
+        depth += node->prefix_len;
+        void** child = find_child(node, prefix[depth]);
+        ref = child == NULL ? NULL : *child;
+        depth++;
+    }
+    if (ref == NULL) {
+        return;
+    }
+    if (is_leaf(ref) && strncmp(as_leaf(ref)->suffix, prefix + depth, qlen - depth) != 0) {
+        return;                   // the one key here lacks the prefix
+    }
+    triewalk_t w = { malloc(trie->max_key + 1), arg, itemfunc };
+    if (w.buf != NULL) {
+        memcpy(w.buf, prefix, depth);   // the bytes above the subtree
+        walk(&w, ref, depth);
+        free(w.buf);
+    }
+}
+
+/**************** trie_size() ****************/
+/* see trie.h for description */
+long
+trie_size(trie_t* trie)
+{
+    return trie == NULL ? 0 : trie->count;
+}
+
+/**************** trie_memory_usage() ****************/
+/* see trie.h for description */
+size_t
+trie_memory_usage(trie_t* trie)
+{
+    if (trie == NULL) {
+        return 0;
+    }
+    return block_size(trie, sizeof(trie_t)) + ref_memory(trie->root);
+}
+
+/**************** trie_delete() ****************/
+/* see trie.h for description */
+void
+trie_delete(trie_t* trie, void (*itemdelete)(void* item) )
+{
+    if (trie != NULL) {
+        ref_delete(trie->root, itemdelete);
+        free(trie);
+    }
+}
+
+/**************** is_leaf() ****************/
+/* true if a child pointer points at a leaf */
+static inline bool
+is_leaf(const void* ref)
+{
+    return ((uintptr_t)ref & 1) != 0;
+}
+
+/**************** as_leaf() ****************/
+/* the leaf a tagged child pointer points at; NULL stays NULL */
+static inline trieleaf_t*
+as_leaf(const void* ref)
+{
+    return (trieleaf_t*)((uintptr_t)ref & ~(uintptr_t)1);
+}
+
+/**************** node_prefix() ****************/
+/* the prefix bytes of an inner node, which follow its children */
+static inline char*
+node_prefix(trienode_t* node)
+{
+    switch (node->type) {
+    case NODE4:  return ((node4_t*)node)->prefix;
+    case NODE16: return ((node16_t*)node)->prefix;
+    case NODE48: return ((node48_t*)node)->prefix;
+    default:     return ((node256_t*)node)->prefix;
+    }
+}
+
+/**************** node_bytes() ****************/
+/* the size of an inner node of the given type and prefix */
+static size_t
+node_bytes(const int type, const size_t prefix_len)
+{
+    static const size_t sizes[] = {
+        sizeof(node4_t), sizeof(node16_t), sizeof(node48_t), sizeof(node256_t)
+    };
+    return sizes[type] + prefix_len;
+}
+
+/**************** node_new() ****************/
+/* a new inner node with no children; NULL if out of memory */
+static trienode_t*
+node_new(const int type, const char* prefix, const size_t prefix_len)
+{
+    trienode_t* node = calloc(1, node_bytes(type, prefix_len));
+    if (node != NULL) {
+        node->type = type;
+        node->prefix_len = prefix_len;
+        memcpy(node_prefix(node), prefix, prefix_len);
+    }
+    return node;
+}
+
+/**************** leaf_new() ****************/
+/* a new leaf, as a tagged child pointer; NULL if out of memory */
+static void*
+leaf_new(const char* suffix, void* item)
+{
+    size_t len = strlen(suffix) + 1;
+    trieleaf_t* leaf = malloc(sizeof(trieleaf_t) + len);
+    if (leaf == NULL) {
+        return NULL;
+    }
+    leaf->item = item;
+    memcpy(leaf->suffix, suffix, len);
+    return (void*)((uintptr_t)leaf | 1);
+}
+
+/**************** find_child() ****************/
+/* the node's child pointer for byte c; NULL if none */
+static void**
+find_child(trienode_t* node, const unsigned char c)
+{
+    switch (node->type) {
+    case NODE4: {
+        node4_t* n = (node4_t*)node;
+        for (int i = 0; i < n->h.count; i++) {
+            if (n->keys[i] == c) {
+                return &n->children[i];
+            }
+        }
+        return NULL;
+    }
+    case NODE16: {
+        node16_t* n = (node16_t*)node;
+#ifdef __SSE2__
+        __m128i match = _mm_cmpeq_epi8(_mm_set1_epi8((char)c),
+                                       _mm_loadu_si128((const __m128i*)n->keys));
+        int mask = _mm_movemask_epi8(match) & ((1 << n->h.count) - 1);
+        return mask != 0 ? &n->children[__builtin_ctz(mask)] : NULL;
+#else
+        for (int i = 0; i < n->h.count; i++) {
+            if (n->keys[i] == c) {
+                return &n->children[i];
+            }
+        }
+        return NULL;
+#endif
+    }
+    case NODE48: {
+        node48_t* n = (node48_t*)node;
+        return n->index[c] != 0 ? &n->children[n->index[c] - 1] : NULL;
+    }
+    default: {
+        node256_t* n = (node256_t*)node;
+        return n->children[c] != NULL ? &n->children[c] : NULL;
+    }
+    }
+}
+
+/**************** add_child() ****************/
+/* give the node at *ref a child for byte c (which it lacks), growing it
+ * into *ref first if it is full; false if out of memory */
+static bool
+add_child(void** ref, const unsigned char c, void* child)
+{
+    trienode_t* node = *ref;
+    if ((node->type == NODE4 && node->count == 4)
+        || (node->type == NODE16 && node->count == 16)
+        || (node->type == NODE48 && node->count == 48)) {
+        if ((node = grow(node)) == NULL) {
+            return false;
+        }
+        *ref = node;
+    }
+    if (node->type == NODE4 || node->type == NODE16) {
+        unsigned char* keys = node->type == NODE4 ? ((node4_t*)node)->keys
+                                                  : ((node16_t*)node)->keys;
+        void** children = node->type == NODE4 ? ((node4_t*)node)->children
+                                              : ((node16_t*)node)->children;
+        int i = node->count;
+        while (i > 0 && keys[i - 1] > c) {   // keep the bytes sorted
+            keys[i] = keys[i - 1];
+            children[i] = children[i - 1];
+            i--;
+        }
+        keys[i] = c;
+        children[i] = child;
+    } else if (node->type == NODE48) {
+        node48_t* n = (node48_t*)node;
+        n->children[n->h.count] = child;     // slots fill in order
+        n->index[c] = n->h.count + 1;
+    } else {
+        ((node256_t*)node)->children[c] = child;
+    }
+    node->count++;
+    return true;
+}
+
+/**************** grow() ****************/
+/* replace a full node with one of the next size, holding the same
+ * prefix and children; NULL (leaving the node alone) if out of memory */
+static trienode_t*
+grow(trienode_t* node)
+{
+    trienode_t* big = node_new(node->type + 1, node_prefix(node), node->prefix_len);
+    if (big == NULL) {
+        return NULL;
+    }
+    big->count = node->count;
+    if (node->type == NODE4) {
+        node4_t* from = (node4_t*)node;
+        node16_t* to = (node16_t*)big;
+        memcpy(to->keys, from->keys, 4);
+        memcpy(to->children, from->children, 4 * sizeof(void*));
+    } else if (node->type == NODE16) {
+        node16_t* from = (node16_t*)node;
+        node48_t* to = (node48_t*)big;
+        for (int i = 0; i < 16; i++) {
+            to->index[from->keys[i]] = i + 1;
+            to->children[i] = from->children[i];
+        }
+    } else {
+        node48_t* from = (node48_t*)node;
+        node256_t* to = (node256_t*)big;
+        for (int c = 0; c < 256; c++) {
+            if (from->index[c] != 0) {
+                to->children[c] = from->children[from->index[c] - 1];
+            }
+        }
+    }
+    free(node);
+    return big;
+}
+
+/**************** walk() ****************/
+/* visit every key below ref in order; buf holds its first len bytes */
+static void
+walk(triewalk_t* w, void* ref, size_t len)
+{
+    if (is_leaf(ref)) {
+        trieleaf_t* leaf = as_leaf(ref);
+        strcpy(w->buf + len, leaf->suffix);
+        (*w->itemfunc)(w->arg, w->buf, leaf->item);
+        return;
+    }
+    trienode_t* node = ref;
+    memcpy(w->buf + len, node_prefix(node), node->prefix_len);
+    len += node->prefix_len;
+    for (int c = 0; c < 256; c++) {
+        void** child;
+        if (node->type == NODE4 || node->type == NODE16) {
+            // the bytes are sorted; visit them in turn, not all 256
+            if (c >= node->count) {
+                break;
+            }
+            unsigned char* keys = node->type == NODE4 ? ((node4_t*)node)->keys
+                                                      : ((node16_t*)node)->keys;
+            child = find_child(node, keys[c]);
+            w->buf[len] = keys[c];
+        } else {
+            if ((child = find_child(node, c)) == NULL) {
+                continue;
+            }
+            w->buf[len] = c;
+        }
+        if (w->buf[len] == '\0') {
+            (*w->itemfunc)(w->arg, w->buf, as_leaf(*child)->item);   // the key ends here
+        } else {
+            walk(w, *child, len + 1);
+        }
+    }
+}
+
+/**************** printone() ****************/
+/* print one pair for trie_print, with a comma before all but the first */
+static void
+printone(void* arg, const char* key, void* item)
+{
+    trieprint_t* state = arg;
+    if (!state->first) {
+        fputc(',', state->fp);
+    }
+    state->first = false;
+    (*state->itemprint)(state->fp, key, item);
+}
+
+/**************** block_size() ****************/
+/* bytes a block really occupies: its usable size, if malloc can tell us */
+static size_t
+block_size(void* ptr, size_t requested)
+{
+#ifdef __GLIBC__
+    size_t usable = malloc_usable_size(ptr);
+    if (usable > requested) {
+        return usable;            // requested bytes plus slack
+    }
+#endif
+    return requested;
+}
+
+/**************** ref_memory() ****************/
+/* the bytes in the subtree below ref */
+static size_t
+ref_memory(void* ref)
+{
+    if (ref == NULL) {
+        return 0;
+    }
+    if (is_leaf(ref)) {
+        trieleaf_t* leaf = as_leaf(ref);
+        return block_size(leaf, sizeof(trieleaf_t) + strlen(leaf->suffix) + 1);
+    }
+    trienode_t* node = ref;
+    size_t bytes = block_size(node, node_bytes(node->type, node->prefix_len));
+    for (int c = 0; c < 256; c++) {
+        void** child = find_child(node, c);
+        if (child != NULL) {
+            bytes += ref_memory(*child);
+        }
+    }
+    return bytes;
+}
+
+/**************** ref_delete() ****************/
+/* free the subtree below ref, handing each item to itemdelete */
+static void
+ref_delete(void* ref, void (*itemdelete)(void* item))
+{
+    if (ref == NULL) {
+        return;
+    }
+    if (is_leaf(ref)) {
+        trieleaf_t* leaf = as_leaf(ref);
+        if (itemdelete != NULL) {
+            (*itemdelete)(leaf->item);
+        }
+        free(leaf);
+        return;
+    }
+    trienode_t* node = ref;
+    for (int c = 0; c < 256; c++) {
+        void** child = find_child(node, c);
+        if (child != NULL) {
+            ref_delete(*child, itemdelete);
+        }
+    }
+    free(node);
+}
@@ -0,0 +1,98 @@
+/*
+ * trie.h - header file for trie module
+ *
+ * A *trie* is a set of (key,item) pairs with string keys, just like a
+ * set, with the same functions, but built for keys that share long
+ * prefixes, such as URLs and paths.  It is an adaptive radix tree
+ * (Leis et al., ICDE 2013): each inner node branches on one byte of the
+ * key and grows from 4 to 16, 48 and 256 children as it fills, and a run
+ * of bytes with no branch is stored once, in the node where it ends.  A
+ * shared prefix is therefore stored once, not once per key, and a lookup
+ * costs O(key length) whatever the number of keys.
+ *
+ * Adwiteeya Rupantee Paul, April 2025
+ */
+
+#ifndef __TRIE_H
+#define __TRIE_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/**************** global types ****************/
+typedef struct trie trie_t;  // opaque to users of the module
+
+/**************** functions ****************/
+
+/**************** trie_new ****************/
+/* Create a new (empty) trie; NULL if error.
+ * Caller is responsible for later calling trie_delete.
+ */
+trie_t* trie_new(void);
+
+/**************** trie_insert ****************/
+/* Insert item, identified by a key (string), into the given trie.
+ *
+ * Caller provides:
+ *   valid trie pointer, valid string pointer, and pointer to item.
+ * We return:
+ *   false if key exists, any parameter is NULL, or error;
+ *   true iff new item was inserted.
+ * Notes:
+ *   The key is copied, as by set_insert, but only the bytes no other key
+ *   shares are stored anew.
+ */
+bool trie_insert(trie_t* trie, const char* key, void* item);
+
+/**************** trie_find ****************/
+/* Return the item associated with the given key, like set_find;
+ * NULL if trie is NULL, key is NULL, or key is not found.
+ */
+void* trie_find(trie_t* trie, const char* key);
+
+/**************** trie_print ****************/
+/* Print the whole trie, exactly as set_print prints a set with the same
+ * pairs: {(key,item),...} in key order.
+ */
+void trie_print(trie_t* trie, FILE* fp,
+                void (*itemprint)(FILE* fp, const char* key, void* item) );
+
+/**************** trie_iterate ****************/
+/* Call itemfunc(arg, key, item) on each item, in increasing strcmp order
+ * of the keys, like set_iterate; nothing if trie or itemfunc is NULL.
+ * Notes:
+ *   the key passed to itemfunc is rebuilt for the call, and is only
+ *   valid until itemfunc returns.
+ */
+void trie_iterate(trie_t* trie, void* arg,
+                  void (*itemfunc)(void* arg, const char* key, void* item) );
+
+/**************** trie_prefix_iterate ****************/
+/* Like trie_iterate, but only over the keys that start with prefix,
+ * like set_prefix_iterate.
+ * We do:
+ *   walk down O(prefix length) nodes to the subtree holding exactly the
+ *   matching keys, and visit only that subtree.
+ */
+void trie_prefix_iterate(trie_t* trie, const char* prefix, void* arg,
+                         void (*itemfunc)(void* arg, const char* key, void* item) );
+
+/**************** trie_size ****************/
+/* Return the number of keys in the trie; 0 if trie is NULL. */
+long trie_size(trie_t* trie);
+
+/**************** trie_memory_usage ****************/
+/* Return the bytes the trie uses: its nodes, leaves and key bytes, plus
+ * allocator slack where malloc can report it, comparable with
+ * set_memory_usage; 0 if trie is NULL.  Items are not counted.
+ */
+size_t trie_memory_usage(trie_t* trie);
+
+/**************** trie_delete ****************/
+/* Delete the trie, calling itemdelete (if not NULL) on each item, like
+ * set_delete; ignore NULL trie.
+ */
+void trie_delete(trie_t* trie, void (*itemdelete)(void* item) );
+
+#endif // __TRIE_H